@@ -42,6 +42,9 @@
 #include <gst/video/video-event.h>
 #include "kmsbufferlacentymeta.h"
 #include "kmsstats.h"
+#include "kmsjbcontroller.h"
+#include "kmsfeccontroller.h"
+#include "kmsrtphdrext.h"
 
 #include <glib/gstdio.h>
 #include <gio/gio.h>
@@ -76,6 +79,7 @@ G_DEFINE_TYPE_WITH_CODE (KmsBaseRtpEndpoint, kms_base_rtp_endpoint,
 #define JB_INITIAL_LATENCY 0
 #define JB_READY_AUDIO_LATENCY 100
 #define JB_READY_VIDEO_LATENCY 500
+#define JB_ADAPT_INTERVAL GST_SECOND
 #define RTCP_FB_CCM_FIR   SDP_MEDIA_RTCP_FB_CCM " " SDP_MEDIA_RTCP_FB_FIR
 #define RTCP_FB_NACK_PLI  SDP_MEDIA_RTCP_FB_NACK " " SDP_MEDIA_RTCP_FB_PLI
 
@@ -99,12 +103,22 @@ struct _KmsSSRCStats
   GstElement *jitter_buffer;
 };
 
+typedef struct _KmsFecData
+{
+  KmsRefStruct ref;
+  GstElement *encoder;          /* ulpfecenc of the aux sender */
+  GstElement *decoder;          /* ulpfecdec of the aux receiver */
+  KmsFecController *controller; /* NULL if FEC rate is not adaptive */
+} KmsFecData;
+
 typedef struct _KmsRTPSessionStats KmsRTPSessionStats;
 struct _KmsRTPSessionStats
 {
   GObject *rtp_session;
   GstSDPDirection direction;
   GSList *ssrcs;                /* list of all jitter buffers associated to a ssrc */
+  GstElement *rtx_cache;        /* Retransmission cache of the aux sender */
+  KmsFecData *fec;
 };
 
 typedef struct _KmsBaseRTPStats KmsBaseRTPStats;
@@ -115,6 +129,9 @@ struct _KmsBaseRTPStats
   GSList *probes;
   /* End-to-end average stream stats */
   GHashTable *avg_e2e;          /* <"pad_name", StreamE2EAvgStat> */
+  GHashTable *rtx_caches;       /* <session_id, rtxcache element> */
+  GHashTable *fec;              /* <session_id, KmsFecData> */
+  KmsStatsSnapshots *snapshots;
 };
 
 typedef struct _ExtData
@@ -205,6 +222,31 @@ ext_data_new ()
   return edata;
 }
 
+static void
+fec_data_destroy (KmsFecData * data)
+{
+  g_clear_object (&data->encoder);
+  g_clear_object (&data->decoder);
+
+  if (data->controller != NULL) {
+    kms_fec_controller_free (data->controller);
+  }
+
+  g_slice_free (KmsFecData, data);
+}
+
+static KmsFecData *
+fec_data_new ()
+{
+  KmsFecData *data;
+
+  data = g_slice_new0 (KmsFecData);
+  kms_ref_struct_init (KMS_REF_STRUCT_CAST (data),
+      (GDestroyNotify) fec_data_destroy);
+
+  return data;
+}
+
 struct _KmsBaseRtpEndpointPrivate
 {
   KmsBaseRtpSession *sess;
@@ -240,6 +282,25 @@ struct _KmsBaseRtpEndpointPrivate
   /* RTP settings */
   guint mtu;
 
+  /* RTP hdrext */
+  gboolean transport_cc;
+  gint transport_seqnum;
+  gint min_playout_delay;
+  gint max_playout_delay;
+
+  /* Retransmissions */
+  guint rtx_cache_time;
+
+  /* Forward error correction */
+  guint max_fec_percentage;
+
+  /* Max age (ms) of the RTC stats returned by getStats */
+  guint stats_max_staleness;
+
+  /* Jitter buffer latency bounds (ms) */
+  guint min_jb_latency;
+  guint max_jb_latency;
+
   /* RTP statistics */
   KmsBaseRTPStats stats;
 
@@ -275,6 +336,14 @@ static guint obj_signals[LAST_SIGNAL] = { 0 };
 #define MIN_VIDEO_SEND_BW_DEFAULT 100  // kbps
 #define MAX_VIDEO_SEND_BW_DEFAULT 500  // kbps
 #define DEFAULT_MTU 1200 // Bytes
+#define DEFAULT_MIN_PLAYOUT_DELAY 0 // ms
+#define DEFAULT_MAX_PLAYOUT_DELAY -1 // ms, disabled
+#define DEFAULT_TRANSPORT_CC FALSE
+#define DEFAULT_RTX_CACHE_TIME 1000 // ms
+#define DEFAULT_MAX_FEC_PERCENTAGE 0 // %, adaptive FEC disabled
+#define DEFAULT_STATS_MAX_STALENESS 0 // ms, always fresh
+#define DEFAULT_MIN_JB_LATENCY 0 // ms
+#define DEFAULT_MAX_JB_LATENCY 0 // ms, fixed latency
 
 enum
 {
@@ -292,6 +361,14 @@ enum
   PROP_SUPPORT_FEC,
   PROP_OFFER_DIR,
   PROP_MTU,
+  PROP_MIN_PLAYOUT_DELAY,
+  PROP_MAX_PLAYOUT_DELAY,
+  PROP_TRANSPORT_CC,
+  PROP_RTX_CACHE_TIME,
+  PROP_MAX_FEC_PERCENTAGE,
+  PROP_STATS_MAX_STALENESS,
+  PROP_MIN_JB_LATENCY,
+  PROP_MAX_JB_LATENCY,
   PROP_LAST
 };
 
@@ -313,189 +390,84 @@ is_proto (const gchar * term, const gchar * opt, const gchar * proto)
 
 /* RTP hdrext begin */
 
-typedef struct _HdrExtData
-{
-  GstPad *pad;
-  /* Useful to make buffers writable when needed. */
-  gboolean add_hdr;
-  gboolean set_time;
-  gint abs_send_time_id;
-} HdrExtData;
-
-static HdrExtData *
-hdr_ext_data_new (GstPad * pad, gboolean add_hdr, gboolean set_time,
-    gint abs_send_time_id)
-{
-  HdrExtData *data;
-
-  data = g_slice_new0 (HdrExtData);
-  data->pad = pad;
-  data->add_hdr = add_hdr;
-  data->set_time = set_time;
-  data->abs_send_time_id = abs_send_time_id;
-
-  return data;
-}
-
-static void
-hdr_ext_data_destroy (HdrExtData * data)
-{
-  g_slice_free (HdrExtData, data);
-}
-
-static void
-hdr_ext_data_destroy_pointer (gpointer data)
-{
-  hdr_ext_data_destroy ((HdrExtData *) data);
-}
-
-static void
-kms_base_rtp_endpoint_rtp_hdr_ext_set_time (guint8 * data)
-{
-  GstClockTime current_time, ms;
-  guint value;
-
-  current_time = kms_utils_get_time_nsecs ();
-  ms = GST_TIME_AS_MSECONDS (current_time);
-  value = (((ms << 18) / 1000) & 0x00ffffff);
-
-  data[0] = (guint8) (value >> 16);
-  data[1] = (guint8) (value >> 8);
-  data[2] = (guint8) (value);
-}
-
+/*
+ * Add a single probe handling every negotiated extension of @media: reserve
+ * them at the payloader output (@add_hdr) or fill them at the rtpbin output.
+ */
 static void
-kms_base_rtp_endpoint_add_rtp_hdr_ext (HdrExtData * data, GstBuffer * buffer)
+kms_base_rtp_endpoint_add_rtp_hdr_ext_probes (KmsBaseRtpEndpoint * self,
+    const GstSDPMedia * media, GstPad * pad, gboolean add_hdr)
 {
-  GstRTPBuffer rtp = { NULL, };
-  guint8 id = data->abs_send_time_id;
-  GstMapFlags map_flags;
-  guint8 *time;
-  guint size;
+  KmsRtpHdrExtConfig config;
+  KmsRtpHdrExtList *list;
 
-  if (data->add_hdr) {
-    map_flags = GST_MAP_WRITE;
-  } else {
-    map_flags = GST_MAP_READ;
-  }
+  config.transport_seqnum =
+      self->priv->transport_cc ? &self->priv->transport_seqnum : NULL;
+  config.min_playout_delay = self->priv->min_playout_delay;
+  config.max_playout_delay = self->priv->max_playout_delay;
 
-  if (!gst_rtp_buffer_map (buffer, map_flags, &rtp)) {
-    GST_WARNING_OBJECT (data->pad, "Can not map RTP buffer");
+  list = kms_rtp_hdr_ext_list_new (media, &config);
+  if (list == NULL) {
+    GST_DEBUG_OBJECT (self, "No RTP hdrext configured for %" GST_PTR_FORMAT,
+        pad);
     return;
   }
 
-  if (!gst_rtp_buffer_get_extension_onebyte_header (&rtp,
-          id, 0, (gpointer) & time, &size)) {
-    GST_TRACE_OBJECT (data->pad,
-        "RTP hdrext abs-send-time with id '%d' not found", id);
-
-    if (data->add_hdr) {
-      GST_TRACE_OBJECT (data->pad, " Adding new one.");
-    } else {
-      GST_WARNING_OBJECT (data->pad, "Cannot add new one: not writable");
-      goto end;
-    }
-
-    time = g_malloc0 (RTP_HDR_EXT_ABS_SEND_TIME_SIZE);
-    if (data->set_time) {
-      kms_base_rtp_endpoint_rtp_hdr_ext_set_time (time);
-    }
-
-    if (!gst_rtp_buffer_add_extension_onebyte_header (&rtp,
-            id, time, RTP_HDR_EXT_ABS_SEND_TIME_SIZE)) {
-      GST_WARNING_OBJECT (data->pad, "RTP hdrext abs-send-time not added");
-    }
-
-    g_free (time);
-  } else if (data->set_time) {
-    if (size != RTP_HDR_EXT_ABS_SEND_TIME_SIZE) {
-      GST_WARNING_OBJECT (data->pad,
-          "RTP hdrext abs-send-time size with id '%d' not matching", id);
-    } else {
-      GST_TRACE_OBJECT (data->pad,
-          "RTP hdrext abs-send-time with id '%d' found. Update time.", id);
-      kms_base_rtp_endpoint_rtp_hdr_ext_set_time (time);
-    }
-  }
-
-end:
-  gst_rtp_buffer_unmap (&rtp);
-}
-
-static gboolean
-kms_base_rtp_endpoint_add_rtp_hdr_ext_bufflist (GstBuffer ** buf, guint idx,
-    HdrExtData * data)
-{
-  if (data->add_hdr) {
-    *buf = gst_buffer_make_writable (*buf);
-  }
-  kms_base_rtp_endpoint_add_rtp_hdr_ext (data, *buf);
-
-  return TRUE;
-}
-
-static GstPadProbeReturn
-kms_base_rtp_endpoint_add_rtp_hdr_ext_probe (GstPad * pad,
-    GstPadProbeInfo * info, gpointer gp)
-{
-  HdrExtData *data = (HdrExtData *) gp;
-
-  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
-    GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
-
-    if (data->add_hdr) {
-      buffer = gst_buffer_make_writable (buffer);
-    }
-    kms_base_rtp_endpoint_add_rtp_hdr_ext (data, buffer);
-    GST_PAD_PROBE_INFO_DATA (info) = buffer;
-  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
-    GstBufferList *bufflist = gst_pad_probe_info_get_buffer_list (info);
-
-    if (data->add_hdr) {
-      bufflist = gst_buffer_list_make_writable (bufflist);
-    }
-    gst_buffer_list_foreach (bufflist,
-        (GstBufferListFunc) kms_base_rtp_endpoint_add_rtp_hdr_ext_bufflist,
-        data);
-
-    GST_PAD_PROBE_INFO_DATA (info) = bufflist;
+  if (!add_hdr && !kms_rtp_hdr_ext_list_has_updaters (list)) {
+    /* Like playout-delay, only written when reserved */
+    GST_DEBUG_OBJECT (self, "No RTP hdrext to update for %" GST_PTR_FORMAT,
+        pad);
+    kms_rtp_hdr_ext_list_free (list);
+    return;
   }
 
-  return GST_PAD_PROBE_OK;
+  GST_DEBUG_OBJECT (self, "Add probe for %s %u RTP hdrexts (%" GST_PTR_FORMAT
+      ").", add_hdr ? "adding" : "updating",
+      kms_rtp_hdr_ext_list_get_length (list), pad);
+  kms_rtp_hdr_ext_list_add_probe (list, pad, add_hdr);
 }
 
 static void
 kms_base_rtp_endpoint_config_rtp_hdr_ext (KmsBaseRtpEndpoint * self,
     const GstSDPMedia * media, GstElement * payloader)
 {
-  HdrExtData *data;
-  gint abs_send_time_id;
   GstPad *pad;
 
-  abs_send_time_id = sdp_utils_get_abs_send_time_id (media);
-  if (abs_send_time_id == -1) {
-    GST_DEBUG_OBJECT (self, "abs-send-time-id not configured.");
-    return;
-  }
-
   pad = gst_element_get_static_pad (payloader, "src");
   if (pad == NULL) {
     GST_WARNING_OBJECT (self, "No RTP pad to configure hdrext probe.");
     return;
   }
 
-  data = hdr_ext_data_new (pad, TRUE, FALSE, abs_send_time_id);
-
-  GST_DEBUG_OBJECT (self,
-      "Add probe for adding abs-send-time (id: %d, %" GST_PTR_FORMAT
-      ").", abs_send_time_id, pad);
-  gst_pad_add_probe (pad,
-      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
-      kms_base_rtp_endpoint_add_rtp_hdr_ext_probe, data,
-      hdr_ext_data_destroy_pointer);
+  kms_base_rtp_endpoint_add_rtp_hdr_ext_probes (self, media, pad, TRUE);
   g_object_unref (pad);
 }
 
+static void
+kms_base_rtp_endpoint_add_extmaps (KmsBaseRtpEndpoint * self,
+    KmsSdpRtpAvpMediaHandler * h_avp)
+{
+  GError *err = NULL;
+
+  kms_sdp_rtp_avp_media_handler_add_extmap (h_avp, RTP_HDR_EXT_ABS_SEND_TIME_ID,
+      RTP_HDR_EXT_ABS_SEND_TIME_URI, &err);
+
+  if (err == NULL && self->priv->transport_cc) {
+    kms_sdp_rtp_avp_media_handler_add_extmap (h_avp,
+        RTP_HDR_EXT_TRANSPORT_CC_ID, RTP_HDR_EXT_TRANSPORT_CC_URI, &err);
+  }
+
+  if (err == NULL && self->priv->max_playout_delay >= 0) {
+    kms_sdp_rtp_avp_media_handler_add_extmap (h_avp,
+        RTP_HDR_EXT_PLAYOUT_DELAY_ID, RTP_HDR_EXT_PLAYOUT_DELAY_URI, &err);
+  }
+
+  if (err != NULL) {
+    GST_WARNING_OBJECT (self, "Cannot add extmap '%s'", err->message);
+    g_error_free (err);
+  }
+}
+
 /* RTP hdrext end */
 
 /* Media handler management begin */
@@ -603,7 +575,6 @@ kms_base_rtp_create_media_handler (KmsBaseSdpEndpoint * base_sdp,
   KmsBaseRtpEndpoint *self = KMS_BASE_RTP_ENDPOINT (base_sdp);
 
   KmsSdpRtpAvpMediaHandler *h_avp;
-  GError *err = NULL;
 
   if (*handler == NULL) {
     /* Media not supported */
@@ -623,14 +594,7 @@ kms_base_rtp_create_media_handler (KmsBaseSdpEndpoint * base_sdp,
         "goog-remb", self->priv->rtcp_remb, NULL);
   }
   h_avp = KMS_SDP_RTP_AVP_MEDIA_HANDLER (*handler);
-  kms_sdp_rtp_avp_media_handler_add_extmap (h_avp, RTP_HDR_EXT_ABS_SEND_TIME_ID,
-      RTP_HDR_EXT_ABS_SEND_TIME_URI, &err);
-
-  if (err != NULL) {
-    GST_WARNING_OBJECT (base_sdp, "Cannot add extmap '%s'", err->message);
-    g_error_free (err);
-    err = NULL;
-  }
+  kms_base_rtp_endpoint_add_extmaps (self, h_avp);
 
   kms_base_rtp_configure_extensions (self, media, *handler);
 }
@@ -691,7 +655,8 @@ ssrc_stats_destroy (KmsSSRCStats * stats)
 }
 
 static KmsRTPSessionStats *
-rtp_session_stats_new (GObject * rtp_session, GstSDPDirection direction)
+rtp_session_stats_new (GObject * rtp_session, GstSDPDirection direction,
+    GstElement * rtx_cache, KmsFecData * fec)
 {
   KmsRTPSessionStats *stats;
 
@@ -699,6 +664,12 @@ rtp_session_stats_new (GObject * rtp_session, GstSDPDirection direction)
   stats->rtp_session = g_object_ref (rtp_session);
   stats->direction = direction;
 
+  if (rtx_cache != NULL) {
+    stats->rtx_cache = gst_object_ref (rtx_cache);
+  }
+
+  stats->fec = (KmsFecData *) kms_ref_struct_ref (KMS_REF_STRUCT_CAST (fec));
+
   return stats;
 }
 
@@ -710,6 +681,8 @@ rtp_session_stats_destroy (KmsRTPSessionStats * stats)
   }
 
   g_clear_object (&stats->rtp_session);
+  g_clear_object (&stats->rtx_cache);
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (stats->fec));
 
   g_slice_free (KmsRTPSessionStats, stats);
 }
@@ -741,6 +714,24 @@ kms_base_rtp_endpoint_is_video_rtcp_nack (KmsBaseRtpEndpoint * self)
   return FALSE;
 }
 
+/* Must be called with the lock held */
+static KmsFecData *
+kms_base_rtp_endpoint_get_fec_data (KmsBaseRtpEndpoint * self, guint session)
+{
+  KmsFecData *data;
+
+  data = g_hash_table_lookup (self->priv->stats.fec,
+      GUINT_TO_POINTER (session));
+
+  if (data == NULL) {
+    data = fec_data_new ();
+    g_hash_table_insert (self->priv->stats.fec, GUINT_TO_POINTER (session),
+        data);
+  }
+
+  return data;
+}
+
 /* Configure media SDP begin */
 static GObject *
 kms_base_rtp_endpoint_create_rtp_session (KmsBaseRtpEndpoint * self,
@@ -769,7 +760,11 @@ kms_base_rtp_endpoint_create_rtp_session (KmsBaseRtpEndpoint * self,
       GUINT_TO_POINTER (session_id));
 
   if (rtp_stats == NULL) {
-    rtp_stats = rtp_session_stats_new (rtpsession, direction);
+    /* The aux sender was created when requesting the pad */
+    rtp_stats = rtp_session_stats_new (rtpsession, direction,
+        g_hash_table_lookup (self->priv->stats.rtx_caches,
+            GUINT_TO_POINTER (session_id)),
+        kms_base_rtp_endpoint_get_fec_data (self, session_id));
     g_hash_table_insert (self->priv->stats.rtp_stats,
         GUINT_TO_POINTER (session_id), rtp_stats);
   } else {
@@ -943,32 +938,19 @@ kms_base_rtp_endpoint_request_rtp_src (KmsIRtpSessionManager * manager,
         gst_element_get_static_pad (self->priv->rtpbin,
         AUDIO_RTPBIN_SEND_RTP_SRC);
   } else if (g_strcmp0 (VIDEO_STREAM_NAME, media_str) == 0) {
-    gint abs_send_time_id;
-
     pad =
         gst_element_get_static_pad (self->priv->rtpbin,
         VIDEO_RTPBIN_SEND_RTP_SRC);
 
     kms_utils_drop_until_keyframe (pad, TRUE);
-
-    /* TODO: check if needed for audio */
-    abs_send_time_id = sdp_utils_get_abs_send_time_id (media);
-    if (abs_send_time_id != -1) {
-      HdrExtData *data = hdr_ext_data_new (pad, FALSE, TRUE, abs_send_time_id);
-
-      GST_DEBUG_OBJECT (self,
-          "Add probe for updating abs-send-time (id: %d, %" GST_PTR_FORMAT ").",
-          abs_send_time_id, pad);
-      gst_pad_add_probe (pad,
-          GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
-          kms_base_rtp_endpoint_add_rtp_hdr_ext_probe,
-          data, hdr_ext_data_destroy_pointer);
-    }
   } else {
     GST_ERROR_OBJECT (self, "'%s' not valid", media_str);
     return NULL;
   }
 
+  /* Transport-wide sequence numbers must cover audio packets too */
+  kms_base_rtp_endpoint_add_rtp_hdr_ext_probes (self, media, pad, FALSE);
+
   return pad;
 }
 
@@ -1076,9 +1058,111 @@ end:
   return ret;
 }
 
+typedef struct _RembPacketData
+{
+  KmsRembLocal *rl;
+  guint8 abs_send_time_id;
+  GstClockTime arrival;
+} RembPacketData;
+
+static gboolean
+kms_base_rtp_endpoint_remb_packet_it (GstBuffer ** buffer, guint idx,
+    RembPacketData * data)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  gpointer ext;
+  guint size;
+
+  if (!gst_rtp_buffer_map (*buffer, GST_MAP_READ, &rtp)) {
+    return TRUE;
+  }
+
+  if (gst_rtp_buffer_get_extension_onebyte_header (&rtp,
+          data->abs_send_time_id, 0, &ext, &size)
+      && size == RTP_HDR_EXT_ABS_SEND_TIME_SIZE) {
+    guint8 *d = ext;
+
+    kms_remb_local_on_rtp_packet (data->rl, (d[0] << 16) | (d[1] << 8) | d[2],
+        data->arrival, gst_buffer_get_size (*buffer));
+  }
+
+  gst_rtp_buffer_unmap (&rtp);
+
+  return TRUE;
+}
+
+static GstPadProbeReturn
+kms_base_rtp_endpoint_remb_packet_probe (GstPad * pad, GstPadProbeInfo * info,
+    RembPacketData * data)
+{
+  if (g_atomic_int_get (&data->rl->estimator) != KMS_REMB_ESTIMATOR_DELAY) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  data->arrival = kms_utils_get_time_nsecs ();
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
+
+    kms_base_rtp_endpoint_remb_packet_it (&buffer, 0, data);
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = gst_pad_probe_info_get_buffer_list (info);
+
+    gst_buffer_list_foreach (list,
+        (GstBufferListFunc) kms_base_rtp_endpoint_remb_packet_it, data);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+remb_packet_data_destroy (RembPacketData * data)
+{
+  g_slice_free (RembPacketData, data);
+}
+
+/* Timing of every received video packet, for the delay-based estimator */
+static void
+kms_base_rtp_endpoint_monitor_remb_packets (KmsBaseRtpEndpoint * self,
+    const GstSDPMedia * media)
+{
+  RembPacketData *data;
+  gint abs_send_time_id;
+  GstPad *pad;
+
+  abs_send_time_id = sdp_utils_get_abs_send_time_id (media);
+  if (abs_send_time_id < 1) {
+    GST_DEBUG_OBJECT (self, "abs-send-time not negotiated, "
+        "delay-based REMB estimator not available");
+    return;
+  }
+
+  pad = gst_element_get_static_pad (self->priv->rtpbin,
+      VIDEO_RTPBIN_RECV_RTP_SINK);
+  if (pad == NULL) {
+    pad = gst_element_get_request_pad (self->priv->rtpbin,
+        VIDEO_RTPBIN_RECV_RTP_SINK);
+  }
+
+  if (pad == NULL) {
+    GST_WARNING_OBJECT (self, "No video RTP sink to monitor REMB packets");
+    return;
+  }
+
+  data = g_slice_new0 (RembPacketData);
+  data->rl = self->priv->rl;
+  data->abs_send_time_id = abs_send_time_id;
+
+  gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      (GstPadProbeCallback) kms_base_rtp_endpoint_remb_packet_probe, data,
+      (GDestroyNotify) remb_packet_data_destroy);
+  g_object_unref (pad);
+}
+
 static void
 kms_base_rtp_endpoint_create_remb_manager (KmsBaseRtpEndpoint *self,
-    KmsBaseRtpSession *sess)
+    KmsBaseRtpSession *sess, const GstSDPMedia * media)
 {
   GstPad *pad;
 
@@ -1137,6 +1221,8 @@ kms_base_rtp_endpoint_create_remb_manager (KmsBaseRtpEndpoint *self,
     kms_remb_remote_set_params (self->priv->rm, self->priv->remb_params);
   }
 
+  kms_base_rtp_endpoint_monitor_remb_packets (self, media);
+
   GST_DEBUG_OBJECT (self, "REMB managers added");
 }
 
@@ -1156,7 +1242,7 @@ kms_base_rtp_endpoint_start_transport_send (KmsBaseSdpEndpoint *
     if (sdp_utils_media_has_remb (media)) {
       const gchar *media_str = gst_sdp_media_get_media (media);
       GST_INFO_OBJECT (self, "Media '%s' has REMB", media_str);
-      kms_base_rtp_endpoint_create_remb_manager (self, base_rtp_sess);
+      kms_base_rtp_endpoint_create_remb_manager (self, base_rtp_sess, media);
     }
   }
 }
@@ -1518,10 +1604,10 @@ kms_base_rtp_endpoint_set_media_payloader (KmsBaseRtpEndpoint * self,
   GST_DEBUG_OBJECT (self, "Found payloader %" GST_PTR_FORMAT, payloader);
 
   if (g_strcmp0 (AUDIO_STREAM_NAME, media_str) == 0) {
+    kms_base_rtp_endpoint_config_rtp_hdr_ext (self, media, payloader);
     type = KMS_ELEMENT_PAD_TYPE_AUDIO;
     rtpbin_pad_name = AUDIO_RTPBIN_SEND_RTP_SINK;
   } else if (g_strcmp0 (VIDEO_STREAM_NAME, media_str) == 0) {
-    /* TODO: check if is needed for audio  */
     kms_base_rtp_endpoint_config_rtp_hdr_ext (self, media, payloader);
     type = KMS_ELEMENT_PAD_TYPE_VIDEO;
     rtpbin_pad_name = VIDEO_RTPBIN_SEND_RTP_SINK;
@@ -1931,35 +2017,135 @@ end:
   }
 }
 
+typedef struct _JbLatencyData
+{
+  KmsJbController *controller;
+  gboolean latency_set;
+  GstClockTime next_update;
+
+  /* Source of the stream, for its jitter and round trip time */
+  GObject *rtpsession;
+  guint ssrc;
+} JbLatencyData;
+
+static void
+jb_latency_data_destroy (JbLatencyData * data)
+{
+  kms_jb_controller_free (data->controller);
+  g_clear_object (&data->rtpsession);
+  g_slice_free (JbLatencyData, data);
+}
+
+static void
+kms_base_rtp_endpoint_jitterbuffer_adapt_latency (GstElement * jitterbuffer,
+    JbLatencyData * data)
+{
+  GstStructure *jb_stats = NULL, *source_stats = NULL;
+  GObject *source = NULL;
+  guint latency;
+
+  g_signal_emit_by_name (data->rtpsession, "get-source-by-ssrc", data->ssrc,
+      &source);
+
+  if (source == NULL) {
+    GST_DEBUG_OBJECT (jitterbuffer, "No source for SSRC %u", data->ssrc);
+    return;
+  }
+
+  g_object_get (source, "stats", &source_stats, NULL);
+  g_object_unref (source);
+  g_object_get (jitterbuffer, "stats", &jb_stats, NULL);
+
+  latency = kms_jb_controller_get_latency (data->controller);
+
+  if (jb_stats != NULL && source_stats != NULL
+      && kms_jb_controller_update_from_stats (data->controller, jb_stats,
+          source_stats)
+      && kms_jb_controller_get_latency (data->controller) != latency) {
+    latency = kms_jb_controller_get_latency (data->controller);
+    GST_DEBUG_OBJECT (jitterbuffer, "Adapting latency to %u ms", latency);
+    g_object_set (jitterbuffer, "latency", latency, NULL);
+  }
+
+  if (jb_stats != NULL) {
+    gst_structure_free (jb_stats);
+  }
+
+  if (source_stats != NULL) {
+    gst_structure_free (source_stats);
+  }
+}
+
 static GstPadProbeReturn
-kms_base_rtp_endpoint_jitterbuffer_set_latency_probe (GstPad * pad,
+kms_base_rtp_endpoint_jitterbuffer_latency_probe (GstPad * pad,
     GstPadProbeInfo * info, gpointer user_data)
 {
   GstElement *jitterbuffer = GST_PAD_PARENT (pad);
-  gint latency = GPOINTER_TO_INT (user_data);
+  JbLatencyData *data = user_data;
+  GstClockTime now = kms_utils_get_time_nsecs ();
+
+  if (!data->latency_set) {
+    guint latency = kms_jb_controller_get_latency (data->controller);
 
-  GST_INFO_OBJECT (jitterbuffer, "Setting latency to %d ms", latency);
-  g_object_set (jitterbuffer, "latency", latency, NULL);
+    GST_INFO_OBJECT (jitterbuffer, "Setting latency to %u ms", latency);
+    g_object_set (jitterbuffer, "latency", latency, NULL);
+    data->latency_set = TRUE;
+    data->next_update = now + JB_ADAPT_INTERVAL;
 
-  GST_INFO_OBJECT (jitterbuffer, "Jitterbuffer latency set; remove probe");
+    if (!kms_jb_controller_is_adaptive (data->controller)) {
+      GST_INFO_OBJECT (jitterbuffer, "Jitterbuffer latency set; remove probe");
+      return GST_PAD_PROBE_REMOVE;
+    }
+
+    return GST_PAD_PROBE_OK;
+  }
 
-  return GST_PAD_PROBE_REMOVE;
+  if (now >= data->next_update) {
+    data->next_update = now + JB_ADAPT_INTERVAL;
+    kms_base_rtp_endpoint_jitterbuffer_adapt_latency (jitterbuffer, data);
+  }
+
+  return GST_PAD_PROBE_OK;
 }
 
-// Latency is set only when there are actual buffers flowing out
+/*
+ * Latency is set only when there are actual buffers flowing out, starting at
+ * @latency. If the endpoint has a maximum latency, it is then adapted to the
+ * jitter of the stream within the endpoint bounds.
+ */
 static void
-kms_base_rtp_endpoint_jitterbuffer_set_latency (GstElement * jitterbuffer,
-    gint latency)
+kms_base_rtp_endpoint_jitterbuffer_set_latency (KmsBaseRtpEndpoint * self,
+    GstElement * jitterbuffer, guint session, guint ssrc, gint latency)
 {
+  KmsRTPSessionStats *rtp_stats;
+  JbLatencyData *data;
   GstPad *src_pad;
 
   GST_INFO_OBJECT (jitterbuffer, "Add probe: Set jitterbuffer latency");
 
+  data = g_slice_new0 (JbLatencyData);
+  data->ssrc = ssrc;
+
+  KMS_ELEMENT_LOCK (self);
+
+  rtp_stats = g_hash_table_lookup (self->priv->stats.rtp_stats,
+      GUINT_TO_POINTER (session));
+
+  if (self->priv->max_jb_latency > 0 && rtp_stats != NULL) {
+    data->controller = kms_jb_controller_new (self->priv->min_jb_latency,
+        self->priv->max_jb_latency, latency);
+    data->rtpsession = g_object_ref (rtp_stats->rtp_session);
+  } else {
+    data->controller = kms_jb_controller_new (latency, latency, latency);
+  }
+
+  KMS_ELEMENT_UNLOCK (self);
+
   src_pad = gst_element_get_static_pad (jitterbuffer, "src");
   gst_pad_add_probe (src_pad,
       GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
-      kms_base_rtp_endpoint_jitterbuffer_set_latency_probe,
-      GINT_TO_POINTER (latency), NULL);
+      kms_base_rtp_endpoint_jitterbuffer_latency_probe, data,
+      (GDestroyNotify) jb_latency_data_destroy);
   g_object_unref (src_pad);
 }
 
@@ -2067,8 +2253,8 @@ kms_base_rtp_endpoint_rtpbin_new_jitterbuffer (GstElement * rtpbin,
 
   switch (session) {
     case AUDIO_RTP_SESSION: {
-      kms_base_rtp_endpoint_jitterbuffer_set_latency (jitterbuffer,
-          JB_READY_AUDIO_LATENCY);
+      kms_base_rtp_endpoint_jitterbuffer_set_latency (self, jitterbuffer,
+          session, ssrc, JB_READY_AUDIO_LATENCY);
 
       kms_base_rtp_endpoint_jitterbuffer_monitor_rtp_out (jitterbuffer,
           self->priv->sync_audio);
@@ -2080,8 +2266,8 @@ kms_base_rtp_endpoint_rtpbin_new_jitterbuffer (GstElement * rtpbin,
       break;
     }
     case VIDEO_RTP_SESSION: {
-      kms_base_rtp_endpoint_jitterbuffer_set_latency (jitterbuffer,
-          JB_READY_VIDEO_LATENCY);
+      kms_base_rtp_endpoint_jitterbuffer_set_latency (self, jitterbuffer,
+          session, ssrc, JB_READY_VIDEO_LATENCY);
 
       kms_base_rtp_endpoint_jitterbuffer_monitor_rtp_out (jitterbuffer,
           self->priv->sync_video);
@@ -2221,6 +2407,70 @@ get_structure_from_id (const GstStructure * structure, const gchar * fieldname)
   return gst_value_get_structure (value);
 }
 
+static void
+ssrc_stats_add_rtx_cache_stats (GstStructure * ssrc_stats,
+    const GstStructure * rtx_stats, const gchar * ssrc_id)
+{
+  const GstStructure *cache_stats;
+
+  cache_stats = get_structure_from_id (rtx_stats, ssrc_id);
+
+  if (cache_stats != NULL) {
+    gst_structure_set (ssrc_stats, "rtx-cache", GST_TYPE_STRUCTURE,
+        cache_stats, NULL);
+  }
+}
+
+/*
+ * Copy the counter @name of @fec into @stats. Not every ulpfec implementation
+ * provides counters, missing ones are left out instead of reported as 0.
+ */
+static void
+fec_stats_add_counter (GstStructure * stats, GstElement * fec,
+    const gchar * name)
+{
+  static volatile gint warned = FALSE;
+  GParamSpec *pspec;
+  guint counter;
+
+  pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (fec), name);
+  if (pspec == NULL || pspec->value_type != G_TYPE_UINT) {
+    if (g_atomic_int_compare_and_exchange (&warned, FALSE, TRUE)) {
+      GST_WARNING_OBJECT (fec, "No '%s' counter, FEC stats will be partial",
+          name);
+    }
+    return;
+  }
+
+  g_object_get (fec, name, &counter, NULL);
+  gst_structure_set (stats, name, G_TYPE_UINT, counter, NULL);
+}
+
+static void
+ssrc_stats_add_fec_stats (GstStructure * ssrc_stats, KmsFecData * fec,
+    gboolean internal)
+{
+  GstStructure *fec_stats;
+  guint percentage = 0;
+
+  if (internal && fec->encoder != NULL) {
+    /* The percentage is the bandwidth overhead in packets */
+    g_object_get (fec->encoder, "percentage", &percentage, NULL);
+    fec_stats = gst_structure_new ("fec", "adaptive", G_TYPE_BOOLEAN,
+        fec->controller != NULL, "percentage", G_TYPE_UINT, percentage, NULL);
+    fec_stats_add_counter (fec_stats, fec->encoder, "protected");
+  } else if (!internal && fec->decoder != NULL) {
+    fec_stats = gst_structure_new_empty ("fec");
+    fec_stats_add_counter (fec_stats, fec->decoder, "recovered");
+    fec_stats_add_counter (fec_stats, fec->decoder, "unrecovered");
+  } else {
+    return;
+  }
+
+  gst_structure_set (ssrc_stats, "fec", GST_TYPE_STRUCTURE, fec_stats, NULL);
+  gst_structure_free (fec_stats);
+}
+
 static void
 set_outbound_additional_params (const GstStructure * session_stats,
     const gchar * ssrc_id, guint rtt, guint fraction_lost, gint packet_lost)
@@ -2259,7 +2509,7 @@ static void
 append_rtp_session_stats (gpointer * session, KmsRTPSessionStats * rtp_stats,
     GstStructure * stats)
 {
-  GstStructure *session_stats;
+  GstStructure *session_stats, *rtx_stats = NULL;
   gchar *str_session;
   GValueArray *arr;
   gchar *ssrc_id = NULL;
@@ -2273,6 +2523,10 @@ append_rtp_session_stats (gpointer * session, KmsRTPSessionStats * rtp_stats,
   if (session_stats == NULL)
     return;
 
+  if (rtp_stats->rtx_cache != NULL) {
+    g_object_get (rtp_stats->rtx_cache, "stats", &rtx_stats, NULL);
+  }
+
   /* Get stats for each source */
   g_object_get (rtp_stats->rtp_session, "sources", &arr, NULL);
 
@@ -2345,6 +2599,12 @@ append_rtp_session_stats (gpointer * session, KmsRTPSessionStats * rtp_stats,
       ssrc_stats_add_jitter_stats (source_stats, jitter_buffer);
     }
 
+    if (internal && rtx_stats != NULL) {
+      ssrc_stats_add_rtx_cache_stats (source_stats, rtx_stats, name);
+    }
+
+    ssrc_stats_add_fec_stats (source_stats, rtp_stats->fec, internal);
+
     gst_structure_set (session_stats, name, GST_TYPE_STRUCTURE, source_stats,
         NULL);
 
@@ -2370,6 +2630,10 @@ append_rtp_session_stats (gpointer * session, KmsRTPSessionStats * rtp_stats,
 
   gst_structure_free (session_stats);
   g_free (str_session);
+
+  if (rtx_stats != NULL) {
+    gst_structure_free (rtx_stats);
+  }
 }
 
 static GstStructure *
@@ -2520,6 +2784,30 @@ kms_base_rtp_endpoint_set_property (GObject * object, guint property_id,
     case PROP_MTU:
       self->priv->mtu = g_value_get_uint (value);
       break;
+    case PROP_MIN_PLAYOUT_DELAY:
+      self->priv->min_playout_delay = g_value_get_int (value);
+      break;
+    case PROP_MAX_PLAYOUT_DELAY:
+      self->priv->max_playout_delay = g_value_get_int (value);
+      break;
+    case PROP_TRANSPORT_CC:
+      self->priv->transport_cc = g_value_get_boolean (value);
+      break;
+    case PROP_RTX_CACHE_TIME:
+      self->priv->rtx_cache_time = g_value_get_uint (value);
+      break;
+    case PROP_MAX_FEC_PERCENTAGE:
+      self->priv->max_fec_percentage = g_value_get_uint (value);
+      break;
+    case PROP_STATS_MAX_STALENESS:
+      self->priv->stats_max_staleness = g_value_get_uint (value);
+      break;
+    case PROP_MIN_JB_LATENCY:
+      self->priv->min_jb_latency = g_value_get_uint (value);
+      break;
+    case PROP_MAX_JB_LATENCY:
+      self->priv->max_jb_latency = g_value_get_uint (value);
+      break;
     case PROP_OFFER_DIR:
       self->priv->offer_dir = g_value_get_enum (value);
       break;
@@ -2586,6 +2874,30 @@ kms_base_rtp_endpoint_get_property (GObject * object, guint property_id,
     case PROP_MTU:
       g_value_set_uint (value, self->priv->mtu);
       break;
+    case PROP_MIN_PLAYOUT_DELAY:
+      g_value_set_int (value, self->priv->min_playout_delay);
+      break;
+    case PROP_MAX_PLAYOUT_DELAY:
+      g_value_set_int (value, self->priv->max_playout_delay);
+      break;
+    case PROP_TRANSPORT_CC:
+      g_value_set_boolean (value, self->priv->transport_cc);
+      break;
+    case PROP_RTX_CACHE_TIME:
+      g_value_set_uint (value, self->priv->rtx_cache_time);
+      break;
+    case PROP_MAX_FEC_PERCENTAGE:
+      g_value_set_uint (value, self->priv->max_fec_percentage);
+      break;
+    case PROP_STATS_MAX_STALENESS:
+      g_value_set_uint (value, self->priv->stats_max_staleness);
+      break;
+    case PROP_MIN_JB_LATENCY:
+      g_value_set_uint (value, self->priv->min_jb_latency);
+      break;
+    case PROP_MAX_JB_LATENCY:
+      g_value_set_uint (value, self->priv->max_jb_latency);
+      break;
     case PROP_SUPPORT_FEC:
       g_value_set_boolean (value, self->priv->support_fec);
       break;
@@ -2631,6 +2943,9 @@ kms_base_rtp_endpoint_destroy_stats (KmsBaseRtpEndpoint * self)
   g_slist_free_full (self->priv->stats.probes,
       (GDestroyNotify) kms_stats_probe_destroy);
   g_hash_table_unref (self->priv->stats.avg_e2e);
+  g_hash_table_destroy (self->priv->stats.rtx_caches);
+  g_hash_table_destroy (self->priv->stats.fec);
+  kms_stats_snapshots_free (self->priv->stats.snapshots);
 }
 
 static void
@@ -2808,6 +3123,7 @@ kms_element_get_e2e_latency_stats (KmsBaseRtpEndpoint * self, gchar * selector)
         (avg->type ==
             KMS_MEDIA_TYPE_AUDIO) ? AUDIO_STREAM_NAME : VIDEO_STREAM_NAME,
         "avg", G_TYPE_UINT64, (guint64) avg->avg, NULL);
+    kms_latency_histogram_append_percentiles (avg->histogram, pad_latency);
 
     gst_structure_set (stats, padname, GST_TYPE_STRUCTURE, pad_latency, NULL);
     gst_structure_free (pad_latency);
@@ -2819,6 +3135,38 @@ kms_element_get_e2e_latency_stats (KmsBaseRtpEndpoint * self, gchar * selector)
   return stats;
 }
 
+/*
+ * Collecting the RTC stats walks every source of every session, so callers
+ * polling faster than "stats-max-staleness" get a copy of the last snapshot
+ */
+static GstStructure *
+kms_base_rtp_endpoint_collect_rtc_stats (const gchar * selector,
+    KmsBaseRtpEndpoint * self)
+{
+  GstStructure *rtc_stats;
+
+  rtc_stats = gst_structure_new_empty (KMS_RTP_STRUCT_NAME);
+  kms_base_rtp_endpoint_add_rtp_stats (self, rtc_stats, selector);
+  kms_base_rtp_endpoint_append_remb_stats (self, rtc_stats, selector);
+
+  return rtc_stats;
+}
+
+static GstStructure *
+kms_base_rtp_endpoint_get_rtc_stats (KmsBaseRtpEndpoint * self,
+    const gchar * selector)
+{
+  GstClockTime max_age;
+
+  KMS_ELEMENT_LOCK (self);
+  max_age = self->priv->stats_max_staleness * GST_MSECOND;
+  KMS_ELEMENT_UNLOCK (self);
+
+  return kms_stats_snapshots_get (self->priv->stats.snapshots, selector,
+      kms_utils_get_time_nsecs (), max_age,
+      (KmsStatsCollectFunc) kms_base_rtp_endpoint_collect_rtc_stats, self);
+}
+
 static GstStructure *
 kms_base_rtp_endpoint_stats (KmsElement * obj, gchar * selector)
 {
@@ -2830,9 +3178,11 @@ kms_base_rtp_endpoint_stats (KmsElement * obj, gchar * selector)
       KMS_ELEMENT_CLASS (kms_base_rtp_endpoint_parent_class)->stats (obj,
       selector);
 
-  rtc_stats = gst_structure_new_empty (KMS_RTP_STRUCT_NAME);
-  kms_base_rtp_endpoint_add_rtp_stats (self, rtc_stats, selector);
-  kms_base_rtp_endpoint_append_remb_stats (self, rtc_stats, selector);
+  if (kms_element_stats_selector_is_pad_counters (selector)) {
+    return stats;
+  }
+
+  rtc_stats = kms_base_rtp_endpoint_get_rtc_stats (self, selector);
 
   gst_structure_set (stats, KMS_RTC_STATISTICS_FIELD, GST_TYPE_STRUCTURE,
       rtc_stats, NULL);
@@ -3041,6 +3391,63 @@ kms_base_rtp_endpoint_class_init (KmsBaseRtpEndpointClass * klass)
           0, G_MAXUINT, DEFAULT_MTU,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (object_class, PROP_MIN_PLAYOUT_DELAY,
+      g_param_spec_int ("min-playout-delay",
+          "Minimum playout delay",
+          "Minimum playout delay (ms) requested to receivers",
+          0, 40950, DEFAULT_MIN_PLAYOUT_DELAY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_MAX_PLAYOUT_DELAY,
+      g_param_spec_int ("max-playout-delay",
+          "Maximum playout delay",
+          "Maximum playout delay (ms) requested to receivers "
+          "(-1 = do not negotiate playout-delay)",
+          -1, 40950, DEFAULT_MAX_PLAYOUT_DELAY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_TRANSPORT_CC,
+      g_param_spec_boolean ("transport-cc",
+          "Transport-wide congestion control",
+          "Negotiate and send the transport-wide sequence number extension",
+          DEFAULT_TRANSPORT_CC, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_RTX_CACHE_TIME,
+      g_param_spec_uint ("rtx-cache-time",
+          "Retransmission cache time",
+          "Time (ms) sent packets are kept for retransmission",
+          0, G_MAXUINT, DEFAULT_RTX_CACHE_TIME,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_MAX_FEC_PERCENTAGE,
+      g_param_spec_uint ("max-fec-percentage", "Maximum FEC percentage",
+          "Upper bound of the ULPFEC protection, adapted to the losses "
+          "reported by the remote peer (0 = adaptive FEC disabled)",
+          0, 100, DEFAULT_MAX_FEC_PERCENTAGE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_STATS_MAX_STALENESS,
+      g_param_spec_uint ("stats-max-staleness", "Stats max staleness",
+          "Max age (ms) of the RTC stats snapshot reused by consecutive "
+          "stats requests (0 = always collect fresh stats)",
+          0, G_MAXUINT, DEFAULT_STATS_MAX_STALENESS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_MIN_JB_LATENCY,
+      g_param_spec_uint ("min-jitter-buffer-latency",
+          "Minimum jitter buffer latency",
+          "Lower bound (ms) of the adaptive jitter buffer latency",
+          0, G_MAXUINT, DEFAULT_MIN_JB_LATENCY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_MAX_JB_LATENCY,
+      g_param_spec_uint ("max-jitter-buffer-latency",
+          "Maximum jitter buffer latency",
+          "Upper bound (ms) of the adaptive jitter buffer latency "
+          "(0 = fixed latency)",
+          0, G_MAXUINT, DEFAULT_MAX_JB_LATENCY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (object_class, PROP_SUPPORT_FEC,
       g_param_spec_boolean ("support-fec", "Forward error correction supported",
           "Forward error correction supported", FALSE,
@@ -3239,6 +3646,70 @@ kms_base_rtp_endpoint_rtpbin_on_timeout (GstElement * rtpbin,
       KMS_MEDIA_STATE_DISCONNECTED);
 }
 
+/* Adapt the FEC protection to the losses reported by the remote @ssrc */
+static void
+kms_base_rtp_endpoint_adapt_fec (KmsBaseRtpEndpoint * self, guint session,
+    guint ssrc)
+{
+  GObject *rtpsession = NULL, *source = NULL;
+  gboolean internal = TRUE, have_rb = FALSE;
+  guint fraction_lost = 0, prev, percentage;
+  GstStructure *stats;
+  KmsFecData *fec;
+
+  KMS_ELEMENT_LOCK (self);
+
+  fec = g_hash_table_lookup (self->priv->stats.fec,
+      GUINT_TO_POINTER (session));
+
+  if (fec == NULL || fec->controller == NULL) {
+    KMS_ELEMENT_UNLOCK (self);
+    return;
+  }
+
+  kms_ref_struct_ref (KMS_REF_STRUCT_CAST (fec));
+
+  KMS_ELEMENT_UNLOCK (self);
+
+  g_signal_emit_by_name (self->priv->rtpbin, "get-internal-session", session,
+      &rtpsession);
+  if (rtpsession == NULL) {
+    goto end;
+  }
+
+  g_signal_emit_by_name (rtpsession, "get-source-by-ssrc", ssrc, &source);
+  g_object_unref (rtpsession);
+  if (source == NULL) {
+    goto end;
+  }
+
+  g_object_get (source, "stats", &stats, NULL);
+  g_object_unref (source);
+
+  gst_structure_get (stats, "internal", G_TYPE_BOOLEAN, &internal,
+      "have-rb", G_TYPE_BOOLEAN, &have_rb, "rb-fractionlost", G_TYPE_UINT,
+      &fraction_lost, NULL);
+  gst_structure_free (stats);
+
+  if (internal || !have_rb) {
+    goto end;
+  }
+
+  KMS_ELEMENT_LOCK (self);
+  prev = kms_fec_controller_get_percentage (fec->controller);
+  percentage = kms_fec_controller_update (fec->controller, fraction_lost);
+  KMS_ELEMENT_UNLOCK (self);
+
+  if (percentage != prev) {
+    GST_DEBUG_OBJECT (self, "Session %u FEC percentage: %u", session,
+        percentage);
+    g_object_set (fec->encoder, "percentage", percentage, NULL);
+  }
+
+end:
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (fec));
+}
+
 static void
 kms_base_rtp_endpoint_rtpbin_on_ssrc_active (GstElement * rtpbin,
     guint session, guint ssrc, gpointer user_data)
@@ -3247,6 +3718,8 @@ kms_base_rtp_endpoint_rtpbin_on_ssrc_active (GstElement * rtpbin,
 
   kms_base_rtp_endpoint_set_media_state (self, session,
       KMS_MEDIA_STATE_CONNECTED);
+
+  kms_base_rtp_endpoint_adapt_fec (self, session, ssrc);
 }
 
 static GstElement *
@@ -3312,9 +3785,14 @@ kms_base_rtp_endpoint_create_aux_receiver (KmsBaseRtpEndpoint * self,
   }
 
   if (edata->ulpfec_pt != 0) {
+    KmsFecData *fec = kms_base_rtp_endpoint_get_fec_data (self, session);
+
     e = gst_element_factory_make ("ulpfecdec", NULL);
     g_object_set (e, "pt", edata->ulpfec_pt, NULL);
     list = g_slist_prepend (list, e);
+
+    g_clear_object (&fec->decoder);
+    fec->decoder = gst_object_ref (e);
   }
 
   if (edata->red_pt != 0) {
@@ -3363,6 +3841,30 @@ kms_base_rtp_endpoint_rtpbin_request_aux_receiver (GstElement * rtpbin,
   return receiver;
 }
 
+/* Must be called with the lock held */
+static GstElement *
+kms_base_rtp_endpoint_create_rtx_cache (KmsBaseRtpEndpoint * self,
+    guint session)
+{
+  GstElement *e;
+
+  e = gst_element_factory_make ("rtxcache", NULL);
+
+  if (e == NULL) {
+    GST_WARNING_OBJECT (self, "rtxcache not available, using rtprtxqueue");
+    e = gst_element_factory_make ("rtprtxqueue", NULL);
+    g_object_set (e, "max-size-packets", RTP_RTX_SIZE, NULL);
+    return e;
+  }
+
+  g_object_set (e, "max-size-packets", RTP_RTX_SIZE, "max-size-time",
+      self->priv->rtx_cache_time, NULL);
+  g_hash_table_insert (self->priv->stats.rtx_caches,
+      GUINT_TO_POINTER (session), gst_object_ref (e));
+
+  return e;
+}
+
 static GstElement *
 kms_base_rtp_endpoint_create_aux_sender (KmsBaseRtpEndpoint * self,
     guint session, ExtData * edata)
@@ -3370,8 +3872,7 @@ kms_base_rtp_endpoint_create_aux_sender (KmsBaseRtpEndpoint * self,
   GSList *list = NULL;
   GstElement *e;
 
-  e = gst_element_factory_make ("rtprtxqueue", NULL);
-  g_object_set (e, "max-size-packets", RTP_RTX_SIZE, NULL);
+  e = kms_base_rtp_endpoint_create_rtx_cache (self, session);
   list = g_slist_prepend (list, e);
 
   if (edata == NULL) {
@@ -3386,11 +3887,21 @@ kms_base_rtp_endpoint_create_aux_sender (KmsBaseRtpEndpoint * self,
   }
 
   if (edata->ulpfec_pt != 0) {
+    KmsFecData *fec = kms_base_rtp_endpoint_get_fec_data (self, session);
+
     e = gst_element_factory_make ("ulpfecenc", NULL);
     /* FIXME: Chrome does not seem to work well with FEC packages generated */
-    /* in our side. Uncomment this when this issue is fixed.                */
-//    g_object_set (e, "pt", edata->ulpfec_pt, NULL);
+    /* in our side. Only enabled when adaptive FEC is explicitly requested. */
+    if (self->priv->max_fec_percentage > 0) {
+      g_object_set (e, "pt", edata->ulpfec_pt, "percentage", 0, NULL);
+      g_clear_pointer (&fec->controller, kms_fec_controller_free);
+      fec->controller =
+          kms_fec_controller_new (self->priv->max_fec_percentage);
+    }
     list = g_slist_prepend (list, e);
+
+    g_clear_object (&fec->encoder);
+    fec->encoder = gst_object_ref (e);
   }
 
 end:
@@ -3438,6 +3949,11 @@ kms_base_rtp_endpoint_init_stats (KmsBaseRtpEndpoint * self)
       g_direct_equal, NULL, (GDestroyNotify) rtp_session_stats_destroy);
   self->priv->stats.avg_e2e = g_hash_table_new_full (g_str_hash, g_str_equal,
       g_free, (GDestroyNotify) kms_ref_struct_unref);
+  self->priv->stats.rtx_caches = g_hash_table_new_full (g_direct_hash,
+      g_direct_equal, NULL, gst_object_unref);
+  self->priv->stats.fec = g_hash_table_new_full (g_direct_hash,
+      g_direct_equal, NULL, (GDestroyNotify) kms_ref_struct_unref);
+  self->priv->stats.snapshots = kms_stats_snapshots_new ();
 }
 
 static gboolean
@@ -3522,6 +4038,14 @@ kms_base_rtp_endpoint_init (KmsBaseRtpEndpoint * self)
   self->priv->max_port = DEFAULT_MAX_PORT;
 
   self->priv->mtu = DEFAULT_MTU;
+  self->priv->min_playout_delay = DEFAULT_MIN_PLAYOUT_DELAY;
+  self->priv->max_playout_delay = DEFAULT_MAX_PLAYOUT_DELAY;
+  self->priv->transport_cc = DEFAULT_TRANSPORT_CC;
+  self->priv->rtx_cache_time = DEFAULT_RTX_CACHE_TIME;
+  self->priv->max_fec_percentage = DEFAULT_MAX_FEC_PERCENTAGE;
+  self->priv->stats_max_staleness = DEFAULT_STATS_MAX_STALENESS;
+  self->priv->min_jb_latency = DEFAULT_MIN_JB_LATENCY;
+  self->priv->max_jb_latency = DEFAULT_MAX_JB_LATENCY;
 
   self->priv->offer_dir = DEFAULT_OFFER_DIR;
 }
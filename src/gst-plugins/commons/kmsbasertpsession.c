@@ -211,6 +211,7 @@ kms_base_rtp_session_e2e_latency_cb (GstPad * pad, KmsMediaType type,
 
     stat = (StreamE2EAvgStat *) value;
     stat->avg = KMS_STATS_CALCULATE_LATENCY_AVG (t, stat->avg);
+    kms_latency_histogram_record (stat->histogram, t);
   }
 
   g_free (name);
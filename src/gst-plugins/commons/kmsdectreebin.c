@@ -29,12 +29,11 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define kms_dec_tree_bin_parent_class parent_class
 G_DEFINE_TYPE (KmsDecTreeBin, kms_dec_tree_bin, KMS_TYPE_TREE_BIN);
 
-static GstElement *
-create_decoder_for_caps (const GstCaps * caps, const GstCaps * raw_caps)
+static GstElementFactory *
+select_decoder_factory (const GstCaps * caps, const GstCaps * raw_caps)
 {
   GList *decoder_list, *filtered_list, *aux_list, *l;
   GstElementFactory *decoder_factory = NULL;
-  GstElement *decoder = NULL;
   gboolean contains_openh264 = FALSE;
 
   decoder_list =
@@ -84,13 +83,30 @@ create_decoder_for_caps (const GstCaps * caps, const GstCaps * raw_caps)
   }
 
   if (decoder_factory != NULL) {
-    decoder = gst_element_factory_create (decoder_factory, NULL);
+    gst_object_ref (decoder_factory);
   }
 
   gst_plugin_feature_list_free (filtered_list);
   gst_plugin_feature_list_free (decoder_list);
   gst_plugin_feature_list_free (aux_list);
 
+  return decoder_factory;
+}
+
+static GstElement *
+create_decoder_for_caps (const GstCaps * caps, const GstCaps * raw_caps)
+{
+  GstElementFactory *decoder_factory;
+  GstElement *decoder = NULL;
+
+  decoder_factory = kms_utils_factory_cache_get ("decoder", caps, raw_caps,
+      select_decoder_factory);
+
+  if (decoder_factory != NULL) {
+    decoder = gst_element_factory_create (decoder_factory, NULL);
+    gst_object_unref (decoder_factory);
+  }
+
   return decoder;
 }
 
@@ -27,6 +27,7 @@
 #include "kmsstats.h"
 #include "kmsutils.h"
 #include "kmsrefstruct.h"
+#include "kmsmetrics.h"
 #include "constants.h"
 
 #define PLUGIN_NAME "kmselement"
@@ -37,12 +38,25 @@
 #define MAX_ENCODER_BITRATE "max-encoder-bitrate"
 
 #define CODEC_CONFIG "codec-config"
+#define LATENCY_BUDGET "latency-budget"
+#define OUTPUT_STATS "output-stats"
+#define TRANSCODING_STATS "transcoding-stats"
 
 #define DEFAULT_TARGET_ENCODER_BITRATE 300000
 #define DEFAULT_MIN_ENCODER_BITRATE 0
 #define DEFAULT_MAX_ENCODER_BITRATE G_MAXINT
+#define DEFAULT_LATENCY_BUDGET 0
 
 #define MEDIA_FLOW_INTERNAL_TIME_MSEC 2000
+#define MEDIA_FLOW_WHEEL_SLOTS 8
+
+#define CACHE_LINE_SIZE 64
+#define PAD_COUNTER_ADD(counter, value) \
+  __atomic_fetch_add (&(counter), (value), __ATOMIC_RELAXED)
+#define PAD_COUNTER_SET(counter, value) \
+  __atomic_store_n (&(counter), (value), __ATOMIC_RELAXED)
+#define PAD_COUNTER_GET(counter) \
+  __atomic_load_n (&(counter), __ATOMIC_RELAXED)
 
 GST_DEBUG_CATEGORY_STATIC (kms_element_debug_category);
 #define GST_CAT_DEFAULT kms_element_debug_category
@@ -91,6 +105,7 @@ typedef struct _StreamInputAvgStat
   KmsRefStruct ref;
   KmsMediaType type;
   gdouble avg;
+  KmsLatencyHistogram *histogram;
 } StreamInputAvgStat;
 
 typedef struct _PendingPad
@@ -120,6 +135,24 @@ typedef enum _KmsMediaFlowType
   KMS_MEDIA_FLOW_OUT
 } KmsMediaFlowType;
 
+/* Traffic of the pads of a media flow, keyed by direction, type and name */
+typedef struct _KmsPadCounters
+{
+  KmsRefStruct ref;
+
+  KmsElementPadType type;
+
+  /* Written from the streaming threads, kept in their own cache lines */
+  guint8 padding0[CACHE_LINE_SIZE];
+  guint64 buffers;
+  guint64 bytes;
+  guint64 keyframes;
+  guint64 gaps;                 /* discontinuities */
+  guint64 flagged;              /* delivered with GAP or CORRUPTED */
+  guint64 last_timestamp;
+  guint8 padding1[CACHE_LINE_SIZE];
+} KmsPadCounters;
+
 typedef struct _KmsMediaFlowData
 {
   KmsRefStruct ref;
@@ -128,8 +161,9 @@ typedef struct _KmsMediaFlowData
   KmsElementPadType type;
   char *pad_description;
   gint media_flowing;
-  gint buffers;
+  gint buffers;                 /* set by the probes, cleared by the wheel */
   KmsMediaFlowType media_flow_type;
+  KmsPadCounters *counters;
 } KmsMediaFlowData;
 
 typedef struct _KmsMediaFlowTimeoutData
@@ -140,8 +174,8 @@ typedef struct _KmsMediaFlowTimeoutData
 
   /* Media Flow signal */
   GOnce init;
-  KmsLoop *loop;
-  guint source_id;
+  KmsTimerWheel *wheel;
+  guint timer_id;
 } KmsMediaFlowTimeoutData;
 
 struct _KmsElementPrivate
@@ -164,9 +198,12 @@ struct _KmsElementPrivate
   gint max_encoder_bitrate;
 
   GstStructure *codec_config;
+  guint latency_budget;
 
   /* Statistics */
   KmsElementStats stats;
+  GHashTable *pad_counters;     /* <"in|out-type-desc", KmsPadCounters> */
+  guint metrics_id;
 };
 
 /* Signals and args */
@@ -195,6 +232,7 @@ enum
   PROP_MAX_ENCODER_BITRATE,
   PROP_MEDIA_STATS,
   PROP_CODEC_CONFIG,
+  PROP_LATENCY_BUDGET,
   PROP_LAST
 };
 
@@ -236,9 +274,79 @@ create_output_element_data (KmsElementPadType type)
   return data;
 }
 
+static void
+pad_counters_destroy (KmsPadCounters * counters)
+{
+  g_slice_free (KmsPadCounters, counters);
+}
+
+static KmsPadCounters *
+pad_counters_new (KmsElementPadType type)
+{
+  KmsPadCounters *counters;
+
+  counters = g_slice_new0 (KmsPadCounters);
+  kms_ref_struct_init (KMS_REF_STRUCT_CAST (counters),
+      (GDestroyNotify) pad_counters_destroy);
+  counters->type = type;
+  counters->last_timestamp = GST_CLOCK_TIME_NONE;
+
+  return counters;
+}
+
+static void
+pad_counters_add_buffer (KmsPadCounters * counters, GstBuffer * buffer)
+{
+  PAD_COUNTER_ADD (counters->buffers, 1);
+  PAD_COUNTER_ADD (counters->bytes, gst_buffer_get_size (buffer));
+
+  if (counters->type == KMS_ELEMENT_PAD_TYPE_VIDEO &&
+      !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    PAD_COUNTER_ADD (counters->keyframes, 1);
+  }
+
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DISCONT)) {
+    PAD_COUNTER_ADD (counters->gaps, 1);
+  }
+
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_GAP) ||
+      GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_CORRUPTED)) {
+    PAD_COUNTER_ADD (counters->flagged, 1);
+  }
+
+  if (GST_BUFFER_PTS_IS_VALID (buffer)) {
+    PAD_COUNTER_SET (counters->last_timestamp, GST_BUFFER_PTS (buffer));
+  }
+}
+
+static gboolean
+pad_counters_add_list_item (GstBuffer ** buffer, guint idx, gpointer user_data)
+{
+  pad_counters_add_buffer (user_data, *buffer);
+
+  return TRUE;
+}
+
+static GstStructure *
+pad_counters_to_structure (KmsPadCounters * counters)
+{
+  /* Pad names are not always valid structure names, so they are only */
+  /* used as the field names in the "pad-counters" structure */
+  return gst_structure_new (KMS_PAD_COUNTERS_STRUCT_NAME,
+      "type", G_TYPE_STRING, kms_element_pad_type_str (counters->type),
+      "buffers", G_TYPE_UINT64, PAD_COUNTER_GET (counters->buffers),
+      "bytes", G_TYPE_UINT64, PAD_COUNTER_GET (counters->bytes),
+      "keyframes", G_TYPE_UINT64, PAD_COUNTER_GET (counters->keyframes),
+      "gaps", G_TYPE_UINT64, PAD_COUNTER_GET (counters->gaps),
+      "flagged", G_TYPE_UINT64, PAD_COUNTER_GET (counters->flagged),
+      "last-timestamp", G_TYPE_UINT64,
+      PAD_COUNTER_GET (counters->last_timestamp), NULL);
+}
+
 static void
 media_flow_data_destroy (KmsMediaFlowData * data)
 {
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (data->counters));
   g_free (data->pad_description);
   g_weak_ref_clear (&data->element);
 
@@ -250,6 +358,7 @@ media_flow_data_new (KmsElement * self, const gchar * description,
     KmsElementPadType type, KmsMediaFlowType media_flow_type)
 {
   KmsMediaFlowData *data;
+  gchar *key;
 
   data = g_slice_new0 (KmsMediaFlowData);
 
@@ -263,6 +372,21 @@ media_flow_data_new (KmsElement * self, const gchar * description,
   data->type = type;
   data->media_flow_type = media_flow_type;
 
+  /* Counters outlive the flow, so they add up if the pad is requested again */
+  KMS_ELEMENT_LOCK (self);
+  key = g_strdup_printf ("%s-%s-%s",
+      media_flow_type == KMS_MEDIA_FLOW_IN ? "in" : "out",
+      kms_element_pad_type_str (type), description);
+  data->counters = g_hash_table_lookup (self->priv->pad_counters, key);
+  if (data->counters == NULL) {
+    data->counters = pad_counters_new (type);
+    g_hash_table_insert (self->priv->pad_counters, key, data->counters);
+  } else {
+    g_free (key);
+  }
+  kms_ref_struct_ref (KMS_REF_STRUCT_CAST (data->counters));
+  KMS_ELEMENT_UNLOCK (self);
+
   return data;
 }
 
@@ -281,8 +405,8 @@ media_flow_data_ref (KmsMediaFlowData * data)
 static void
 media_flow_timeout_data_destroy (KmsMediaFlowTimeoutData * data)
 {
-  if (data->source_id != 0) {
-    kms_loop_remove (data->loop, data->source_id);
+  if (data->timer_id != 0) {
+    kms_timer_wheel_remove (data->wheel, data->timer_id);
   }
 
   media_flow_data_unref (data->media_flow_data);
@@ -305,8 +429,8 @@ media_flow_timeout_data_new (KmsElement * self, const gchar * description,
   data->media_flow_data =
       media_flow_data_new (self, description, type, media_flow_type);
   data->init.status = G_ONCE_STATUS_NOTCALLED;
-  data->source_id = 0;
-  data->loop = klass->loop;
+  data->timer_id = 0;
+  data->wheel = klass->flow_wheel;
 
   return data;
 }
@@ -326,6 +450,7 @@ media_flow_timeout_data_ref (KmsMediaFlowTimeoutData * data)
 static void
 stream_input_avg_stat_destroy (StreamInputAvgStat * stat)
 {
+  kms_latency_histogram_free (stat->histogram);
   g_slice_free (StreamInputAvgStat, stat);
 }
 
@@ -338,6 +463,7 @@ stream_input_avg_stat_new (KmsMediaType type)
   kms_ref_struct_init (KMS_REF_STRUCT_CAST (stat),
       (GDestroyNotify) stream_input_avg_stat_destroy);
   stat->type = type;
+  stat->histogram = kms_latency_histogram_new ();
 
   return stat;
 }
@@ -563,16 +689,14 @@ kms_element_get_data_output_element (KmsElement * self,
       description);
 }
 
-static GstPadProbeReturn
-cb_buffer_received (GstPad * pad, GstPadProbeInfo * info, gpointer data)
+static void
+media_flow_data_notify_flowing (KmsMediaFlowData * fd_data)
 {
-  KmsMediaFlowTimeoutData *fdto_data = (KmsMediaFlowTimeoutData *) data;
-  KmsMediaFlowData *fd_data = fdto_data->media_flow_data;
   gpointer weak_ptr = g_weak_ref_get (&fd_data->element);
   KmsElement *element;
 
   if (weak_ptr == NULL) {
-    return FALSE;
+    return;
   }
 
   element = KMS_ELEMENT (weak_ptr);
@@ -588,27 +712,45 @@ cb_buffer_received (GstPad * pad, GstPadProbeInfo * info, gpointer data)
     }
   }
 
-  g_atomic_int_compare_and_exchange (&fd_data->buffers, 0, 1);
-
   g_object_unref (element);
+}
+
+static GstPadProbeReturn
+cb_buffer_received (GstPad * pad, GstPadProbeInfo * info, gpointer data)
+{
+  KmsMediaFlowTimeoutData *fdto_data = (KmsMediaFlowTimeoutData *) data;
+  KmsMediaFlowData *fd_data = fdto_data->media_flow_data;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    pad_counters_add_buffer (fd_data->counters,
+        GST_PAD_PROBE_INFO_BUFFER (info));
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    gst_buffer_list_foreach (GST_PAD_PROBE_INFO_BUFFER_LIST (info),
+        pad_counters_add_list_item, fd_data->counters);
+  }
+
+  /* Only read the flags while media keeps flowing */
+  if (g_atomic_int_get (&fd_data->buffers) == 0) {
+    g_atomic_int_set (&fd_data->buffers, 1);
+  }
+
+  if (G_UNLIKELY (g_atomic_int_get (&fd_data->media_flowing) == 0)) {
+    media_flow_data_notify_flowing (fd_data);
+  }
 
   return GST_PAD_PROBE_OK;
 }
 
-gboolean
+static gboolean
 check_if_flow_media (gpointer user_data)
 {
   KmsMediaFlowData *data = (KmsMediaFlowData *) user_data;
   gpointer weak_ptr;
   KmsElement *element;
 
-  if (g_source_is_destroyed (g_main_current_source ())) {
-    return G_SOURCE_REMOVE;
-  }
-
   weak_ptr = g_weak_ref_get (&data->element);
   if (weak_ptr == NULL) {
-    return G_SOURCE_REMOVE;
+    return FALSE;
   }
 
   element = KMS_ELEMENT (weak_ptr);
@@ -631,7 +773,7 @@ check_if_flow_media (gpointer user_data)
 
   g_object_unref (element);
 
-  return G_SOURCE_CONTINUE;
+  return TRUE;
 }
 
 static gpointer
@@ -640,9 +782,9 @@ attach_timeout (gpointer data)
   KmsMediaFlowTimeoutData *fdto_data = data;
   KmsMediaFlowData *fd_data = fdto_data->media_flow_data;
 
-  fdto_data->source_id = kms_loop_timeout_add_full (fdto_data->loop,
-      G_PRIORITY_DEFAULT, MEDIA_FLOW_INTERNAL_TIME_MSEC, check_if_flow_media,
-      media_flow_data_ref (fd_data), (GDestroyNotify) media_flow_data_unref);
+  fdto_data->timer_id = kms_timer_wheel_add (fdto_data->wheel,
+      check_if_flow_media, media_flow_data_ref (fd_data),
+      (GDestroyNotify) media_flow_data_unref);
 
   return NULL;
 }
@@ -656,8 +798,8 @@ add_flow_event_probes (GstPad * pad, KmsMediaFlowTimeoutData * fdto_data)
       media_flow_timeout_data_ref (fdto_data),
       (GDestroyNotify) media_flow_timeout_data_unref);
 
-  /* TODO: the timeout could be detached when all pads are removed,
-     but it must be added if a new pad is added */
+  /* TODO: the wheel timer could be removed when all pads are removed,
+     but it must be added again if a new pad is added */
   g_once (&fdto_data->init, attach_timeout, fdto_data);
 }
 
@@ -665,7 +807,7 @@ static void
 add_flow_event_probes_pad_added (GstElement * element, GstPad * pad,
     KmsMediaFlowTimeoutData * fdto_data)
 {
-  if (!GST_PAD_IS_SINK (pad)) {
+  if (!GST_PAD_IS_SINK (pad) || kms_utils_pad_is_link_ghost (pad)) {
     return;
   }
 
@@ -785,6 +927,9 @@ kms_element_get_output_element (KmsElement * self, KmsElementPadType pad_type,
       kms_element_set_video_output_properties (self, odata->element);
     }
 
+    KMS_SET_OBJECT_PROPERTY_SAFELY (odata->element, LATENCY_BUDGET,
+        self->priv->latency_budget);
+
     gst_bin_add (GST_BIN (self), odata->element);
     gst_element_sync_state_with_parent (odata->element);
     KMS_ELEMENT_UNLOCK (self);
@@ -932,6 +1077,7 @@ kms_element_calculate_stats (GstPad * pad, KmsMediaType type,
   }
 
   sstat->avg = KMS_STATS_CALCULATE_LATENCY_AVG (t, sstat->avg);
+  kms_latency_histogram_record (sstat->histogram, t);
 }
 
 static void
@@ -1252,6 +1398,18 @@ set_codec_config (gchar * id, KmsOutputElementData * odata, KmsElement * self)
   }
 }
 
+static void
+set_latency_budget (gchar * id, KmsOutputElementData * odata, KmsElement * self)
+{
+  if (odata->type == KMS_ELEMENT_PAD_TYPE_AUDIO ||
+      odata->type == KMS_ELEMENT_PAD_TYPE_VIDEO) {
+    if (odata->element != NULL) {
+      KMS_SET_OBJECT_PROPERTY_SAFELY (odata->element, LATENCY_BUDGET,
+          self->priv->latency_budget);
+    }
+  }
+}
+
 static void
 kms_element_set_property (GObject * object, guint property_id,
     const GValue * value, GParamSpec * pspec)
@@ -1328,6 +1486,13 @@ kms_element_set_property (GObject * object, guint property_id,
       KMS_ELEMENT_UNLOCK (self);
       break;
     }
+    case PROP_LATENCY_BUDGET:
+      KMS_ELEMENT_LOCK (self);
+      self->priv->latency_budget = g_value_get_uint (value);
+      g_hash_table_foreach (self->priv->output_elements,
+          (GHFunc) set_latency_budget, self);
+      KMS_ELEMENT_UNLOCK (self);
+      break;
     case PROP_MEDIA_STATS:{
       gboolean enable = g_value_get_boolean (value);
 
@@ -1388,6 +1553,11 @@ kms_element_get_property (GObject * object, guint property_id,
       g_value_set_boxed (value, self->priv->codec_config);
       KMS_ELEMENT_UNLOCK (self);
       break;
+    case PROP_LATENCY_BUDGET:
+      KMS_ELEMENT_LOCK (self);
+      g_value_set_uint (value, self->priv->latency_budget);
+      KMS_ELEMENT_UNLOCK (self);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -1408,12 +1578,14 @@ kms_element_finalize (GObject * object)
 
   GST_DEBUG_OBJECT (object, "finalize");
 
+  kms_metrics_remove_collector (element->priv->metrics_id);
   kms_element_destroy_stats (element);
 
   /* free resources allocated by this object */
   g_hash_table_unref (element->priv->pendingpads);
   g_hash_table_unref (element->priv->output_elements);
   g_hash_table_unref (element->priv->stats.avg_iss);
+  g_hash_table_unref (element->priv->pad_counters);
 
   g_rec_mutex_clear (&element->mutex);
 
@@ -1678,6 +1850,7 @@ kms_element_get_input_latency_stats (KmsElement * self, gchar * selector)
         (avg->type ==
             KMS_MEDIA_TYPE_AUDIO) ? AUDIO_STREAM_NAME : VIDEO_STREAM_NAME,
         "avg", G_TYPE_UINT64, (guint64) avg->avg, NULL);
+    kms_latency_histogram_append_percentiles (avg->histogram, pad_latency);
 
     gst_structure_set (stats, padname, GST_TYPE_STRUCTURE, pad_latency, NULL);
     gst_structure_free (pad_latency);
@@ -1688,22 +1861,267 @@ kms_element_get_input_latency_stats (KmsElement * self, gchar * selector)
   return stats;
 }
 
+/*
+ * Gather the structure held in @property by each output element, keyed by
+ * element name
+ */
 static GstStructure *
-kms_element_stats_impl (KmsElement * self, gchar * selector)
+kms_element_get_output_elements_stats (KmsElement * self, gchar * selector,
+    const gchar * property)
+{
+  KmsOutputElementData *odata;
+  GHashTableIter iter;
+  GstStructure *stats;
+  gpointer value;
+
+  stats = gst_structure_new_empty (property);
+
+  KMS_ELEMENT_LOCK (self);
+
+  g_hash_table_iter_init (&iter, self->priv->output_elements);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    GstStructure *element_stats = NULL;
+
+    odata = value;
+
+    if (odata->element == NULL ||
+        (odata->type != KMS_ELEMENT_PAD_TYPE_AUDIO &&
+            odata->type != KMS_ELEMENT_PAD_TYPE_VIDEO)) {
+      continue;
+    }
+
+    if (selector != NULL && ((g_strcmp0 (selector, AUDIO_STREAM_NAME) == 0 &&
+                odata->type != KMS_ELEMENT_PAD_TYPE_AUDIO) ||
+            (g_strcmp0 (selector, VIDEO_STREAM_NAME) == 0 &&
+                odata->type != KMS_ELEMENT_PAD_TYPE_VIDEO))) {
+      continue;
+    }
+
+    if (g_object_class_find_property (G_OBJECT_GET_CLASS (odata->element),
+            property) == NULL) {
+      continue;
+    }
+
+    g_object_get (odata->element, property, &element_stats, NULL);
+    if (element_stats != NULL) {
+      gst_structure_set (stats, GST_ELEMENT_NAME (odata->element),
+          GST_TYPE_STRUCTURE, element_stats, NULL);
+      gst_structure_free (element_stats);
+    }
+  }
+
+  KMS_ELEMENT_UNLOCK (self);
+
+  return stats;
+}
+
+GstStructure *
+kms_element_get_pad_counters (KmsElement * self, const gchar * selector)
 {
+  gpointer key, value;
+  GHashTableIter iter;
   GstStructure *stats;
 
+  stats = gst_structure_new_empty (KMS_PAD_COUNTERS_FIELD);
+
+  KMS_ELEMENT_LOCK (self);
+
+  g_hash_table_iter_init (&iter, self->priv->pad_counters);
+
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    KmsPadCounters *counters = value;
+    GstStructure *pad_stats;
+
+    if (selector != NULL && g_strcmp0 (selector,
+            kms_element_pad_type_str (counters->type)) != 0) {
+      continue;
+    }
+
+    pad_stats = pad_counters_to_structure (counters);
+    gst_structure_set (stats, key, GST_TYPE_STRUCTURE, pad_stats, NULL);
+    gst_structure_free (pad_stats);
+  }
+
+  KMS_ELEMENT_UNLOCK (self);
+
+  return stats;
+}
+
+gboolean
+kms_element_stats_selector_is_pad_counters (const gchar * selector)
+{
+  return g_strcmp0 (selector, KMS_PAD_COUNTERS_SELECTOR) == 0;
+}
+
+void
+kms_element_merge_input_latency (KmsElement * self, KmsMediaType type,
+    KmsLatencyHistogram * histogram)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  KMS_ELEMENT_LOCK (self);
+
+  g_hash_table_iter_init (&iter, self->priv->stats.avg_iss);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    StreamInputAvgStat *sstat = value;
+
+    if (sstat->type == type) {
+      kms_latency_histogram_merge (histogram, sstat->histogram);
+    }
+  }
+
+  KMS_ELEMENT_UNLOCK (self);
+}
+
+static gchar *
+kms_element_get_pipeline_name (KmsElement * self)
+{
+  GstObject *parent, *next;
+  gchar *name = NULL;
+
+  parent = gst_object_get_parent (GST_OBJECT (self));
+
+  while (parent != NULL && (next = gst_object_get_parent (parent)) != NULL) {
+    gst_object_unref (parent);
+    parent = next;
+  }
+
+  if (parent != NULL) {
+    name = gst_object_get_name (parent);
+    gst_object_unref (parent);
+  }
+
+  return name;
+}
+
+#define PAD_METRIC_LABELS "pipeline", pipeline, "element", element, \
+  "pad", key, "direction", direction, "media", media, NULL
+
+static void
+kms_element_collect_pad_counters (KmsElement * self,
+    KmsMetricsCollector * collector, const gchar * pipeline,
+    const gchar * element)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init (&iter, self->priv->pad_counters);
+
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    KmsPadCounters *counters = value;
+    const gchar *media = kms_element_pad_type_str (counters->type);
+    const gchar *direction = g_str_has_prefix (key, "in-") ? "in" : "out";
+
+    kms_metrics_collector_add (collector, "kms_element_buffers_total",
+        KMS_METRIC_TYPE_COUNTER, "Buffers that went through the pad",
+        PAD_COUNTER_GET (counters->buffers), PAD_METRIC_LABELS);
+    kms_metrics_collector_add (collector, "kms_element_bytes_total",
+        KMS_METRIC_TYPE_COUNTER, "Bytes that went through the pad",
+        PAD_COUNTER_GET (counters->bytes), PAD_METRIC_LABELS);
+    kms_metrics_collector_add (collector, "kms_element_keyframes_total",
+        KMS_METRIC_TYPE_COUNTER, "Key frames that went through the pad",
+        PAD_COUNTER_GET (counters->keyframes), PAD_METRIC_LABELS);
+    kms_metrics_collector_add (collector, "kms_element_gaps_total",
+        KMS_METRIC_TYPE_COUNTER, "Discontinuities seen in the pad",
+        PAD_COUNTER_GET (counters->gaps), PAD_METRIC_LABELS);
+    kms_metrics_collector_add (collector, "kms_element_flagged_total",
+        KMS_METRIC_TYPE_COUNTER,
+        "Buffers flagged as gap or corrupted that went through the pad",
+        PAD_COUNTER_GET (counters->flagged), PAD_METRIC_LABELS);
+  }
+}
+
+static void
+kms_element_collect_metrics (KmsMetricsCollector * collector,
+    gpointer user_data)
+{
+  KmsElement *self = g_weak_ref_get (user_data);
+  gchar *pipeline, *element;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  if (self == NULL) {
+    return;
+  }
+
+  pipeline = kms_element_get_pipeline_name (self);
+  element = gst_object_get_name (GST_OBJECT (self));
+
+  KMS_ELEMENT_LOCK (self);
+
+  kms_element_collect_pad_counters (self, collector, pipeline, element);
+
+  /* Only filled while media stats are enabled */
+  g_hash_table_iter_init (&iter, self->priv->stats.avg_iss);
+
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    StreamInputAvgStat *sstat = value;
+
+    if (kms_latency_histogram_get_count (sstat->histogram) == 0) {
+      continue;
+    }
+
+    kms_metrics_collector_add_latency (collector,
+        "kms_element_input_latency_seconds",
+        "Time that buffers take to get to the input pad",
+        sstat->histogram, "pipeline", pipeline, "element", element,
+        "pad", key, "media", sstat->type == KMS_MEDIA_TYPE_AUDIO ?
+        AUDIO_STREAM_NAME : VIDEO_STREAM_NAME, NULL);
+  }
+
+  KMS_ELEMENT_UNLOCK (self);
+
+  g_free (pipeline);
+  g_free (element);
+  g_object_unref (self);
+}
+
+static void
+metrics_weak_ref_free (GWeakRef * ref)
+{
+  g_weak_ref_clear (ref);
+  g_slice_free (GWeakRef, ref);
+}
+
+static GstStructure *
+kms_element_stats_impl (KmsElement * self, gchar * selector)
+{
+  GstStructure *stats, *c_stats;
+
   stats = gst_structure_new_empty ("stats");
 
+  /* Always available, they do not need the latency probes */
+  if (kms_element_stats_selector_is_pad_counters (selector)) {
+    c_stats = kms_element_get_pad_counters (self, NULL);
+    gst_structure_set (stats, KMS_PAD_COUNTERS_FIELD, GST_TYPE_STRUCTURE,
+        c_stats, NULL);
+    gst_structure_free (c_stats);
+
+    return stats;
+  }
+
   if (self->priv->stats_enabled) {
     GstStructure *e_stats;
     GstStructure *l_stats;
+    GstStructure *o_stats;
+    GstStructure *t_stats;
 
     l_stats = kms_element_get_input_latency_stats (self, selector);
+    o_stats = kms_element_get_output_elements_stats (self, selector,
+        OUTPUT_STATS);
+    t_stats = kms_element_get_output_elements_stats (self, selector,
+        TRANSCODING_STATS);
 
     e_stats = gst_structure_new (KMS_ELEMENT_STATS_STRUCT_NAME,
-        "input-latencies", GST_TYPE_STRUCTURE, l_stats, NULL);
+        "input-latencies", GST_TYPE_STRUCTURE, l_stats,
+        "output-stats", GST_TYPE_STRUCTURE, o_stats,
+        "transcodings", GST_TYPE_STRUCTURE, t_stats, NULL);
     gst_structure_free (l_stats);
+    gst_structure_free (o_stats);
+    gst_structure_free (t_stats);
 
     gst_structure_set (stats, KMS_MEDIA_ELEMENT_FIELD, GST_TYPE_STRUCTURE,
         e_stats, NULL);
@@ -1887,6 +2305,12 @@ kms_element_class_init (KmsElementClass * klass)
       g_param_spec_boxed ("codec-config", "codec config",
           "Codec configuration", GST_TYPE_STRUCTURE, G_PARAM_READWRITE));
 
+  g_object_class_install_property (gobject_class, PROP_LATENCY_BUDGET,
+      g_param_spec_uint ("latency-budget", "Latency budget",
+          "Maximum time in milliseconds that media may wait in output queues"
+          " before being dropped (0 keeps the default queue sizes)",
+          0, G_MAXUINT, DEFAULT_LATENCY_BUDGET, G_PARAM_READWRITE));
+
   klass->sink_query = GST_DEBUG_FUNCPTR (kms_element_sink_query_default);
   klass->collect_media_stats =
       GST_DEBUG_FUNCPTR (kms_element_collect_media_stats_impl);
@@ -1962,11 +2386,15 @@ kms_element_class_init (KmsElementClass * klass)
   g_type_class_add_private (klass, sizeof (KmsElementPrivate));
 
   klass->loop = kms_loop_new ();
+  klass->flow_wheel = kms_timer_wheel_new (klass->loop,
+      MEDIA_FLOW_INTERNAL_TIME_MSEC, MEDIA_FLOW_WHEEL_SLOTS);
 }
 
 static void
 kms_element_init (KmsElement * element)
 {
+  GWeakRef *ref;
+
   g_rec_mutex_init (&element->mutex);
 
   element->priv = KMS_ELEMENT_GET_PRIVATE (element);
@@ -1976,14 +2404,23 @@ kms_element_init (KmsElement * element)
   element->priv->target_encoder_bitrate = DEFAULT_TARGET_ENCODER_BITRATE;
   element->priv->min_encoder_bitrate = DEFAULT_MIN_ENCODER_BITRATE;
   element->priv->max_encoder_bitrate = DEFAULT_MAX_ENCODER_BITRATE;
+  element->priv->latency_budget = DEFAULT_LATENCY_BUDGET;
 
   element->priv->pendingpads = g_hash_table_new_full (g_str_hash, g_str_equal,
       g_free, (GDestroyNotify) destroy_pendingpads);
+  element->priv->pad_counters = g_hash_table_new_full (g_str_hash,
+      g_str_equal, g_free, (GDestroyNotify) kms_ref_struct_unref);
   element->priv->output_elements =
       g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
       (GDestroyNotify) destroy_output_element_data);
   element->priv->stats.avg_iss = g_hash_table_new_full (g_str_hash, g_str_equal,
       g_free, (GDestroyNotify) kms_ref_struct_unref);
+
+  ref = g_slice_new0 (GWeakRef);
+  g_weak_ref_init (ref, element);
+  element->priv->metrics_id =
+      kms_metrics_add_collector (kms_element_collect_metrics, ref,
+      (GDestroyNotify) metrics_weak_ref_free);
 }
 
 KmsElementPadType
@@ -19,6 +19,8 @@
 
 #include <gst/gst.h>
 #include "kmsloop.h"
+#include "kmstimerwheel.h"
+#include "kmslatencyhistogram.h"
 #include "kmselementpadtype.h"
 #include "kmsmediatype.h"
 
@@ -77,6 +79,7 @@ struct _KmsElementClass
   GstBinClass parent_class;
 
   KmsLoop * loop;
+  KmsTimerWheel * flow_wheel;
 
   /* actions */
   gchar * (*request_new_pad) (KmsElement *self, KmsElementPadType type, const gchar *desc, GstPadDirection dir);
@@ -119,6 +122,17 @@ GstElement * kms_element_get_output_element (KmsElement * self,
 GstElement * kms_element_get_output_element_from_media_type (KmsElement * self,
     KmsMediaType media_type, const gchar * description);
 
+/* Traffic counters of every media flow, optionally filtered by media type */
+GstStructure * kms_element_get_pad_counters (KmsElement * self,
+    const gchar * selector);
+
+/* Stats requested with this selector only hold the pad counters */
+gboolean kms_element_stats_selector_is_pad_counters (const gchar * selector);
+
+/* Adds the input latencies of every @type stream into @histogram */
+void kms_element_merge_input_latency (KmsElement * self, KmsMediaType type,
+    KmsLatencyHistogram * histogram);
+
 #define kms_element_connect_sink_target(self, target, type)   \
   kms_element_connect_sink_target_full (self, target, type, NULL, NULL, NULL)
 
@@ -63,8 +63,23 @@ struct _KmsEncTreeBinPrivate
 
   gint max_bitrate;
   gint min_bitrate;
+
+  /* Layer of a bitrate ladder, video is scaled down by 2^rendition */
+  guint rendition;
+
+  GstElement *queue;
+
+  /* Elements using a shared encoder -> their KmsBitrateLimits */
+  GMutex consumers_mutex;
+  GHashTable *consumers;
 };
 
+typedef struct _KmsBitrateLimits
+{
+  gint min_bitrate;
+  gint max_bitrate;
+} KmsBitrateLimits;
+
 static const gchar *
 kms_enc_tree_bin_get_name_from_type (EncoderType enc_type)
 {
@@ -339,6 +354,77 @@ kms_enc_tree_bin_set_bitrate_limits (KmsEncTreeBin * self, gint min_bitrate,
   kms_enc_tree_bin_set_target_bitrate (self);
 }
 
+/* Must be called with the consumers mutex held */
+static void
+kms_enc_tree_bin_apply_consumer_limits (KmsEncTreeBin * self)
+{
+  gint min_bitrate = 0, max_bitrate = G_MAXINT;
+  GHashTableIter iter;
+  gpointer value;
+
+  if (g_hash_table_size (self->priv->consumers) == 0) {
+    return;
+  }
+
+  g_hash_table_iter_init (&iter, self->priv->consumers);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    KmsBitrateLimits *limits = value;
+
+    min_bitrate = MAX (min_bitrate, limits->min_bitrate);
+    max_bitrate = MIN (max_bitrate, limits->max_bitrate);
+  }
+
+  GST_DEBUG_OBJECT (self, "Limits of %u consumers: [%d, %d]",
+      g_hash_table_size (self->priv->consumers), min_bitrate, max_bitrate);
+
+  kms_enc_tree_bin_set_bitrate_limits (self, MIN (min_bitrate, max_bitrate),
+      max_bitrate);
+}
+
+/*
+ * A shared encoder is used by several elements, each one with its own
+ * bitrate limits. It is given the tightest limits of all of them.
+ */
+void
+kms_enc_tree_bin_set_consumer_bitrate_limits (KmsEncTreeBin * self,
+    gpointer consumer, gint min_bitrate, gint max_bitrate)
+{
+  KmsBitrateLimits *limits;
+
+  g_mutex_lock (&self->priv->consumers_mutex);
+
+  limits = g_hash_table_lookup (self->priv->consumers, consumer);
+  if (limits == NULL) {
+    limits = g_slice_new (KmsBitrateLimits);
+    g_hash_table_insert (self->priv->consumers, consumer, limits);
+  }
+
+  limits->min_bitrate = min_bitrate;
+  limits->max_bitrate = max_bitrate;
+
+  kms_enc_tree_bin_apply_consumer_limits (self);
+
+  g_mutex_unlock (&self->priv->consumers_mutex);
+}
+
+void
+kms_enc_tree_bin_remove_consumer (KmsEncTreeBin * self, gpointer consumer)
+{
+  g_mutex_lock (&self->priv->consumers_mutex);
+
+  if (g_hash_table_remove (self->priv->consumers, consumer)) {
+    kms_enc_tree_bin_apply_consumer_limits (self);
+  }
+
+  g_mutex_unlock (&self->priv->consumers_mutex);
+}
+
+static void
+kms_bitrate_limits_destroy (KmsBitrateLimits * limits)
+{
+  g_slice_free (KmsBitrateLimits, limits);
+}
+
 gint
 kms_enc_tree_bin_get_min_bitrate (KmsEncTreeBin * self)
 {
@@ -351,6 +437,31 @@ kms_enc_tree_bin_get_max_bitrate (KmsEncTreeBin * self)
   return self->priv->max_bitrate;
 }
 
+guint
+kms_enc_tree_bin_get_rendition (KmsEncTreeBin * self)
+{
+  return self->priv->rendition;
+}
+
+/*
+ * Bound the raw video waiting for the encoder to @budget, or to the default
+ * LEAKY_TIME if it is GST_CLOCK_TIME_NONE.
+ */
+void
+kms_enc_tree_bin_set_latency_budget (KmsEncTreeBin * self,
+    GstClockTime budget)
+{
+  if (self->priv->queue == NULL) {
+    return;
+  }
+
+  if (!GST_CLOCK_TIME_IS_VALID (budget)) {
+    budget = LEAKY_TIME;
+  }
+
+  g_object_set (self->priv->queue, "max-size-time", budget, NULL);
+}
+
 static void
 bitrate_callback (RembEventManager * remb_manager, guint bitrate,
     gpointer user_data)
@@ -440,13 +551,58 @@ check_caps_probe (GstPad * pad, GstPadProbeInfo * info, gpointer data)
   return GST_PAD_PROBE_OK;
 }
 
+/*
+ * Scale down the input resolution of renditions of a bitrate ladder, so
+ * the mediator (videoscale) is the only element scaling the frames. The
+ * probe is placed on the input of the bin, so the caps of the filter are
+ * already set when the mediator negotiates the new input caps.
+ */
+static GstPadProbeReturn
+rendition_caps_probe (GstPad * pad, GstPadProbeInfo * info, gpointer data)
+{
+  GstElement *scalefilter = data;
+  KmsEncTreeBin *self;
+  GstEvent *event = gst_pad_probe_info_get_event (info);
+  GstCaps *filter_caps, *caps;
+  GstStructure *st;
+  gint width, height;
+
+  if (GST_EVENT_TYPE (event) != GST_EVENT_CAPS) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  gst_event_parse_caps (event, &caps);
+  st = gst_caps_get_structure (caps, 0);
+
+  if (!gst_structure_get (st, "width", G_TYPE_INT, &width, "height",
+          G_TYPE_INT, &height, NULL)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  self = KMS_ENC_TREE_BIN (GST_OBJECT_PARENT (scalefilter));
+
+  /* Keep dimensions even, some encoders do not support odd ones */
+  width = MAX (2, (width >> self->priv->rendition) & ~1);
+  height = MAX (2, (height >> self->priv->rendition) & ~1);
+
+  GST_DEBUG_OBJECT (self, "Rendition %u scaled to %dx%d",
+      self->priv->rendition, width, height);
+
+  filter_caps = gst_caps_new_simple ("video/x-raw", "width", G_TYPE_INT, width,
+      "height", G_TYPE_INT, height, NULL);
+  g_object_set (scalefilter, "caps", filter_caps, NULL);
+  gst_caps_unref (filter_caps);
+
+  return GST_PAD_PROBE_OK;
+}
+
 static gboolean
 kms_enc_tree_bin_configure (KmsEncTreeBin * self, const GstCaps * caps,
     gint target_bitrate, GstStructure * codec_configs)
 {
   KmsTreeBin *tree_bin = KMS_TREE_BIN (self);
   GstElement *rate, *convert, *mediator, *output_tee, *capsfilter = NULL;
-  GstElement *queue;
+  GstElement *queue, *scalefilter = NULL;
   GstPad *enc_src;
 
   self->priv->current_bitrate = target_bitrate;
@@ -475,6 +631,7 @@ kms_enc_tree_bin_configure (KmsEncTreeBin * self, const GstCaps * caps,
   mediator = kms_utils_create_mediator_element (caps);
   queue = kms_utils_element_factory_make ("queue", "enctreebin");
   g_object_set (queue, "leaky", 2, "max-size-time", LEAKY_TIME, NULL);
+  self->priv->queue = queue;
 
   if (rate) {
     gst_bin_add (GST_BIN (self), rate);
@@ -508,6 +665,20 @@ kms_enc_tree_bin_configure (KmsEncTreeBin * self, const GstCaps * caps,
     gst_element_sync_state_with_parent (capsfilter);
   }
 
+  if (self->priv->rendition > 0 && kms_utils_caps_is_video (caps)) {
+    GstPad *sink;
+
+    scalefilter = kms_utils_element_factory_make ("capsfilter", "enctreebin");
+    sink = gst_element_get_static_pad (rate != NULL ? rate : convert, "sink");
+    gst_pad_add_probe (sink, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+        rendition_caps_probe, gst_object_ref (scalefilter),
+        gst_object_unref);
+    g_object_unref (sink);
+
+    gst_bin_add (GST_BIN (self), scalefilter);
+    gst_element_sync_state_with_parent (scalefilter);
+  }
+
   if (rate) {
     kms_tree_bin_set_input_element (tree_bin, rate);
   } else {
@@ -517,12 +688,16 @@ kms_enc_tree_bin_configure (KmsEncTreeBin * self, const GstCaps * caps,
   if (rate) {
     gst_element_link (rate, convert);
   }
+  gst_element_link (convert, mediator);
+  if (scalefilter) {
+    gst_element_link (mediator, scalefilter);
+    mediator = scalefilter;
+  }
   if (self->priv->enc_type == X264) {
-    gst_element_link_many (convert, mediator, capsfilter, queue,
-        self->priv->enc, output_tee, NULL);
-  } else {
-    gst_element_link_many (convert, mediator, queue, self->priv->enc,
+    gst_element_link_many (mediator, capsfilter, queue, self->priv->enc,
         output_tee, NULL);
+  } else {
+    gst_element_link_many (mediator, queue, self->priv->enc, output_tee, NULL);
   }
 
   return TRUE;
@@ -531,12 +706,22 @@ kms_enc_tree_bin_configure (KmsEncTreeBin * self, const GstCaps * caps,
 KmsEncTreeBin *
 kms_enc_tree_bin_new (const GstCaps * caps, gint target_bitrate,
     gint min_bitrate, gint max_bitrate, GstStructure * codec_configs)
+{
+  return kms_enc_tree_bin_new_full (caps, target_bitrate, min_bitrate,
+      max_bitrate, codec_configs, 0);
+}
+
+KmsEncTreeBin *
+kms_enc_tree_bin_new_full (const GstCaps * caps, gint target_bitrate,
+    gint min_bitrate, gint max_bitrate, GstStructure * codec_configs,
+    guint rendition)
 {
   KmsEncTreeBin *enc;
 
   enc = g_object_new (KMS_TYPE_ENC_TREE_BIN, NULL);
   enc->priv->max_bitrate = max_bitrate;
   enc->priv->min_bitrate = min_bitrate;
+  enc->priv->rendition = rendition;
 
   target_bitrate = KMS_ENC_TREE_BIN_LIMIT (enc, target_bitrate);
   if (!kms_enc_tree_bin_configure (enc, caps, target_bitrate, codec_configs)) {
@@ -559,6 +744,22 @@ kms_enc_tree_bin_init (KmsEncTreeBin * self)
 
   self->priv->max_bitrate = G_MAXINT;
   self->priv->min_bitrate = 0;
+
+  g_mutex_init (&self->priv->consumers_mutex);
+  self->priv->consumers = g_hash_table_new_full (g_direct_hash,
+      g_direct_equal, NULL, (GDestroyNotify) kms_bitrate_limits_destroy);
+}
+
+static void
+kms_enc_tree_bin_finalize (GObject * object)
+{
+  KmsEncTreeBin *self = KMS_ENC_TREE_BIN (object);
+
+  g_hash_table_unref (self->priv->consumers);
+  g_mutex_clear (&self->priv->consumers_mutex);
+
+  /* chain up */
+  G_OBJECT_CLASS (kms_enc_tree_bin_parent_class)->finalize (object);
 }
 
 static void
@@ -593,6 +794,7 @@ kms_enc_tree_bin_class_init (KmsEncTreeBinClass * klass)
       GST_DEFAULT_NAME);
 
   gobject_class->dispose = kms_enc_tree_bin_dispose;
+  gobject_class->finalize = kms_enc_tree_bin_finalize;
 
   g_type_class_add_private (klass, sizeof (KmsEncTreeBinPrivate));
 }
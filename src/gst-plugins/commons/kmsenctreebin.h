@@ -53,9 +53,16 @@ struct _KmsEncTreeBinClass
 GType kms_enc_tree_bin_get_type (void);
 
 KmsEncTreeBin * kms_enc_tree_bin_new (const GstCaps * caps, gint target_bitrate, gint min_bitrate, gint max_bitrate, GstStructure *codec_configs);
+KmsEncTreeBin * kms_enc_tree_bin_new_full (const GstCaps * caps, gint target_bitrate, gint min_bitrate, gint max_bitrate, GstStructure *codec_configs, guint rendition);
+guint kms_enc_tree_bin_get_rendition (KmsEncTreeBin *self);
+void kms_enc_tree_bin_set_latency_budget (KmsEncTreeBin *self, GstClockTime budget);
 void kms_enc_tree_bin_set_bitrate_limits (KmsEncTreeBin *self, gint min_bitrate, gint max_bitrate);
 gint kms_enc_tree_bin_get_min_bitrate (KmsEncTreeBin *self);
 gint kms_enc_tree_bin_get_max_bitrate (KmsEncTreeBin *self);
 
+/* Limits of each element using a shared encoder, the tightest ones apply */
+void kms_enc_tree_bin_set_consumer_bitrate_limits (KmsEncTreeBin *self, gpointer consumer, gint min_bitrate, gint max_bitrate);
+void kms_enc_tree_bin_remove_consumer (KmsEncTreeBin *self, gpointer consumer);
+
 G_END_DECLS
 #endif /* __KMS_ENC_TREE_BIN_H__ */
@@ -0,0 +1,105 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsfeccontroller.h"
+
+#define GST_CAT_DEFAULT kms_fec_controller_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "kmsfeccontroller"
+
+/* Target = LOSS_FACTOR * loss + LOSS_MARGIN (%) */
+#define LOSS_FACTOR 2
+#define LOSS_MARGIN 5
+
+#define LOSS_THRESHOLD 1        /* %, below it the link is clean */
+#define CLEAN_REPORTS 3         /* clean reports before decreasing */
+#define DECREASE_STEP 5         /* % per report */
+
+struct _KmsFecController
+{
+  guint max_percentage;
+  guint percentage;
+  guint clean_reports;
+};
+
+KmsFecController *
+kms_fec_controller_new (guint max_percentage)
+{
+  KmsFecController *self = g_slice_new0 (KmsFecController);
+
+  self->max_percentage = MIN (max_percentage, 100);
+
+  return self;
+}
+
+void
+kms_fec_controller_free (KmsFecController * self)
+{
+  g_slice_free (KmsFecController, self);
+}
+
+guint
+kms_fec_controller_get_percentage (KmsFecController * self)
+{
+  return self->percentage;
+}
+
+guint
+kms_fec_controller_update (KmsFecController * self, guint fraction_lost)
+{
+  guint loss = MIN (fraction_lost, 255) * 100 / 256;
+  guint percentage = self->percentage;
+
+  if (loss < LOSS_THRESHOLD) {
+    /* Do not drop the protection on a single good report */
+    if (++self->clean_reports >= CLEAN_REPORTS) {
+      percentage = percentage > DECREASE_STEP ? percentage - DECREASE_STEP : 0;
+    }
+  } else {
+    guint target = MIN (LOSS_FACTOR * loss + LOSS_MARGIN, self->max_percentage);
+
+    self->clean_reports = 0;
+
+    if (target > percentage) {
+      percentage = target;
+    } else {
+      percentage = MAX (target, percentage > DECREASE_STEP ?
+          percentage - DECREASE_STEP : 0);
+    }
+  }
+
+  if (percentage != self->percentage) {
+    GST_DEBUG ("FEC percentage %u -> %u (loss: %u%%)", self->percentage,
+        percentage, loss);
+    self->percentage = percentage;
+  }
+
+  return self->percentage;
+}
+
+static void init_debug (void) __attribute__ ((constructor));
+
+static void
+init_debug (void)
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+}
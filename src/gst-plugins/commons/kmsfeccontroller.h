@@ -0,0 +1,45 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_FEC_CONTROLLER_H__
+#define __KMS_FEC_CONTROLLER_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * ULPFEC protection level controller. The percentage of FEC packets follows
+ * the fraction lost reported by the receiver: it grows at once on lossy
+ * links and goes down to zero after some clean reports.
+ */
+typedef struct _KmsFecController KmsFecController;
+
+KmsFecController *kms_fec_controller_new (guint max_percentage);
+void kms_fec_controller_free (KmsFecController * self);
+
+guint kms_fec_controller_get_percentage (KmsFecController * self);
+
+/*
+ * Feed the fraction lost (0-255) of a RTCP report block.
+ * Returns the new FEC percentage (0-100).
+ */
+guint kms_fec_controller_update (KmsFecController * self,
+    guint fraction_lost);
+
+G_END_DECLS
+#endif /* __KMS_FEC_CONTROLLER_H__ */
@@ -0,0 +1,184 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsjbcontroller.h"
+
+#define GST_CAT_DEFAULT kms_jb_controller_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "kmsjbcontroller"
+
+/* Target = JITTER_FACTOR * jitter + JITTER_MARGIN */
+#define JITTER_FACTOR 4
+#define JITTER_MARGIN 10        /* ms */
+
+#define LATE_RATE_THRESHOLD 0.01
+#define INCREASE_FACTOR 1.25
+#define INCREASE_STEP 10        /* ms */
+#define DECREASE_FACTOR 0.05    /* per update */
+#define DECREASE_HOLD 10        /* updates without decreasing after late */
+#define MIN_CHANGE 5            /* ms */
+
+struct _KmsJbController
+{
+  guint min_latency;
+  guint max_latency;
+  guint initial_latency;
+  guint latency;
+
+  guint64 last_pushed;
+  guint64 last_late;
+  guint hold;
+};
+
+KmsJbController *
+kms_jb_controller_new (guint min_latency, guint max_latency,
+    guint initial_latency)
+{
+  KmsJbController *self = g_slice_new0 (KmsJbController);
+
+  self->min_latency = min_latency;
+  self->max_latency = MAX (min_latency, max_latency);
+  self->latency = CLAMP (initial_latency, self->min_latency,
+      self->max_latency);
+  self->initial_latency = self->latency;
+
+  return self;
+}
+
+void
+kms_jb_controller_free (KmsJbController * self)
+{
+  g_slice_free (KmsJbController, self);
+}
+
+gboolean
+kms_jb_controller_is_adaptive (KmsJbController * self)
+{
+  return self->min_latency != self->max_latency;
+}
+
+guint
+kms_jb_controller_get_latency (KmsJbController * self)
+{
+  return self->latency;
+}
+
+guint
+kms_jb_controller_update (KmsJbController * self, guint64 num_pushed,
+    guint64 num_late, GstClockTime jitter, GstClockTime rtt)
+{
+  guint64 pushed = num_pushed - self->last_pushed;
+  guint64 late = num_late - self->last_late;
+  guint target, latency;
+  gdouble late_rate;
+
+  self->last_pushed = num_pushed;
+  self->last_late = num_late;
+
+  if (pushed + late == 0) {
+    /* Nothing received, nothing learnt */
+    return self->latency;
+  }
+
+  late_rate = (gdouble) late / (pushed + late);
+  target = JITTER_FACTOR * (jitter / GST_MSECOND) + JITTER_MARGIN;
+
+  if (GST_CLOCK_TIME_IS_VALID (rtt)) {
+    /* Room for a NACK and its retransmission */
+    target = MAX (target, rtt / GST_MSECOND + JITTER_MARGIN);
+  } else {
+    target = MAX (target, self->initial_latency);
+  }
+
+  if (late_rate > LATE_RATE_THRESHOLD) {
+    latency = MAX ((guint) (self->latency * INCREASE_FACTOR) + INCREASE_STEP,
+        target);
+    self->hold = DECREASE_HOLD;
+  } else if (target >= self->latency) {
+    latency = target;
+  } else if (self->hold > 0) {
+    self->hold--;
+    latency = self->latency;
+  } else {
+    latency = self->latency - MIN (self->latency - target,
+        (guint) (self->latency * DECREASE_FACTOR) + 1);
+  }
+
+  latency = CLAMP (latency, self->min_latency, self->max_latency);
+
+  /* Avoid small changes, the jitter buffer resyncs on every one */
+  if (latency != self->latency && (ABS ((gint) latency - (gint) self->latency)
+          >= MIN_CHANGE || latency == self->min_latency
+          || latency == self->max_latency)) {
+    GST_DEBUG ("Latency %u -> %u ms (jitter: %" G_GUINT64_FORMAT
+        " ms, rtt: %" GST_TIME_FORMAT ", late: %.2f%%)", self->latency,
+        latency, jitter / GST_MSECOND, GST_TIME_ARGS (rtt), late_rate * 100);
+    self->latency = latency;
+  }
+
+  return self->latency;
+}
+
+gboolean
+kms_jb_controller_update_from_stats (KmsJbController * self,
+    const GstStructure * jb_stats, const GstStructure * source_stats)
+{
+  GstClockTime rtt = GST_CLOCK_TIME_NONE;
+  guint64 pushed, late;
+  guint jitter, round_trip;
+  gboolean have_rb = FALSE;
+  gint clock_rate;
+
+  if (!gst_structure_get_uint64 (jb_stats, "num-pushed", &pushed)
+      || !gst_structure_get_uint64 (jb_stats, "num-late", &late)) {
+    GST_WARNING ("No jitter buffer counters in %" GST_PTR_FORMAT, jb_stats);
+    return FALSE;
+  }
+
+  /* RFC 3550 interarrival jitter, in clock rate units */
+  if (!gst_structure_get_uint (source_stats, "jitter", &jitter)
+      || !gst_structure_get_int (source_stats, "clock-rate", &clock_rate)
+      || clock_rate <= 0) {
+    GST_DEBUG ("No jitter yet in %" GST_PTR_FORMAT, source_stats);
+    return FALSE;
+  }
+
+  /* Known once the sender reports on our own stream, in 1/65536 s */
+  if (gst_structure_get_boolean (source_stats, "have-rb", &have_rb) && have_rb
+      && gst_structure_get_uint (source_stats, "rb-round-trip", &round_trip)
+      && round_trip > 0) {
+    rtt = gst_util_uint64_scale (round_trip, GST_SECOND, 65536);
+  }
+
+  kms_jb_controller_update (self, pushed, late,
+      gst_util_uint64_scale_int (jitter, GST_SECOND, clock_rate), rtt);
+
+  return TRUE;
+}
+
+static void init_debug (void) __attribute__ ((constructor));
+
+static void
+init_debug (void)
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+}
@@ -0,0 +1,61 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_JB_CONTROLLER_H__
+#define __KMS_JB_CONTROLLER_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Jitter buffer latency controller. The target latency follows the observed
+ * interarrival jitter; late packets make it grow fast, and it only shrinks
+ * slowly after a quiet period. It never goes below the round trip time, so
+ * retransmissions still arrive in time, nor below the initial latency while
+ * the round trip time is unknown. The result is always within [min, max].
+ */
+typedef struct _KmsJbController KmsJbController;
+
+/* Latencies in ms */
+KmsJbController *kms_jb_controller_new (guint min_latency, guint max_latency,
+    guint initial_latency);
+void kms_jb_controller_free (KmsJbController * self);
+
+/* FALSE if min and max latencies are the same */
+gboolean kms_jb_controller_is_adaptive (KmsJbController * self);
+
+guint kms_jb_controller_get_latency (KmsJbController * self);
+
+/*
+ * Feed the jitter buffer counters (cumulative), the interarrival jitter and
+ * the round trip time (GST_CLOCK_TIME_NONE if unknown).
+ * Returns the new latency in ms.
+ */
+guint kms_jb_controller_update (KmsJbController * self, guint64 num_pushed,
+    guint64 num_late, GstClockTime jitter, GstClockTime rtt);
+
+/*
+ * Update from the "stats" of the rtpjitterbuffer and of the RTPSource of the
+ * same stream. Returns FALSE, without any update, if a needed field is
+ * missing.
+ */
+gboolean kms_jb_controller_update_from_stats (KmsJbController * self,
+    const GstStructure * jb_stats, const GstStructure * source_stats);
+
+G_END_DECLS
+#endif /* __KMS_JB_CONTROLLER_H__ */
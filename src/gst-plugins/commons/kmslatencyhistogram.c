@@ -0,0 +1,268 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "kmslatencyhistogram.h"
+
+#define GST_CAT_DEFAULT kms_latency_histogram_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "kmslatencyhistogram"
+
+#define SUB_BITS 4
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define MAX_EXP 31              /* Values are clamped below 2^31 us */
+#define MAX_VALUE ((G_GUINT64_CONSTANT (1) << MAX_EXP) - 1)
+#define N_BUCKETS (SUB_BUCKETS + (MAX_EXP - SUB_BITS) * SUB_BUCKETS)
+
+/* Recorded values before halving all the buckets */
+#define DECAY_COUNT (1 << 16)
+
+struct _KmsLatencyHistogram
+{
+  GMutex mutex;
+  guint64 count;
+  guint32 buckets[N_BUCKETS];
+
+  /* Every recorded value, never decayed */
+  guint64 total_count;
+  GstClockTime total_sum;
+};
+
+KmsLatencyHistogram *
+kms_latency_histogram_new (void)
+{
+  KmsLatencyHistogram *self = g_slice_new0 (KmsLatencyHistogram);
+
+  g_mutex_init (&self->mutex);
+
+  return self;
+}
+
+void
+kms_latency_histogram_free (KmsLatencyHistogram * self)
+{
+  g_mutex_clear (&self->mutex);
+  g_slice_free (KmsLatencyHistogram, self);
+}
+
+static guint
+bucket_index (guint64 us)
+{
+  guint exp;
+
+  if (us < SUB_BUCKETS) {
+    return us;
+  }
+
+  us = MIN (us, MAX_VALUE);
+  exp = g_bit_storage (us) - 1;
+
+  return SUB_BUCKETS + (exp - SUB_BITS) * SUB_BUCKETS +
+      ((us >> (exp - SUB_BITS)) - SUB_BUCKETS);
+}
+
+/* Middle point of the bucket, in microseconds */
+static guint64
+bucket_value (guint idx)
+{
+  guint shift;
+
+  if (idx < SUB_BUCKETS) {
+    return idx;
+  }
+
+  shift = (idx - SUB_BUCKETS) / SUB_BUCKETS;
+
+  return ((guint64) (SUB_BUCKETS + idx % SUB_BUCKETS) << shift) +
+      ((G_GUINT64_CONSTANT (1) << shift) >> 1);
+}
+
+static void
+kms_latency_histogram_decay (KmsLatencyHistogram * self)
+{
+  guint i;
+
+  self->count = 0;
+
+  for (i = 0; i < N_BUCKETS; i++) {
+    self->buckets[i] >>= 1;
+    self->count += self->buckets[i];
+  }
+
+  GST_TRACE ("Histogram decayed to %" G_GUINT64_FORMAT " values", self->count);
+}
+
+void
+kms_latency_histogram_record (KmsLatencyHistogram * self,
+    GstClockTimeDiff latency)
+{
+  guint idx;
+
+  /* Clock skew between hosts can produce negative values */
+  latency = MAX (latency, 0);
+  idx = bucket_index (latency / GST_USECOND);
+
+  g_mutex_lock (&self->mutex);
+
+  if (self->count >= DECAY_COUNT) {
+    kms_latency_histogram_decay (self);
+  }
+
+  self->buckets[idx]++;
+  self->count++;
+  self->total_count++;
+  self->total_sum += latency;
+
+  g_mutex_unlock (&self->mutex);
+}
+
+void
+kms_latency_histogram_merge (KmsLatencyHistogram * self,
+    KmsLatencyHistogram * other)
+{
+  guint32 buckets[N_BUCKETS];
+  guint64 total_count;
+  GstClockTime total_sum;
+  guint i;
+
+  if (self == other) {
+    return;
+  }
+
+  /* Copy first, so both mutexes are never held at once */
+  g_mutex_lock (&other->mutex);
+  memcpy (buckets, other->buckets, sizeof (buckets));
+  total_count = other->total_count;
+  total_sum = other->total_sum;
+  g_mutex_unlock (&other->mutex);
+
+  g_mutex_lock (&self->mutex);
+
+  self->total_count += total_count;
+  self->total_sum += total_sum;
+
+  for (i = 0; i < N_BUCKETS; i++) {
+    self->buckets[i] += buckets[i];
+    self->count += buckets[i];
+  }
+
+  g_mutex_unlock (&self->mutex);
+}
+
+void
+kms_latency_histogram_reset (KmsLatencyHistogram * self)
+{
+  g_mutex_lock (&self->mutex);
+  memset (self->buckets, 0, sizeof (self->buckets));
+  self->count = 0;
+  self->total_count = 0;
+  self->total_sum = 0;
+  g_mutex_unlock (&self->mutex);
+}
+
+guint64
+kms_latency_histogram_get_count (KmsLatencyHistogram * self)
+{
+  guint64 count;
+
+  g_mutex_lock (&self->mutex);
+  count = self->count;
+  g_mutex_unlock (&self->mutex);
+
+  return count;
+}
+
+void
+kms_latency_histogram_get_totals (KmsLatencyHistogram * self, guint64 * count,
+    GstClockTime * sum)
+{
+  g_mutex_lock (&self->mutex);
+  *count = self->total_count;
+  *sum = self->total_sum;
+  g_mutex_unlock (&self->mutex);
+}
+
+static GstClockTime
+kms_latency_histogram_percentile_unlocked (KmsLatencyHistogram * self,
+    gdouble percentile)
+{
+  guint64 rank, acc = 0;
+  guint i;
+
+  if (self->count == 0) {
+    return 0;
+  }
+
+  rank = (guint64) (CLAMP (percentile, 0, 100) * self->count / 100.0 + 0.5);
+  rank = CLAMP (rank, 1, self->count);
+
+  for (i = 0; i < N_BUCKETS; i++) {
+    acc += self->buckets[i];
+
+    if (acc >= rank) {
+      break;
+    }
+  }
+
+  return bucket_value (MIN (i, N_BUCKETS - 1)) * GST_USECOND;
+}
+
+GstClockTime
+kms_latency_histogram_get_percentile (KmsLatencyHistogram * self,
+    gdouble percentile)
+{
+  GstClockTime value;
+
+  g_mutex_lock (&self->mutex);
+  value = kms_latency_histogram_percentile_unlocked (self, percentile);
+  g_mutex_unlock (&self->mutex);
+
+  return value;
+}
+
+void
+kms_latency_histogram_append_percentiles (KmsLatencyHistogram * self,
+    GstStructure * stats)
+{
+  g_mutex_lock (&self->mutex);
+
+  if (self->count > 0) {
+    gst_structure_set (stats,
+        "p50", G_TYPE_UINT64,
+        kms_latency_histogram_percentile_unlocked (self, 50),
+        "p95", G_TYPE_UINT64,
+        kms_latency_histogram_percentile_unlocked (self, 95),
+        "p99", G_TYPE_UINT64,
+        kms_latency_histogram_percentile_unlocked (self, 99), NULL);
+  }
+
+  g_mutex_unlock (&self->mutex);
+}
+
+static void init_debug (void) __attribute__ ((constructor));
+
+static void
+init_debug (void)
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+}
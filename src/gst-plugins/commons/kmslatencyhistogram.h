@@ -0,0 +1,57 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_LATENCY_HISTOGRAM_H__
+#define __KMS_LATENCY_HISTOGRAM_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Fixed size latency histogram with logarithmic buckets: 16 linear buckets
+ * per power of two of microseconds, so any value is reported with less than
+ * 6.25% error. Histograms are mergeable, which allows summaries of several
+ * streams or elements. Old values fade out by halving all the buckets once
+ * enough values have been recorded. All functions are thread safe.
+ */
+typedef struct _KmsLatencyHistogram KmsLatencyHistogram;
+
+KmsLatencyHistogram *kms_latency_histogram_new (void);
+void kms_latency_histogram_free (KmsLatencyHistogram * self);
+
+void kms_latency_histogram_record (KmsLatencyHistogram * self,
+    GstClockTimeDiff latency);
+void kms_latency_histogram_merge (KmsLatencyHistogram * self,
+    KmsLatencyHistogram * other);
+void kms_latency_histogram_reset (KmsLatencyHistogram * self);
+
+guint64 kms_latency_histogram_get_count (KmsLatencyHistogram * self);
+
+/* Number and sum of all the recorded values. Unlike the count above, */
+/* they are not decayed, so they only grow until the histogram is reset */
+void kms_latency_histogram_get_totals (KmsLatencyHistogram * self,
+    guint64 * count, GstClockTime * sum);
+GstClockTime kms_latency_histogram_get_percentile (KmsLatencyHistogram * self,
+    gdouble percentile);
+
+/* Sets "p50", "p95" and "p99" (ns) in @stats, if any value was recorded */
+void kms_latency_histogram_append_percentiles (KmsLatencyHistogram * self,
+    GstStructure * stats);
+
+G_END_DECLS
+#endif /* __KMS_LATENCY_HISTOGRAM_H__ */
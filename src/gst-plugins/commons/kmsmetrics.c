@@ -0,0 +1,645 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <glib-unix.h>
+#include <glib/gstdio.h>
+
+#include "kmsmetrics.h"
+#include "kmsrefstruct.h"
+
+#define GST_CAT_DEFAULT kms_metrics_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "kmsmetrics"
+
+#define LISTEN_BACKLOG 8
+#define SEND_TIMEOUT 5          /* s, so a stuck scraper can not block us */
+/* Exact for integers below 10^15, without noise in decimal values */
+#define VALUE_FORMAT "%.15g"
+
+typedef struct _CollectorEntry
+{
+  KmsRefStruct ref;
+
+  KmsMetricsCollectFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+} CollectorEntry;
+
+typedef struct _MetricFamily
+{
+  KmsMetricType type;
+  gchar *help;
+  GString *samples;
+} MetricFamily;
+
+struct _KmsMetricsCollector
+{
+  GHashTable *families;         /* <name, MetricFamily> */
+  GPtrArray *names;             /* in order of appearance */
+};
+
+struct _KmsMetricsExporter
+{
+  gchar *socket_path;
+  gchar *file_path;
+  guint interval;
+
+  gint listen_fd;
+  gint wakeup[2];
+  GThread *thread;
+};
+
+static GMutex registry_mutex;
+static GHashTable *collectors;  /* <id, CollectorEntry> */
+static guint last_collector_id;
+
+static void
+collector_entry_destroy (CollectorEntry * entry)
+{
+  if (entry->notify != NULL) {
+    entry->notify (entry->user_data);
+  }
+
+  g_slice_free (CollectorEntry, entry);
+}
+
+guint
+kms_metrics_add_collector (KmsMetricsCollectFunc func, gpointer user_data,
+    GDestroyNotify notify)
+{
+  CollectorEntry *entry;
+  guint id;
+
+  g_return_val_if_fail (func != NULL, 0);
+
+  entry = g_slice_new0 (CollectorEntry);
+  kms_ref_struct_init (KMS_REF_STRUCT_CAST (entry),
+      (GDestroyNotify) collector_entry_destroy);
+  entry->func = func;
+  entry->user_data = user_data;
+  entry->notify = notify;
+
+  g_mutex_lock (&registry_mutex);
+
+  if (collectors == NULL) {
+    collectors = g_hash_table_new_full (NULL, NULL, NULL,
+        (GDestroyNotify) kms_ref_struct_unref);
+  }
+
+  id = ++last_collector_id;
+  g_hash_table_insert (collectors, GUINT_TO_POINTER (id), entry);
+
+  g_mutex_unlock (&registry_mutex);
+
+  return id;
+}
+
+void
+kms_metrics_remove_collector (guint collector_id)
+{
+  gpointer entry = NULL;
+
+  g_mutex_lock (&registry_mutex);
+
+  if (collectors != NULL) {
+    entry = g_hash_table_lookup (collectors, GUINT_TO_POINTER (collector_id));
+  }
+
+  if (entry != NULL) {
+    /* Notify must not be called with the registry locked */
+    kms_ref_struct_ref (entry);
+    g_hash_table_remove (collectors, GUINT_TO_POINTER (collector_id));
+  }
+
+  g_mutex_unlock (&registry_mutex);
+
+  /* A running scrape keeps its own reference */
+  if (entry != NULL) {
+    kms_ref_struct_unref (entry);
+  }
+}
+
+static void
+metric_family_destroy (MetricFamily * family)
+{
+  g_free (family->help);
+  g_string_free (family->samples, TRUE);
+  g_slice_free (MetricFamily, family);
+}
+
+static const gchar *
+metric_type_str (KmsMetricType type)
+{
+  switch (type) {
+    case KMS_METRIC_TYPE_COUNTER:
+      return "counter";
+    case KMS_METRIC_TYPE_GAUGE:
+      return "gauge";
+    case KMS_METRIC_TYPE_SUMMARY:
+      return "summary";
+    default:
+      return "untyped";
+  }
+}
+
+static MetricFamily *
+kms_metrics_collector_get_family (KmsMetricsCollector * self,
+    const gchar * name, KmsMetricType type, const gchar * help)
+{
+  MetricFamily *family;
+
+  family = g_hash_table_lookup (self->families, name);
+
+  if (family == NULL) {
+    family = g_slice_new0 (MetricFamily);
+    family->type = type;
+    family->help = g_strdup (help);
+    family->samples = g_string_new (NULL);
+    g_hash_table_insert (self->families, g_strdup (name), family);
+    g_ptr_array_add (self->names, g_strdup (name));
+  } else if (family->type != type) {
+    GST_WARNING ("Metric %s already collected as a %s", name,
+        metric_type_str (family->type));
+    return NULL;
+  }
+
+  return family;
+}
+
+static void
+append_escaped (GString * str, const gchar * value, gboolean quotes)
+{
+  for (; *value != '\0'; value++) {
+    switch (*value) {
+      case '\\':
+        g_string_append (str, "\\\\");
+        break;
+      case '\n':
+        g_string_append (str, "\\n");
+        break;
+      case '"':
+        g_string_append (str, quotes ? "\\\"" : "\"");
+        break;
+      default:
+        g_string_append_c (str, *value);
+        break;
+    }
+  }
+}
+
+static gchar *
+format_labels (va_list args)
+{
+  GString *labels = g_string_new (NULL);
+  const gchar *name;
+
+  while ((name = va_arg (args, const gchar *)) != NULL) {
+    const gchar *value = va_arg (args, const gchar *);
+
+    if (labels->len > 0) {
+      g_string_append_c (labels, ',');
+    }
+
+    g_string_append_printf (labels, "%s=\"", name);
+    append_escaped (labels, value != NULL ? value : "", TRUE);
+    g_string_append_c (labels, '"');
+  }
+
+  return g_string_free (labels, FALSE);
+}
+
+static void
+append_sample (GString * samples, const gchar * name, const gchar * labels,
+    const gchar * extra_label, gdouble value)
+{
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+  g_string_append (samples, name);
+
+  if (*labels != '\0' || extra_label != NULL) {
+    g_string_append_printf (samples, "{%s%s%s}", labels,
+        *labels != '\0' && extra_label != NULL ? "," : "",
+        extra_label != NULL ? extra_label : "");
+  }
+
+  g_string_append_printf (samples, " %s\n", g_ascii_formatd (buf,
+          sizeof (buf), VALUE_FORMAT, value));
+}
+
+void
+kms_metrics_collector_add (KmsMetricsCollector * collector,
+    const gchar * name, KmsMetricType type, const gchar * help,
+    gdouble value, ...)
+{
+  MetricFamily *family;
+  gchar *labels;
+  va_list args;
+
+  family = kms_metrics_collector_get_family (collector, name, type, help);
+
+  if (family == NULL) {
+    return;
+  }
+
+  va_start (args, value);
+  labels = format_labels (args);
+  va_end (args);
+
+  append_sample (family->samples, name, labels, NULL, value);
+  g_free (labels);
+}
+
+void
+kms_metrics_collector_add_latency (KmsMetricsCollector * collector,
+    const gchar * name, const gchar * help, KmsLatencyHistogram * histogram,
+    ...)
+{
+  static const gdouble quantiles[] = { 0.5, 0.95, 0.99 };
+  MetricFamily *family;
+  gchar *labels, *sum_name, *count_name;
+  GstClockTime total_sum;
+  guint64 total_count;
+  va_list args;
+  guint i;
+
+  family = kms_metrics_collector_get_family (collector, name,
+      KMS_METRIC_TYPE_SUMMARY, help);
+
+  if (family == NULL) {
+    return;
+  }
+
+  va_start (args, histogram);
+  labels = format_labels (args);
+  va_end (args);
+
+  for (i = 0; i < G_N_ELEMENTS (quantiles); i++) {
+    gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+    gchar *quantile;
+    GstClockTime value;
+
+    value = kms_latency_histogram_get_percentile (histogram,
+        quantiles[i] * 100);
+    quantile = g_strdup_printf ("quantile=\"%s\"",
+        g_ascii_formatd (buf, sizeof (buf), VALUE_FORMAT, quantiles[i]));
+    append_sample (family->samples, name, labels, quantile,
+        (gdouble) value / GST_SECOND);
+    g_free (quantile);
+  }
+
+  /* The quantiles follow the recent values, but _sum and _count */
+  /* must be monotonic, so they come from the undecayed totals    */
+  kms_latency_histogram_get_totals (histogram, &total_count, &total_sum);
+
+  sum_name = g_strdup_printf ("%s_sum", name);
+  append_sample (family->samples, sum_name, labels, NULL,
+      (gdouble) total_sum / GST_SECOND);
+  g_free (sum_name);
+
+  count_name = g_strdup_printf ("%s_count", name);
+  append_sample (family->samples, count_name, labels, NULL, total_count);
+  g_free (count_name);
+
+  g_free (labels);
+}
+
+static gint
+compare_collectors (gconstpointer a, gconstpointer b)
+{
+  guint id_a = GPOINTER_TO_UINT (*(gpointer *) a);
+  guint id_b = GPOINTER_TO_UINT (*(gpointer *) b);
+
+  return (id_a > id_b) - (id_a < id_b);
+}
+
+gchar *
+kms_metrics_render (void)
+{
+  KmsMetricsCollector collector;
+  GPtrArray *ids, *entries;
+  GHashTableIter iter;
+  gpointer key, value;
+  GString *output;
+  guint i;
+
+  /* Collectors run unlocked, so they may take any lock of their own */
+  ids = g_ptr_array_new ();
+  entries = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) kms_ref_struct_unref);
+
+  g_mutex_lock (&registry_mutex);
+
+  if (collectors != NULL) {
+    g_hash_table_iter_init (&iter, collectors);
+
+    while (g_hash_table_iter_next (&iter, &key, &value)) {
+      g_ptr_array_add (ids, key);
+    }
+  }
+
+  /* Registration order keeps the output stable between scrapes */
+  g_ptr_array_sort (ids, compare_collectors);
+
+  for (i = 0; i < ids->len; i++) {
+    g_ptr_array_add (entries, kms_ref_struct_ref (g_hash_table_lookup
+            (collectors, g_ptr_array_index (ids, i))));
+  }
+
+  g_mutex_unlock (&registry_mutex);
+
+  collector.families = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) metric_family_destroy);
+  collector.names = g_ptr_array_new_with_free_func (g_free);
+
+  for (i = 0; i < entries->len; i++) {
+    CollectorEntry *entry = g_ptr_array_index (entries, i);
+
+    entry->func (&collector, entry->user_data);
+  }
+
+  output = g_string_new (NULL);
+
+  for (i = 0; i < collector.names->len; i++) {
+    const gchar *name = g_ptr_array_index (collector.names, i);
+    MetricFamily *family = g_hash_table_lookup (collector.families, name);
+
+    if (family->help != NULL) {
+      g_string_append_printf (output, "# HELP %s ", name);
+      append_escaped (output, family->help, FALSE);
+      g_string_append_c (output, '\n');
+    }
+
+    g_string_append_printf (output, "# TYPE %s %s\n", name,
+        metric_type_str (family->type));
+    g_string_append_len (output, family->samples->str, family->samples->len);
+  }
+
+  g_ptr_array_unref (collector.names);
+  g_hash_table_unref (collector.families);
+  g_ptr_array_unref (entries);
+  g_ptr_array_unref (ids);
+
+  return g_string_free (output, FALSE);
+}
+
+gboolean
+kms_metrics_write_file (const gchar * path, GError ** error)
+{
+  gchar *metrics;
+  gboolean ret;
+
+  metrics = kms_metrics_render ();
+  /* Atomic, readers never see a partial file */
+  ret = g_file_set_contents (path, metrics, -1, error);
+  g_free (metrics);
+
+  return ret;
+}
+
+static void
+kms_metrics_exporter_serve (KmsMetricsExporter * self)
+{
+  struct timeval timeout = { SEND_TIMEOUT, 0 };
+  gchar *metrics;
+  gsize len, sent = 0;
+  gint fd;
+
+  fd = accept (self->listen_fd, NULL, NULL);
+
+  if (fd < 0) {
+    GST_WARNING ("Can not accept connection: %s", g_strerror (errno));
+    return;
+  }
+
+  fcntl (fd, F_SETFD, FD_CLOEXEC);
+
+  setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof (timeout));
+
+  metrics = kms_metrics_render ();
+  len = strlen (metrics);
+
+  while (sent < len) {
+    gssize ret = send (fd, metrics + sent, len - sent, MSG_NOSIGNAL);
+
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      GST_DEBUG ("Metrics not fully sent: %s", g_strerror (errno));
+      break;
+    }
+
+    sent += ret;
+  }
+
+  g_free (metrics);
+  close (fd);
+}
+
+static gpointer
+kms_metrics_exporter_thread (gpointer user_data)
+{
+  KmsMetricsExporter *self = user_data;
+  gint64 next_write = g_get_monotonic_time ();
+
+  while (TRUE) {
+    struct pollfd fds[2];
+    gint timeout = -1, nfds = 1;
+
+    if (self->file_path != NULL) {
+      GError *err = NULL;
+      gint64 now = g_get_monotonic_time ();
+
+      if (now >= next_write) {
+        if (!kms_metrics_write_file (self->file_path, &err)) {
+          GST_WARNING ("Can not write metrics: %s", err->message);
+          g_error_free (err);
+        }
+
+        next_write = now + self->interval * G_USEC_PER_SEC;
+      }
+
+      timeout = (next_write - now) / 1000 + 1;
+    }
+
+    fds[0].fd = self->wakeup[0];
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+
+    if (self->listen_fd >= 0) {
+      fds[1].fd = self->listen_fd;
+      fds[1].events = POLLIN;
+      fds[1].revents = 0;
+      nfds = 2;
+    }
+
+    if (poll (fds, nfds, timeout) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      GST_ERROR ("Metrics exporter stopped: %s", g_strerror (errno));
+      break;
+    }
+
+    if (fds[0].revents != 0) {
+      break;
+    }
+
+    if (nfds > 1 && (fds[1].revents & POLLIN)) {
+      kms_metrics_exporter_serve (self);
+    }
+  }
+
+  return NULL;
+}
+
+static gint
+kms_metrics_exporter_listen (const gchar * path, GError ** error)
+{
+  struct sockaddr_un addr;
+  gint fd, saved_errno;
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+
+  if (strlen (path) >= sizeof (addr.sun_path)) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NAMETOOLONG,
+        "Socket path too long: %s", path);
+    return -1;
+  }
+
+  strcpy (addr.sun_path, path);
+
+  fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+  if (fd < 0) {
+    goto error;
+  }
+
+  /* Remove the socket left by a previous run */
+  g_unlink (path);
+
+  if (bind (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0 ||
+      listen (fd, LISTEN_BACKLOG) < 0) {
+    goto error;
+  }
+
+  return fd;
+
+error:
+  saved_errno = errno;
+
+  if (fd >= 0) {
+    close (fd);
+  }
+
+  g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+      "Can not listen on %s: %s", path, g_strerror (saved_errno));
+
+  return -1;
+}
+
+KmsMetricsExporter *
+kms_metrics_exporter_new (const gchar * socket_path, const gchar * file_path,
+    guint interval, GError ** error)
+{
+  KmsMetricsExporter *self;
+  gint listen_fd = -1;
+  gint wakeup[2];
+
+  g_return_val_if_fail (socket_path != NULL || file_path != NULL, NULL);
+
+  if (socket_path != NULL) {
+    listen_fd = kms_metrics_exporter_listen (socket_path, error);
+
+    if (listen_fd < 0) {
+      return NULL;
+    }
+  }
+
+  if (!g_unix_open_pipe (wakeup, FD_CLOEXEC, error)) {
+    if (listen_fd >= 0) {
+      close (listen_fd);
+      g_unlink (socket_path);
+    }
+
+    return NULL;
+  }
+
+  self = g_slice_new0 (KmsMetricsExporter);
+  self->socket_path = g_strdup (socket_path);
+  self->file_path = g_strdup (file_path);
+  self->interval = MAX (interval, 1);
+  self->listen_fd = listen_fd;
+  self->wakeup[0] = wakeup[0];
+  self->wakeup[1] = wakeup[1];
+
+  self->thread = g_thread_new (GST_DEFAULT_NAME, kms_metrics_exporter_thread,
+      self);
+
+  GST_INFO ("Exporting metrics to socket: %s, file: %s", socket_path,
+      file_path);
+
+  return self;
+}
+
+void
+kms_metrics_exporter_free (KmsMetricsExporter * self)
+{
+  gssize ret;
+
+  do {
+    ret = write (self->wakeup[1], "x", 1);
+  } while (ret < 0 && errno == EINTR);
+
+  g_thread_join (self->thread);
+
+  if (self->listen_fd >= 0) {
+    close (self->listen_fd);
+    g_unlink (self->socket_path);
+  }
+
+  close (self->wakeup[0]);
+  close (self->wakeup[1]);
+
+  g_free (self->socket_path);
+  g_free (self->file_path);
+  g_slice_free (KmsMetricsExporter, self);
+}
+
+static void init_debug (void) __attribute__ ((constructor));
+
+static void
+init_debug (void)
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+}
@@ -0,0 +1,74 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_METRICS_H__
+#define __KMS_METRICS_H__
+
+#include <gst/gst.h>
+#include "kmslatencyhistogram.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Process-wide metrics registry. Nothing is stored per update: objects
+ * register a collector that reads their own counters when metrics are
+ * rendered, so the aggregation is done once per scrape. The output uses the
+ * Prometheus text exposition format.
+ */
+typedef enum
+{
+  KMS_METRIC_TYPE_COUNTER,
+  KMS_METRIC_TYPE_GAUGE,
+  KMS_METRIC_TYPE_SUMMARY
+} KmsMetricType;
+
+typedef struct _KmsMetricsCollector KmsMetricsCollector;
+
+/* Called without any registry lock held, from the thread rendering */
+typedef void (*KmsMetricsCollectFunc) (KmsMetricsCollector * collector,
+    gpointer user_data);
+
+guint kms_metrics_add_collector (KmsMetricsCollectFunc func,
+    gpointer user_data, GDestroyNotify notify);
+void kms_metrics_remove_collector (guint collector_id);
+
+/* Labels are name and value pairs, terminated by NULL */
+void kms_metrics_collector_add (KmsMetricsCollector * collector,
+    const gchar * name, KmsMetricType type, const gchar * help,
+    gdouble value, ...) G_GNUC_NULL_TERMINATED;
+
+/* Adds a summary, in seconds, with the 0.5, 0.95 and 0.99 quantiles */
+void kms_metrics_collector_add_latency (KmsMetricsCollector * collector,
+    const gchar * name, const gchar * help, KmsLatencyHistogram * histogram,
+    ...) G_GNUC_NULL_TERMINATED;
+
+gchar *kms_metrics_render (void);
+gboolean kms_metrics_write_file (const gchar * path, GError ** error);
+
+/*
+ * Serves the metrics on the Unix socket @socket_path, rendered once per
+ * connection, and rewrites @file_path every @interval seconds. Any of the
+ * paths can be NULL.
+ */
+typedef struct _KmsMetricsExporter KmsMetricsExporter;
+
+KmsMetricsExporter *kms_metrics_exporter_new (const gchar * socket_path,
+    const gchar * file_path, guint interval, GError ** error);
+void kms_metrics_exporter_free (KmsMetricsExporter * self);
+
+G_END_DECLS
+#endif /* __KMS_METRICS_H__ */
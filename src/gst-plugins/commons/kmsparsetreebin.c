@@ -50,12 +50,11 @@ struct _KmsParseTreeBinPrivate
   guint last_pushed_bitrate;
 };
 
-static GstElement *
-create_parser_for_caps (const GstCaps * caps)
+static GstElementFactory *
+select_parser_factory (const GstCaps * caps, const GstCaps * unused)
 {
   GList *parser_list, *filtered_list, *l;
   GstElementFactory *parser_factory = NULL;
-  GstElement *parser = NULL;
 
   parser_list =
       gst_element_factory_list_get_elements (GST_ELEMENT_FACTORY_TYPE_PARSER,
@@ -70,14 +69,31 @@ create_parser_for_caps (const GstCaps * caps)
   }
 
   if (parser_factory != NULL) {
-    parser = gst_element_factory_create (parser_factory, NULL);
-  } else {
-    parser = kms_utils_element_factory_make ("capsfilter", "parsetreebin");
+    gst_object_ref (parser_factory);
   }
 
   gst_plugin_feature_list_free (filtered_list);
   gst_plugin_feature_list_free (parser_list);
 
+  return parser_factory;
+}
+
+static GstElement *
+create_parser_for_caps (const GstCaps * caps)
+{
+  GstElementFactory *parser_factory;
+  GstElement *parser = NULL;
+
+  parser_factory = kms_utils_factory_cache_get ("parser", caps, NULL,
+      select_parser_factory);
+
+  if (parser_factory != NULL) {
+    parser = gst_element_factory_create (parser_factory, NULL);
+    gst_object_unref (parser_factory);
+  } else {
+    parser = kms_utils_element_factory_make ("capsfilter", "parsetreebin");
+  }
+
   return parser;
 }
 
@@ -87,68 +103,96 @@ difference_over_threshold (guint a, guint b, float th)
   return (a > b ? (a - b) > (a * th) : (b - a) > (b * th));
 }
 
-static GstPadProbeReturn
-bitrate_calculation_probe (GstPad * pad, GstPadProbeInfo * info,
-    KmsParseTreeBin * self)
+static void
+bitrate_calculation_update (KmsParseTreeBin * self, GstPad * pad, gsize size,
+    GstClockTime pts, GstClockTime dts)
 {
-  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
-    GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
-    GstClockTime timediff = GST_CLOCK_TIME_NONE;
-    guint bitrate;
-
-    if (GST_CLOCK_TIME_IS_VALID (buffer->dts)
-        && GST_CLOCK_TIME_IS_VALID (self->priv->last_buffer_dts)) {
-      timediff = buffer->dts - self->priv->last_buffer_dts;
-    } else if (GST_CLOCK_TIME_IS_VALID (buffer->pts)
-        && GST_CLOCK_TIME_IS_VALID (self->priv->last_buffer_pts)) {
-      timediff = buffer->pts - self->priv->last_buffer_pts;
-    }
-
-    if (timediff > 0) {
-      bitrate = (gst_buffer_get_size (buffer) * GST_SECOND * 8) / timediff;
+  GstClockTime timediff = GST_CLOCK_TIME_NONE;
+  guint bitrate;
+
+  if (GST_CLOCK_TIME_IS_VALID (dts)
+      && GST_CLOCK_TIME_IS_VALID (self->priv->last_buffer_dts)) {
+    timediff = dts - self->priv->last_buffer_dts;
+  } else if (GST_CLOCK_TIME_IS_VALID (pts)
+      && GST_CLOCK_TIME_IS_VALID (self->priv->last_buffer_pts)) {
+    timediff = pts - self->priv->last_buffer_pts;
+  }
 
-      self->priv->bitrate_mean = (self->priv->bitrate_mean * 7 + bitrate) / 8;
+  if (timediff > 0) {
+    bitrate = (size * GST_SECOND * 8) / timediff;
 
-      if (self->priv->last_pushed_bitrate == 0
-          || difference_over_threshold (self->priv->bitrate_mean,
-              self->priv->last_pushed_bitrate, BITRATE_THRESHOLD)) {
-        GstTagList *taglist = NULL;
-        GstEvent *previous_tag_event;
+    self->priv->bitrate_mean = (self->priv->bitrate_mean * 7 + bitrate) / 8;
 
-        GST_TRACE_OBJECT (self, "Bitrate: %u", bitrate);
-        GST_TRACE_OBJECT (self, "Bitrate_mean:\t\t%u",
-            self->priv->bitrate_mean);
+    if (self->priv->last_pushed_bitrate == 0
+        || difference_over_threshold (self->priv->bitrate_mean,
+            self->priv->last_pushed_bitrate, BITRATE_THRESHOLD)) {
+      GstTagList *taglist = NULL;
+      GstEvent *previous_tag_event;
 
-        previous_tag_event = gst_pad_get_sticky_event (pad, GST_EVENT_TAG, 0);
+      GST_TRACE_OBJECT (self, "Bitrate: %u", bitrate);
+      GST_TRACE_OBJECT (self, "Bitrate_mean:\t\t%u", self->priv->bitrate_mean);
 
-        if (previous_tag_event) {
-          GST_TRACE_OBJECT (self, "Previous tag event: %" GST_PTR_FORMAT,
-              previous_tag_event);
-          gst_event_parse_tag (previous_tag_event, &taglist);
+      previous_tag_event = gst_pad_get_sticky_event (pad, GST_EVENT_TAG, 0);
 
-          taglist = gst_tag_list_copy (taglist);
-          gst_tag_list_add (taglist, GST_TAG_MERGE_REPLACE, "bitrate",
-              self->priv->bitrate_mean, NULL);
+      if (previous_tag_event) {
+        GST_TRACE_OBJECT (self, "Previous tag event: %" GST_PTR_FORMAT,
+            previous_tag_event);
+        gst_event_parse_tag (previous_tag_event, &taglist);
 
-          gst_event_unref (previous_tag_event);
-        }
+        taglist = gst_tag_list_copy (taglist);
+        gst_tag_list_add (taglist, GST_TAG_MERGE_REPLACE, "bitrate",
+            self->priv->bitrate_mean, NULL);
 
-        if (!taglist) {
-          taglist =
-              gst_tag_list_new ("bitrate", self->priv->bitrate_mean, NULL);
-        }
+        gst_event_unref (previous_tag_event);
+      }
 
-        gst_pad_send_event (pad, gst_event_new_tag (taglist));
-        self->priv->last_pushed_bitrate = self->priv->bitrate_mean;
+      if (!taglist) {
+        taglist = gst_tag_list_new ("bitrate", self->priv->bitrate_mean, NULL);
       }
-    }
 
-    self->priv->last_buffer_pts = buffer->pts;
-    self->priv->last_buffer_dts = buffer->dts;
+      gst_pad_send_event (pad, gst_event_new_tag (taglist));
+      self->priv->last_pushed_bitrate = self->priv->bitrate_mean;
+    }
   }
-  else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
-    GST_WARNING_OBJECT (self,
-        "Bufferlist is not supported yet for bitrate calculation");
+
+  self->priv->last_buffer_pts = pts;
+  self->priv->last_buffer_dts = dts;
+}
+
+static gboolean
+buffer_list_add_size (GstBuffer ** buffer, guint idx, gpointer user_data)
+{
+  gsize *size = user_data;
+
+  *size += gst_buffer_get_size (*buffer);
+
+  return TRUE;
+}
+
+static GstPadProbeReturn
+bitrate_calculation_probe (GstPad * pad, GstPadProbeInfo * info,
+    KmsParseTreeBin * self)
+{
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
+
+    bitrate_calculation_update (self, pad, gst_buffer_get_size (buffer),
+        buffer->pts, buffer->dts);
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = gst_pad_probe_info_get_buffer_list (info);
+    GstBuffer *first;
+    gsize size = 0;
+
+    if (gst_buffer_list_length (list) == 0) {
+      return GST_PAD_PROBE_OK;
+    }
+
+    /* A list carries one frame (or a burst of them) as a whole; account it */
+    /* as a single sample stamped with its first buffer to avoid splitting */
+    first = gst_buffer_list_get (list, 0);
+    gst_buffer_list_foreach (list, buffer_list_add_size, &size);
+
+    bitrate_calculation_update (self, pad, size, first->pts, first->dts);
   }
 
   return GST_PAD_PROBE_OK;
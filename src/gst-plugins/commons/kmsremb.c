@@ -36,6 +36,7 @@ G_DEFINE_QUARK (KMS_REMB_REMOTE, kms_remb_remote);
 #define DEFAULT_REMB_DECREMENT_FACTOR 0.5
 #define DEFAULT_REMB_THRESHOLD_FACTOR 0.8
 #define DEFAULT_REMB_UP_LOSSES 12       /* 4% losses */
+#define DEFAULT_REMB_ESTIMATOR KMS_REMB_ESTIMATOR_LOSS
 
 #define REMB_MAX_FACTOR_INPUT_BR 2
 
@@ -329,17 +330,61 @@ kms_remb_local_get_video_recv_info (KmsRembLocal * self,
   return TRUE;
 }
 
+void
+kms_remb_local_on_rtp_packet (KmsRembLocal * self, guint32 abs_send_time,
+    GstClockTime arrival, guint size)
+{
+  KMS_REMB_BASE_LOCK (self);
+  kms_remb_delay_on_packet (self->delay, abs_send_time, arrival, size);
+  KMS_REMB_BASE_UNLOCK (self);
+}
+
 static gboolean
-kms_remb_local_update (KmsRembLocal * self)
+kms_remb_local_update_delay (KmsRembLocal * self, guint fraction_lost,
+    GstClockTime now)
 {
-  guint64 bitrate, packets_rcv_interval;
-  guint fraction_lost, packets_rcv_interval_top;
+  guint estimate;
 
-  if (!kms_remb_local_get_video_recv_info (self,
-      &bitrate, &fraction_lost, &packets_rcv_interval)) {
+  KMS_REMB_BASE_LOCK (self);
+  estimate = kms_remb_delay_update (self->delay, now);
+  KMS_REMB_BASE_UNLOCK (self);
+
+  if (estimate == 0) {
+    /* No packets with abs-send-time yet */
     return FALSE;
   }
 
+  /* Losses not preceded by queuing delay (e.g. wireless) are not seen by */
+  /* the delay estimator, so heavy losses still reduce the estimation */
+  if ((gint) fraction_lost >= self->up_losses) {
+    estimate = (guint64) estimate * (512 - fraction_lost) / 512;
+  }
+
+  self->remb = estimate;
+  self->probed = TRUE;
+
+  if (self->max_bw > 0) {
+    self->remb = MIN (self->remb, self->max_bw * 1000);
+  }
+
+  GST_TRACE_OBJECT (KMS_REMB_BASE (self)->rtpsess,
+      "REMB (delay): %" G_GUINT32_FORMAT ", usage: %d, fraction_lost: %u",
+      self->remb, kms_remb_delay_get_usage (self->delay), fraction_lost);
+
+  return TRUE;
+}
+
+gboolean
+kms_remb_local_process_stats (KmsRembLocal * self, guint64 bitrate,
+    guint fraction_lost, guint64 packets_rcv_interval, GstClockTime now)
+{
+  guint packets_rcv_interval_top;
+
+  if (g_atomic_int_get (&self->estimator) == KMS_REMB_ESTIMATOR_DELAY
+      && kms_remb_local_update_delay (self, fraction_lost, now)) {
+    return TRUE;
+  }
+
   if (!self->probed) {
     if (bitrate == 0) {
       GST_DEBUG_OBJECT (KMS_REMB_BASE (self)->rtpsess,
@@ -427,6 +472,21 @@ kms_remb_local_update (KmsRembLocal * self)
   return TRUE;
 }
 
+static gboolean
+kms_remb_local_update (KmsRembLocal * self)
+{
+  guint64 bitrate, packets_rcv_interval;
+  guint fraction_lost;
+
+  if (!kms_remb_local_get_video_recv_info (self,
+      &bitrate, &fraction_lost, &packets_rcv_interval)) {
+    return FALSE;
+  }
+
+  return kms_remb_local_process_stats (self, bitrate, fraction_lost,
+      packets_rcv_interval, kms_utils_get_time_nsecs ());
+}
+
 typedef struct _AddSsrcsData
 {
   KmsRembLocal *rl;
@@ -448,6 +508,29 @@ add_ssrcs (KmsRlRemoteSession * rlrs, AddSsrcsData * data)
   kms_remb_base_update_stats (rb, rlrs->ssrc, data->remb_packet->bitrate);
 }
 
+guint32
+kms_remb_local_get_bitrate (KmsRembLocal * self)
+{
+  guint32 new_bitrate = self->remb;
+
+  if (self->event_manager != NULL) {
+    guint remb_local_max;
+
+    remb_local_max = kms_utils_remb_event_manager_get_min (self->event_manager);
+    if (remb_local_max > 0) {
+      GST_TRACE_OBJECT (KMS_REMB_BASE (self)->rtpsess,
+          "Local max: %" G_GUINT32_FORMAT, remb_local_max);
+      new_bitrate = MIN (new_bitrate, remb_local_max);
+    }
+  }
+
+  if (self->min_bw > 0) {
+    new_bitrate = MAX (new_bitrate, self->min_bw * 1000);
+  }
+
+  return MAX (new_bitrate, REMB_MIN);
+}
+
 // Signal "RTPSession::on-sending-rtcp" doc: GStreamer/rtpsession.c
 static gboolean
 kms_remb_local_on_sending_rtcp (GObject *rtpsession,
@@ -488,24 +571,7 @@ kms_remb_local_on_sending_rtcp (GObject *rtpsession,
   }
 
   //const guint32 old_bitrate = self->remb_sent;
-  guint32 new_bitrate = self->remb;
-
-  if (self->event_manager != NULL) {
-    guint remb_local_max;
-
-    remb_local_max = kms_utils_remb_event_manager_get_min (self->event_manager);
-    if (remb_local_max > 0) {
-      GST_TRACE_OBJECT (rtpsession, "Local max: %" G_GUINT32_FORMAT,
-          remb_local_max);
-      new_bitrate = MIN (new_bitrate, remb_local_max);
-    }
-  }
-
-  if (self->min_bw > 0) {
-    new_bitrate = MAX (new_bitrate, self->min_bw * 1000);
-  }
-
-  new_bitrate = MAX (new_bitrate, REMB_MIN);
+  guint32 new_bitrate = kms_remb_local_get_bitrate (self);
 
   self->remb_sent = new_bitrate;
 
@@ -542,6 +608,7 @@ kms_remb_local_destroy (KmsRembLocal * self)
 
   g_slist_free_full (self->remote_sessions,
       (GDestroyNotify) kms_rl_remote_session_destroy);
+  kms_remb_delay_free (self->delay);
   kms_remb_base_destroy (KMS_REMB_BASE (self));
 
   g_slice_free (KmsRembLocal, self);
@@ -574,6 +641,9 @@ kms_remb_local_create (GObject * rtpsession, guint min_bw, guint max_bw)
   self->threshold_factor = DEFAULT_REMB_THRESHOLD_FACTOR;
   self->up_losses = DEFAULT_REMB_UP_LOSSES;
 
+  g_atomic_int_set (&self->estimator, DEFAULT_REMB_ESTIMATOR);
+  self->delay = kms_remb_delay_new ();
+
   return self;
 }
 
@@ -642,6 +712,16 @@ kms_remb_local_set_params (KmsRembLocal * rl, GstStructure * params)
   if (is_set) {
     rl->up_losses = auxi;
   }
+
+  is_set = gst_structure_get (params, "estimator", G_TYPE_INT, &auxi, NULL);
+  if (is_set) {
+    if (auxi != KMS_REMB_ESTIMATOR_LOSS && auxi != KMS_REMB_ESTIMATOR_DELAY) {
+      GST_WARNING ("'estimator' %d not valid. Set to loss-based.", auxi);
+      auxi = KMS_REMB_ESTIMATOR_LOSS;
+    }
+
+    g_atomic_int_set (&rl->estimator, auxi);
+  }
 }
 
 void
@@ -654,7 +734,9 @@ kms_remb_local_get_params (KmsRembLocal * rl, GstStructure ** params)
       "lineal-factor-grade", G_TYPE_FLOAT, rl->lineal_factor_grade,
       "decrement-factor", G_TYPE_FLOAT, rl->decrement_factor,
       "threshold-factor", G_TYPE_FLOAT, rl->threshold_factor,
-      "up-losses", G_TYPE_INT, rl->up_losses, NULL);
+      "up-losses", G_TYPE_INT, rl->up_losses,
+      "estimator", G_TYPE_INT, g_atomic_int_get (&rl->estimator),
+      NULL);
 }
 
 /* KmsRembLocal end */
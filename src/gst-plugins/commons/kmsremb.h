@@ -19,6 +19,7 @@
 #define __KMS_REMB_H__
 
 #include "kmsutils.h" /* TODO: must be not needed */
+#include "kmsrembdelay.h"
 
 G_BEGIN_DECLS
 
@@ -42,6 +43,12 @@ struct _KmsRembBase
 /* KmsRembLocal begin */
 typedef struct _KmsRembLocal KmsRembLocal;
 
+typedef enum
+{
+  KMS_REMB_ESTIMATOR_LOSS,      /* AIMD driven by RTCP fraction lost */
+  KMS_REMB_ESTIMATOR_DELAY      /* Trendline over abs-send-time delays */
+} KmsRembEstimator;
+
 struct _KmsRembLocal
 {
   KmsRembBase base;
@@ -69,6 +76,9 @@ struct _KmsRembLocal
   GstClockTime last_time;
   guint64 fraction_lost_record;
   RembEventManager *event_manager;
+
+  gint estimator; // KmsRembEstimator, read from streaming threads (atomic)
+  KmsRembDelay *delay; // Protected by KMS_REMB_BASE_LOCK
 };
 
 KmsRembLocal * kms_remb_local_create (GObject *rtpsess,
@@ -77,6 +87,23 @@ void kms_remb_local_destroy (KmsRembLocal *rl);
 void kms_remb_local_add_remote_session (KmsRembLocal *rl, GObject *rtpsess, guint ssrc);
 void kms_remb_local_set_params (KmsRembLocal *rl, GstStructure *params);
 void kms_remb_local_get_params (KmsRembLocal *rl, GstStructure **params);
+
+/* Feed a received RTP packet carrying abs-send-time to the delay estimator */
+void kms_remb_local_on_rtp_packet (KmsRembLocal *rl, guint32 abs_send_time,
+  GstClockTime arrival, guint size);
+
+/*
+ * Update the estimation with the receive stats of one RTCP interval, as taken
+ * from the RTP session. Exposed to replay recorded traces offline.
+ */
+gboolean kms_remb_local_process_stats (KmsRembLocal *rl, guint64 bitrate,
+  guint fraction_lost, guint64 packets_rcv_interval, GstClockTime now);
+
+/*
+ * Bitrate to send in the next REMB: the estimation limited by the REMBs of
+ * the local consumers and by min-bw.
+ */
+guint32 kms_remb_local_get_bitrate (KmsRembLocal *rl);
 /* KmsRembLocal end */
 
 /* KmsRembRemote begin */
@@ -0,0 +1,369 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsrembdelay.h"
+
+#define GST_CAT_DEFAULT kms_remb_delay_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "kmsrembdelay"
+
+#define ABS_SEND_TIME_WRAP (1 << 24)
+#define ABS_SEND_TIME_TO_MS(t) (((gdouble) (t)) * 1000.0 / (1 << 18))
+
+#define BURST_INTERVAL_MS 5.0
+
+#define TRENDLINE_WINDOW 20
+#define TRENDLINE_SMOOTHING 0.9
+#define TRENDLINE_GAIN 4.0
+#define TRENDLINE_MAX_DELTAS 60
+
+#define OVERUSE_TIME_TH_MS 10.0
+#define THRESHOLD_INIT 12.5
+#define THRESHOLD_MIN 6.0
+#define THRESHOLD_MAX 600.0
+#define THRESHOLD_K_UP 0.0087
+#define THRESHOLD_K_DOWN 0.039
+#define THRESHOLD_MAX_STEP_MS 100.0
+#define THRESHOLD_OUTLIER 15.0
+
+#define RATE_DECREASE_FACTOR 0.85
+#define RATE_INCREASE_FACTOR 0.08       /* per second */
+#define RATE_MAX_INCOMING_FACTOR 1.5
+#define RATE_MAX_INCOMING_MARGIN 10000  /* bps */
+
+typedef enum
+{
+  RATE_STATE_HOLD,
+  RATE_STATE_INCREASE,
+  RATE_STATE_DECREASE
+} RateState;
+
+typedef struct _PacketGroup
+{
+  gdouble first_send_ms;
+  gdouble last_send_ms;
+  gdouble last_arrival_ms;
+} PacketGroup;
+
+struct _KmsRembDelay
+{
+  /* abs-send-time unwrapping */
+  gboolean has_send_time;
+  guint32 last_abs_send_time;
+  guint64 send_time;
+
+  gboolean has_group;
+  gboolean has_prev_group;
+  PacketGroup group;
+  PacketGroup prev_group;
+
+  /* Trendline */
+  gdouble first_arrival_ms;
+  gdouble acc_delay;
+  gdouble smoothed_delay;
+  guint num_deltas;
+  gdouble window_x[TRENDLINE_WINDOW];
+  gdouble window_y[TRENDLINE_WINDOW];
+  guint window_len;
+  guint window_pos;
+  gdouble prev_trend;
+
+  /* Over-use detector */
+  gdouble threshold;
+  gdouble last_threshold_update_ms;
+  gdouble time_over_using;
+  guint overuse_counter;
+  KmsRembDelayUsage usage;
+
+  /* Rate control */
+  RateState state;
+  guint64 bytes;
+  GstClockTime last_update;
+  gdouble estimate;
+};
+
+KmsRembDelay *
+kms_remb_delay_new (void)
+{
+  KmsRembDelay *self = g_slice_new0 (KmsRembDelay);
+
+  self->threshold = THRESHOLD_INIT;
+  self->last_threshold_update_ms = -1;
+  self->time_over_using = -1;
+  self->usage = KMS_REMB_DELAY_USAGE_NORMAL;
+  self->state = RATE_STATE_INCREASE;
+  self->last_update = GST_CLOCK_TIME_NONE;
+
+  return self;
+}
+
+void
+kms_remb_delay_free (KmsRembDelay * self)
+{
+  if (self == NULL) {
+    return;
+  }
+
+  g_slice_free (KmsRembDelay, self);
+}
+
+KmsRembDelayUsage
+kms_remb_delay_get_usage (KmsRembDelay * self)
+{
+  return self->usage;
+}
+
+static gdouble
+kms_remb_delay_trendline_slope (KmsRembDelay * self)
+{
+  gdouble sum_x = 0, sum_y = 0, avg_x, avg_y, num = 0, den = 0;
+  guint i;
+
+  for (i = 0; i < self->window_len; i++) {
+    sum_x += self->window_x[i];
+    sum_y += self->window_y[i];
+  }
+
+  avg_x = sum_x / self->window_len;
+  avg_y = sum_y / self->window_len;
+
+  for (i = 0; i < self->window_len; i++) {
+    num += (self->window_x[i] - avg_x) * (self->window_y[i] - avg_y);
+    den += (self->window_x[i] - avg_x) * (self->window_x[i] - avg_x);
+  }
+
+  if (den == 0) {
+    return self->prev_trend;
+  }
+
+  return num / den;
+}
+
+static void
+kms_remb_delay_update_threshold (KmsRembDelay * self, gdouble modified_trend,
+    gdouble now_ms)
+{
+  gdouble abs_trend = ABS (modified_trend);
+  gdouble k, dt;
+
+  if (self->last_threshold_update_ms < 0) {
+    self->last_threshold_update_ms = now_ms;
+  }
+
+  /* Do not let big spikes (e.g. a route change) move the threshold */
+  if (abs_trend > self->threshold + THRESHOLD_OUTLIER) {
+    self->last_threshold_update_ms = now_ms;
+    return;
+  }
+
+  k = abs_trend < self->threshold ? THRESHOLD_K_DOWN : THRESHOLD_K_UP;
+  dt = MIN (now_ms - self->last_threshold_update_ms, THRESHOLD_MAX_STEP_MS);
+
+  self->threshold += k * (abs_trend - self->threshold) * dt;
+  self->threshold = CLAMP (self->threshold, THRESHOLD_MIN, THRESHOLD_MAX);
+  self->last_threshold_update_ms = now_ms;
+}
+
+static void
+kms_remb_delay_detect (KmsRembDelay * self, gdouble trend, gdouble ts_delta,
+    gdouble now_ms)
+{
+  gdouble modified_trend;
+
+  modified_trend =
+      MIN (self->num_deltas, TRENDLINE_MAX_DELTAS) * trend * TRENDLINE_GAIN;
+
+  if (modified_trend > self->threshold) {
+    if (self->time_over_using < 0) {
+      /* Assume over-use started half way since the previous sample */
+      self->time_over_using = ts_delta / 2;
+    } else {
+      self->time_over_using += ts_delta;
+    }
+    self->overuse_counter++;
+
+    if (self->time_over_using > OVERUSE_TIME_TH_MS
+        && self->overuse_counter > 1 && trend >= self->prev_trend) {
+      self->time_over_using = 0;
+      self->overuse_counter = 0;
+      self->usage = KMS_REMB_DELAY_USAGE_OVERUSE;
+    }
+  } else if (modified_trend < -self->threshold) {
+    self->time_over_using = -1;
+    self->overuse_counter = 0;
+    self->usage = KMS_REMB_DELAY_USAGE_UNDERUSE;
+  } else {
+    self->time_over_using = -1;
+    self->overuse_counter = 0;
+    self->usage = KMS_REMB_DELAY_USAGE_NORMAL;
+  }
+
+  self->prev_trend = trend;
+  kms_remb_delay_update_threshold (self, modified_trend, now_ms);
+}
+
+static void
+kms_remb_delay_on_group (KmsRembDelay * self, PacketGroup * prev,
+    PacketGroup * cur)
+{
+  gdouble send_delta, arrival_delta;
+
+  send_delta = cur->last_send_ms - prev->last_send_ms;
+  arrival_delta = cur->last_arrival_ms - prev->last_arrival_ms;
+
+  if (self->num_deltas == 0) {
+    self->first_arrival_ms = cur->last_arrival_ms;
+  }
+
+  self->num_deltas = MIN (self->num_deltas + 1, 1000);
+  self->acc_delay += arrival_delta - send_delta;
+  self->smoothed_delay = TRENDLINE_SMOOTHING * self->smoothed_delay +
+      (1 - TRENDLINE_SMOOTHING) * self->acc_delay;
+
+  self->window_x[self->window_pos] =
+      cur->last_arrival_ms - self->first_arrival_ms;
+  self->window_y[self->window_pos] = self->smoothed_delay;
+  self->window_pos = (self->window_pos + 1) % TRENDLINE_WINDOW;
+  self->window_len = MIN (self->window_len + 1, TRENDLINE_WINDOW);
+
+  if (self->window_len < TRENDLINE_WINDOW) {
+    return;
+  }
+
+  kms_remb_delay_detect (self, kms_remb_delay_trendline_slope (self),
+      send_delta, cur->last_arrival_ms);
+}
+
+void
+kms_remb_delay_on_packet (KmsRembDelay * self, guint32 abs_send_time,
+    GstClockTime arrival, guint size)
+{
+  gdouble send_ms, arrival_ms;
+
+  self->bytes += size;
+
+  abs_send_time &= ABS_SEND_TIME_WRAP - 1;
+  if (!self->has_send_time) {
+    self->has_send_time = TRUE;
+    self->send_time = abs_send_time;
+  } else {
+    guint32 diff = (abs_send_time - self->last_abs_send_time) &
+        (ABS_SEND_TIME_WRAP - 1);
+
+    if (diff >= ABS_SEND_TIME_WRAP / 2) {
+      /* Reordered packet, it does not start a new group */
+      return;
+    }
+
+    self->send_time += diff;
+  }
+  self->last_abs_send_time = abs_send_time;
+
+  send_ms = ABS_SEND_TIME_TO_MS (self->send_time);
+  arrival_ms = (gdouble) arrival / GST_MSECOND;
+
+  if (self->has_group
+      && send_ms - self->group.first_send_ms <= BURST_INTERVAL_MS) {
+    /* Same burst */
+    self->group.last_send_ms = send_ms;
+    self->group.last_arrival_ms = MAX (self->group.last_arrival_ms,
+        arrival_ms);
+    return;
+  }
+
+  if (self->has_group) {
+    if (self->has_prev_group) {
+      kms_remb_delay_on_group (self, &self->prev_group, &self->group);
+    }
+
+    self->prev_group = self->group;
+    self->has_prev_group = TRUE;
+  }
+
+  self->group.first_send_ms = send_ms;
+  self->group.last_send_ms = send_ms;
+  self->group.last_arrival_ms = arrival_ms;
+  self->has_group = TRUE;
+}
+
+guint
+kms_remb_delay_update (KmsRembDelay * self, GstClockTime now)
+{
+  gdouble incoming, elapsed;
+
+  if (!GST_CLOCK_TIME_IS_VALID (self->last_update)) {
+    self->last_update = now;
+    self->bytes = 0;
+    return 0;
+  }
+
+  if (now <= self->last_update) {
+    return (guint) self->estimate;
+  }
+
+  elapsed = (gdouble) (now - self->last_update) / GST_SECOND;
+  incoming = self->bytes * 8 / elapsed;
+  self->bytes = 0;
+  self->last_update = now;
+
+  if (self->estimate == 0) {
+    if (incoming == 0) {
+      return 0;
+    }
+
+    self->estimate = incoming;
+  }
+
+  switch (self->usage) {
+    case KMS_REMB_DELAY_USAGE_OVERUSE:
+      self->estimate = MIN (self->estimate, RATE_DECREASE_FACTOR * incoming);
+      self->state = RATE_STATE_DECREASE;
+      break;
+    case KMS_REMB_DELAY_USAGE_UNDERUSE:
+      /* Queues are draining, keep the rate until they are empty */
+      self->state = RATE_STATE_HOLD;
+      break;
+    case KMS_REMB_DELAY_USAGE_NORMAL:
+      if (self->state == RATE_STATE_INCREASE) {
+        self->estimate *= 1 + RATE_INCREASE_FACTOR * MIN (elapsed, 1.0);
+      }
+      self->state = RATE_STATE_INCREASE;
+      break;
+  }
+
+  /* Never go too far above what is actually being received */
+  self->estimate = MIN (self->estimate,
+      RATE_MAX_INCOMING_FACTOR * incoming + RATE_MAX_INCOMING_MARGIN);
+
+  GST_TRACE ("Usage: %d, threshold: %f, incoming: %f, estimate: %f",
+      self->usage, self->threshold, incoming, self->estimate);
+
+  return (guint) self->estimate;
+}
+
+static void init_debug (void) __attribute__ ((constructor));
+
+static void
+init_debug (void)
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+}
@@ -0,0 +1,60 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_REMB_DELAY_H__
+#define __KMS_REMB_DELAY_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Receive-side delay-based bandwidth estimator. Packets are grouped in
+ * bursts by their abs-send-time; a trendline over the inter-group delay
+ * variation is compared with an adaptive threshold to detect over-use, and
+ * an AIMD controller turns that signal into a bitrate.
+ */
+typedef struct _KmsRembDelay KmsRembDelay;
+
+typedef enum
+{
+  KMS_REMB_DELAY_USAGE_NORMAL,
+  KMS_REMB_DELAY_USAGE_UNDERUSE,
+  KMS_REMB_DELAY_USAGE_OVERUSE
+} KmsRembDelayUsage;
+
+KmsRembDelay *kms_remb_delay_new (void);
+void kms_remb_delay_free (KmsRembDelay * self);
+
+/*
+ * @abs_send_time: 24 bits abs-send-time (6.18 fixed point seconds)
+ * @arrival: local reception time
+ * @size: packet size in bytes
+ */
+void kms_remb_delay_on_packet (KmsRembDelay * self, guint32 abs_send_time,
+    GstClockTime arrival, guint size);
+
+/*
+ * Run the rate controller. Returns the estimated bitrate in bps, or 0 if no
+ * packet has been received yet.
+ */
+guint kms_remb_delay_update (KmsRembDelay * self, GstClockTime now);
+
+KmsRembDelayUsage kms_remb_delay_get_usage (KmsRembDelay * self);
+
+G_END_DECLS
+#endif /* __KMS_REMB_DELAY_H__ */
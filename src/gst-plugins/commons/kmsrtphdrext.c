@@ -0,0 +1,449 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsrtphdrext.h"
+#include "constants.h"
+#include "sdp_utils.h"
+#include "kmsutils.h"
+
+#define GST_CAT_DEFAULT kms_rtp_hdr_ext_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "kmsrtphdrext"
+
+guint32
+kms_rtp_hdr_ext_abs_send_time_from_time (GstClockTime time)
+{
+  guint64 ms = GST_TIME_AS_MSECONDS (time);
+
+  return (guint32) (((ms << 18) / 1000) & 0x00ffffff);
+}
+
+#define ONE_BYTE_HDR_EXT_BITS 0xBEDE
+#define ONE_BYTE_HDR_EXT_MAX_ID 14
+#define ONE_BYTE_HDR_EXT_MAX_SIZE 16
+
+typedef struct _KmsRtpHdrExtProcessor
+{
+  const gchar *uri;
+  guint size;
+
+  gboolean (*enabled) (const KmsRtpHdrExtConfig * config);
+  /* Initial value, written when the extension is reserved. May be NULL. */
+  void (*reserve) (guint8 * data, const KmsRtpHdrExtConfig * config);
+  /* Value written right before sending. May be NULL. */
+  void (*update) (guint8 * data, const KmsRtpHdrExtConfig * config,
+      GstClockTime now);
+} KmsRtpHdrExtProcessor;
+
+typedef struct _KmsRtpHdrExtEntry
+{
+  guint8 id;
+  const KmsRtpHdrExtProcessor *processor;
+} KmsRtpHdrExtEntry;
+
+struct _KmsRtpHdrExtList
+{
+  KmsRtpHdrExtConfig config;
+
+  KmsRtpHdrExtEntry entries[ONE_BYTE_HDR_EXT_MAX_ID];
+  guint n_entries;
+  guint32 used_ids;
+
+  /* Processor with send time work for each id, NULL otherwise */
+  const KmsRtpHdrExtProcessor *updaters[ONE_BYTE_HDR_EXT_MAX_ID + 1];
+  gboolean has_updaters;
+};
+
+static void
+abs_send_time_update (guint8 * data, const KmsRtpHdrExtConfig * config,
+    GstClockTime now)
+{
+  guint32 value = kms_rtp_hdr_ext_abs_send_time_from_time (now);
+
+  data[0] = (guint8) (value >> 16);
+  data[1] = (guint8) (value >> 8);
+  data[2] = (guint8) (value);
+}
+
+static gboolean
+transport_cc_enabled (const KmsRtpHdrExtConfig * config)
+{
+  return config->transport_seqnum != NULL;
+}
+
+static void
+transport_cc_update (guint8 * data, const KmsRtpHdrExtConfig * config,
+    GstClockTime now)
+{
+  guint16 seqnum = (guint16) g_atomic_int_add (config->transport_seqnum, 1);
+
+  data[0] = (guint8) (seqnum >> 8);
+  data[1] = (guint8) (seqnum);
+}
+
+static gboolean
+playout_delay_enabled (const KmsRtpHdrExtConfig * config)
+{
+  return config->max_playout_delay >= 0;
+}
+
+static void
+playout_delay_reserve (guint8 * data, const KmsRtpHdrExtConfig * config)
+{
+  /* 12 bits each, in 10 ms units */
+  guint min = CLAMP (config->min_playout_delay / 10, 0, 0xfff);
+  guint max = CLAMP (config->max_playout_delay / 10, min, 0xfff);
+
+  data[0] = (guint8) (min >> 4);
+  data[1] = (guint8) (((min & 0xf) << 4) | (max >> 8));
+  data[2] = (guint8) (max);
+}
+
+static const KmsRtpHdrExtProcessor processors[] = {
+  {RTP_HDR_EXT_ABS_SEND_TIME_URI, RTP_HDR_EXT_ABS_SEND_TIME_SIZE, NULL, NULL,
+      abs_send_time_update},
+  {RTP_HDR_EXT_TRANSPORT_CC_URI, RTP_HDR_EXT_TRANSPORT_CC_SIZE,
+      transport_cc_enabled, NULL, transport_cc_update},
+  {RTP_HDR_EXT_PLAYOUT_DELAY_URI, RTP_HDR_EXT_PLAYOUT_DELAY_SIZE,
+      playout_delay_enabled, playout_delay_reserve, NULL},
+};
+
+KmsRtpHdrExtList *
+kms_rtp_hdr_ext_list_new (const GstSDPMedia * media,
+    const KmsRtpHdrExtConfig * config)
+{
+  KmsRtpHdrExtList *list = NULL;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (processors); i++) {
+    const KmsRtpHdrExtProcessor *processor = &processors[i];
+    gint id;
+
+    if (processor->enabled != NULL && !processor->enabled (config)) {
+      continue;
+    }
+
+    id = sdp_utils_get_extmap_id (media, processor->uri);
+    if (id < 1 || id > ONE_BYTE_HDR_EXT_MAX_ID) {
+      continue;
+    }
+
+    if (list == NULL) {
+      list = g_slice_new0 (KmsRtpHdrExtList);
+      list->config = *config;
+    }
+
+    if (list->used_ids & (1 << id)) {
+      /* Id already in use by another extension */
+      continue;
+    }
+
+    list->used_ids |= 1 << id;
+
+    list->entries[list->n_entries].id = id;
+    list->entries[list->n_entries].processor = processor;
+    list->n_entries++;
+
+    if (processor->update != NULL) {
+      list->updaters[id] = processor;
+      list->has_updaters = TRUE;
+    }
+  }
+
+  return list;
+}
+
+void
+kms_rtp_hdr_ext_list_free (KmsRtpHdrExtList * list)
+{
+  g_slice_free (KmsRtpHdrExtList, list);
+}
+
+guint
+kms_rtp_hdr_ext_list_get_length (KmsRtpHdrExtList * list)
+{
+  return list->n_entries;
+}
+
+gboolean
+kms_rtp_hdr_ext_list_has_updaters (KmsRtpHdrExtList * list)
+{
+  return list->has_updaters;
+}
+
+gboolean
+kms_rtp_hdr_ext_list_is_reserved (KmsRtpHdrExtList * list, GstRTPBuffer * rtp)
+{
+  guint i;
+
+  for (i = 0; i < list->n_entries; i++) {
+    gpointer data;
+    guint size;
+
+    if (!gst_rtp_buffer_get_extension_onebyte_header (rtp,
+            list->entries[i].id, 0, &data, &size)) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+gboolean
+kms_rtp_hdr_ext_list_reserve (KmsRtpHdrExtList * list, GstRTPBuffer * rtp)
+{
+  gboolean ret = TRUE;
+  guint i;
+
+  for (i = 0; i < list->n_entries; i++) {
+    const KmsRtpHdrExtProcessor *processor = list->entries[i].processor;
+    guint8 data[ONE_BYTE_HDR_EXT_MAX_SIZE] = { 0, };
+    gpointer current;
+    guint size;
+
+    if (gst_rtp_buffer_get_extension_onebyte_header (rtp,
+            list->entries[i].id, 0, &current, &size)) {
+      ret &= size == processor->size;
+      continue;
+    }
+
+    if (processor->reserve != NULL) {
+      processor->reserve (data, &list->config);
+    }
+
+    ret &= gst_rtp_buffer_add_extension_onebyte_header (rtp,
+        list->entries[i].id, data, processor->size);
+  }
+
+  return ret;
+}
+
+void
+kms_rtp_hdr_ext_list_update (KmsRtpHdrExtList * list, GstRTPBuffer * rtp,
+    GstClockTime now)
+{
+  guint8 *data, *end;
+  gpointer ext;
+  guint16 bits;
+  guint wordlen;
+
+  if (!list->has_updaters
+      || !gst_rtp_buffer_get_extension_data (rtp, &bits, &ext, &wordlen)
+      || bits != ONE_BYTE_HDR_EXT_BITS) {
+    return;
+  }
+
+  data = ext;
+  end = data + wordlen * 4;
+
+  while (data < end) {
+    guint8 id = data[0] >> 4;
+    guint8 len = (data[0] & 0x0f) + 1;
+
+    if (id == 0) {
+      /* Padding */
+      data++;
+      continue;
+    }
+
+    if (id == 15 || data + 1 + len > end) {
+      break;
+    }
+
+    if (list->updaters[id] != NULL && list->updaters[id]->size == len) {
+      list->updaters[id]->update (data + 1, &list->config, now);
+    }
+
+    data += 1 + len;
+  }
+}
+
+typedef struct _KmsRtpHdrExtProbeData
+{
+  KmsRtpHdrExtList *list;
+  /* Useful to make buffers writable when needed. */
+  gboolean add_hdr;
+} KmsRtpHdrExtProbeData;
+
+static KmsRtpHdrExtProbeData *
+kms_rtp_hdr_ext_probe_data_new (KmsRtpHdrExtList * list, gboolean add_hdr)
+{
+  KmsRtpHdrExtProbeData *data;
+
+  data = g_slice_new0 (KmsRtpHdrExtProbeData);
+  data->list = list;
+  data->add_hdr = add_hdr;
+
+  return data;
+}
+
+static void
+kms_rtp_hdr_ext_probe_data_destroy (gpointer user_data)
+{
+  KmsRtpHdrExtProbeData *data = user_data;
+
+  kms_rtp_hdr_ext_list_free (data->list);
+  g_slice_free (KmsRtpHdrExtProbeData, data);
+}
+
+/*
+ * Reserve the extensions in buffers coming from the payloader. They are
+ * normally writable, so no copy is needed to add them.
+ */
+static GstBuffer *
+kms_rtp_hdr_ext_reserve_buffer (KmsRtpHdrExtList * list, GstPad * pad,
+    GstBuffer * buffer)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+
+  if (!gst_buffer_is_writable (buffer)) {
+    gboolean reserved;
+
+    if (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp)) {
+      GST_WARNING_OBJECT (pad, "Can not map RTP buffer");
+      return buffer;
+    }
+
+    reserved = kms_rtp_hdr_ext_list_is_reserved (list, &rtp);
+    gst_rtp_buffer_unmap (&rtp);
+
+    if (reserved) {
+      return buffer;
+    }
+
+    buffer = gst_buffer_make_writable (buffer);
+  }
+
+  if (!gst_rtp_buffer_map (buffer, GST_MAP_WRITE, &rtp)) {
+    GST_WARNING_OBJECT (pad, "Can not map RTP buffer");
+    return buffer;
+  }
+
+  if (!kms_rtp_hdr_ext_list_reserve (list, &rtp)) {
+    GST_WARNING_OBJECT (pad, "Not all RTP hdrexts could be added");
+  }
+
+  gst_rtp_buffer_unmap (&rtp);
+
+  return buffer;
+}
+
+/*
+ * Run every send time processor with a single map of the packet. The values
+ * are written in place, even if the packet is also kept elsewhere: only the
+ * reserved bytes change, and the retransmission cache sends copies anyway.
+ * Making it writable would copy every packet the cache holds.
+ */
+static void
+kms_rtp_hdr_ext_update_buffer (KmsRtpHdrExtList * list, GstPad * pad,
+    GstBuffer * buffer, GstClockTime now)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+
+  if (!list->has_updaters) {
+    return;
+  }
+
+  if (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp)) {
+    GST_WARNING_OBJECT (pad, "Can not map RTP buffer");
+    return;
+  }
+
+  kms_rtp_hdr_ext_list_update (list, &rtp, now);
+
+  gst_rtp_buffer_unmap (&rtp);
+}
+
+typedef struct _KmsRtpHdrExtListData
+{
+  KmsRtpHdrExtProbeData *data;
+  GstPad *pad;
+  GstClockTime now;
+} KmsRtpHdrExtListData;
+
+static gboolean
+kms_rtp_hdr_ext_process_list_item (GstBuffer ** buf, guint idx,
+    KmsRtpHdrExtListData * list_data)
+{
+  if (list_data->data->add_hdr) {
+    *buf = kms_rtp_hdr_ext_reserve_buffer (list_data->data->list,
+        list_data->pad, *buf);
+  } else {
+    kms_rtp_hdr_ext_update_buffer (list_data->data->list, list_data->pad,
+        *buf, list_data->now);
+  }
+
+  return TRUE;
+}
+
+static GstPadProbeReturn
+kms_rtp_hdr_ext_probe (GstPad * pad, GstPadProbeInfo * info, gpointer gp)
+{
+  KmsRtpHdrExtListData list_data;
+
+  list_data.data = (KmsRtpHdrExtProbeData *) gp;
+  list_data.pad = pad;
+  list_data.now = GST_CLOCK_TIME_NONE;
+
+  /* All the packets of a list are sent at once */
+  if (!list_data.data->add_hdr) {
+    list_data.now = kms_utils_get_time_nsecs ();
+  }
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
+
+    kms_rtp_hdr_ext_process_list_item (&buffer, 0, &list_data);
+    GST_PAD_PROBE_INFO_DATA (info) = buffer;
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *bufflist = gst_pad_probe_info_get_buffer_list (info);
+
+    /* The list is modified in place, it is never split */
+    if (list_data.data->add_hdr) {
+      bufflist = gst_buffer_list_make_writable (bufflist);
+    }
+    gst_buffer_list_foreach (bufflist,
+        (GstBufferListFunc) kms_rtp_hdr_ext_process_list_item, &list_data);
+
+    GST_PAD_PROBE_INFO_DATA (info) = bufflist;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+gulong
+kms_rtp_hdr_ext_list_add_probe (KmsRtpHdrExtList * list, GstPad * pad,
+    gboolean add_hdr)
+{
+  return gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      kms_rtp_hdr_ext_probe, kms_rtp_hdr_ext_probe_data_new (list, add_hdr),
+      kms_rtp_hdr_ext_probe_data_destroy);
+}
+
+static void init_debug (void) __attribute__ ((constructor));
+
+static void
+init_debug (void)
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+}
@@ -0,0 +1,87 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_RTP_HDR_EXT_H__
+#define __KMS_RTP_HDR_EXT_H__
+
+#include <gst/gst.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <gst/sdp/gstsdpmessage.h>
+
+G_BEGIN_DECLS
+
+/* abs-send-time value (6.18 fixed point seconds, 24 bits) for @time */
+guint32 kms_rtp_hdr_ext_abs_send_time_from_time (GstClockTime time);
+
+/* Header extensions negotiated for one media, indexed by their ids */
+typedef struct _KmsRtpHdrExtList KmsRtpHdrExtList;
+
+typedef struct _KmsRtpHdrExtConfig
+{
+  /* Transport-wide sequence number, shared by every stream of a transport */
+  /* (NULL disables transport-cc) */
+  gint *transport_seqnum;
+  /* Playout delay limits in ms, a negative max disables playout-delay */
+  gint min_playout_delay;
+  gint max_playout_delay;
+} KmsRtpHdrExtConfig;
+
+/*
+ * Create the list of extensions negotiated in the extmap lines of @media that
+ * have a processor. Returns NULL if there are none.
+ */
+KmsRtpHdrExtList *kms_rtp_hdr_ext_list_new (const GstSDPMedia * media,
+    const KmsRtpHdrExtConfig * config);
+void kms_rtp_hdr_ext_list_free (KmsRtpHdrExtList * list);
+
+guint kms_rtp_hdr_ext_list_get_length (KmsRtpHdrExtList * list);
+
+/* TRUE if any extension of @list is written right before sending */
+gboolean kms_rtp_hdr_ext_list_has_updaters (KmsRtpHdrExtList * list);
+
+/* TRUE if @rtp already carries every extension of @list */
+gboolean kms_rtp_hdr_ext_list_is_reserved (KmsRtpHdrExtList * list,
+    GstRTPBuffer * rtp);
+
+/*
+ * Add the missing extensions of @list to @rtp with their initial values.
+ * @rtp must be mapped for writing. Returns FALSE if any could not be added.
+ */
+gboolean kms_rtp_hdr_ext_list_reserve (KmsRtpHdrExtList * list,
+    GstRTPBuffer * rtp);
+
+/*
+ * Run the send time processors of @list on @rtp in a single pass over its
+ * one-byte header, overwriting the values in place. The packet size never
+ * changes, so @rtp can be mapped for reading only.
+ */
+void kms_rtp_hdr_ext_list_update (KmsRtpHdrExtList * list, GstRTPBuffer * rtp,
+    GstClockTime now);
+
+/*
+ * Add a probe on @pad that reserves the extensions of @list (@add_hdr) or
+ * fills them right before sending. Buffer lists go through as a whole, with
+ * a single clock read for all their packets. Reserving copies packets that
+ * are not writable; filling writes in place, so packets must be reserved
+ * before anything else keeps them. Takes ownership of @list.
+ */
+gulong kms_rtp_hdr_ext_list_add_probe (KmsRtpHdrExtList * list, GstPad * pad,
+    gboolean add_hdr);
+
+G_END_DECLS
+
+#endif /* __KMS_RTP_HDR_EXT_H__ */
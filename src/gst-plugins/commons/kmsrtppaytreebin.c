@@ -31,12 +31,11 @@ G_DEFINE_TYPE (KmsRtpPayTreeBin, kms_rtp_pay_tree_bin, KMS_TYPE_TREE_BIN);
 
 #define PICTURE_ID_15_BIT 2
 
-static GstElement *
-create_payloader_for_caps (const GstCaps * caps)
+static GstElementFactory *
+select_payloader_factory (const GstCaps * caps, const GstCaps * unused)
 {
   GList *payloader_list, *filtered_list, *l;
   GstElementFactory *payloader_factory = NULL;
-  GstElement *payloader = NULL;
 
   payloader_list =
       gst_element_factory_list_get_elements (GST_ELEMENT_FACTORY_TYPE_PAYLOADER,
@@ -51,8 +50,28 @@ create_payloader_for_caps (const GstCaps * caps)
       payloader_factory = NULL;
   }
 
+  if (payloader_factory != NULL) {
+    gst_object_ref (payloader_factory);
+  }
+
+  gst_plugin_feature_list_free (filtered_list);
+  gst_plugin_feature_list_free (payloader_list);
+
+  return payloader_factory;
+}
+
+static GstElement *
+create_payloader_for_caps (const GstCaps * caps)
+{
+  GstElementFactory *payloader_factory;
+  GstElement *payloader = NULL;
+
+  payloader_factory = kms_utils_factory_cache_get ("payloader", caps, NULL,
+      select_payloader_factory);
+
   if (payloader_factory != NULL) {
     payloader = gst_element_factory_create (payloader_factory, NULL);
+    gst_object_unref (payloader_factory);
   }
 
   if (payloader) {
@@ -75,9 +94,6 @@ create_payloader_for_caps (const GstCaps * caps)
     }
   }
 
-  gst_plugin_feature_list_free (filtered_list);
-  gst_plugin_feature_list_free (payloader_list);
-
   return payloader;
 }
 
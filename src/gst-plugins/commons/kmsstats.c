@@ -19,6 +19,10 @@
 #include "kmsutils.h"
 #include "kmsbufferlacentymeta.h"
 
+/* Process-wide latency sampling. By default every buffer is sampled */
+static volatile gint latency_sampling_buffers = 1;
+static volatile gint latency_sampling_interval = 0;     /* ms */
+
 struct _KmsStatsProbe
 {
   GstPad *pad;
@@ -30,6 +34,10 @@ typedef struct _BufferLatencyValues
 {
   gboolean valid;
   KmsMediaType type;
+
+  /* Sampling state, only used from the streaming thread */
+  guint count;
+  GstClockTime last_sample;
 } BufferLatencyValues;
 
 typedef struct _ProbeData ProbeData;
@@ -46,6 +54,11 @@ typedef struct _ProbeData
   GDestroyNotify destroy_data;
 
   gboolean locked;
+
+  /* Wall-clock time of the buffer or list being probed. Sampled lazily */
+  /* once per probe call so every buffer in a list shares one clock read. */
+  /* Data flow through a pad is serialized, so no locking is required. */
+  GstClockTime now;
 } ProbeData;
 
 static BufferLatencyValues *
@@ -57,6 +70,8 @@ buffer_latency_values_new (gboolean is_valid, KmsMediaType type)
 
   blv->valid = is_valid;
   blv->type = type;
+  blv->count = 0;
+  blv->last_sample = GST_CLOCK_TIME_NONE;
 
   return blv;
 }
@@ -85,6 +100,7 @@ probe_data_new (BufferCb invoke_cb, gpointer invoke_data,
   pdata->destroy_data = destroy_data;
 
   pdata->locked = locked;
+  pdata->now = GST_CLOCK_TIME_NONE;
 
   return pdata;
 }
@@ -103,6 +119,16 @@ probe_data_destroy (ProbeData * pdata)
   g_slice_free (ProbeData, pdata);
 }
 
+static GstClockTime
+probe_data_get_now (ProbeData * pdata)
+{
+  if (!GST_CLOCK_TIME_IS_VALID (pdata->now)) {
+    pdata->now = kms_utils_get_time_nsecs ();
+  }
+
+  return pdata->now;
+}
+
 static void
 process_buffer (GstBuffer * buffer, gpointer user_data)
 {
@@ -125,6 +151,10 @@ static GstPadProbeReturn
 process_buffer_probe_cb (GstPad * pad, GstPadProbeInfo * info,
     gpointer user_data)
 {
+  ProbeData *pdata = user_data;
+
+  pdata->now = GST_CLOCK_TIME_NONE;
+
   if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
     GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
 
@@ -164,15 +194,49 @@ kms_stats_get_element_stats (GstStructure * stats)
   return element_stats;
 }
 
+void
+kms_stats_set_latency_sampling (guint every_n_buffers, guint interval_ms)
+{
+  g_atomic_int_set (&latency_sampling_buffers, MAX (every_n_buffers, 1));
+  g_atomic_int_set (&latency_sampling_interval, interval_ms);
+}
+
+static gboolean
+buffer_latency_values_sample (BufferLatencyValues * blv, ProbeData * pdata)
+{
+  guint interval = g_atomic_int_get (&latency_sampling_interval);
+  GstClockTime now;
+
+  if (interval == 0) {
+    guint every = g_atomic_int_get (&latency_sampling_buffers);
+
+    return every <= 1 || blv->count++ % every == 0;
+  }
+
+  now = probe_data_get_now (pdata);
+
+  if (GST_CLOCK_TIME_IS_VALID (blv->last_sample) &&
+      now < blv->last_sample + interval * GST_MSECOND) {
+    return FALSE;
+  }
+
+  blv->last_sample = now;
+
+  return TRUE;
+}
+
 static void
 buffer_latency_probe_cb (GstBuffer * buffer, ProbeData * pdata)
 {
   BufferLatencyValues *blv = (BufferLatencyValues *) pdata->invoke_data;
-  GstClockTime time;
 
-  time = kms_utils_get_time_nsecs ();
+  /* Buffers without meta are skipped by every latency probe downstream */
+  if (!buffer_latency_values_sample (blv, pdata)) {
+    return;
+  }
 
-  kms_buffer_add_buffer_latency_meta (buffer, time, blv->valid, blv->type);
+  kms_buffer_add_buffer_latency_meta (buffer, probe_data_get_now (pdata),
+      blv->valid, blv->type);
 }
 
 gulong
@@ -245,7 +309,6 @@ buffer_for_each_meta_cb (GstBuffer * buffer, GstMeta ** meta, ProbeData * pdata)
   GstPad *pad = GST_PAD (pdata->invoke_data);
   KmsBufferLatencyMeta *blmeta;
   GstClockTimeDiff diff;
-  GstClockTime now;
 
   if ((*meta)->info->api != KMS_BUFFER_LATENCY_META_API_TYPE) {
     /* continue iterating */
@@ -263,8 +326,7 @@ buffer_for_each_meta_cb (GstBuffer * buffer, GstMeta ** meta, ProbeData * pdata)
     return TRUE;
   }
 
-  now = kms_utils_get_time_nsecs ();
-  diff = GST_CLOCK_DIFF (blmeta->ts, now);
+  diff = GST_CLOCK_DIFF (blmeta->ts, probe_data_get_now (pdata));
 
   if (pdata->locked) {
     KMS_BUFFER_LATENCY_DATA_LOCK (blmeta);
@@ -378,6 +440,7 @@ kms_stats_create_id_for_pad (GstElement * obj, GstPad * pad)
 static void
 kms_stats_stream_e2e_avg_stat_destroy (StreamE2EAvgStat * stat)
 {
+  kms_latency_histogram_free (stat->histogram);
   g_slice_free (StreamE2EAvgStat, stat);
 }
 
@@ -390,6 +453,86 @@ kms_stats_stream_e2e_avg_stat_new (KmsMediaType type)
   kms_ref_struct_init (KMS_REF_STRUCT_CAST (stat),
       (GDestroyNotify) kms_stats_stream_e2e_avg_stat_destroy);
   stat->type = type;
+  stat->histogram = kms_latency_histogram_new ();
 
   return stat;
 }
+
+struct _KmsStatsSnapshots
+{
+  GMutex mutex;
+  GHashTable *snapshots;        /* <selector, KmsStatsSnapshot> */
+};
+
+typedef struct _KmsStatsSnapshot
+{
+  GstStructure *stats;
+  GstClockTime time;
+} KmsStatsSnapshot;
+
+static void
+kms_stats_snapshot_destroy (KmsStatsSnapshot * snapshot)
+{
+  gst_structure_free (snapshot->stats);
+  g_slice_free (KmsStatsSnapshot, snapshot);
+}
+
+KmsStatsSnapshots *
+kms_stats_snapshots_new (void)
+{
+  KmsStatsSnapshots *snapshots;
+
+  snapshots = g_slice_new0 (KmsStatsSnapshots);
+  g_mutex_init (&snapshots->mutex);
+  snapshots->snapshots = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) kms_stats_snapshot_destroy);
+
+  return snapshots;
+}
+
+void
+kms_stats_snapshots_free (KmsStatsSnapshots * snapshots)
+{
+  g_hash_table_destroy (snapshots->snapshots);
+  g_mutex_clear (&snapshots->mutex);
+  g_slice_free (KmsStatsSnapshots, snapshots);
+}
+
+GstStructure *
+kms_stats_snapshots_get (KmsStatsSnapshots * snapshots,
+    const gchar * selector, GstClockTime now, GstClockTime max_age,
+    KmsStatsCollectFunc func, gpointer user_data)
+{
+  const gchar *key = selector != NULL ? selector : "";
+  KmsStatsSnapshot *snapshot;
+  GstStructure *stats;
+
+  g_mutex_lock (&snapshots->mutex);
+
+  snapshot = g_hash_table_lookup (snapshots->snapshots, key);
+
+  if (max_age > 0 && snapshot != NULL && now - snapshot->time <= max_age) {
+    stats = gst_structure_copy (snapshot->stats);
+    g_mutex_unlock (&snapshots->mutex);
+
+    return stats;
+  }
+
+  g_mutex_unlock (&snapshots->mutex);
+
+  stats = func (selector, user_data);
+
+  if (max_age == 0) {
+    return stats;
+  }
+
+  snapshot = g_slice_new0 (KmsStatsSnapshot);
+  snapshot->stats = gst_structure_copy (stats);
+  snapshot->time = now;
+
+  g_mutex_lock (&snapshots->mutex);
+  g_hash_table_replace (snapshots->snapshots, g_strdup (key), snapshot);
+  g_mutex_unlock (&snapshots->mutex);
+
+  return stats;
+}
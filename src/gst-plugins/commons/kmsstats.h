@@ -21,6 +21,7 @@
 #include "kmsmediatype.h"
 #include "kmslist.h"
 #include "kmsrefstruct.h"
+#include "kmslatencyhistogram.h"
 
 G_BEGIN_DECLS
 
@@ -31,6 +32,9 @@ G_BEGIN_DECLS
 #define KMS_RTP_STRUCT_NAME "rtp-stats"
 #define KMS_SESSIONS_STRUCT_NAME "session-stats"
 #define KMS_DATA_SESSION_STRUCT_NAME "data-session-stats"
+#define KMS_PAD_COUNTERS_STRUCT_NAME "pad-stats"
+#define KMS_PAD_COUNTERS_FIELD "pad-counters"
+#define KMS_PAD_COUNTERS_SELECTOR "pad-counters"
 
 /* Macros used to calculate latency stats */
 #define KMS_STATS_ALPHA 0.25
@@ -46,6 +50,10 @@ gulong kms_stats_add_buffer_latency_meta_probe (GstPad * pad, gboolean is_valid,
 gulong kms_stats_add_buffer_update_latency_meta_probe (GstPad * pad, gboolean is_valid, KmsMediaType type);
 gulong kms_stats_add_buffer_latency_notification_probe (GstPad * pad, BufferLatencyCallback cb, gboolean locked, gpointer user_data, GDestroyNotify destroy_data);
 
+/* Only every Nth buffer, or one buffer each @interval_ms if it is not 0, */
+/* gets latency meta on each stream. Applies to the whole process.        */
+void kms_stats_set_latency_sampling (guint every_n_buffers, guint interval_ms);
+
 typedef struct _KmsStatsProbe KmsStatsProbe;
 
 KmsStatsProbe * kms_stats_probe_new (GstPad *pad, KmsMediaType type);
@@ -61,6 +69,7 @@ typedef struct _StreamE2EAvgStat
   KmsRefStruct ref;
   KmsMediaType type;
   gdouble avg;
+  KmsLatencyHistogram *histogram;
 } StreamE2EAvgStat;
 
 gchar * kms_stats_create_id_for_pad (GstElement * obj, GstPad * pad);
@@ -71,6 +80,20 @@ StreamE2EAvgStat * kms_stats_stream_e2e_avg_stat_new (KmsMediaType type);
 #define kms_stats_stream_e2e_avg_stat_unref(obj) \
   kms_ref_struct_unref (KMS_REF_STRUCT_CAST (obj))
 
+/* Last stats collected for each selector, reused while they are fresh */
+typedef struct _KmsStatsSnapshots KmsStatsSnapshots;
+typedef GstStructure * (*KmsStatsCollectFunc) (const gchar *selector, gpointer user_data);
+
+KmsStatsSnapshots * kms_stats_snapshots_new (void);
+void kms_stats_snapshots_free (KmsStatsSnapshots *snapshots);
+
+/* Returns a copy of the snapshot for @selector if it was taken at most   */
+/* @max_age before @now. Otherwise @func collects new stats, which become */
+/* the snapshot unless @max_age is 0. @func is called without any lock.   */
+GstStructure * kms_stats_snapshots_get (KmsStatsSnapshots *snapshots,
+  const gchar *selector, GstClockTime now, GstClockTime max_age,
+  KmsStatsCollectFunc func, gpointer user_data);
+
 G_END_DECLS
 
 #endif /* __KMS_STATS_H__ */
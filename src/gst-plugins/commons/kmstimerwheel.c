@@ -0,0 +1,240 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmstimerwheel.h"
+#include "kmsrefstruct.h"
+
+#define GST_CAT_DEFAULT kms_timer_wheel_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "kmstimerwheel"
+
+typedef struct _KmsTimerWheelEntry
+{
+  KmsRefStruct ref;
+
+  guint id;
+  guint slot;
+  GList *link;                  /* in the slot queue */
+  gint removed;
+
+  KmsTimerWheelFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+} KmsTimerWheelEntry;
+
+struct _KmsTimerWheel
+{
+  GMutex mutex;
+
+  KmsLoop *loop;
+  guint source_id;
+
+  GQueue *slots;
+  guint n_slots;
+  guint current;
+
+  GHashTable *entries;          /* <id, KmsTimerWheelEntry> */
+  guint next_id;
+};
+
+static void
+kms_timer_wheel_entry_destroy (KmsTimerWheelEntry * entry)
+{
+  if (entry->notify != NULL) {
+    entry->notify (entry->user_data);
+  }
+
+  g_slice_free (KmsTimerWheelEntry, entry);
+}
+
+static void
+kms_timer_wheel_destroy (KmsTimerWheel * self)
+{
+  guint i;
+
+  for (i = 0; i < self->n_slots; i++) {
+    g_queue_clear (&self->slots[i]);
+  }
+  g_free (self->slots);
+
+  g_hash_table_unref (self->entries);
+  g_mutex_clear (&self->mutex);
+
+  g_slice_free (KmsTimerWheel, self);
+}
+
+static gboolean
+kms_timer_wheel_tick (gpointer user_data)
+{
+  KmsTimerWheel *self = user_data;
+  GPtrArray *due;
+  GList *l;
+  guint i;
+
+  /* Callbacks run unlocked, so they can add or remove timers */
+  g_mutex_lock (&self->mutex);
+
+  due = g_ptr_array_new_full (self->slots[self->current].length,
+      (GDestroyNotify) kms_ref_struct_unref);
+
+  for (l = self->slots[self->current].head; l != NULL; l = l->next) {
+    g_ptr_array_add (due, kms_ref_struct_ref (l->data));
+  }
+
+  self->current = (self->current + 1) % self->n_slots;
+
+  g_mutex_unlock (&self->mutex);
+
+  for (i = 0; i < due->len; i++) {
+    KmsTimerWheelEntry *entry = g_ptr_array_index (due, i);
+
+    if (g_atomic_int_get (&entry->removed)) {
+      continue;
+    }
+
+    if (!entry->func (entry->user_data)) {
+      kms_timer_wheel_remove (self, entry->id);
+    }
+  }
+
+  g_ptr_array_unref (due);
+
+  return G_SOURCE_CONTINUE;
+}
+
+KmsTimerWheel *
+kms_timer_wheel_new (KmsLoop * loop, guint period, guint slots)
+{
+  KmsTimerWheel *self = g_slice_new0 (KmsTimerWheel);
+  guint i;
+
+  g_mutex_init (&self->mutex);
+
+  self->n_slots = MAX (slots, 1);
+  self->slots = g_new (GQueue, self->n_slots);
+  for (i = 0; i < self->n_slots; i++) {
+    g_queue_init (&self->slots[i]);
+  }
+
+  self->entries = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+      (GDestroyNotify) kms_ref_struct_unref);
+  self->next_id = 1;
+
+  self->loop = g_object_ref (loop);
+  self->source_id = kms_loop_timeout_add_full (loop, G_PRIORITY_DEFAULT,
+      MAX (period / self->n_slots, 1), kms_timer_wheel_tick, self,
+      (GDestroyNotify) kms_timer_wheel_destroy);
+
+  return self;
+}
+
+void
+kms_timer_wheel_free (KmsTimerWheel * self)
+{
+  KmsLoop *loop = self->loop;
+
+  /* Resources are released once a running tick, if any, is over */
+  kms_loop_remove (loop, self->source_id);
+  g_object_unref (loop);
+}
+
+guint
+kms_timer_wheel_add (KmsTimerWheel * self, KmsTimerWheelFunc func,
+    gpointer user_data, GDestroyNotify notify)
+{
+  KmsTimerWheelEntry *entry;
+
+  g_return_val_if_fail (func != NULL, 0);
+
+  entry = g_slice_new0 (KmsTimerWheelEntry);
+  kms_ref_struct_init (KMS_REF_STRUCT_CAST (entry),
+      (GDestroyNotify) kms_timer_wheel_entry_destroy);
+  entry->func = func;
+  entry->user_data = user_data;
+  entry->notify = notify;
+
+  g_mutex_lock (&self->mutex);
+
+  entry->id = self->next_id++;
+  if (self->next_id == 0) {
+    self->next_id = 1;
+  }
+
+  /* Ids are consecutive, so timers are evenly spread */
+  entry->slot = entry->id % self->n_slots;
+  g_queue_push_tail (&self->slots[entry->slot], entry);
+  entry->link = self->slots[entry->slot].tail;
+
+  g_hash_table_insert (self->entries, GUINT_TO_POINTER (entry->id), entry);
+
+  g_mutex_unlock (&self->mutex);
+
+  return entry->id;
+}
+
+gboolean
+kms_timer_wheel_remove (KmsTimerWheel * self, guint timer_id)
+{
+  KmsTimerWheelEntry *entry;
+
+  g_mutex_lock (&self->mutex);
+
+  entry = g_hash_table_lookup (self->entries, GUINT_TO_POINTER (timer_id));
+
+  if (entry == NULL) {
+    g_mutex_unlock (&self->mutex);
+    return FALSE;
+  }
+
+  g_atomic_int_set (&entry->removed, TRUE);
+  g_queue_delete_link (&self->slots[entry->slot], entry->link);
+  entry->link = NULL;
+
+  g_hash_table_steal (self->entries, GUINT_TO_POINTER (timer_id));
+
+  g_mutex_unlock (&self->mutex);
+
+  /* A running tick may still keep a reference */
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (entry));
+
+  return TRUE;
+}
+
+guint
+kms_timer_wheel_size (KmsTimerWheel * self)
+{
+  guint size;
+
+  g_mutex_lock (&self->mutex);
+  size = g_hash_table_size (self->entries);
+  g_mutex_unlock (&self->mutex);
+
+  return size;
+}
+
+static void init_debug (void) __attribute__ ((constructor));
+
+static void
+init_debug (void)
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+}
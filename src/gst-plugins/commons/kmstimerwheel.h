@@ -0,0 +1,50 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_TIMER_WHEEL_H__
+#define __KMS_TIMER_WHEEL_H__
+
+#include <gst/gst.h>
+#include "kmsloop.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Periodic timers sharing a single source of a KmsLoop. Timers are spread
+ * over @slots buckets and one bucket is scanned every @period / @slots ms,
+ * so each timer fires once per @period.
+ */
+typedef struct _KmsTimerWheel KmsTimerWheel;
+
+/* Returns FALSE to remove the timer */
+typedef gboolean (*KmsTimerWheelFunc) (gpointer user_data);
+
+KmsTimerWheel *kms_timer_wheel_new (KmsLoop * loop, guint period,
+    guint slots);
+
+/* Pending timers are destroyed, without firing */
+void kms_timer_wheel_free (KmsTimerWheel * self);
+
+guint kms_timer_wheel_add (KmsTimerWheel * self, KmsTimerWheelFunc func,
+    gpointer user_data, GDestroyNotify notify);
+
+gboolean kms_timer_wheel_remove (KmsTimerWheel * self, guint timer_id);
+
+guint kms_timer_wheel_size (KmsTimerWheel * self);
+
+G_END_DECLS
+#endif /* __KMS_TIMER_WHEEL_H__ */
@@ -37,11 +37,32 @@ G_DEFINE_TYPE (KmsTreeBin, kms_tree_bin, GST_TYPE_BIN);
   )                                     \
 )
 
+#define KMS_TREE_BIN_REGISTRY "kms-tree-bin-registry"
+G_DEFINE_QUARK (KMS_TREE_BIN_REGISTRY, kms_tree_bin_registry);
+
+G_LOCK_DEFINE_STATIC (registry_creation);
+
+typedef struct _KmsTreeBinRegistry
+{
+  GMutex mutex;
+  /* key -> KmsTreeBin (not owned) */
+  GHashTable *bins;
+} KmsTreeBinRegistry;
+
 struct _KmsTreeBinPrivate
 {
   GstElement *input_element, *output_tee;
   GstCaps *input_caps;
+  guint input_caps_generation;
   GMutex input_caps_mutex;
+
+  KmsTreeBinRegistry *registry;
+  gchar *shared_key;
+
+  /* Parking, protected by the object lock */
+  gulong park_probe_id;
+  guint park_id;
+  guint park_count;
 };
 
 GstElement *
@@ -109,10 +130,31 @@ kms_tree_bin_get_input_caps (KmsTreeBin * self)
   return ret;
 }
 
+/*
+ * Incremented every time the input caps really change, so users caching
+ * decisions taken from the input caps can detect stale entries cheaply.
+ */
+guint
+kms_tree_bin_get_input_caps_generation (KmsTreeBin * self)
+{
+  guint ret;
+
+  g_mutex_lock (&self->priv->input_caps_mutex);
+  ret = self->priv->input_caps_generation;
+  g_mutex_unlock (&self->priv->input_caps_mutex);
+
+  return ret;
+}
+
 static void
 kms_tree_bin_set_input_caps (KmsTreeBin * self, GstCaps * caps)
 {
   g_mutex_lock (&self->priv->input_caps_mutex);
+  if (self->priv->input_caps == NULL
+      || !gst_caps_is_equal (self->priv->input_caps, caps)) {
+    self->priv->input_caps_generation++;
+  }
+
   if (self->priv->input_caps) {
     gst_caps_unref (self->priv->input_caps);
   }
@@ -121,6 +163,288 @@ kms_tree_bin_set_input_caps (KmsTreeBin * self, GstCaps * caps)
   g_mutex_unlock (&self->priv->input_caps_mutex);
 }
 
+static void
+kms_tree_bin_registry_destroy (KmsTreeBinRegistry * registry)
+{
+  g_hash_table_unref (registry->bins);
+  g_mutex_clear (&registry->mutex);
+  g_slice_free (KmsTreeBinRegistry, registry);
+}
+
+/*
+ * The registry lives in the top-level bin (usually the pipeline), so only
+ * elements of the same pipeline can share TreeBins.
+ */
+static KmsTreeBinRegistry *
+kms_tree_bin_registry_get (GstElement * element, gboolean create)
+{
+  GstObject *top = gst_object_ref (element), *parent;
+  KmsTreeBinRegistry *registry;
+
+  while ((parent = gst_object_get_parent (top)) != NULL) {
+    gst_object_unref (top);
+    top = parent;
+  }
+
+  if ((void *) top == (void *) element) {
+    /* Not in a pipeline yet */
+    gst_object_unref (top);
+    return NULL;
+  }
+
+  G_LOCK (registry_creation);
+  registry = g_object_get_qdata (G_OBJECT (top),
+      kms_tree_bin_registry_quark ());
+  if (registry == NULL && create) {
+    registry = g_slice_new0 (KmsTreeBinRegistry);
+    g_mutex_init (&registry->mutex);
+    registry->bins = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        NULL);
+    g_object_set_qdata_full (G_OBJECT (top), kms_tree_bin_registry_quark (),
+        registry, (GDestroyNotify) kms_tree_bin_registry_destroy);
+  }
+  G_UNLOCK (registry_creation);
+
+  gst_object_unref (top);
+
+  return registry;
+}
+
+/**
+ * kms_tree_bin_get_shared:
+ * @element: Element asking for the TreeBin, used to find its pipeline
+ * @key: Key describing the media produced by the TreeBin
+ *
+ * Returns: (transfer full) (nullable): A TreeBin published with @key by
+ * another element of the same pipeline, or %NULL if there is none.
+ */
+KmsTreeBin *
+kms_tree_bin_get_shared (GstElement * element, const gchar * key)
+{
+  KmsTreeBinRegistry *registry;
+  KmsTreeBin *bin;
+
+  registry = kms_tree_bin_registry_get (element, FALSE);
+  if (registry == NULL) {
+    return NULL;
+  }
+
+  g_mutex_lock (&registry->mutex);
+  bin = g_hash_table_lookup (registry->bins, key);
+  if (bin != NULL) {
+    g_object_ref (bin);
+  }
+  g_mutex_unlock (&registry->mutex);
+
+  GST_DEBUG_OBJECT (element, "Shared TreeBin for %s: %" GST_PTR_FORMAT, key,
+      bin);
+
+  return bin;
+}
+
+/**
+ * kms_tree_bin_set_shared:
+ *
+ * Publish @self so that other elements of the same pipeline needing the same
+ * media can link to its output tee instead of creating a new TreeBin.
+ * The element owning @self must call kms_tree_bin_unset_shared() before
+ * removing it.
+ */
+void
+kms_tree_bin_set_shared (KmsTreeBin * self, GstElement * element,
+    const gchar * key)
+{
+  KmsTreeBinRegistry *registry;
+
+  if (self->priv->registry != NULL) {
+    return;
+  }
+
+  registry = kms_tree_bin_registry_get (element, TRUE);
+  if (registry == NULL) {
+    return;
+  }
+
+  g_mutex_lock (&registry->mutex);
+  if (!g_hash_table_contains (registry->bins, key)) {
+    g_hash_table_insert (registry->bins, g_strdup (key), self);
+    self->priv->registry = registry;
+    self->priv->shared_key = g_strdup (key);
+  }
+  g_mutex_unlock (&registry->mutex);
+}
+
+static void
+unlink_foreign_peer (const GValue * item, gpointer owner)
+{
+  GstPad *pad = g_value_get_object (item);
+  GstPad *peer = kms_utils_get_ghosted_peer (pad);
+
+  if (peer == NULL) {
+    return;
+  }
+
+  if (!gst_object_has_as_ancestor (GST_OBJECT (peer), GST_OBJECT (owner))) {
+    GST_DEBUG_OBJECT (pad, "Unlinking shared consumer %" GST_PTR_FORMAT, peer);
+    kms_utils_unlink_ghosted_pads (pad);
+  }
+
+  g_object_unref (peer);
+}
+
+/**
+ * kms_tree_bin_unset_shared:
+ *
+ * Remove @self from the registry and unlink the consumers that other
+ * elements attached to its output tee, so they can rebuild their branches
+ * before @self is removed from its owner.
+ */
+void
+kms_tree_bin_unset_shared (KmsTreeBin * self)
+{
+  KmsTreeBinRegistry *registry = self->priv->registry;
+  GstObject *owner;
+  GstIterator *it;
+
+  if (registry == NULL) {
+    return;
+  }
+
+  g_mutex_lock (&registry->mutex);
+  if (g_hash_table_lookup (registry->bins, self->priv->shared_key) == self) {
+    g_hash_table_remove (registry->bins, self->priv->shared_key);
+  }
+  g_mutex_unlock (&registry->mutex);
+
+  g_clear_pointer (&self->priv->shared_key, g_free);
+  self->priv->registry = NULL;
+
+  owner = gst_object_get_parent (GST_OBJECT (self));
+  it = gst_element_iterate_src_pads (self->priv->output_tee);
+  while (gst_iterator_foreach (it, unlink_foreign_peer,
+          owner != NULL ? owner : GST_OBJECT (self)) == GST_ITERATOR_RESYNC) {
+    gst_iterator_resync (it);
+  }
+  gst_iterator_free (it);
+
+  if (owner != NULL) {
+    gst_object_unref (owner);
+  }
+}
+
+gboolean
+kms_tree_bin_is_shared (KmsTreeBin * self)
+{
+  return self->priv->registry != NULL;
+}
+
+guint
+kms_tree_bin_get_consumer_count (KmsTreeBin * self)
+{
+  GstElement *tee = self->priv->output_tee;
+  guint count;
+
+  GST_OBJECT_LOCK (tee);
+  /* Do not count the internal fakesink */
+  count = tee->numsrcpads > 0 ? tee->numsrcpads - 1 : 0;
+  GST_OBJECT_UNLOCK (tee);
+
+  return count;
+}
+
+static GstPadProbeReturn
+parked_drop_probe (GstPad * pad, GstPadProbeInfo * info, gpointer data)
+{
+  return GST_PAD_PROBE_DROP;
+}
+
+/*
+ * Stop processing media while nobody consumes the output of this TreeBin,
+ * keeping its elements configured so it can be resumed quickly. Returns an
+ * identifier of this parking, never 0.
+ */
+guint
+kms_tree_bin_park (KmsTreeBin * self)
+{
+  GstPad *sink;
+  guint park_id;
+
+  GST_OBJECT_LOCK (self);
+
+  if (self->priv->park_id != 0) {
+    park_id = self->priv->park_id;
+    GST_OBJECT_UNLOCK (self);
+    return park_id;
+  }
+
+  sink = gst_element_get_static_pad (self->priv->input_element, "sink");
+  self->priv->park_probe_id = gst_pad_add_probe (sink,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      parked_drop_probe, NULL, NULL);
+  g_object_unref (sink);
+
+  if (++self->priv->park_count == 0) {
+    self->priv->park_count = 1;
+  }
+  park_id = self->priv->park_id = self->priv->park_count;
+
+  GST_OBJECT_UNLOCK (self);
+
+  GST_DEBUG_OBJECT (self, "Parked");
+
+  return park_id;
+}
+
+/*
+ * Resume a parked TreeBin. Encoded input is dropped until the next keyframe,
+ * which is requested upstream. Returns FALSE if the TreeBin was not parked.
+ */
+gboolean
+kms_tree_bin_unpark (KmsTreeBin * self)
+{
+  GstCaps *caps;
+  GstPad *sink;
+
+  GST_OBJECT_LOCK (self);
+
+  if (self->priv->park_id == 0) {
+    GST_OBJECT_UNLOCK (self);
+    return FALSE;
+  }
+
+  sink = gst_element_get_static_pad (self->priv->input_element, "sink");
+  gst_pad_remove_probe (sink, self->priv->park_probe_id);
+  self->priv->park_probe_id = 0;
+  self->priv->park_id = 0;
+
+  GST_OBJECT_UNLOCK (self);
+
+  caps = gst_pad_get_current_caps (sink);
+  if (caps != NULL) {
+    if (!kms_utils_caps_is_raw (caps)) {
+      kms_utils_drop_until_keyframe (sink, TRUE);
+    }
+    gst_caps_unref (caps);
+  }
+  g_object_unref (sink);
+
+  GST_DEBUG_OBJECT (self, "Unparked");
+
+  return TRUE;
+}
+
+guint
+kms_tree_bin_get_park_id (KmsTreeBin * self)
+{
+  guint park_id;
+
+  GST_OBJECT_LOCK (self);
+  park_id = self->priv->park_id;
+  GST_OBJECT_UNLOCK (self);
+
+  return park_id;
+}
+
 static gboolean
 tee_query_function (GstPad * pad, GstObject * parent, GstQuery * query)
 {
@@ -165,6 +489,7 @@ kms_tree_bin_finalize (GObject * object)
   }
 
   g_mutex_clear (&self->priv->input_caps_mutex);
+  g_free (self->priv->shared_key);
 
   /* chain up */
   G_OBJECT_CLASS (kms_tree_bin_parent_class)->finalize (object);
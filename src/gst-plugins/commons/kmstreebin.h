@@ -60,6 +60,19 @@ GstElement * kms_tree_bin_get_output_tee (KmsTreeBin * self);
 void kms_tree_bin_unlink_input_element_from_tee (KmsTreeBin * self);
 
 GstCaps * kms_tree_bin_get_input_caps (KmsTreeBin *self);
+guint kms_tree_bin_get_input_caps_generation (KmsTreeBin *self);
+
+/* Pipeline-wide registry of TreeBins, to share them between agnosticbins */
+KmsTreeBin * kms_tree_bin_get_shared (GstElement * element, const gchar * key);
+void kms_tree_bin_set_shared (KmsTreeBin * self, GstElement * element, const gchar * key);
+void kms_tree_bin_unset_shared (KmsTreeBin * self);
+gboolean kms_tree_bin_is_shared (KmsTreeBin * self);
+
+/* Idle TreeBins can be parked until a consumer links again */
+guint kms_tree_bin_get_consumer_count (KmsTreeBin * self);
+guint kms_tree_bin_park (KmsTreeBin * self);
+gboolean kms_tree_bin_unpark (KmsTreeBin * self);
+guint kms_tree_bin_get_park_id (KmsTreeBin * self);
 
 G_END_DECLS
 #endif /* __KMS_TREE_BIN_H__ */
@@ -32,6 +32,9 @@ G_DEFINE_QUARK (LAST_KEY_FRAME_REQUEST_TIME, last_key_frame_request_time);
 #define KMS_KEY_ID "kms-key-id"
 G_DEFINE_QUARK (KMS_KEY_ID, kms_key_id);
 
+#define KMS_LINK_GHOST "kms-link-ghost"
+G_DEFINE_QUARK (KMS_LINK_GHOST, kms_link_ghost);
+
 #define DEFAULT_KEYFRAME_DISPERSION GST_SECOND  /* 1s */
 
 #define UUID_STR_SIZE 37        /* 36-byte string (plus tailing '\0') */
@@ -124,6 +127,199 @@ kms_utils_bin_remove (GstBin * bin, GstElement * element)
   gst_bin_remove (bin, element);
 }
 
+/* ---- GstPad ---- */
+
+gboolean
+kms_utils_pad_is_link_ghost (GstPad * pad)
+{
+  return GST_IS_GHOST_PAD (pad)
+      && g_object_get_qdata (G_OBJECT (pad), kms_link_ghost_quark ()) != NULL;
+}
+
+static GstObject *
+get_common_ancestor (GstObject * a, GstObject * b)
+{
+  GstObject *ancestor = gst_object_get_parent (a), *parent;
+
+  while (ancestor != NULL && !gst_object_has_as_ancestor (b, ancestor)) {
+    parent = gst_object_get_parent (ancestor);
+    gst_object_unref (ancestor);
+    ancestor = parent;
+  }
+
+  return ancestor;
+}
+
+/* Ghost @pad on every bin above its element, up to @ancestor excluded */
+static GstPad *
+ghost_pad_up_to (GstPad * pad, GstElement * element, GstObject * ancestor)
+{
+  GstPad *outer = gst_object_ref (pad);
+  GstObject *bin = gst_object_get_parent (GST_OBJECT (element)), *parent;
+
+  while (bin != NULL && bin != ancestor) {
+    GstPad *ghost = gst_ghost_pad_new (NULL, outer);
+
+    g_object_set_qdata (G_OBJECT (ghost), kms_link_ghost_quark (),
+        GINT_TO_POINTER (TRUE));
+    gst_pad_set_active (ghost, TRUE);
+    gst_element_add_pad (GST_ELEMENT (bin), ghost);
+
+    gst_object_unref (outer);
+    outer = gst_object_ref (ghost);
+
+    parent = gst_object_get_parent (bin);
+    gst_object_unref (bin);
+    bin = parent;
+  }
+
+  if (bin != NULL) {
+    gst_object_unref (bin);
+  }
+
+  return outer;
+}
+
+/* Remove @pad, if it is a link ghost, and the link ghosts it targets */
+static void
+remove_link_ghosts (GstPad * pad)
+{
+  GstPad *current = gst_object_ref (pad), *target;
+  GstElement *bin;
+
+  while (kms_utils_pad_is_link_ghost (current)) {
+    target = gst_ghost_pad_get_target (GST_GHOST_PAD (current));
+    gst_ghost_pad_set_target (GST_GHOST_PAD (current), NULL);
+
+    bin = gst_pad_get_parent_element (current);
+    if (bin != NULL) {
+      gst_pad_set_active (current, FALSE);
+      gst_element_remove_pad (bin, current);
+      gst_object_unref (bin);
+    }
+
+    gst_object_unref (current);
+    current = target;
+
+    if (current == NULL) {
+      return;
+    }
+  }
+
+  gst_object_unref (current);
+}
+
+/* Outermost link ghost targeting @pad, or @pad itself */
+static GstPad *
+get_outer_pad (GstPad * pad)
+{
+  GstPad *outer = gst_object_ref (pad), *peer;
+  GstObject *ghost;
+
+  while ((peer = gst_pad_get_peer (outer)) != NULL) {
+    /* The peer of a ghost pad target is the internal pad of the ghost pad */
+    ghost = GST_IS_PROXY_PAD (peer) ?
+        gst_object_get_parent (GST_OBJECT (peer)) : NULL;
+    gst_object_unref (peer);
+
+    if (ghost == NULL) {
+      break;
+    }
+
+    if (!GST_IS_PAD (ghost) || !kms_utils_pad_is_link_ghost (GST_PAD (ghost))) {
+      gst_object_unref (ghost);
+      break;
+    }
+
+    gst_object_unref (outer);
+    outer = GST_PAD (ghost);
+  }
+
+  return outer;
+}
+
+GstPadLinkReturn
+kms_utils_link_ghosted_pads (GstPad * src, GstPad * sink)
+{
+  GstElement *src_element, *sink_element;
+  GstObject *ancestor = NULL;
+  GstPad *outer_src, *outer_sink;
+  GstPadLinkReturn ret = GST_PAD_LINK_WRONG_HIERARCHY;
+
+  src_element = gst_pad_get_parent_element (src);
+  sink_element = gst_pad_get_parent_element (sink);
+
+  if (src_element != NULL && sink_element != NULL) {
+    ancestor = get_common_ancestor (GST_OBJECT (src_element),
+        GST_OBJECT (sink_element));
+  }
+
+  if (ancestor == NULL) {
+    GST_ERROR ("%" GST_PTR_FORMAT " and %" GST_PTR_FORMAT " are not in the"
+        " same pipeline", src, sink);
+    goto end;
+  }
+
+  outer_src = ghost_pad_up_to (src, src_element, ancestor);
+  outer_sink = ghost_pad_up_to (sink, sink_element, ancestor);
+
+  ret = gst_pad_link (outer_src, outer_sink);
+
+  if (GST_PAD_LINK_FAILED (ret)) {
+    remove_link_ghosts (outer_src);
+    remove_link_ghosts (outer_sink);
+  }
+
+  gst_object_unref (outer_src);
+  gst_object_unref (outer_sink);
+  gst_object_unref (ancestor);
+
+end:
+  g_clear_object (&src_element);
+  g_clear_object (&sink_element);
+
+  return ret;
+}
+
+void
+kms_utils_unlink_ghosted_pads (GstPad * pad)
+{
+  GstPad *outer = get_outer_pad (pad), *outer_peer;
+
+  outer_peer = gst_pad_get_peer (outer);
+
+  if (outer_peer != NULL) {
+    if (GST_PAD_IS_SRC (outer)) {
+      gst_pad_unlink (outer, outer_peer);
+    } else {
+      gst_pad_unlink (outer_peer, outer);
+    }
+
+    remove_link_ghosts (outer_peer);
+    gst_object_unref (outer_peer);
+  }
+
+  remove_link_ghosts (outer);
+  gst_object_unref (outer);
+}
+
+GstPad *
+kms_utils_get_ghosted_peer (GstPad * pad)
+{
+  GstPad *outer = get_outer_pad (pad), *peer, *target;
+
+  peer = gst_pad_get_peer (outer);
+  gst_object_unref (outer);
+
+  while (peer != NULL && kms_utils_pad_is_link_ghost (peer)) {
+    target = gst_ghost_pad_get_target (GST_GHOST_PAD (peer));
+    gst_object_unref (peer);
+    peer = target;
+  }
+
+  return peer;
+}
+
 /* ---- GstElement ---- */
 
 GstElement *
@@ -152,6 +348,139 @@ end:
   return element;
 }
 
+/* Factory cache begin */
+
+static void
+factory_cache_unref_factory (gpointer factory)
+{
+  if (factory != NULL) {
+    gst_object_unref (factory);
+  }
+}
+
+typedef struct _FactoryCache
+{
+  GMutex mutex;
+  guint32 cookie;
+  GHashTable *factories;        /* key -> GstElementFactory or NULL */
+} FactoryCache;
+
+static FactoryCache *
+factory_cache_get_default (void)
+{
+  static gsize initialized = 0;
+  static FactoryCache cache;
+
+  if (g_once_init_enter (&initialized)) {
+    g_mutex_init (&cache.mutex);
+    cache.cookie = 0;
+    cache.factories = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        factory_cache_unref_factory);
+    g_once_init_leave (&initialized, 1);
+  }
+
+  return &cache;
+}
+
+static gchar *
+factory_cache_caps_to_string (const GstCaps * caps)
+{
+  GstCaps *copy;
+  gchar *str;
+  guint i;
+
+  if (caps == NULL) {
+    return g_strdup ("");
+  }
+
+  /* Buffer fields are unique per stream and never affect the selection */
+  copy = gst_caps_copy (caps);
+  for (i = 0; i < gst_caps_get_size (copy); i++) {
+    gst_structure_remove_fields (gst_caps_get_structure (copy, i),
+        "codec_data", "streamheader", NULL);
+  }
+
+  str = gst_caps_to_string (copy);
+  gst_caps_unref (copy);
+
+  return str;
+}
+
+static gchar *
+factory_cache_key (const gchar * kind, const GstCaps * caps,
+    const GstCaps * other_caps)
+{
+  gchar *caps_str, *other_str, *key;
+
+  caps_str = factory_cache_caps_to_string (caps);
+  other_str = factory_cache_caps_to_string (other_caps);
+  key = g_strdup_printf ("%s|%s|%s", kind, caps_str, other_str);
+  g_free (caps_str);
+  g_free (other_str);
+
+  return key;
+}
+
+/* Must be called with the cache mutex held */
+static void
+factory_cache_check_cookie (FactoryCache * cache)
+{
+  guint32 cookie = gst_registry_get_feature_list_cookie (gst_registry_get ());
+
+  if (cookie != cache->cookie) {
+    GST_DEBUG ("Registry changed, dropping %u cached factories",
+        g_hash_table_size (cache->factories));
+    g_hash_table_remove_all (cache->factories);
+    cache->cookie = cookie;
+  }
+}
+
+GstElementFactory *
+kms_utils_factory_cache_get (const gchar * kind, const GstCaps * caps,
+    const GstCaps * other_caps, KmsFactorySelectFunc select)
+{
+  FactoryCache *cache = factory_cache_get_default ();
+  GstElementFactory *factory = NULL;
+  gpointer value;
+  guint32 cookie;
+  gchar *key;
+
+  g_return_val_if_fail (kind != NULL, NULL);
+  g_return_val_if_fail (select != NULL, NULL);
+
+  key = factory_cache_key (kind, caps, other_caps);
+
+  g_mutex_lock (&cache->mutex);
+  factory_cache_check_cookie (cache);
+  if (g_hash_table_lookup_extended (cache->factories, key, NULL, &value)) {
+    factory = value != NULL ? gst_object_ref (value) : NULL;
+    g_mutex_unlock (&cache->mutex);
+    GST_TRACE ("Cached factory for %s: %" GST_PTR_FORMAT, key, factory);
+    g_free (key);
+    return factory;
+  }
+  cookie = cache->cookie;
+  g_mutex_unlock (&cache->mutex);
+
+  /* Walk the registry without holding the cache lock */
+  factory = select (caps, other_caps);
+
+  g_mutex_lock (&cache->mutex);
+  factory_cache_check_cookie (cache);
+  if (cookie == cache->cookie) {
+    g_hash_table_insert (cache->factories, key,
+        factory != NULL ? gst_object_ref (factory) : NULL);
+    key = NULL;
+  }
+  g_mutex_unlock (&cache->mutex);
+
+  g_free (key);
+
+  return factory;
+}
+
+/* Factory cache end */
+
 /* Caps begin */
 
 static GstStaticCaps static_audio_caps =
@@ -604,7 +933,10 @@ kms_element_iterate_pads (GstIterator * it, KmsPadCallback action,
     switch (gst_iterator_next (it, &item)) {
       case GST_ITERATOR_OK:
         pad = g_value_get_object (&item);
-        action (pad, data);
+        /* Ghost pads of links crossing the element are not its own pads */
+        if (!kms_utils_pad_is_link_ghost (pad)) {
+          action (pad, data);
+        }
         g_value_reset (&item);
         break;
       case GST_ITERATOR_RESYNC:
@@ -826,15 +1158,64 @@ kms_utils_remb_event_upstream_parse (GstEvent * event, guint * bitrate,
   return TRUE;
 }
 
+/*
+ * REMB values are kept in per-SSRC slots updated with atomic operations from
+ * the streaming threads. Slots are claimed under the mutex only the first time
+ * an SSRC is seen and expired ones are recycled, but their chunks live as long
+ * as the manager, so lookups need no lock. The minimum is lowered in place
+ * with a CAS; rescans (when the minimum rises or entries expire) and
+ * notifications are done by whichever thread gets the aggregator role, the
+ * others just leave a pending request.
+ */
+
+#define REMB_SLOTS_PER_CHUNK 32
+
+#define REMB_PENDING_RESCAN (1 << 0)
+#define REMB_PENDING_NOTIFY (1 << 1)
+
+/* Timestamps are 64 bits, g_atomic only handles 32 bits and pointers */
+#define REMB_TIME_GET(t) __atomic_load_n (&(t), __ATOMIC_RELAXED)
+#define REMB_TIME_SET(t, value) \
+  __atomic_store_n (&(t), (value), __ATOMIC_RELAXED)
+
+typedef enum
+{
+  REMB_SLOT_FREE = 0,
+  REMB_SLOT_USED,
+  REMB_SLOT_RECLAIMING
+} RembSlotState;
+
+typedef struct _RembSlot
+{
+  volatile gint state;
+  volatile gint writers;        /* Threads updating the slot, see reclaim */
+  volatile gint ssrc;           /* Set before the slot becomes USED */
+  volatile gint bitrate;
+  GstClockTime ts;              /* Atomic, REMB_TIME_GET/SET */
+} RembSlot;
+
+typedef struct _RembSlotChunk RembSlotChunk;
+
+struct _RembSlotChunk
+{
+  RembSlot slots[REMB_SLOTS_PER_CHUNK];
+  RembSlotChunk *next;
+};
+
 struct _RembEventManager
 {
-  GMutex mutex;
-  guint remb_min;
-  GHashTable *remb_hash;
+  GMutex mutex;                 /* Protects slot claims and the callback */
+  RembSlotChunk *chunks;        /* Atomic, only prepended */
+  volatile gint remb_min;
+  volatile gint pending;
+  volatile gint aggregating;
+  volatile gint default_min;
+  guint notified_min;
   GstPad *pad;
   gulong probe_id;
-  GstClockTime oldest_remb_time;
+  GstClockTime oldest_remb_time;        /* Atomic, written by the aggregator */
   GstClockTime clear_interval;
+  GstClock *clock;              /* NULL for the monotonic time */
 
   /* Callback */
   RembBitrateUpdatedCallback callback;
@@ -842,69 +1223,161 @@ struct _RembEventManager
   GDestroyNotify user_data_destroy;
 };
 
-typedef struct _RembHashValue
+static GstClockTime
+remb_event_manager_get_time (RembEventManager * manager)
 {
-  guint bitrate;
-  GstClockTime ts;
-} RembHashValue;
-
-static RembHashValue *
-remb_hash_value_create (guint bitrate)
-{
-  RembHashValue *value = g_slice_new0 (RembHashValue);
+  if (manager->clock != NULL) {
+    return gst_clock_get_time (manager->clock);
+  }
 
-  value->bitrate = bitrate;
-  value->ts = kms_utils_get_time_nsecs ();
+  return kms_utils_get_time_nsecs ();
+}
 
-  return value;
+/*
+ * @ts can be newer than @time when it was refreshed after @time was taken,
+ * so the difference is signed.
+ */
+static gboolean
+remb_event_manager_is_expired (RembEventManager * manager, GstClockTime ts,
+    GstClockTime time)
+{
+  return GST_CLOCK_DIFF (ts, time) > (GstClockTimeDiff) manager->clear_interval;
 }
 
 static void
-remb_hash_value_destroy (gpointer value)
+remb_slot_release (RembSlot * slot)
 {
-  g_slice_free (RembHashValue, value);
+  g_atomic_int_dec_and_test (&slot->writers);
 }
 
-static void
-remb_event_manager_set_min (RembEventManager * manager, guint min)
+/* Returns the slot of @ssrc pinned for writing, or NULL */
+static RembSlot *
+remb_event_manager_acquire_slot (RembEventManager * manager, guint ssrc)
 {
-  if (manager->remb_min != min) {
-    manager->remb_min = min;
+  RembSlotChunk *chunk;
+  guint i;
 
-    if (manager->callback) {
-      // TODO: Think about having a threshold to not notify in excess
-      manager->callback (manager, manager->remb_min, manager->user_data);
+  for (chunk = g_atomic_pointer_get (&manager->chunks); chunk != NULL;
+      chunk = chunk->next) {
+    for (i = 0; i < REMB_SLOTS_PER_CHUNK; i++) {
+      RembSlot *slot = &chunk->slots[(ssrc + i) % REMB_SLOTS_PER_CHUNK];
+
+      if (g_atomic_int_get (&slot->state) != REMB_SLOT_USED
+          || (guint) g_atomic_int_get (&slot->ssrc) != ssrc) {
+        continue;
+      }
+
+      /* Pairs with remb_slot_try_reclaim */
+      g_atomic_int_inc (&slot->writers);
+      if (g_atomic_int_get (&slot->state) == REMB_SLOT_USED
+          && (guint) g_atomic_int_get (&slot->ssrc) == ssrc) {
+        return slot;
+      }
+      remb_slot_release (slot);
     }
   }
+
+  return NULL;
 }
 
-static void
+/* Must be called with the mutex held */
+static RembSlot *
+remb_event_manager_claim_slot (RembEventManager * manager, guint ssrc)
+{
+  RembSlotChunk *chunk;
+  RembSlot *slot;
+  guint i;
+
+  for (chunk = manager->chunks; chunk != NULL; chunk = chunk->next) {
+    for (i = 0; i < REMB_SLOTS_PER_CHUNK; i++) {
+      slot = &chunk->slots[(ssrc + i) % REMB_SLOTS_PER_CHUNK];
+
+      if (g_atomic_int_get (&slot->state) == REMB_SLOT_FREE) {
+        goto claim;
+      }
+    }
+  }
+
+  chunk = g_slice_new0 (RembSlotChunk);
+  chunk->next = manager->chunks;
+  slot = &chunk->slots[ssrc % REMB_SLOTS_PER_CHUNK];
+  g_atomic_pointer_set (&manager->chunks, chunk);
+
+claim:
+  g_atomic_int_set (&slot->ssrc, ssrc);
+  g_atomic_int_set (&slot->bitrate, 0);
+  g_atomic_int_inc (&slot->writers);
+  g_atomic_int_set (&slot->state, REMB_SLOT_USED);
+
+  return slot;
+}
+
+/*
+ * A slot is only freed when no writer has it pinned. Writers pin before
+ * checking the state and the reclaimer changes the state before checking the
+ * pins, so one of them always backs off.
+ */
+static gboolean
+remb_slot_try_reclaim (RembSlot * slot)
+{
+  if (!g_atomic_int_compare_and_exchange (&slot->state, REMB_SLOT_USED,
+          REMB_SLOT_RECLAIMING)) {
+    return FALSE;
+  }
+
+  if (g_atomic_int_get (&slot->writers) > 0) {
+    g_atomic_int_set (&slot->state, REMB_SLOT_USED);
+    return FALSE;
+  }
+
+  g_atomic_int_set (&slot->state, REMB_SLOT_FREE);
+
+  return TRUE;
+}
+
+/* Only called by the aggregator */
+static guint
 remb_event_manager_calc_min (RembEventManager * manager, guint default_min)
 {
   guint remb_min = 0;
-  GstClockTime time = kms_utils_get_time_nsecs ();
+  GstClockTime time = remb_event_manager_get_time (manager);
   GstClockTime oldest_time = GST_CLOCK_TIME_NONE;
-  GHashTableIter iter;
-  gpointer key, v;
-
-  g_hash_table_iter_init (&iter, manager->remb_hash);
-  while (g_hash_table_iter_next (&iter, &key, &v)) {
-    guint br = ((RembHashValue *) v)->bitrate;
-    GstClockTime ts = ((RembHashValue *) v)->ts;
-
-    if (time - ts > manager->clear_interval) {
-      GST_TRACE ("Remove entry %" G_GUINT32_FORMAT, GPOINTER_TO_UINT (key));
-      g_hash_table_iter_remove (&iter);
-      continue;
-    }
+  RembSlotChunk *chunk;
+  guint i;
 
-    if (remb_min == 0) {
-      remb_min = br;
-    } else {
-      remb_min = MIN (remb_min, br);
+  for (chunk = g_atomic_pointer_get (&manager->chunks); chunk != NULL;
+      chunk = chunk->next) {
+    for (i = 0; i < REMB_SLOTS_PER_CHUNK; i++) {
+      RembSlot *slot = &chunk->slots[i];
+      GstClockTime ts;
+      guint br;
+
+      if (g_atomic_int_get (&slot->state) != REMB_SLOT_USED) {
+        continue;
+      }
+
+      br = g_atomic_int_get (&slot->bitrate);
+      ts = REMB_TIME_GET (slot->ts);
+
+      if (remb_event_manager_is_expired (manager, ts, time)
+          && remb_slot_try_reclaim (slot)) {
+        GST_TRACE ("Remove entry %" G_GUINT32_FORMAT,
+            (guint) g_atomic_int_get (&slot->ssrc));
+        continue;
+      }
+
+      if (br == 0) {
+        continue;
+      }
+
+      if (remb_min == 0) {
+        remb_min = br;
+      } else {
+        remb_min = MIN (remb_min, br);
+      }
+
+      oldest_time = MIN (oldest_time, ts);
     }
-
-    oldest_time = MIN (oldest_time, ts);
   }
 
   if (remb_min == 0 && default_min > 0) {
@@ -913,50 +1386,109 @@ remb_event_manager_calc_min (RembEventManager * manager, guint default_min)
     remb_min = default_min;
   }
 
-  manager->oldest_remb_time = oldest_time;
-  remb_event_manager_set_min (manager, remb_min);
+  REMB_TIME_SET (manager->oldest_remb_time,
+      GST_CLOCK_TIME_IS_VALID (oldest_time) ? oldest_time : time);
+
+  return remb_min;
 }
 
 static void
-remb_event_manager_update_min (RembEventManager * manager, guint bitrate,
-    guint ssrc)
+remb_event_manager_notify (RembEventManager * manager)
 {
-  RembHashValue *last_value;
-  GstClockTime time = kms_utils_get_time_nsecs ();
-  gboolean new_br = TRUE;
+  guint remb_min = g_atomic_int_get (&manager->remb_min);
 
   g_mutex_lock (&manager->mutex);
-  last_value = g_hash_table_lookup (manager->remb_hash,
-      GUINT_TO_POINTER (ssrc));
+  if (manager->notified_min != remb_min) {
+    manager->notified_min = remb_min;
 
-  if (last_value != NULL) {
-    new_br = (bitrate != last_value->bitrate);
-    last_value->bitrate = bitrate;
-    last_value->ts = kms_utils_get_time_nsecs ();
-  } else {
-    RembHashValue *value;
+    if (manager->callback) {
+      // TODO: Think about having a threshold to not notify in excess
+      manager->callback (manager, remb_min, manager->user_data);
+    }
+  }
+  g_mutex_unlock (&manager->mutex);
+}
+
+/*
+ * Serve the pending requests unless another thread is already doing it. The
+ * aggregator checks again after leaving the role, so no request is lost.
+ */
+static void
+remb_event_manager_aggregate (RembEventManager * manager, gint request)
+{
+  g_atomic_int_or (&manager->pending, request);
+
+  while (g_atomic_int_get (&manager->pending) != 0
+      && g_atomic_int_compare_and_exchange (&manager->aggregating, FALSE,
+          TRUE)) {
+    gint pending = g_atomic_int_and (&manager->pending, 0);
 
-    value = remb_hash_value_create (bitrate);
-    g_hash_table_insert (manager->remb_hash, GUINT_TO_POINTER (ssrc), value);
+    if (pending & REMB_PENDING_RESCAN) {
+      gint last = g_atomic_int_get (&manager->remb_min);
+      gint remb_min = remb_event_manager_calc_min (manager,
+          g_atomic_int_and (&manager->default_min, 0));
+
+      if (!g_atomic_int_compare_and_exchange (&manager->remb_min, last,
+              remb_min)) {
+        /* Lowered meanwhile, maybe after its slot was scanned */
+        g_atomic_int_or (&manager->pending, REMB_PENDING_RESCAN);
+      }
+    }
+
+    remb_event_manager_notify (manager);
+    g_atomic_int_set (&manager->aggregating, FALSE);
   }
+}
 
-  if (bitrate < manager->remb_min) {
-    remb_event_manager_set_min (manager, bitrate);
-  } else {
-    gboolean calc_min;
+static void
+remb_event_manager_update_min (RembEventManager * manager, guint bitrate,
+    guint ssrc)
+{
+  GstClockTime time = remb_event_manager_get_time (manager);
+  guint last_br, remb_min;
+  gint request = 0;
+  RembSlot *slot;
+
+  slot = remb_event_manager_acquire_slot (manager, ssrc);
+  if (slot == NULL) {
+    g_mutex_lock (&manager->mutex);
+    slot = remb_event_manager_acquire_slot (manager, ssrc);
+    if (slot == NULL) {
+      slot = remb_event_manager_claim_slot (manager, ssrc);
+    }
+    g_mutex_unlock (&manager->mutex);
+  }
 
-    calc_min = new_br && (bitrate > manager->remb_min);
-    calc_min = calc_min
-        || (time - manager->oldest_remb_time > manager->clear_interval);
-    if (calc_min) {
-      remb_event_manager_calc_min (manager, bitrate);
+  last_br = g_atomic_int_get (&slot->bitrate);
+  REMB_TIME_SET (slot->ts, time);
+  g_atomic_int_set (&slot->bitrate, bitrate);
+  remb_slot_release (slot);
+
+  remb_min = g_atomic_int_get (&manager->remb_min);
+  while (bitrate < remb_min) {
+    if (g_atomic_int_compare_and_exchange (&manager->remb_min, remb_min,
+            bitrate)) {
+      request |= REMB_PENDING_NOTIFY;
+      break;
     }
+    remb_min = g_atomic_int_get (&manager->remb_min);
   }
 
-  GST_TRACE_OBJECT (manager->pad, "remb_min: %" G_GUINT32_FORMAT,
-      manager->remb_min);
+  /* Only a rise of the entry holding the minimum can change it */
+  if (remb_min == 0 || (last_br > 0 && last_br <= remb_min
+          && bitrate > last_br)
+      || remb_event_manager_is_expired (manager,
+          REMB_TIME_GET (manager->oldest_remb_time), time)) {
+    g_atomic_int_set (&manager->default_min, bitrate);
+    request |= REMB_PENDING_RESCAN;
+  }
 
-  g_mutex_unlock (&manager->mutex);
+  if (request != 0) {
+    remb_event_manager_aggregate (manager, request);
+  }
+
+  GST_TRACE_OBJECT (manager->pad, "remb_min: %" G_GUINT32_FORMAT,
+      (guint) g_atomic_int_get (&manager->remb_min));
 }
 
 static GstPadProbeReturn
@@ -987,15 +1519,11 @@ kms_utils_remb_event_manager_create (GstPad * pad)
 
   g_mutex_init (&manager->mutex);
 
-  g_mutex_lock (&manager->mutex);
-  manager->remb_hash =
-      g_hash_table_new_full (NULL, NULL, NULL, remb_hash_value_destroy);
   manager->pad = g_object_ref (pad);
+  REMB_TIME_SET (manager->oldest_remb_time, kms_utils_get_time_nsecs ());
+  manager->clear_interval = DEFAULT_CLEAR_INTERVAL;
   manager->probe_id = gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM,
       remb_probe, manager, NULL);
-  manager->oldest_remb_time = kms_utils_get_time_nsecs ();
-  manager->clear_interval = DEFAULT_CLEAR_INTERVAL;
-  g_mutex_unlock (&manager->mutex);
 
   return manager;
 }
@@ -1013,11 +1541,19 @@ kms_utils_remb_event_manager_destroy_user_data (RembEventManager * manager)
 void
 kms_utils_remb_event_manager_destroy (RembEventManager * manager)
 {
+  RembSlotChunk *chunk, *next;
+
   kms_utils_remb_event_manager_destroy_user_data (manager);
 
   gst_pad_remove_probe (manager->pad, manager->probe_id);
   g_object_unref (manager->pad);
-  g_hash_table_destroy (manager->remb_hash);
+  g_clear_object (&manager->clock);
+
+  for (chunk = manager->chunks; chunk != NULL; chunk = next) {
+    next = chunk->next;
+    g_slice_free (RembSlotChunk, chunk);
+  }
+
   g_mutex_clear (&manager->mutex);
   g_slice_free (RembEventManager, manager);
 }
@@ -1031,18 +1567,14 @@ kms_utils_remb_event_manager_pointer_destroy (gpointer manager)
 guint
 kms_utils_remb_event_manager_get_min (RembEventManager * manager)
 {
-  GstClockTime time = kms_utils_get_time_nsecs ();
-  guint ret;
+  GstClockTime time = remb_event_manager_get_time (manager);
 
-  g_mutex_lock (&manager->mutex);
-  if (time - manager->oldest_remb_time > manager->clear_interval) {
-    remb_event_manager_calc_min (manager, 0);
+  if (remb_event_manager_is_expired (manager,
+          REMB_TIME_GET (manager->oldest_remb_time), time)) {
+    remb_event_manager_aggregate (manager, REMB_PENDING_RESCAN);
   }
 
-  ret = manager->remb_min;
-  g_mutex_unlock (&manager->mutex);
-
-  return ret;
+  return g_atomic_int_get (&manager->remb_min);
 }
 
 void
@@ -1071,6 +1603,20 @@ kms_utils_remb_event_manager_get_clear_interval (RembEventManager * manager)
   return manager->clear_interval;
 }
 
+void
+kms_utils_remb_event_manager_set_clock (RembEventManager * manager,
+    GstClock * clock)
+{
+  g_clear_object (&manager->clock);
+
+  if (clock != NULL) {
+    manager->clock = gst_object_ref (clock);
+  }
+
+  REMB_TIME_SET (manager->oldest_remb_time,
+      remb_event_manager_get_time (manager));
+}
+
 /* REMB event end */
 
 /* time begin */
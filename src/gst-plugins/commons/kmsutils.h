@@ -43,6 +43,20 @@ gboolean gst_element_sync_state_with_parent_target_state (GstElement * element);
  */
 void kms_utils_bin_remove (GstBin * bin, GstElement * element);
 
+/* ---- GstPad ---- */
+
+/*
+ * Link two pads of elements in different bins of the same pipeline, with the
+ * usual link checks, through ghost pads added to every bin between each pad
+ * and their closest common ancestor. kms_utils_unlink_ghosted_pads() unlinks
+ * them and removes those ghost pads, given the pad at either end, and
+ * kms_utils_get_ghosted_peer() returns the pad at the other end.
+ */
+GstPadLinkReturn kms_utils_link_ghosted_pads (GstPad * src, GstPad * sink);
+void kms_utils_unlink_ghosted_pads (GstPad * pad);
+GstPad *kms_utils_get_ghosted_peer (GstPad * pad);
+gboolean kms_utils_pad_is_link_ghost (GstPad * pad);
+
 /* ---- GstElement ---- */
 
 /*
@@ -52,6 +66,18 @@ void kms_utils_bin_remove (GstBin * bin, GstElement * element);
 GstElement *kms_utils_element_factory_make (const gchar *factoryname,
     const gchar *prefix);
 
+/*
+ * Process-wide cache of element factory selections. @select is only called
+ * when no choice is cached for (@kind, @caps, @other_caps); results,
+ * including failed lookups, are dropped whenever the plugin registry changes.
+ * Returns a new reference to the factory, or NULL.
+ */
+typedef GstElementFactory * (*KmsFactorySelectFunc) (const GstCaps * caps,
+    const GstCaps * other_caps);
+GstElementFactory *kms_utils_factory_cache_get (const gchar * kind,
+    const GstCaps * caps, const GstCaps * other_caps,
+    KmsFactorySelectFunc select);
+
 /* Caps */
 gboolean kms_utils_caps_is_audio (const GstCaps * caps);
 gboolean kms_utils_caps_is_video (const GstCaps * caps);
@@ -90,6 +116,8 @@ guint kms_utils_remb_event_manager_get_min (RembEventManager * manager);
 void kms_utils_remb_event_manager_set_callback (RembEventManager * manager, RembBitrateUpdatedCallback cb, gpointer data, GDestroyNotify destroy_notify);
 void kms_utils_remb_event_manager_set_clear_interval (RembEventManager * manager, GstClockTime interval);
 GstClockTime kms_utils_remb_event_manager_get_clear_interval (RembEventManager * manager);
+/* Entries expire with the time of @clock instead of the monotonic time */
+void kms_utils_remb_event_manager_set_clock (RembEventManager * manager, GstClock * clock);
 
 /* time */
 GstClockTime kms_utils_get_time_nsecs ();
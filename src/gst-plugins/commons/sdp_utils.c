@@ -1033,7 +1033,7 @@ sdp_utils_get_pt_for_codec_name (const GstSDPMedia * media,
 }
 
 gint
-sdp_utils_get_abs_send_time_id (const GstSDPMedia * media)
+sdp_utils_get_extmap_id (const GstSDPMedia * media, const gchar * uri)
 {
   guint a;
 
@@ -1047,7 +1047,8 @@ sdp_utils_get_abs_send_time_id (const GstSDPMedia * media)
     }
 
     tokens = g_strsplit (attr, " ", 0);
-    if (g_strcmp0 (RTP_HDR_EXT_ABS_SEND_TIME_URI, tokens[1]) == 0) {
+    if (g_strcmp0 (uri, tokens[1]) == 0) {
+      /* atoi stops at the optional "/direction" suffix */
       gint ret = atoi (tokens[0]);
 
       g_strfreev (tokens);
@@ -1060,6 +1061,12 @@ sdp_utils_get_abs_send_time_id (const GstSDPMedia * media)
   return -1;
 }
 
+gint
+sdp_utils_get_abs_send_time_id (const GstSDPMedia * media)
+{
+  return sdp_utils_get_extmap_id (media, RTP_HDR_EXT_ABS_SEND_TIME_URI);
+}
+
 gboolean
 sdp_utils_media_is_inactive (const GstSDPMedia * media)
 {
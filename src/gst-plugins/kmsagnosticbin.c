@@ -22,6 +22,7 @@
 #include "kmsagnosticbin.h"
 #include "kmsagnosticcaps.h"
 #include "kmsutils.h"
+#include "kmsrefstruct.h"
 #include "kmsparsetreebin.h"
 #include "kmsdectreebin.h"
 #include "kmsenctreebin.h"
@@ -29,11 +30,23 @@
 
 #include "kms-core-enumtypes.h"
 
+#include <pthread.h>
+#include <time.h>
+
 #define PLUGIN_NAME "agnosticbin"
 
 #define UNLINKING_DATA "unlinking-data"
 G_DEFINE_QUARK (UNLINKING_DATA, unlinking_data);
 
+#define RENDITION_DATA "rendition-data"
+G_DEFINE_QUARK (RENDITION_DATA, rendition_data);
+
+#define TARGET_RENDITION_DATA "target-rendition-data"
+G_DEFINE_QUARK (TARGET_RENDITION_DATA, target_rendition_data);
+
+#define FANOUT_DATA "fanout-data"
+G_DEFINE_QUARK (FANOUT_DATA, fanout_data);
+
 #define KMS_AGNOSTIC_PAD_STARTED (GST_PAD_FLAG_LAST << 1)
 
 static GstStaticCaps static_raw_audio_caps =
@@ -68,6 +81,16 @@ G_DEFINE_TYPE (KmsAgnosticBin2, kms_agnostic_bin2, GST_TYPE_BIN);
 #define DEFAULT_TARGET_ENCODER_BITRATE 300000
 #define DEFAULT_MIN_ENCODER_BITRATE 0
 #define DEFAULT_MAX_ENCODER_BITRATE G_MAXINT
+#define DEFAULT_SHARE_TRANSCODERS FALSE
+#define SHARED_BITRATE_BUCKET 100000 /* 100 kbps */
+#define DEFAULT_LADDER_RENDITIONS 1
+#define MAX_LADDER_RENDITIONS 4
+#define LADDER_HYSTERESIS_PERCENT 10
+#define DEFAULT_IDLE_BIN_TIMEOUT 0 /* ms */
+#define DEFAULT_SHARED_OUTPUT_QUEUE FALSE
+#define DEFAULT_LATENCY_BUDGET 0 /* ms, 0 keeps the default queue sizes */
+#define LATENCY_BUDGET_MIN_FRAMES 2
+#define MAX_REMOVED_TRANSCODINGS 16
 
 #define LEAKY_TIME 600000000    /*600 ms */
 
@@ -79,6 +102,58 @@ enum
 
 static guint kms_agnostic_bin2_signals[LAST_SIGNAL] = { 0 };
 
+/* Statistics of an output pad, kept across relinks */
+typedef struct _OutputStats
+{
+  KmsRefStruct ref;
+  gint budget;                  /* ms, atomic */
+  gint overruns;                /* atomic */
+  gint gop_drops;               /* atomic */
+} OutputStats;
+
+#define output_stats_ref(obj) \
+  kms_ref_struct_ref (KMS_REF_STRUCT_CAST (obj))
+#define output_stats_unref(obj) \
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (obj))
+
+/* Adaptive sizing state of the queue of an output */
+typedef struct _OutputQueueWatch
+{
+  OutputStats *stats;
+  gboolean encoded;
+  gint dropping;                /* atomic */
+  GstClockTime last_push;
+  GstClockTime interval;
+  GstClockTime peak_gap;
+  GstClockTime max_size_time;
+} OutputQueueWatch;
+
+/* Streaming thread running inside a TreeBin */
+typedef struct _TranscodingThread
+{
+  pthread_t thread;
+  clockid_t clock;
+} TranscodingThread;
+
+/* Why a TreeBin was created and what it has cost so far */
+typedef struct _TranscodingRecord
+{
+  gchar *type;
+  gchar *input_caps;
+  gchar *output_caps;
+  gchar *elements;
+  gint64 creation_time;         /* us since the epoch */
+  gint64 removal_time;          /* us since the epoch, 0 while in use */
+  guint64 cpu_time;             /* ns spent by threads already finished */
+  GSList *threads;              /* TranscodingThread */
+} TranscodingRecord;
+
+typedef struct _CapsIndexEntry
+{
+  KmsTreeBin *bin;
+  guint generation;
+} CapsIndexEntry;
+
 struct _KmsAgnosticBin2Private
 {
   GHashTable *bins;
@@ -96,6 +171,7 @@ struct _KmsAgnosticBin2Private
   gboolean started;
 
   GThreadPool *remove_pool;
+  GThreadPool *rendition_pool;
 
   gint target_encoder_bitrate;
   gint min_encoder_bitrate;
@@ -105,6 +181,32 @@ struct _KmsAgnosticBin2Private
   gboolean bitrate_unlimited;
 
   gboolean transcoding_emitted;
+  gboolean share_transcoders;
+  guint ladder_renditions;
+
+  /* Canonical caps key -> CapsIndexEntry, bins are owned by @bins */
+  GHashTable *caps_index;
+  guint64 caps_index_hits;
+  guint64 caps_index_misses;
+
+  /* Idle TreeBins: bin name -> loop source id of its teardown */
+  guint idle_bin_timeout;
+  GHashTable *park_timers;
+  guint64 idle_bin_reuses;
+  guint64 idle_bin_teardowns;
+
+  /* TreeBin output tee name -> fan-out tee shared by encoded outputs */
+  gboolean shared_output_queue;
+  GHashTable *fanouts;
+
+  /* Output pad name -> OutputStats */
+  guint latency_budget;
+  GHashTable *output_stats;
+
+  /* TreeBin name -> TranscodingRecord, also updated from streaming threads */
+  GMutex transcodings_mutex;
+  GHashTable *transcodings;
+  GQueue removed_transcodings;
 };
 
 enum
@@ -114,6 +216,17 @@ enum
   PROP_MIN_ENCODER_BITRATE,
   PROP_MAX_ENCODER_BITRATE,
   PROP_CODEC_CONFIG,
+  PROP_SHARE_TRANSCODERS,
+  PROP_LADDER_RENDITIONS,
+  PROP_IDLE_BIN_TIMEOUT,
+  PROP_IDLE_BIN_REUSES,
+  PROP_IDLE_BIN_TEARDOWNS,
+  PROP_SHARED_OUTPUT_QUEUE,
+  PROP_LATENCY_BUDGET,
+  PROP_OUTPUT_STATS,
+  PROP_TRANSCODING_STATS,
+  PROP_CAPS_INDEX_HITS,
+  PROP_CAPS_INDEX_MISSES,
   N_PROPERTIES
 };
 
@@ -132,7 +245,7 @@ static gboolean kms_agnostic_bin2_process_pad (KmsAgnosticBin2 * self,
     GstPad * pad);
 
 static GstBin *kms_agnostic_bin2_find_or_create_bin_for_caps (KmsAgnosticBin2 *
-    self, GstCaps * caps);
+    self, GstCaps * caps, guint rendition);
 
 static void
 kms_agnostic_bin2_insert_bin (KmsAgnosticBin2 * self, GstBin * bin)
@@ -184,6 +297,9 @@ tee_src_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
   return GST_PAD_PROBE_OK;
 }
 
+static gboolean is_shared_link (GstPad * sink);
+static void unlink_from_shared_tee (GstElement * element);
+
 static void
 remove_on_unlinked_async (gpointer data, gpointer not_used)
 {
@@ -197,6 +313,8 @@ remove_on_unlinked_async (gpointer data, gpointer not_used)
     gst_element_send_event (elem, gst_event_new_eos ());
   }
 
+  unlink_from_shared_tee (elem);
+
   parent = gst_object_get_parent (GST_OBJECT (elem));
   if (parent != NULL) {
     gst_bin_remove (GST_BIN (parent), elem);
@@ -237,7 +355,10 @@ remove_on_unlinked_blocked (GstPad * pad, GstPadProbeInfo * info, gpointer elem)
 
   sink = gst_pad_get_peer (pad);
   if (sink != NULL) {
-    gst_pad_unlink (pad, sink);
+    /* Links to shared TreeBins are undone when removing the element */
+    if (!is_shared_link (sink)) {
+      gst_pad_unlink (pad, sink);
+    }
     g_object_unref (sink);
   }
 
@@ -312,6 +433,93 @@ remove_element_on_unlinked (GstElement * element, const gchar * pad_name,
   g_object_unref (pad);
 }
 
+static void kms_agnostic_bin2_park_bin (KmsAgnosticBin2 * self,
+    KmsTreeBin * bin);
+
+/* Work on a TreeBin deferred to the loop of the agnosticbin class */
+typedef struct _DeferredData
+{
+  GWeakRef self;
+  gchar *bin_name;
+} DeferredData;
+
+static void
+deferred_data_destroy (gpointer data)
+{
+  DeferredData *deferred = data;
+
+  g_weak_ref_clear (&deferred->self);
+  g_free (deferred->bin_name);
+  g_slice_free (DeferredData, deferred);
+}
+
+static void
+kms_agnostic_bin2_defer (KmsAgnosticBin2 * self, const gchar * bin_name,
+    GSourceFunc function)
+{
+  DeferredData *deferred = g_slice_new0 (DeferredData);
+
+  g_weak_ref_init (&deferred->self, self);
+  deferred->bin_name = g_strdup (bin_name);
+
+  kms_loop_idle_add_full (KMS_AGNOSTIC_BIN2_GET_CLASS (self)->loop,
+      G_PRIORITY_DEFAULT, function, deferred, deferred_data_destroy);
+}
+
+static gboolean
+park_bin_deferred (gpointer data)
+{
+  DeferredData *deferred = data;
+  KmsAgnosticBin2 *self = g_weak_ref_get (&deferred->self);
+  GstBin *bin;
+
+  if (self == NULL) {
+    return G_SOURCE_REMOVE;
+  }
+
+  KMS_AGNOSTIC_BIN2_LOCK (self);
+
+  bin = g_hash_table_lookup (self->priv->bins, deferred->bin_name);
+  if (bin != NULL) {
+    kms_agnostic_bin2_park_bin (self, KMS_TREE_BIN (bin));
+  }
+
+  KMS_AGNOSTIC_BIN2_UNLOCK (self);
+  g_object_unref (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Let the agnosticbin owning the TreeBin of @tee park it if its last
+ * consumer is gone. The consumer can be another agnosticbin unlinking while
+ * holding its own lock, so the owner is not locked from here.
+ */
+static void
+check_idle_tree_bin (GstElement * tee)
+{
+  GstObject *bin, *owner;
+
+  bin = gst_object_get_parent (GST_OBJECT (tee));
+  if (bin == NULL) {
+    return;
+  }
+
+  owner = gst_object_get_parent (bin);
+  if (owner != NULL) {
+    if (KMS_IS_TREE_BIN (bin) && KMS_IS_AGNOSTIC_BIN2 (owner)) {
+      gchar *name = gst_object_get_name (bin);
+
+      kms_agnostic_bin2_defer (KMS_AGNOSTIC_BIN2 (owner), name,
+          park_bin_deferred);
+      g_free (name);
+    }
+    gst_object_unref (owner);
+  }
+
+  gst_object_unref (bin);
+}
+
 static void
 remove_tee_pad_on_unlink (GstPad * pad, GstPad * peer, gpointer user_data)
 {
@@ -322,6 +530,7 @@ remove_tee_pad_on_unlink (GstPad * pad, GstPad * peer, gpointer user_data)
   }
 
   gst_element_release_request_pad (tee, pad);
+  check_idle_tree_bin (tee);
   g_object_unref (tee);
 }
 
@@ -416,174 +625,1273 @@ proxy_src_pad_query_function (GstPad * pad, GstObject * parent,
   return ret;
 }
 
+static gboolean
+remove_non_input_bin (gpointer key, gpointer value, gpointer agnosticbin);
+
+static void add_linked_pads (GstPad * pad, KmsAgnosticBin2 * self);
+
+typedef struct _SharedLinkData
+{
+  KmsAgnosticBin2 *self;
+  gchar *bin_name;
+} SharedLinkData;
+
 static void
-kms_agnostic_bin2_link_to_tee (KmsAgnosticBin2 * self, GstPad * pad,
-    GstElement * tee, GstCaps * caps)
+shared_link_data_destroy (gpointer data, GClosure * closure)
 {
-  GstElement *queue = kms_utils_element_factory_make ("queue", "agnosticbin");
-  GstPad *target;
-  GstProxyPad *proxy;
+  SharedLinkData *link_data = data;
 
-  gst_bin_add (GST_BIN (self), queue);
-  gst_element_sync_state_with_parent (queue);
+  g_free (link_data->bin_name);
+  g_slice_free (SharedLinkData, link_data);
+}
 
-  if (!(gst_caps_is_any (caps) || gst_caps_is_empty (caps))
-      && kms_utils_caps_is_raw (caps)) {
-    GstElement *convert = kms_utils_create_convert_for_caps (caps);
-    GstElement *rate = kms_utils_create_rate_for_caps (caps);
-    GstElement *mediator = kms_utils_create_mediator_element (caps);
+static gboolean
+rebuild_tree_bins_deferred (gpointer data)
+{
+  DeferredData *deferred = data;
+  KmsAgnosticBin2 *self = g_weak_ref_get (&deferred->self);
+  GstBin *bin;
 
-    g_object_set (queue, "leaky", 2, "max-size-time", LEAKY_TIME, NULL);
+  if (self == NULL) {
+    return G_SOURCE_REMOVE;
+  }
 
-    remove_element_on_unlinked (convert, "src", "sink");
-    if (rate) {
-      remove_element_on_unlinked (rate, "src", "sink");
-    }
-    remove_element_on_unlinked (mediator, "src", "sink");
+  KMS_AGNOSTIC_BIN2_LOCK (self);
 
-    if (rate) {
-      gst_bin_add (GST_BIN (self), rate);
-    }
+  bin = g_hash_table_lookup (self->priv->bins, deferred->bin_name);
 
-    gst_bin_add_many (GST_BIN (self), convert, mediator, NULL);
+  if (bin != NULL && !kms_tree_bin_is_shared (KMS_TREE_BIN (bin))) {
+    GST_DEBUG_OBJECT (self, "Shared TreeBin %" GST_PTR_FORMAT " released,"
+        " rebuilding TreeBins", bin);
+    g_hash_table_remove_all (self->priv->caps_index);
+    g_hash_table_foreach_remove (self->priv->bins, remove_non_input_bin, self);
+    kms_element_for_each_src_pad (GST_ELEMENT (self),
+        (KmsPadIterationAction) add_linked_pads, self);
+  }
 
-    gst_element_sync_state_with_parent (mediator);
-    gst_element_sync_state_with_parent (convert);
-    if (rate) {
-      gst_element_sync_state_with_parent (rate);
-    }
+  KMS_AGNOSTIC_BIN2_UNLOCK (self);
+  g_object_unref (self);
 
-    if (rate) {
-      gst_element_link_many (queue, rate, mediator, NULL);
-    } else {
-      gst_element_link (queue, mediator);
-    }
+  return G_SOURCE_REMOVE;
+}
 
-    gst_element_link_many (mediator, convert, NULL);
-    target = gst_element_get_static_pad (convert, "src");
-  } else {
-    target = gst_element_get_static_pad (queue, "src");
+/*
+ * Called when a consumer of a TreeBin shared by another agnosticbin is
+ * unlinked. If the TreeBin is not shared anymore, its owner is removing it,
+ * so every branch built on top of it is rebuilt. The owner holds its lock
+ * while unlinking, so the rebuild is deferred.
+ */
+static void
+shared_tree_bin_unlinked (GstPad * pad, GstPad * peer, SharedLinkData * data)
+{
+  kms_agnostic_bin2_defer (data->self, data->bin_name,
+      rebuild_tree_bins_deferred);
+}
+
+static void
+kms_agnostic_bin2_watch_shared_link (KmsAgnosticBin2 * self, GstPad * sink,
+    GstElement * output_tee)
+{
+  SharedLinkData *data = g_slice_new (SharedLinkData);
+
+  data->self = self;
+  data->bin_name = gst_object_get_name (GST_OBJECT_PARENT (output_tee));
+
+  g_signal_connect_data (sink, "unlinked",
+      G_CALLBACK (shared_tree_bin_unlinked), data, shared_link_data_destroy, 0);
+}
+
+/*
+ * Link @element to the output tee of a TreeBin owned by another agnosticbin.
+ * The link goes through ghost pads on every bin up to the closest common
+ * ancestor of both agnosticbins, see kms_utils_link_ghosted_pads().
+ */
+static void
+kms_agnostic_bin2_link_to_shared_tee (KmsAgnosticBin2 * self,
+    GstElement * tee, GstElement * element, gboolean output)
+{
+  GstPad *tee_src, *sink;
+  GstPadLinkReturn ret;
+
+  tee_src = gst_element_get_request_pad (tee, "src_%u");
+  sink = gst_element_get_static_pad (element, "sink");
+
+  g_signal_connect (tee_src, "unlinked", G_CALLBACK (remove_tee_pad_on_unlink),
+      NULL);
+
+  if (output) {
+    gst_pad_add_probe (tee_src, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM,
+        tee_src_probe, NULL, NULL);
   }
 
-  gst_ghost_pad_set_target (GST_GHOST_PAD (pad), target);
+  ret = kms_utils_link_ghosted_pads (tee_src, sink);
 
-  proxy = gst_proxy_pad_get_internal (GST_PROXY_PAD (pad));
-  gst_pad_set_query_function (GST_PAD_CAST (proxy),
-      proxy_src_pad_query_function);
-  g_object_unref (proxy);
+  if (G_UNLIKELY (GST_PAD_LINK_FAILED (ret))) {
+    GST_ERROR_OBJECT (self, "Linking %" GST_PTR_FORMAT " with %"
+        GST_PTR_FORMAT " result %d", tee_src, sink, ret);
+    gst_element_release_request_pad (tee, tee_src);
+  } else {
+    kms_agnostic_bin2_watch_shared_link (self, sink, tee);
+  }
 
-  g_object_unref (target);
-  link_element_to_tee (tee, queue);
+  g_object_unref (sink);
+  g_object_unref (tee_src);
 }
 
 static gboolean
-check_bin (KmsTreeBin * tree_bin, const GstCaps * caps)
+is_shared_link (GstPad * sink)
 {
-  gboolean ret = FALSE;
-  GstElement *output_tee = kms_tree_bin_get_output_tee (tree_bin);
-  GstPad *tee_sink = gst_element_get_static_pad (output_tee, "sink");
-  GstCaps *current_caps = kms_tree_bin_get_input_caps (tree_bin);
+  return g_signal_handler_find (sink, G_SIGNAL_MATCH_FUNC, 0, 0, NULL,
+      shared_tree_bin_unlinked, NULL) != 0;
+}
 
-  GST_LOG_OBJECT (tree_bin,
-      "Check compatibility for bin: %" GST_PTR_FORMAT " ...", tree_bin);
+/* Undo the link of @element to a TreeBin of another agnosticbin, if any */
+static void
+unlink_from_shared_tee (GstElement * element)
+{
+  GstPad *sink = gst_element_get_static_pad (element, "sink");
 
-  if (current_caps == NULL) {
-    current_caps = gst_pad_get_allowed_caps (tee_sink);
+  if (sink == NULL) {
+    return;
   }
 
-  GST_LOG_OBJECT (tree_bin, "TreeBin '%" GST_PTR_FORMAT "' caps: %"
-      GST_PTR_FORMAT, tree_bin, current_caps);
+  if (g_signal_handlers_disconnect_matched (sink, G_SIGNAL_MATCH_FUNC, 0, 0,
+          NULL, shared_tree_bin_unlinked, NULL) > 0) {
+    GST_DEBUG_OBJECT (element, "Unlinking from shared TreeBin");
+    kms_utils_unlink_ghosted_pads (sink);
+  }
 
-  if (current_caps != NULL && gst_caps_get_size (current_caps) > 0) {
-    //TODO: Remove this when problem in negotiation with features will be
-    //resolved
-    GstCaps *caps_without_features = gst_caps_make_writable (current_caps);
+  g_object_unref (sink);
+}
 
-    gst_caps_set_features (caps_without_features, 0,
-        gst_caps_features_new_empty ());
-    if (gst_caps_can_intersect (caps, caps_without_features)) {
-      ret = TRUE;
-    }
-    gst_caps_unref (caps_without_features);
+/*
+ * Link the output tee of a TreeBin to the input element of another one. The
+ * TreeBin providing the tee can be owned by another agnosticbin.
+ */
+static void
+kms_agnostic_bin2_link_tree_bin (KmsAgnosticBin2 * self,
+    GstElement * output_tee, GstElement * input_element)
+{
+  GstPad *tee_src;
+
+  if (!gst_object_has_as_ancestor (GST_OBJECT (output_tee),
+          GST_OBJECT (self))) {
+    kms_agnostic_bin2_link_to_shared_tee (self, output_tee, input_element,
+        FALSE);
+    return;
   }
 
-  g_object_unref (tee_sink);
+  tee_src = gst_element_get_request_pad (output_tee, "src_%u");
+  g_signal_connect (tee_src, "unlinked", G_CALLBACK (remove_tee_pad_on_unlink),
+      NULL);
 
-  return ret;
+  /* Both TreeBins are ours, gst_element_link_pads() ghosts their pads */
+  if (!gst_element_link_pads (output_tee, GST_OBJECT_NAME (tee_src),
+          input_element, "sink")) {
+    GST_ERROR_OBJECT (self, "Cannot link %" GST_PTR_FORMAT " with %"
+        GST_PTR_FORMAT, tee_src, input_element);
+    gst_element_release_request_pad (output_tee, tee_src);
+  }
+
+  g_object_unref (tee_src);
 }
 
-static GstBin *
-kms_agnostic_bin2_find_bin_for_caps (KmsAgnosticBin2 * self, GstCaps * caps)
+static void
+output_stats_destroy (OutputStats * stats)
 {
-  GList *bins, *l;
-  GstBin *bin = NULL;
+  g_slice_free (OutputStats, stats);
+}
 
-  if (gst_caps_is_any (caps) || gst_caps_is_empty (caps)) {
-    return self->priv->input_bin;
+static OutputStats *
+kms_agnostic_bin2_get_output_stats (KmsAgnosticBin2 * self, GstPad * pad)
+{
+  OutputStats *stats;
+
+  stats = g_hash_table_lookup (self->priv->output_stats, GST_OBJECT_NAME (pad));
+
+  if (stats == NULL) {
+    stats = g_slice_new0 (OutputStats);
+    kms_ref_struct_init (KMS_REF_STRUCT_CAST (stats),
+        (GDestroyNotify) output_stats_destroy);
+    g_hash_table_insert (self->priv->output_stats,
+        g_strdup (GST_OBJECT_NAME (pad)), stats);
   }
 
-  if (check_bin (KMS_TREE_BIN (self->priv->input_bin), caps)) {
-    bin = self->priv->input_bin;
+  g_atomic_int_set (&stats->budget, self->priv->latency_budget);
+
+  return stats;
+}
+
+static void
+output_queue_watch_destroy (gpointer data, GClosure * closure)
+{
+  OutputQueueWatch *watch = data;
+
+  output_stats_unref (watch->stats);
+  g_slice_free (OutputQueueWatch, watch);
+}
+
+/*
+ * The queue of an output is full: its consumer is slower than the media.
+ * Encoded media is dropped until the next keyframe, as frames referencing the
+ * leaked ones could not be decoded anyway.
+ */
+static void
+output_queue_overrun (GstElement * queue, OutputQueueWatch * watch)
+{
+  GstPad *src;
+
+  g_atomic_int_inc (&watch->stats->overruns);
+
+  if (!watch->encoded || g_atomic_int_get (&watch->stats->budget) == 0
+      || !g_atomic_int_compare_and_exchange (&watch->dropping, FALSE, TRUE)) {
+    return;
   }
 
-  bins = g_hash_table_get_values (self->priv->bins);
-  for (l = bins; l != NULL && bin == NULL; l = l->next) {
-    KmsTreeBin *tree_bin = KMS_TREE_BIN (l->data);
+  GST_DEBUG_OBJECT (queue, "Overrun, dropping until next keyframe");
+  g_atomic_int_inc (&watch->stats->gop_drops);
 
-    if ((void *) tree_bin == (void *) self->priv->input_bin) {
-      // Skip: self->priv->input_bin has been already checked
-      continue;
+  src = gst_element_get_static_pad (queue, "src");
+  kms_utils_drop_until_keyframe (src, TRUE);
+  g_object_unref (src);
+}
+
+/*
+ * Size the queue from the way its consumer takes media. A consumer keeping
+ * up with the media only needs LATENCY_BUDGET_MIN_FRAMES queued, so stale
+ * media is dropped early. A consumer that stalls from time to time, like a
+ * recorder, needs room for its longest recent stall. The latency budget
+ * bounds the result.
+ */
+static GstPadProbeReturn
+output_queue_src_probe (GstPad * pad, GstPadProbeInfo * info, gpointer data)
+{
+  OutputQueueWatch *watch = data;
+  GstBuffer *buffer = NULL;
+  GstClockTime now, gap, budget, max_size_time;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    buffer = gst_pad_probe_info_get_buffer (info);
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = gst_pad_probe_info_get_buffer_list (info);
+
+    /* A list is pushed as one unit, the first buffer tells its frame type */
+    if (gst_buffer_list_length (list) > 0) {
+      buffer = gst_buffer_list_get (list, 0);
     }
+  }
 
-    if (check_bin (tree_bin, caps)) {
-      bin = GST_BIN_CAST (tree_bin);
+  if (buffer == NULL) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (watch->encoded
+      && !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    g_atomic_int_set (&watch->dropping, FALSE);
+  }
+
+  budget = g_atomic_int_get (&watch->stats->budget) * GST_MSECOND;
+  if (budget == 0) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  now = gst_util_get_timestamp ();
+  if (!GST_CLOCK_TIME_IS_VALID (watch->last_push)) {
+    watch->last_push = now;
+    return GST_PAD_PROBE_OK;
+  }
+
+  gap = now - watch->last_push;
+  watch->last_push = now;
+
+  if (watch->interval == 0) {
+    watch->interval = gap;
+  } else {
+    watch->interval = (7 * watch->interval + gap) / 8;
+  }
+
+  /* Stalls are remembered for some tens of buffers, then slowly forgotten */
+  if (gap > watch->peak_gap) {
+    watch->peak_gap = gap;
+  } else {
+    watch->peak_gap = (63 * watch->peak_gap + gap) / 64;
+  }
+
+  /* Room for the longest stall plus the frame arriving meanwhile */
+  max_size_time = MIN (watch->peak_gap + watch->interval, budget);
+  max_size_time = MAX (max_size_time,
+      LATENCY_BUDGET_MIN_FRAMES * watch->interval);
+
+  /* Avoid reconfiguring the queue for small variations */
+  if (max_size_time > watch->max_size_time + watch->max_size_time / 10
+      || max_size_time < watch->max_size_time - watch->max_size_time / 10) {
+    GstElement *queue = gst_pad_get_parent_element (pad);
+
+    if (queue != NULL) {
+      GST_LOG_OBJECT (queue, "Max size time: %" GST_TIME_FORMAT,
+          GST_TIME_ARGS (max_size_time));
+      g_object_set (queue, "max-size-time", max_size_time, NULL);
+      g_object_unref (queue);
     }
+    watch->max_size_time = max_size_time;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+kms_agnostic_bin2_watch_output_queue (KmsAgnosticBin2 * self, GstPad * pad,
+    GstElement * queue, gboolean encoded)
+{
+  OutputQueueWatch *watch;
+  GstPad *src;
+
+  /* Without a budget the queue keeps its default size and leaks silently */
+  if (self->priv->latency_budget == 0) {
+    return;
+  }
+
+  watch = g_slice_new0 (OutputQueueWatch);
+  watch->stats = output_stats_ref (kms_agnostic_bin2_get_output_stats (self,
+          pad));
+  watch->encoded = encoded;
+  watch->last_push = GST_CLOCK_TIME_NONE;
+  watch->max_size_time = self->priv->latency_budget * GST_MSECOND;
+
+  g_object_set (queue, "leaky", 2, "max-size-time", watch->max_size_time,
+      "max-size-buffers", 0, "max-size-bytes", 0, NULL);
+
+  src = gst_element_get_static_pad (queue, "src");
+  gst_pad_add_probe (src,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      output_queue_src_probe, watch, NULL);
+  g_object_unref (src);
+
+  /* The watch lives as long as the queue */
+  g_signal_connect_data (queue, "overrun", G_CALLBACK (output_queue_overrun),
+      watch, output_queue_watch_destroy, 0);
+}
+
+static GstClockTime
+kms_agnostic_bin2_get_latency_budget (KmsAgnosticBin2 * self)
+{
+  if (self->priv->latency_budget == 0) {
+    return GST_CLOCK_TIME_NONE;
+  }
+
+  return self->priv->latency_budget * GST_MSECOND;
+}
+
+static void
+kms_agnostic_bin2_set_latency_budget (KmsAgnosticBin2 * self, guint budget)
+{
+  GHashTableIter iter;
+  gpointer value;
+  GList *bins, *l;
+
+  self->priv->latency_budget = budget;
+
+  g_hash_table_iter_init (&iter, self->priv->output_stats);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    g_atomic_int_set (&((OutputStats *) value)->budget, budget);
+  }
+
+  bins = g_hash_table_get_values (self->priv->bins);
+  for (l = bins; l != NULL; l = l->next) {
+    if (KMS_IS_ENC_TREE_BIN (l->data)
+        && GST_OBJECT_PARENT (l->data) == GST_OBJECT (self)) {
+      kms_enc_tree_bin_set_latency_budget (KMS_ENC_TREE_BIN (l->data),
+          kms_agnostic_bin2_get_latency_budget (self));
+    }
+  }
+  g_list_free (bins);
+}
+
+static GstStructure *
+kms_agnostic_bin2_get_output_stats_structure (KmsAgnosticBin2 * self)
+{
+  GstStructure *stats = gst_structure_new_empty ("output-stats");
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init (&iter, self->priv->output_stats);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    OutputStats *output = value;
+    GstStructure *pad_stats;
+
+    pad_stats = gst_structure_new (key,
+        "overruns", G_TYPE_UINT64,
+        (guint64) g_atomic_int_get (&output->overruns),
+        "gop-drops", G_TYPE_UINT64,
+        (guint64) g_atomic_int_get (&output->gop_drops), NULL);
+    gst_structure_set (stats, key, GST_TYPE_STRUCTURE, pad_stats, NULL);
+    gst_structure_free (pad_stats);
+  }
+
+  return stats;
+}
+
+static guint64
+transcoding_thread_get_cpu_time (TranscodingThread * thread)
+{
+  struct timespec ts;
+
+  if (clock_gettime (thread->clock, &ts) != 0) {
+    return 0;
+  }
+
+  return GST_TIMESPEC_TO_TIME (ts);
+}
+
+static void
+transcoding_thread_free (gpointer thread)
+{
+  g_slice_free (TranscodingThread, thread);
+}
+
+static void
+transcoding_record_destroy (gpointer data)
+{
+  TranscodingRecord *record = data;
+
+  g_free (record->type);
+  g_free (record->input_caps);
+  g_free (record->output_caps);
+  g_free (record->elements);
+  g_slist_free_full (record->threads, transcoding_thread_free);
+  g_slice_free (TranscodingRecord, record);
+}
+
+static guint64
+transcoding_record_get_cpu_time (TranscodingRecord * record)
+{
+  guint64 cpu_time = record->cpu_time;
+  GSList *l;
+
+  for (l = record->threads; l != NULL; l = l->next) {
+    cpu_time += transcoding_thread_get_cpu_time (l->data);
+  }
+
+  return cpu_time;
+}
+
+static const gchar *
+kms_agnostic_bin2_get_bin_type (GstBin * bin)
+{
+  if (KMS_IS_PARSE_TREE_BIN (bin)) {
+    return "parse";
+  } else if (KMS_IS_DEC_TREE_BIN (bin)) {
+    return "decode";
+  } else if (KMS_IS_ENC_TREE_BIN (bin)) {
+    return "encode";
+  } else if (KMS_IS_RTP_PAY_TREE_BIN (bin)) {
+    return "rtppay";
+  }
+
+  return "unknown";
+}
+
+/* Factory names of the elements of @bin, from upstream to downstream */
+static gchar *
+kms_agnostic_bin2_get_bin_elements (GstBin * bin)
+{
+  GValue item = G_VALUE_INIT;
+  GList *names = NULL, *l;
+  gboolean done = FALSE;
+  GstIterator *it;
+  GString *elements;
+
+  it = gst_bin_iterate_sorted (bin);
+
+  while (!done) {
+    switch (gst_iterator_next (it, &item)) {
+      case GST_ITERATOR_OK:{
+        GstElementFactory *factory =
+            gst_element_get_factory (g_value_get_object (&item));
+
+        /* Sorted iteration goes from sinks to sources */
+        if (factory != NULL) {
+          names = g_list_prepend (names, (gpointer)
+              gst_plugin_feature_get_name (GST_PLUGIN_FEATURE (factory)));
+        }
+        g_value_reset (&item);
+        break;
+      }
+      case GST_ITERATOR_RESYNC:
+        g_list_free (names);
+        names = NULL;
+        gst_iterator_resync (it);
+        break;
+      default:
+        done = TRUE;
+        break;
+    }
+  }
+
+  g_value_unset (&item);
+  gst_iterator_free (it);
+
+  elements = g_string_new (NULL);
+  for (l = names; l != NULL; l = l->next) {
+    if (elements->len > 0) {
+      g_string_append (elements, " ! ");
+    }
+    g_string_append (elements, l->data);
+  }
+  g_list_free (names);
+
+  return g_string_free (elements, FALSE);
+}
+
+/*
+ * Keep track of a TreeBin created by this agnosticbin, @output_caps are the
+ * caps wanted by the output that required it
+ */
+static void
+kms_agnostic_bin2_record_bin (KmsAgnosticBin2 * self, GstBin * bin,
+    const GstCaps * input_caps, const GstCaps * output_caps)
+{
+  TranscodingRecord *record = g_slice_new0 (TranscodingRecord);
+
+  record->type = g_strdup (kms_agnostic_bin2_get_bin_type (bin));
+  record->input_caps = input_caps != NULL ?
+      gst_caps_to_string (input_caps) : g_strdup ("");
+  record->output_caps = output_caps != NULL ?
+      gst_caps_to_string (output_caps) : g_strdup ("");
+  record->elements = kms_agnostic_bin2_get_bin_elements (bin);
+  record->creation_time = g_get_real_time ();
+
+  GST_INFO_OBJECT (self, "Created %s TreeBin %" GST_PTR_FORMAT " (%s) for %s",
+      record->type, bin, record->elements, record->output_caps);
+
+  g_mutex_lock (&self->priv->transcodings_mutex);
+  g_hash_table_insert (self->priv->transcodings,
+      gst_object_get_name (GST_OBJECT (bin)), record);
+  g_mutex_unlock (&self->priv->transcodings_mutex);
+}
+
+static void
+kms_agnostic_bin2_record_bin_removed (KmsAgnosticBin2 * self,
+    const gchar * name)
+{
+  TranscodingRecord *record;
+  GSList *l;
+
+  g_mutex_lock (&self->priv->transcodings_mutex);
+
+  record = g_hash_table_lookup (self->priv->transcodings, name);
+  if (record == NULL || record->removal_time != 0) {
+    goto end;
+  }
+
+  /* Messages of its threads will not reach us once it is out of the bin */
+  for (l = record->threads; l != NULL; l = l->next) {
+    record->cpu_time += transcoding_thread_get_cpu_time (l->data);
+  }
+  g_slist_free_full (record->threads, transcoding_thread_free);
+  record->threads = NULL;
+  record->removal_time = g_get_real_time ();
+
+  g_queue_push_tail (&self->priv->removed_transcodings, g_strdup (name));
+
+  while (g_queue_get_length (&self->priv->removed_transcodings) >
+      MAX_REMOVED_TRANSCODINGS) {
+    gchar *old = g_queue_pop_head (&self->priv->removed_transcodings);
+
+    g_hash_table_remove (self->priv->transcodings, old);
+    g_free (old);
+  }
+
+end:
+  g_mutex_unlock (&self->priv->transcodings_mutex);
+}
+
+/* Child TreeBin of @self containing @object */
+static KmsTreeBin *
+kms_agnostic_bin2_get_child_tree_bin (KmsAgnosticBin2 * self,
+    GstObject * object)
+{
+  GstObject *parent;
+
+  gst_object_ref (object);
+
+  while ((parent = gst_object_get_parent (object)) != NULL) {
+    if (parent == GST_OBJECT (self)) {
+      gst_object_unref (parent);
+
+      if (KMS_IS_TREE_BIN (object)) {
+        return KMS_TREE_BIN (object);
+      }
+
+      break;
+    }
+
+    gst_object_unref (object);
+    object = parent;
+  }
+
+  gst_object_unref (object);
+
+  return NULL;
+}
+
+/*
+ * Stream status messages are posted synchronously from the streaming thread
+ * that enters or leaves, so its CPU clock can be taken here.
+ */
+static void
+kms_agnostic_bin2_account_stream_status (KmsAgnosticBin2 * self,
+    GstMessage * message)
+{
+  GstStreamStatusType type;
+  TranscodingRecord *record;
+  GstElement *owner;
+  KmsTreeBin *bin;
+
+  gst_message_parse_stream_status (message, &type, &owner);
+
+  if (type != GST_STREAM_STATUS_TYPE_ENTER
+      && type != GST_STREAM_STATUS_TYPE_LEAVE) {
+    return;
+  }
+
+  bin = kms_agnostic_bin2_get_child_tree_bin (self, GST_OBJECT (owner));
+  if (bin == NULL) {
+    return;
+  }
+
+  g_mutex_lock (&self->priv->transcodings_mutex);
+
+  record = g_hash_table_lookup (self->priv->transcodings,
+      GST_OBJECT_NAME (bin));
+  if (record == NULL || record->removal_time != 0) {
+    goto end;
+  }
+
+  if (type == GST_STREAM_STATUS_TYPE_ENTER) {
+    TranscodingThread *thread = g_slice_new (TranscodingThread);
+
+    thread->thread = pthread_self ();
+    if (pthread_getcpuclockid (thread->thread, &thread->clock) != 0) {
+      GST_WARNING_OBJECT (self, "Cannot get CPU clock of streaming thread");
+      transcoding_thread_free (thread);
+      goto end;
+    }
+
+    record->threads = g_slist_prepend (record->threads, thread);
+  } else {
+    GSList *l;
+
+    for (l = record->threads; l != NULL; l = l->next) {
+      TranscodingThread *thread = l->data;
+
+      if (pthread_equal (thread->thread, pthread_self ())) {
+        record->cpu_time += transcoding_thread_get_cpu_time (thread);
+        record->threads = g_slist_delete_link (record->threads, l);
+        transcoding_thread_free (thread);
+        break;
+      }
+    }
+  }
+
+end:
+  g_mutex_unlock (&self->priv->transcodings_mutex);
+  gst_object_unref (bin);
+}
+
+static GstStructure *
+kms_agnostic_bin2_get_transcoding_stats_structure (KmsAgnosticBin2 * self)
+{
+  GstStructure *stats = gst_structure_new_empty ("transcoding-stats");
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_mutex_lock (&self->priv->transcodings_mutex);
+
+  g_hash_table_iter_init (&iter, self->priv->transcodings);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    TranscodingRecord *record = value;
+    GstStructure *bin_stats;
+
+    bin_stats = gst_structure_new (key,
+        "type", G_TYPE_STRING, record->type,
+        "input-caps", G_TYPE_STRING, record->input_caps,
+        "output-caps", G_TYPE_STRING, record->output_caps,
+        "elements", G_TYPE_STRING, record->elements,
+        "creation-time", G_TYPE_INT64,
+        record->creation_time / G_TIME_SPAN_MILLISECOND,
+        "removal-time", G_TYPE_INT64,
+        record->removal_time / G_TIME_SPAN_MILLISECOND,
+        "cpu-time", G_TYPE_UINT64,
+        transcoding_record_get_cpu_time (record), NULL);
+    gst_structure_set (stats, key, GST_TYPE_STRUCTURE, bin_stats, NULL);
+    gst_structure_free (bin_stats);
+  }
+
+  g_mutex_unlock (&self->priv->transcodings_mutex);
+
+  return stats;
+}
+
+static void
+remove_fanout_pad_on_unlink (GstPad * pad, GstPad * peer,
+    KmsAgnosticBin2 * self)
+{
+  GstElement *fanout = gst_pad_get_parent_element (pad);
+  const gchar *key;
+
+  if (fanout == NULL) {
+    return;
+  }
+
+  KMS_AGNOSTIC_BIN2_LOCK (self);
+
+  gst_element_release_request_pad (fanout, pad);
+
+  key = g_object_get_qdata (G_OBJECT (fanout), fanout_data_quark ());
+
+  if (fanout->numsrcpads == 0 && key != NULL
+      && g_hash_table_lookup (self->priv->fanouts, key) == fanout) {
+    GST_DEBUG_OBJECT (self, "Removing unused %" GST_PTR_FORMAT, fanout);
+    g_hash_table_remove (self->priv->fanouts, key);
+    g_thread_pool_push (self->priv->remove_pool, g_object_ref (fanout), NULL);
+  }
+
+  KMS_AGNOSTIC_BIN2_UNLOCK (self);
+
+  g_object_unref (fanout);
+}
+
+/*
+ * Get the fan-out tee that feeds all encoded outputs attached to @tee from a
+ * single queue, so they share one streaming thread.
+ */
+static GstElement *
+kms_agnostic_bin2_get_fanout (KmsAgnosticBin2 * self, GstElement * tee)
+{
+  GstElement *queue, *fanout;
+
+  fanout = g_hash_table_lookup (self->priv->fanouts, GST_OBJECT_NAME (tee));
+  if (fanout != NULL) {
+    return fanout;
+  }
+
+  queue = kms_utils_element_factory_make ("queue", "agnosticbin");
+  fanout = kms_utils_element_factory_make ("tee", "agnosticbin");
+  /* A blocked output must not stall the TreeBin feeding the others */
+  g_object_set (queue, "leaky", 2, "max-size-time",
+      self->priv->latency_budget > 0 ?
+      self->priv->latency_budget * GST_MSECOND : LEAKY_TIME, NULL);
+  g_object_set (fanout, "allow-not-linked", TRUE, NULL);
+  g_object_set_qdata_full (G_OBJECT (fanout), fanout_data_quark (),
+      g_strdup (GST_OBJECT_NAME (tee)), g_free);
+
+  gst_bin_add_many (GST_BIN (self), queue, fanout, NULL);
+  gst_element_sync_state_with_parent (fanout);
+  gst_element_sync_state_with_parent (queue);
+  gst_element_link (queue, fanout);
+
+  if (gst_object_has_as_ancestor (GST_OBJECT (tee), GST_OBJECT (self))) {
+    link_element_to_tee (tee, queue);
+  } else {
+    remove_element_on_unlinked (queue, "src", "sink");
+    kms_agnostic_bin2_link_to_shared_tee (self, tee, queue, TRUE);
+  }
+
+  g_hash_table_insert (self->priv->fanouts, g_strdup (GST_OBJECT_NAME (tee)),
+      g_object_ref (fanout));
+
+  return fanout;
+}
+
+static void
+kms_agnostic_bin2_link_to_fanout (KmsAgnosticBin2 * self, GstPad * pad,
+    GstElement * tee)
+{
+  GstElement *fanout = kms_agnostic_bin2_get_fanout (self, tee);
+  GstPad *target = gst_element_get_request_pad (fanout, "src_%u");
+  GstProxyPad *proxy;
+
+  GST_DEBUG_OBJECT (self, "Linking %" GST_PTR_FORMAT " to %" GST_PTR_FORMAT,
+      pad, fanout);
+
+  g_signal_connect (target, "unlinked",
+      G_CALLBACK (remove_fanout_pad_on_unlink), self);
+
+  gst_ghost_pad_set_target (GST_GHOST_PAD (pad), target);
+
+  proxy = gst_proxy_pad_get_internal (GST_PROXY_PAD (pad));
+  gst_pad_set_query_function (GST_PAD_CAST (proxy),
+      proxy_src_pad_query_function);
+  g_object_unref (proxy);
+
+  g_object_unref (target);
+}
+
+static void
+kms_agnostic_bin2_link_to_tee (KmsAgnosticBin2 * self, GstPad * pad,
+    GstElement * tee, GstCaps * caps)
+{
+  GstElement *queue;
+  GstPad *target;
+  GstProxyPad *proxy;
+
+  if (self->priv->shared_output_queue && !gst_caps_is_any (caps)
+      && !gst_caps_is_empty (caps) && !kms_utils_caps_is_raw (caps)) {
+    kms_agnostic_bin2_link_to_fanout (self, pad, tee);
+    return;
+  }
+
+  queue = kms_utils_element_factory_make ("queue", "agnosticbin");
+  gst_bin_add (GST_BIN (self), queue);
+  gst_element_sync_state_with_parent (queue);
+
+  if (!(gst_caps_is_any (caps) || gst_caps_is_empty (caps))
+      && kms_utils_caps_is_raw (caps)) {
+    GstElement *convert = kms_utils_create_convert_for_caps (caps);
+    GstElement *rate = kms_utils_create_rate_for_caps (caps);
+    GstElement *mediator = kms_utils_create_mediator_element (caps);
+
+    g_object_set (queue, "leaky", 2, "max-size-time", LEAKY_TIME, NULL);
+
+    remove_element_on_unlinked (convert, "src", "sink");
+    if (rate) {
+      remove_element_on_unlinked (rate, "src", "sink");
+    }
+    remove_element_on_unlinked (mediator, "src", "sink");
+
+    if (rate) {
+      gst_bin_add (GST_BIN (self), rate);
+    }
+
+    gst_bin_add_many (GST_BIN (self), convert, mediator, NULL);
+
+    gst_element_sync_state_with_parent (mediator);
+    gst_element_sync_state_with_parent (convert);
+    if (rate) {
+      gst_element_sync_state_with_parent (rate);
+    }
+
+    if (rate) {
+      gst_element_link_many (queue, rate, mediator, NULL);
+    } else {
+      gst_element_link (queue, mediator);
+    }
+
+    gst_element_link_many (mediator, convert, NULL);
+    target = gst_element_get_static_pad (convert, "src");
+    kms_agnostic_bin2_watch_output_queue (self, pad, queue, FALSE);
+  } else {
+    target = gst_element_get_static_pad (queue, "src");
+    kms_agnostic_bin2_watch_output_queue (self, pad, queue,
+        !(gst_caps_is_any (caps) || gst_caps_is_empty (caps)));
+  }
+
+  gst_ghost_pad_set_target (GST_GHOST_PAD (pad), target);
+
+  proxy = gst_proxy_pad_get_internal (GST_PROXY_PAD (pad));
+  gst_pad_set_query_function (GST_PAD_CAST (proxy),
+      proxy_src_pad_query_function);
+  g_object_unref (proxy);
+
+  g_object_unref (target);
+  if (gst_object_has_as_ancestor (GST_OBJECT (tee), GST_OBJECT (self))) {
+    link_element_to_tee (tee, queue);
+  } else {
+    remove_element_on_unlinked (queue, "src", "sink");
+    kms_agnostic_bin2_link_to_shared_tee (self, tee, queue, TRUE);
+  }
+}
+
+static gboolean
+check_bin (KmsTreeBin * tree_bin, const GstCaps * caps)
+{
+  gboolean ret = FALSE;
+  GstElement *output_tee = kms_tree_bin_get_output_tee (tree_bin);
+  GstPad *tee_sink = gst_element_get_static_pad (output_tee, "sink");
+  GstCaps *current_caps = kms_tree_bin_get_input_caps (tree_bin);
+
+  GST_LOG_OBJECT (tree_bin,
+      "Check compatibility for bin: %" GST_PTR_FORMAT " ...", tree_bin);
+
+  if (current_caps == NULL) {
+    current_caps = gst_pad_get_allowed_caps (tee_sink);
+  }
+
+  GST_LOG_OBJECT (tree_bin, "TreeBin '%" GST_PTR_FORMAT "' caps: %"
+      GST_PTR_FORMAT, tree_bin, current_caps);
+
+  if (current_caps != NULL && gst_caps_get_size (current_caps) > 0) {
+    //TODO: Remove this when problem in negotiation with features will be
+    //resolved
+    GstCaps *caps_without_features = gst_caps_make_writable (current_caps);
+
+    gst_caps_set_features (caps_without_features, 0,
+        gst_caps_features_new_empty ());
+    if (gst_caps_can_intersect (caps, caps_without_features)) {
+      ret = TRUE;
+    }
+    gst_caps_unref (caps_without_features);
+  }
+
+  g_object_unref (tee_sink);
+
+  return ret;
+}
+
+/*
+ * Build a canonical key for the wanted caps. Caps features are ignored, as
+ * check_bin does, so that equivalent requests resolve to the same entry.
+ */
+static gchar *
+kms_agnostic_bin2_caps_index_key (const GstCaps * caps, guint rendition)
+{
+  GstCaps *normalized = gst_caps_copy (caps);
+  gchar *caps_str, *key;
+  guint i;
+
+  for (i = 0; i < gst_caps_get_size (normalized); i++) {
+    gst_caps_set_features (normalized, i, gst_caps_features_new_empty ());
+  }
+
+  caps_str = gst_caps_to_string (normalized);
+  gst_caps_unref (normalized);
+
+  if (rendition == 0) {
+    return caps_str;
+  }
+
+  key = g_strdup_printf ("%s|rendition=%u", caps_str, rendition);
+  g_free (caps_str);
+
+  return key;
+}
+
+static GstBin *
+kms_agnostic_bin2_caps_index_lookup (KmsAgnosticBin2 * self,
+    const gchar * key)
+{
+  CapsIndexEntry *entry;
+
+  entry = g_hash_table_lookup (self->priv->caps_index, key);
+  if (entry == NULL) {
+    return NULL;
+  }
+
+  if (kms_tree_bin_get_input_caps_generation (entry->bin) != entry->generation) {
+    GST_LOG_OBJECT (self, "Invalidating caps index entry for %s: input caps"
+        " of %" GST_PTR_FORMAT " changed", key, entry->bin);
+    g_hash_table_remove (self->priv->caps_index, key);
+    return NULL;
+  }
+
+  return GST_BIN_CAST (entry->bin);
+}
+
+static void
+kms_agnostic_bin2_caps_index_insert (KmsAgnosticBin2 * self, gchar * key,
+    GstBin * bin)
+{
+  CapsIndexEntry *entry = g_slice_new (CapsIndexEntry);
+
+  entry->bin = KMS_TREE_BIN (bin);
+  entry->generation = kms_tree_bin_get_input_caps_generation (entry->bin);
+
+  g_hash_table_insert (self->priv->caps_index, key, entry);
+}
+
+static void
+caps_index_entry_destroy (gpointer data)
+{
+  g_slice_free (CapsIndexEntry, data);
+}
+
+static guint
+kms_agnostic_bin2_get_bin_rendition (gpointer bin)
+{
+  if (KMS_IS_ENC_TREE_BIN (bin)) {
+    return kms_enc_tree_bin_get_rendition (KMS_ENC_TREE_BIN (bin));
+  }
+
+  return 0;
+}
+
+static void
+kms_agnostic_bin2_resume_bin (KmsAgnosticBin2 * self, GstBin * bin)
+{
+  if (kms_tree_bin_unpark (KMS_TREE_BIN (bin))) {
+    GST_DEBUG_OBJECT (self, "Reusing idle TreeBin %" GST_PTR_FORMAT, bin);
+    self->priv->idle_bin_reuses++;
+  }
+}
+
+static GstBin *
+kms_agnostic_bin2_find_bin_for_caps (KmsAgnosticBin2 * self, GstCaps * caps,
+    guint rendition)
+{
+  GList *bins, *l;
+  GstBin *bin = NULL;
+  gchar *key;
+
+  if (gst_caps_is_any (caps) || gst_caps_is_empty (caps)) {
+    return self->priv->input_bin;
+  }
+
+  key = kms_agnostic_bin2_caps_index_key (caps, rendition);
+  bin = kms_agnostic_bin2_caps_index_lookup (self, key);
+
+  if (bin != NULL) {
+    self->priv->caps_index_hits++;
+    GST_LOG_OBJECT (self, "Caps index hit for %s: %" GST_PTR_FORMAT, key, bin);
+    g_free (key);
+    kms_agnostic_bin2_resume_bin (self, bin);
+    return bin;
+  }
+
+  self->priv->caps_index_misses++;
+
+  if (rendition == 0 && check_bin (KMS_TREE_BIN (self->priv->input_bin), caps)) {
+    bin = self->priv->input_bin;
+  }
+
+  bins = g_hash_table_get_values (self->priv->bins);
+  for (l = bins; l != NULL && bin == NULL; l = l->next) {
+    KmsTreeBin *tree_bin = KMS_TREE_BIN (l->data);
+
+    if ((void *) tree_bin == (void *) self->priv->input_bin) {
+      // Skip: self->priv->input_bin has been already checked
+      continue;
+    }
+
+    if (kms_agnostic_bin2_get_bin_rendition (tree_bin) != rendition) {
+      continue;
+    }
+
+    if (check_bin (tree_bin, caps)) {
+      bin = GST_BIN_CAST (tree_bin);
+    }
+  }
+  g_list_free (bins);
+
+  if (bin != NULL) {
+    kms_agnostic_bin2_caps_index_insert (self, key, bin);
+    kms_agnostic_bin2_resume_bin (self, bin);
+  } else {
+    g_free (key);
+  }
+
+  return bin;
+}
+
+static GstCaps *
+kms_agnostic_bin2_get_raw_caps (const GstCaps * caps)
+{
+  GstCaps *raw_caps = NULL;
+
+  if (kms_utils_caps_is_audio (caps)) {
+    raw_caps = gst_static_caps_get (&static_raw_audio_caps);
+  } else if (kms_utils_caps_is_video (caps)) {
+    raw_caps = gst_static_caps_get (&static_raw_video_caps);
+  }
+
+  return raw_caps;
+}
+
+static GstBin *
+kms_agnostic_bin2_create_dec_bin (KmsAgnosticBin2 * self,
+    const GstCaps * raw_caps)
+{
+  KmsDecTreeBin *dec_bin;
+  GstElement *output_tee, *input_element;
+  GstCaps *caps = self->priv->input_bin_src_caps;
+
+  if (caps == NULL || raw_caps == NULL) {
+    return NULL;
+  }
+
+  dec_bin = kms_dec_tree_bin_new (caps, raw_caps);
+  if (dec_bin == NULL) {
+    return NULL;
+  }
+
+  kms_agnostic_bin2_record_bin (self, GST_BIN (dec_bin), caps, raw_caps);
+
+  gst_bin_add (GST_BIN (self), GST_ELEMENT (dec_bin));
+  gst_element_sync_state_with_parent (GST_ELEMENT (dec_bin));
+
+  output_tee =
+      kms_tree_bin_get_output_tee (KMS_TREE_BIN (self->priv->input_bin));
+  input_element = kms_tree_bin_get_input_element (KMS_TREE_BIN (dec_bin));
+  kms_agnostic_bin2_link_tree_bin (self, output_tee, input_element);
+
+  return GST_BIN (dec_bin);
+}
+
+/*
+ * Path of the element producing the media that enters @self, found by
+ * following the ghost pads of the bins containing the agnosticbin. Elements
+ * downstream of a filter keep the stream id of the source, so it cannot be
+ * used to tell apart the media of two filters fed by the same source.
+ */
+static gchar *
+kms_agnostic_bin2_get_upstream_path (KmsAgnosticBin2 * self)
+{
+  GstPad *pad = gst_object_ref (self->priv->sink), *peer;
+  GstObject *parent;
+  gchar *path = NULL;
+
+  while ((peer = gst_pad_get_peer (pad)) != NULL) {
+    gst_object_unref (pad);
+    parent = gst_object_get_parent (GST_OBJECT (peer));
+
+    if (parent != NULL && GST_IS_PROXY_PAD (peer) && GST_IS_GHOST_PAD (parent)) {
+      /* Internal pad of the sink of a bin containing us, go on upstream */
+      gst_object_unref (peer);
+      pad = GST_PAD (parent);
+      continue;
+    }
+
+    if (parent != NULL) {
+      path = gst_object_get_path_string (parent);
+      gst_object_unref (parent);
+    }
+
+    gst_object_unref (peer);
+    return path;
+  }
+
+  gst_object_unref (pad);
+
+  return NULL;
+}
+
+/*
+ * Key identifying the media produced by a TreeBin in the pipeline-wide
+ * registry: the upstream element feeding the agnosticbin plus the input and
+ * output caps.
+ */
+static gchar *
+kms_agnostic_bin2_get_shared_key (KmsAgnosticBin2 * self, const gchar * type,
+    const GstCaps * caps, const gchar * params)
+{
+  gchar *upstream, *input_caps_str, *caps_str, *key;
+
+  if (!self->priv->share_transcoders || self->priv->input_bin_src_caps == NULL) {
+    return NULL;
+  }
+
+  upstream = kms_agnostic_bin2_get_upstream_path (self);
+  if (upstream == NULL) {
+    return NULL;
+  }
+
+  input_caps_str = gst_caps_to_string (self->priv->input_bin_src_caps);
+  caps_str = gst_caps_to_string (caps);
+  key = g_strdup_printf ("%s|%s|%s|%s|%s", type, upstream, input_caps_str,
+      caps_str, params != NULL ? params : "");
+
+  g_free (caps_str);
+  g_free (input_caps_str);
+  g_free (upstream);
+
+  return key;
+}
+
+/*
+ * Rendition @i of the ladder carries a quarter of the pixels of rendition
+ * @i - 1, but it is given half of its target bitrate: smaller frames need
+ * more bits per pixel for the same quality. Rendition 0 keeps the configured
+ * target.
+ */
+static gint
+kms_agnostic_bin2_get_rendition_target (KmsAgnosticBin2 * self,
+    guint rendition)
+{
+  return self->priv->target_encoder_bitrate >> rendition;
+}
+
+/* Lowest estimation a rendition is kept for */
+static gint
+kms_agnostic_bin2_get_rendition_threshold (KmsAgnosticBin2 * self,
+    guint rendition)
+{
+  return kms_agnostic_bin2_get_rendition_target (self, rendition) / 2;
+}
+
+static gint
+kms_agnostic_bin2_get_rendition_max_bitrate (KmsAgnosticBin2 * self,
+    guint rendition)
+{
+  if (rendition == 0) {
+    return self->priv->max_encoder_bitrate;
   }
-  g_list_free (bins);
 
-  return bin;
+  return MIN (self->priv->max_encoder_bitrate,
+      kms_agnostic_bin2_get_rendition_target (self, rendition));
 }
 
-static GstCaps *
-kms_agnostic_bin2_get_raw_caps (const GstCaps * caps)
+static gint
+kms_agnostic_bin2_get_rendition_min_bitrate (KmsAgnosticBin2 * self,
+    guint rendition)
 {
-  GstCaps *raw_caps = NULL;
+  return MIN (self->priv->min_encoder_bitrate,
+      kms_agnostic_bin2_get_rendition_max_bitrate (self, rendition));
+}
 
-  if (kms_utils_caps_is_audio (caps)) {
-    raw_caps = gst_static_caps_get (&static_raw_audio_caps);
-  } else if (kms_utils_caps_is_video (caps)) {
-    raw_caps = gst_static_caps_get (&static_raw_video_caps);
+static void
+kms_agnostic_bin2_set_consumer_bitrate_limits (KmsAgnosticBin2 * self,
+    KmsEncTreeBin * enc_bin)
+{
+  guint rendition = kms_enc_tree_bin_get_rendition (enc_bin);
+
+  kms_enc_tree_bin_set_consumer_bitrate_limits (enc_bin, self,
+      kms_agnostic_bin2_get_rendition_min_bitrate (self, rendition),
+      kms_agnostic_bin2_get_rendition_max_bitrate (self, rendition));
+}
+
+static gchar *
+kms_agnostic_bin2_get_enc_shared_key (KmsAgnosticBin2 * self,
+    const GstCaps * caps, guint rendition)
+{
+  gchar *config_str = NULL, *params, *key;
+
+  if (self->priv->codec_config != NULL) {
+    config_str = gst_structure_to_string (self->priv->codec_config);
   }
 
-  return raw_caps;
+  params = g_strdup_printf ("%s|%d|%d|%d|%u",
+      config_str != NULL ? config_str : "",
+      self->priv->target_encoder_bitrate / SHARED_BITRATE_BUCKET,
+      self->priv->min_encoder_bitrate, self->priv->max_encoder_bitrate,
+      rendition);
+  key = kms_agnostic_bin2_get_shared_key (self, "enc", caps, params);
+
+  g_free (params);
+  g_free (config_str);
+
+  return key;
 }
 
 static GstBin *
-kms_agnostic_bin2_create_dec_bin (KmsAgnosticBin2 * self,
-    const GstCaps * raw_caps)
+kms_agnostic_bin2_get_shared_bin (KmsAgnosticBin2 * self, const gchar * key)
 {
-  KmsDecTreeBin *dec_bin;
-  GstElement *output_tee, *input_element;
-  GstCaps *caps = self->priv->input_bin_src_caps;
+  KmsTreeBin *bin;
 
-  if (caps == NULL || raw_caps == NULL) {
+  if (key == NULL) {
     return NULL;
   }
 
-  dec_bin = kms_dec_tree_bin_new (caps, raw_caps);
-  if (dec_bin == NULL) {
+  bin = kms_tree_bin_get_shared (GST_ELEMENT (self), key);
+  if (bin == NULL) {
     return NULL;
   }
 
-  gst_bin_add (GST_BIN (self), GST_ELEMENT (dec_bin));
-  gst_element_sync_state_with_parent (GST_ELEMENT (dec_bin));
-
-  output_tee =
-      kms_tree_bin_get_output_tee (KMS_TREE_BIN (self->priv->input_bin));
-  input_element = kms_tree_bin_get_input_element (KMS_TREE_BIN (dec_bin));
-  gst_element_link (output_tee, input_element);
+  GST_DEBUG_OBJECT (self, "Reusing TreeBin %" GST_PTR_FORMAT, bin);
+  kms_agnostic_bin2_insert_bin (self, GST_BIN (bin));
+  kms_agnostic_bin2_resume_bin (self, GST_BIN (bin));
+  g_object_unref (bin);
 
-  return GST_BIN (dec_bin);
+  return GST_BIN (bin);
 }
 
 static GstBin *
@@ -600,16 +1908,28 @@ kms_agnostic_bin2_get_or_create_dec_bin (KmsAgnosticBin2 * self, GstCaps * caps)
 
   if (raw_caps != NULL) {
     GstBin *dec_bin;
+    gchar *key;
 
     GST_LOG ("Raw caps: %" GST_PTR_FORMAT, raw_caps);
-    dec_bin = kms_agnostic_bin2_find_bin_for_caps (self, raw_caps);
+    dec_bin = kms_agnostic_bin2_find_bin_for_caps (self, raw_caps, 0);
 
     if (dec_bin == NULL) {
-      dec_bin = kms_agnostic_bin2_create_dec_bin (self, raw_caps);
-
-      if (dec_bin != NULL) {
-        kms_agnostic_bin2_insert_bin (self, dec_bin);
+      key = kms_agnostic_bin2_get_shared_key (self, "dec", raw_caps, NULL);
+      dec_bin = kms_agnostic_bin2_get_shared_bin (self, key);
+
+      if (dec_bin == NULL) {
+        dec_bin = kms_agnostic_bin2_create_dec_bin (self, raw_caps);
+
+        if (dec_bin != NULL) {
+          kms_agnostic_bin2_insert_bin (self, dec_bin);
+          if (key != NULL) {
+            kms_tree_bin_set_shared (KMS_TREE_BIN (dec_bin), GST_ELEMENT (self),
+                key);
+          }
+        }
       }
+
+      g_free (key);
     }
 
     gst_caps_unref (raw_caps);
@@ -645,29 +1965,49 @@ kms_agnostic_bin2_create_rtp_pay_bin (KmsAgnosticBin2 * self, GstCaps * caps)
   input_caps = gst_pad_query_caps (sink, NULL);
   g_object_unref (sink);
 
-  enc_bin = kms_agnostic_bin2_find_or_create_bin_for_caps (self, input_caps);
+  kms_agnostic_bin2_record_bin (self, GST_BIN (bin), input_caps, caps);
+
+  enc_bin = kms_agnostic_bin2_find_or_create_bin_for_caps (self, input_caps,
+      0);
   kms_agnostic_bin2_insert_bin (self, GST_BIN (bin));
   gst_caps_unref (input_caps);
 
   output_tee = kms_tree_bin_get_output_tee (KMS_TREE_BIN (enc_bin));
-  gst_element_link (output_tee, input_element);
+  kms_agnostic_bin2_link_tree_bin (self, output_tee, input_element);
 
   return GST_BIN (bin);
 }
 
 static GstBin *
-kms_agnostic_bin2_create_bin_for_caps (KmsAgnosticBin2 * self, GstCaps * caps)
+kms_agnostic_bin2_create_bin_for_caps (KmsAgnosticBin2 * self, GstCaps * caps,
+    guint rendition)
 {
-  GstBin *dec_bin;
+  GstBin *dec_bin, *shared_bin;
   KmsEncTreeBin *enc_bin;
   GstElement *input_element, *output_tee;
+  GstCaps *raw_caps;
+  gchar *key = NULL;
 
   if (kms_utils_caps_is_rtp (caps)) {
     return kms_agnostic_bin2_create_rtp_pay_bin (self, caps);
   }
 
+  if (!kms_utils_caps_is_raw (caps)) {
+    /* Another agnosticbin may be already encoding this stream to @caps */
+    key = kms_agnostic_bin2_get_enc_shared_key (self, caps, rendition);
+    shared_bin = kms_agnostic_bin2_get_shared_bin (self, key);
+
+    if (shared_bin != NULL) {
+      g_free (key);
+      kms_agnostic_bin2_set_consumer_bitrate_limits (self,
+          KMS_ENC_TREE_BIN (shared_bin));
+      return shared_bin;
+    }
+  }
+
   dec_bin = kms_agnostic_bin2_get_or_create_dec_bin (self, caps);
   if (dec_bin == NULL) {
+    g_free (key);
     return NULL;
   }
 
@@ -675,20 +2015,40 @@ kms_agnostic_bin2_create_bin_for_caps (KmsAgnosticBin2 * self, GstCaps * caps)
     return dec_bin;
   }
 
-  enc_bin = kms_enc_tree_bin_new (caps, self->priv->target_encoder_bitrate,
-      self->priv->min_encoder_bitrate, self->priv->max_encoder_bitrate,
-      self->priv->codec_config);
+  enc_bin = kms_enc_tree_bin_new_full (caps,
+      kms_agnostic_bin2_get_rendition_target (self, rendition),
+      kms_agnostic_bin2_get_rendition_min_bitrate (self, rendition),
+      kms_agnostic_bin2_get_rendition_max_bitrate (self, rendition),
+      self->priv->codec_config, rendition);
 
   if (enc_bin == NULL) {
+    g_free (key);
     return NULL;
   }
 
+  raw_caps = kms_agnostic_bin2_get_raw_caps (caps);
+  kms_agnostic_bin2_record_bin (self, GST_BIN (enc_bin), raw_caps, caps);
+  if (raw_caps != NULL) {
+    gst_caps_unref (raw_caps);
+  }
+
+  if (self->priv->latency_budget > 0) {
+    kms_enc_tree_bin_set_latency_budget (enc_bin,
+        kms_agnostic_bin2_get_latency_budget (self));
+  }
+
+  if (key != NULL) {
+    kms_agnostic_bin2_set_consumer_bitrate_limits (self, enc_bin);
+    kms_tree_bin_set_shared (KMS_TREE_BIN (enc_bin), GST_ELEMENT (self), key);
+    g_free (key);
+  }
+
   gst_bin_add (GST_BIN (self), GST_ELEMENT (enc_bin));
   gst_element_sync_state_with_parent (GST_ELEMENT (enc_bin));
 
   output_tee = kms_tree_bin_get_output_tee (KMS_TREE_BIN (dec_bin));
   input_element = kms_tree_bin_get_input_element (KMS_TREE_BIN (enc_bin));
-  gst_element_link (output_tee, input_element);
+  kms_agnostic_bin2_link_tree_bin (self, output_tee, input_element);
 
   kms_agnostic_bin2_insert_bin (self, GST_BIN (enc_bin));
 
@@ -697,7 +2057,7 @@ kms_agnostic_bin2_create_bin_for_caps (KmsAgnosticBin2 * self, GstCaps * caps)
 
 static GstBin *
 kms_agnostic_bin2_find_or_create_bin_for_caps (KmsAgnosticBin2 * self,
-    GstCaps * caps)
+    GstCaps * caps, guint rendition)
 {
   GstBin *bin;
   KmsMediaType type;
@@ -712,15 +2072,22 @@ kms_agnostic_bin2_find_or_create_bin_for_caps (KmsAgnosticBin2 * self,
     media_type = g_strdup ("video");
   }
 
-  GST_LOG_OBJECT (self, "Find TreeBin with wanted caps: %" GST_PTR_FORMAT, caps);
+  /* Only encoded video outputs can be served from a lower rendition */
+  if (type != KMS_MEDIA_TYPE_VIDEO || kms_utils_caps_is_raw (caps)
+      || kms_utils_caps_is_rtp (caps)) {
+    rendition = 0;
+  }
+
+  GST_LOG_OBJECT (self, "Find TreeBin with wanted caps: %" GST_PTR_FORMAT
+      ", rendition: %u", caps, rendition);
 
-  bin = kms_agnostic_bin2_find_bin_for_caps (self, caps);
+  bin = kms_agnostic_bin2_find_bin_for_caps (self, caps, rendition);
 
   if (bin == NULL) {
     GST_LOG_OBJECT (self, "TreeBin not found! Transcoding required for %s",
         media_type);
 
-    bin = kms_agnostic_bin2_create_bin_for_caps (self, caps);
+    bin = kms_agnostic_bin2_create_bin_for_caps (self, caps, rendition);
     GST_TRACE_OBJECT (self, "Created TreeBin: %" GST_PTR_FORMAT, bin);
 
     if (!self->priv->transcoding_emitted) {
@@ -766,6 +2133,7 @@ kms_agnostic_bin2_link_pad (KmsAgnosticBin2 * self, GstPad * pad, GstPad * peer)
 {
   GstCaps *pad_caps, *peer_caps;
   GstBin *bin;
+  guint rendition;
 
   GST_TRACE_OBJECT (self, "Linking: %" GST_PTR_FORMAT
       " to %" GST_PTR_FORMAT, pad, peer);
@@ -783,7 +2151,10 @@ kms_agnostic_bin2_link_pad (KmsAgnosticBin2 * self, GstPad * pad, GstPad * peer)
 
   GST_DEBUG_OBJECT (self, "Downstream wanted caps: %" GST_PTR_FORMAT, peer_caps);
 
-  bin = kms_agnostic_bin2_find_or_create_bin_for_caps (self, peer_caps);
+  rendition = GPOINTER_TO_UINT (g_object_get_qdata (G_OBJECT (pad),
+          rendition_data_quark ()));
+  bin = kms_agnostic_bin2_find_or_create_bin_for_caps (self, peer_caps,
+      rendition);
 
   if (bin != NULL) {
     GstElement *tee = kms_tree_bin_get_output_tee (KMS_TREE_BIN (bin));
@@ -912,11 +2283,166 @@ input_bin_src_caps_probe (GstPad * pad, GstPadProbeInfo * info, gpointer bin)
 static void
 remove_bin (gpointer key, gpointer value, gpointer agnosticbin)
 {
+  if (GST_OBJECT_PARENT (value) != GST_OBJECT (agnosticbin)) {
+    /* TreeBin shared by another agnosticbin, its owner will remove it */
+    GST_TRACE_OBJECT (agnosticbin, "Releasing %" GST_PTR_FORMAT, value);
+
+    if (KMS_IS_ENC_TREE_BIN (value)) {
+      kms_enc_tree_bin_remove_consumer (KMS_ENC_TREE_BIN (value), agnosticbin);
+    }
+
+    return;
+  }
+
+  kms_tree_bin_unset_shared (KMS_TREE_BIN (value));
+  unlink_from_shared_tee (kms_tree_bin_get_input_element (KMS_TREE_BIN
+          (value)));
+  kms_agnostic_bin2_record_bin_removed (KMS_AGNOSTIC_BIN2 (agnosticbin),
+      GST_OBJECT_NAME (value));
+
   GST_TRACE_OBJECT (agnosticbin, "Removing %" GST_PTR_FORMAT, value);
   gst_bin_remove (GST_BIN (agnosticbin), value);
   gst_element_set_state (value, GST_STATE_NULL);
 }
 
+static gboolean
+remove_non_input_bin (gpointer key, gpointer value, gpointer agnosticbin)
+{
+  KmsAgnosticBin2 *self = KMS_AGNOSTIC_BIN2 (agnosticbin);
+
+  if (value == (gpointer) self->priv->input_bin) {
+    return FALSE;
+  }
+
+  remove_bin (key, value, agnosticbin);
+
+  return TRUE;
+}
+
+static void
+unshare_bin (gpointer key, gpointer value, gpointer agnosticbin)
+{
+  if (GST_OBJECT_PARENT (value) == GST_OBJECT (agnosticbin)) {
+    kms_tree_bin_unset_shared (KMS_TREE_BIN (value));
+  }
+}
+
+typedef struct _ParkData
+{
+  GWeakRef self;
+  gchar *bin_name;
+  guint park_id;
+  guint timer_id;
+} ParkData;
+
+static void
+park_data_destroy (gpointer data)
+{
+  ParkData *park_data = data;
+
+  g_weak_ref_clear (&park_data->self);
+  g_free (park_data->bin_name);
+  g_slice_free (ParkData, park_data);
+}
+
+static void
+remove_park_timer (gpointer key, gpointer id, gpointer agnosticbin)
+{
+  kms_loop_remove (KMS_AGNOSTIC_BIN2_GET_CLASS (agnosticbin)->loop,
+      GPOINTER_TO_UINT (id));
+}
+
+static gboolean
+park_timeout_cb (gpointer user_data)
+{
+  ParkData *data = user_data;
+  KmsAgnosticBin2 *self = g_weak_ref_get (&data->self);
+  KmsTreeBin *bin;
+
+  if (self == NULL) {
+    return G_SOURCE_REMOVE;
+  }
+
+  KMS_AGNOSTIC_BIN2_LOCK (self);
+
+  if (GPOINTER_TO_UINT (g_hash_table_lookup (self->priv->park_timers,
+              data->bin_name)) == data->timer_id) {
+    g_hash_table_remove (self->priv->park_timers, data->bin_name);
+  }
+
+  bin = g_hash_table_lookup (self->priv->bins, data->bin_name);
+
+  if (bin == NULL || kms_tree_bin_get_park_id (bin) != data->park_id) {
+    /* Removed or reused meanwhile */
+    goto end;
+  }
+
+  if (kms_tree_bin_get_consumer_count (bin) > 0) {
+    kms_agnostic_bin2_resume_bin (self, GST_BIN (bin));
+    goto end;
+  }
+
+  GST_DEBUG_OBJECT (self, "Removing idle TreeBin %" GST_PTR_FORMAT, bin);
+  self->priv->idle_bin_teardowns++;
+
+  g_hash_table_remove_all (self->priv->caps_index);
+  g_object_ref (bin);
+  g_hash_table_remove (self->priv->bins, data->bin_name);
+  remove_bin (data->bin_name, bin, self);
+  g_object_unref (bin);
+
+end:
+  KMS_AGNOSTIC_BIN2_UNLOCK (self);
+  g_object_unref (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Stop a TreeBin without consumers and schedule its removal. It is resumed
+ * if a new consumer needs it before the idle timeout expires. The removal
+ * runs in the loop of the class, as it changes the state of the TreeBin.
+ */
+static void
+kms_agnostic_bin2_park_bin (KmsAgnosticBin2 * self, KmsTreeBin * bin)
+{
+  KmsLoop *loop = KMS_AGNOSTIC_BIN2_GET_CLASS (self)->loop;
+  ParkData *data;
+  gpointer old_timer;
+
+  KMS_AGNOSTIC_BIN2_LOCK (self);
+
+  if (self->priv->idle_bin_timeout == 0
+      || (gpointer) bin == (gpointer) self->priv->input_bin
+      || g_hash_table_lookup (self->priv->bins, GST_OBJECT_NAME (bin)) != bin
+      || kms_tree_bin_get_consumer_count (bin) > 0) {
+    goto end;
+  }
+
+  data = g_slice_new0 (ParkData);
+  g_weak_ref_init (&data->self, self);
+  data->bin_name = gst_object_get_name (GST_OBJECT (bin));
+  data->park_id = kms_tree_bin_park (bin);
+
+  GST_DEBUG_OBJECT (self, "Parking idle TreeBin %" GST_PTR_FORMAT
+      " for %u ms", bin, self->priv->idle_bin_timeout);
+
+  /* A timer left from a previous parking would find a stale park id */
+  old_timer = g_hash_table_lookup (self->priv->park_timers, data->bin_name);
+  if (old_timer != NULL) {
+    remove_park_timer (NULL, old_timer, self);
+  }
+
+  /* The callback takes our lock, so it cannot see the id before it is set */
+  data->timer_id = kms_loop_timeout_add_full (loop, G_PRIORITY_DEFAULT,
+      self->priv->idle_bin_timeout, park_timeout_cb, data, park_data_destroy);
+  g_hash_table_insert (self->priv->park_timers, g_strdup (data->bin_name),
+      GUINT_TO_POINTER (data->timer_id));
+
+end:
+  KMS_AGNOSTIC_BIN2_UNLOCK (self);
+}
+
 static void
 kms_agnostic_bin2_configure_input (KmsAgnosticBin2 * self, const GstCaps * caps)
 {
@@ -934,6 +2460,7 @@ kms_agnostic_bin2_configure_input (KmsAgnosticBin2 * self, const GstCaps * caps)
 
   parse_bin = kms_parse_tree_bin_new (caps);
   self->priv->input_bin = GST_BIN (parse_bin);
+  kms_agnostic_bin2_record_bin (self, GST_BIN (parse_bin), caps, NULL);
 
   parser = kms_parse_tree_bin_get_parser (KMS_PARSE_TREE_BIN (parse_bin));
   parser_src = gst_element_get_static_pad (parser, "src");
@@ -950,6 +2477,7 @@ kms_agnostic_bin2_configure_input (KmsAgnosticBin2 * self, const GstCaps * caps)
   self->priv->started = FALSE;
 
   GST_TRACE_OBJECT (self, "Removing old treebins");
+  g_hash_table_remove_all (self->priv->caps_index);
   g_hash_table_foreach (self->priv->bins, remove_bin, self);
   g_hash_table_remove_all (self->priv->bins);
 
@@ -1025,6 +2553,107 @@ kms_agnostic_bin2_sink_caps_probe (GstPad * pad, GstPadProbeInfo * info,
   return GST_PAD_PROBE_OK;
 }
 
+static guint
+kms_agnostic_bin2_select_rendition (KmsAgnosticBin2 * self, guint bitrate,
+    guint current)
+{
+  guint i;
+
+  for (i = 0; i < self->priv->ladder_renditions; i++) {
+    guint64 threshold = kms_agnostic_bin2_get_rendition_threshold (self, i);
+
+    /* Require some headroom before moving up to avoid flapping */
+    if (i < current) {
+      threshold += threshold * LADDER_HYSTERESIS_PERCENT / 100;
+    }
+
+    if (bitrate >= threshold) {
+      return i;
+    }
+  }
+
+  return self->priv->ladder_renditions - 1;
+}
+
+/*
+ * Switching renditions relinks the pad, which cannot be done from the
+ * streaming thread delivering the REMB event.
+ */
+static void
+kms_agnostic_bin2_switch_rendition_async (gpointer data, gpointer user_data)
+{
+  GstPad *pad = data;
+  KmsAgnosticBin2 *self;
+  GstElement *parent;
+  guint current, rendition;
+
+  parent = gst_pad_get_parent_element (pad);
+  if (parent == NULL) {
+    goto end;
+  }
+
+  self = KMS_AGNOSTIC_BIN2 (parent);
+
+  KMS_AGNOSTIC_BIN2_LOCK (self);
+
+  current = GPOINTER_TO_UINT (g_object_get_qdata (G_OBJECT (pad),
+          rendition_data_quark ()));
+  rendition = GPOINTER_TO_UINT (g_object_get_qdata (G_OBJECT (pad),
+          target_rendition_data_quark ()));
+
+  if (rendition != current) {
+    GST_DEBUG_OBJECT (pad, "Switching rendition %u -> %u", current,
+        rendition);
+
+    g_object_set_qdata (G_OBJECT (pad), rendition_data_quark (),
+        GUINT_TO_POINTER (rendition));
+    remove_target_pad (pad);
+    kms_agnostic_bin2_process_pad (self, pad);
+  }
+
+  KMS_AGNOSTIC_BIN2_UNLOCK (self);
+
+  gst_object_unref (parent);
+
+end:
+  g_object_unref (pad);
+}
+
+static void
+kms_agnostic_bin2_src_check_rendition (KmsAgnosticBin2 * self, GstPad * pad,
+    GstEvent * event)
+{
+  guint bitrate, ssrc, target, rendition;
+
+  if (!kms_utils_remb_event_upstream_parse (event, &bitrate, &ssrc)) {
+    return;
+  }
+
+  KMS_AGNOSTIC_BIN2_LOCK (self);
+
+  if (self->priv->ladder_renditions <= 1) {
+    goto end;
+  }
+
+  target = GPOINTER_TO_UINT (g_object_get_qdata (G_OBJECT (pad),
+          target_rendition_data_quark ()));
+  rendition = kms_agnostic_bin2_select_rendition (self, bitrate, target);
+
+  if (rendition == target) {
+    goto end;
+  }
+
+  GST_DEBUG_OBJECT (pad, "Rendition %u selected (bitrate: %u)", rendition,
+      bitrate);
+
+  g_object_set_qdata (G_OBJECT (pad), target_rendition_data_quark (),
+      GUINT_TO_POINTER (rendition));
+  g_thread_pool_push (self->priv->rendition_pool, g_object_ref (pad), NULL);
+
+end:
+  KMS_AGNOSTIC_BIN2_UNLOCK (self);
+}
+
 static GstPadProbeReturn
 kms_agnostic_bin2_src_reconfigure_probe (GstPad * pad, GstPadProbeInfo * info,
     gpointer user_data)
@@ -1049,6 +2678,8 @@ kms_agnostic_bin2_src_reconfigure_probe (GstPad * pad, GstPadProbeInfo * info,
       GST_OBJECT_FLAG_SET (pad, KMS_AGNOSTIC_PAD_STARTED);
       kms_agnostic_bin2_process_pad (self, pad);
       KMS_AGNOSTIC_BIN2_UNLOCK (self);
+    } else if (kms_utils_is_remb_event_upstream (event)) {
+      kms_agnostic_bin2_src_check_rendition (self, pad, event);
     }
   }
 
@@ -1105,6 +2736,12 @@ kms_agnostic_bin2_request_new_pad (GstElement * element,
 static void
 kms_agnostic_bin2_release_pad (GstElement * element, GstPad * pad)
 {
+  KmsAgnosticBin2 *self = KMS_AGNOSTIC_BIN2 (element);
+
+  KMS_AGNOSTIC_BIN2_LOCK (self);
+  g_hash_table_remove (self->priv->output_stats, GST_OBJECT_NAME (pad));
+  KMS_AGNOSTIC_BIN2_UNLOCK (self);
+
   gst_element_remove_pad (element, pad);
 }
 
@@ -1116,7 +2753,12 @@ kms_agnostic_bin2_dispose (GObject * object)
   GST_LOG_OBJECT (object, "dispose");
 
   KMS_AGNOSTIC_BIN2_LOCK (self);
+  self->priv->idle_bin_timeout = 0;
+  g_hash_table_foreach (self->priv->park_timers, remove_park_timer, self);
+  g_hash_table_remove_all (self->priv->park_timers);
+  g_hash_table_foreach (self->priv->bins, unshare_bin, self);
   g_thread_pool_free (self->priv->remove_pool, FALSE, FALSE);
+  g_thread_pool_free (self->priv->rendition_pool, FALSE, FALSE);
 
   if (self->priv->input_bin_src_caps) {
     gst_caps_unref (self->priv->input_bin_src_caps);
@@ -1147,13 +2789,23 @@ kms_agnostic_bin2_finalize (GObject * object)
   GST_LOG_OBJECT (object, "finalize");
 
   g_rec_mutex_clear (&self->priv->thread_mutex);
+  g_mutex_clear (&self->priv->transcodings_mutex);
 
+  g_queue_foreach (&self->priv->removed_transcodings, (GFunc) g_free, NULL);
+  g_queue_clear (&self->priv->removed_transcodings);
+  g_hash_table_unref (self->priv->transcodings);
+
+  g_hash_table_unref (self->priv->park_timers);
+  g_hash_table_unref (self->priv->fanouts);
+  g_hash_table_unref (self->priv->output_stats);
+  g_hash_table_unref (self->priv->caps_index);
   g_hash_table_unref (self->priv->bins);
 
   /* chain up */
   G_OBJECT_CLASS (kms_agnostic_bin2_parent_class)->finalize (object);
 }
 
+/* Encoders shared with other agnosticbins also get their limits */
 static void
 kms_agnostic_bin_set_encoders_bitrate (KmsAgnosticBin2 * self)
 {
@@ -1162,10 +2814,12 @@ kms_agnostic_bin_set_encoders_bitrate (KmsAgnosticBin2 * self)
   bins = g_hash_table_get_values (self->priv->bins);
   for (l = bins; l != NULL; l = l->next) {
     if (KMS_IS_ENC_TREE_BIN (l->data)) {
-      kms_enc_tree_bin_set_bitrate_limits (KMS_ENC_TREE_BIN (l->data),
-          self->priv->min_encoder_bitrate, self->priv->max_encoder_bitrate);
+      kms_agnostic_bin2_set_consumer_bitrate_limits (self,
+          KMS_ENC_TREE_BIN (l->data));
     }
   }
+
+  g_list_free (bins);
 }
 
 void
@@ -1235,6 +2889,31 @@ kms_agnostic_bin2_set_property (GObject * object, guint property_id,
       self->priv->codec_config = g_value_dup_boxed (value);
       KMS_AGNOSTIC_BIN2_UNLOCK (self);
       break;
+    case PROP_SHARE_TRANSCODERS:
+      KMS_AGNOSTIC_BIN2_LOCK (self);
+      self->priv->share_transcoders = g_value_get_boolean (value);
+      KMS_AGNOSTIC_BIN2_UNLOCK (self);
+      break;
+    case PROP_LADDER_RENDITIONS:
+      KMS_AGNOSTIC_BIN2_LOCK (self);
+      self->priv->ladder_renditions = g_value_get_uint (value);
+      KMS_AGNOSTIC_BIN2_UNLOCK (self);
+      break;
+    case PROP_IDLE_BIN_TIMEOUT:
+      KMS_AGNOSTIC_BIN2_LOCK (self);
+      self->priv->idle_bin_timeout = g_value_get_uint (value);
+      KMS_AGNOSTIC_BIN2_UNLOCK (self);
+      break;
+    case PROP_SHARED_OUTPUT_QUEUE:
+      KMS_AGNOSTIC_BIN2_LOCK (self);
+      self->priv->shared_output_queue = g_value_get_boolean (value);
+      KMS_AGNOSTIC_BIN2_UNLOCK (self);
+      break;
+    case PROP_LATENCY_BUDGET:
+      KMS_AGNOSTIC_BIN2_LOCK (self);
+      kms_agnostic_bin2_set_latency_budget (self, g_value_get_uint (value));
+      KMS_AGNOSTIC_BIN2_UNLOCK (self);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -1272,26 +2951,96 @@ kms_agnostic_bin2_get_property (GObject * object, guint property_id,
       g_value_set_boxed (value, self->priv->codec_config);
       KMS_AGNOSTIC_BIN2_UNLOCK (self);
       break;
+    case PROP_SHARE_TRANSCODERS:
+      KMS_AGNOSTIC_BIN2_LOCK (self);
+      g_value_set_boolean (value, self->priv->share_transcoders);
+      KMS_AGNOSTIC_BIN2_UNLOCK (self);
+      break;
+    case PROP_LADDER_RENDITIONS:
+      KMS_AGNOSTIC_BIN2_LOCK (self);
+      g_value_set_uint (value, self->priv->ladder_renditions);
+      KMS_AGNOSTIC_BIN2_UNLOCK (self);
+      break;
+    case PROP_IDLE_BIN_TIMEOUT:
+      KMS_AGNOSTIC_BIN2_LOCK (self);
+      g_value_set_uint (value, self->priv->idle_bin_timeout);
+      KMS_AGNOSTIC_BIN2_UNLOCK (self);
+      break;
+    case PROP_SHARED_OUTPUT_QUEUE:
+      KMS_AGNOSTIC_BIN2_LOCK (self);
+      g_value_set_boolean (value, self->priv->shared_output_queue);
+      KMS_AGNOSTIC_BIN2_UNLOCK (self);
+      break;
+    case PROP_LATENCY_BUDGET:
+      KMS_AGNOSTIC_BIN2_LOCK (self);
+      g_value_set_uint (value, self->priv->latency_budget);
+      KMS_AGNOSTIC_BIN2_UNLOCK (self);
+      break;
+    case PROP_OUTPUT_STATS:
+      KMS_AGNOSTIC_BIN2_LOCK (self);
+      g_value_take_boxed (value,
+          kms_agnostic_bin2_get_output_stats_structure (self));
+      KMS_AGNOSTIC_BIN2_UNLOCK (self);
+      break;
+    case PROP_TRANSCODING_STATS:
+      g_value_take_boxed (value,
+          kms_agnostic_bin2_get_transcoding_stats_structure (self));
+      break;
+    case PROP_IDLE_BIN_REUSES:
+      KMS_AGNOSTIC_BIN2_LOCK (self);
+      g_value_set_uint64 (value, self->priv->idle_bin_reuses);
+      KMS_AGNOSTIC_BIN2_UNLOCK (self);
+      break;
+    case PROP_IDLE_BIN_TEARDOWNS:
+      KMS_AGNOSTIC_BIN2_LOCK (self);
+      g_value_set_uint64 (value, self->priv->idle_bin_teardowns);
+      KMS_AGNOSTIC_BIN2_UNLOCK (self);
+      break;
+    case PROP_CAPS_INDEX_HITS:
+      KMS_AGNOSTIC_BIN2_LOCK (self);
+      g_value_set_uint64 (value, self->priv->caps_index_hits);
+      KMS_AGNOSTIC_BIN2_UNLOCK (self);
+      break;
+    case PROP_CAPS_INDEX_MISSES:
+      KMS_AGNOSTIC_BIN2_LOCK (self);
+      g_value_set_uint64 (value, self->priv->caps_index_misses);
+      KMS_AGNOSTIC_BIN2_UNLOCK (self);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
   }
 }
 
+static void
+kms_agnostic_bin2_handle_message (GstBin * bin, GstMessage * message)
+{
+  if (GST_MESSAGE_TYPE (message) == GST_MESSAGE_STREAM_STATUS) {
+    kms_agnostic_bin2_account_stream_status (KMS_AGNOSTIC_BIN2 (bin), message);
+  }
+
+  GST_BIN_CLASS (parent_class)->handle_message (bin, message);
+}
+
 static void
 kms_agnostic_bin2_class_init (KmsAgnosticBin2Class * klass)
 {
   GObjectClass *gobject_class;
   GstElementClass *gstelement_class;
+  GstBinClass *gstbin_class;
 
   gobject_class = G_OBJECT_CLASS (klass);
   gstelement_class = GST_ELEMENT_CLASS (klass);
+  gstbin_class = GST_BIN_CLASS (klass);
 
   gobject_class->dispose = kms_agnostic_bin2_dispose;
   gobject_class->finalize = kms_agnostic_bin2_finalize;
   gobject_class->set_property = kms_agnostic_bin2_set_property;
   gobject_class->get_property = kms_agnostic_bin2_get_property;
 
+  gstbin_class->handle_message =
+      GST_DEBUG_FUNCPTR (kms_agnostic_bin2_handle_message);
+
   gst_element_class_set_details_simple (gstelement_class,
       "Agnostic connector 2nd version",
       "Generic/Bin/Connector",
@@ -1329,6 +3078,73 @@ kms_agnostic_bin2_class_init (KmsAgnosticBin2Class * klass)
       g_param_spec_boxed ("codec-config", "codec config",
           "Codec configuration", GST_TYPE_STRUCTURE, G_PARAM_READWRITE));
 
+  g_object_class_install_property (gobject_class, PROP_SHARE_TRANSCODERS,
+      g_param_spec_boolean ("share-transcoders", "share transcoders",
+          "Reuse decoders and encoders of other agnosticbins of the same"
+          " pipeline fed by the same upstream element",
+          DEFAULT_SHARE_TRANSCODERS, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_LADDER_RENDITIONS,
+      g_param_spec_uint ("ladder-renditions", "ladder renditions",
+          "Number of resolutions encoded for each output codec. Each output"
+          " is switched to the rendition fitting its REMB estimation"
+          " (1 disables the ladder)",
+          1, MAX_LADDER_RENDITIONS, DEFAULT_LADDER_RENDITIONS,
+          G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_IDLE_BIN_TIMEOUT,
+      g_param_spec_uint ("idle-bin-timeout", "idle bin timeout",
+          "Time in milliseconds that a transcoding TreeBin without consumers"
+          " is kept parked for reuse before being removed (0 keeps idle"
+          " TreeBins running)",
+          0, G_MAXUINT, DEFAULT_IDLE_BIN_TIMEOUT, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_IDLE_BIN_REUSES,
+      g_param_spec_uint64 ("idle-bin-reuses", "idle bin reuses",
+          "Number of parked TreeBins resumed by a new consumer",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE));
+
+  g_object_class_install_property (gobject_class, PROP_IDLE_BIN_TEARDOWNS,
+      g_param_spec_uint64 ("idle-bin-teardowns", "idle bin teardowns",
+          "Number of parked TreeBins removed after the idle timeout",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE));
+
+  g_object_class_install_property (gobject_class, PROP_SHARED_OUTPUT_QUEUE,
+      g_param_spec_boolean ("shared-output-queue", "shared output queue",
+          "Feed all encoded outputs served by the same TreeBin from a single"
+          " queue and streaming thread, instead of one queue per output",
+          DEFAULT_SHARED_OUTPUT_QUEUE, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_LATENCY_BUDGET,
+      g_param_spec_uint ("latency-budget", "latency budget",
+          "Maximum time in milliseconds that media may wait in the queues"
+          " of the outputs. Each queue is sized within it to absorb the"
+          " stalls of its consumer, holding at least two frames. Outputs"
+          " linked while it is 0 keep the default queue sizes",
+          0, G_MAXUINT, DEFAULT_LATENCY_BUDGET, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_OUTPUT_STATS,
+      g_param_spec_boxed ("output-stats", "output stats",
+          "Queue overruns and keyframe waits of each output",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE));
+
+  g_object_class_install_property (gobject_class, PROP_TRANSCODING_STATS,
+      g_param_spec_boxed ("transcoding-stats", "transcoding stats",
+          "TreeBins created by this element: caps that required them,"
+          " elements, creation and removal time and CPU time of their"
+          " streaming threads",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE));
+
+  g_object_class_install_property (gobject_class, PROP_CAPS_INDEX_HITS,
+      g_param_spec_uint64 ("caps-index-hits", "caps index hits",
+          "Number of output caps resolved to an existing TreeBin by the index",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE));
+
+  g_object_class_install_property (gobject_class, PROP_CAPS_INDEX_MISSES,
+      g_param_spec_uint64 ("caps-index-misses", "caps index misses",
+          "Number of output caps that required scanning all TreeBins",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE));
+
   /* Signal "KmsAgnosticBin::media-transcoding"
    * Arguments:
    * - Is transcoding?
@@ -1343,6 +3159,8 @@ kms_agnostic_bin2_class_init (KmsAgnosticBin2Class * klass)
       2, G_TYPE_BOOLEAN, KMS_TYPE_MEDIA_TYPE);
 
   g_type_class_add_private (klass, sizeof (KmsAgnosticBin2Private));
+
+  klass->loop = kms_loop_new ();
 }
 
 static gboolean
@@ -1494,14 +3312,38 @@ kms_agnostic_bin2_init (KmsAgnosticBin2 * self)
   self->priv->started = FALSE;
   self->priv->remove_pool =
       g_thread_pool_new (remove_on_unlinked_async, NULL, -1, FALSE, NULL);
+  /* A single thread keeps the switches of a pad in order */
+  self->priv->rendition_pool =
+      g_thread_pool_new (kms_agnostic_bin2_switch_rendition_async, NULL, 1,
+      FALSE, NULL);
   self->priv->bins =
       g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_object_unref);
+  self->priv->caps_index =
+      g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      caps_index_entry_destroy);
+  self->priv->park_timers =
+      g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->priv->fanouts =
+      g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+  self->priv->output_stats =
+      g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) kms_ref_struct_unref);
+  self->priv->transcodings =
+      g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      transcoding_record_destroy);
+  g_queue_init (&self->priv->removed_transcodings);
+  g_mutex_init (&self->priv->transcodings_mutex);
   g_rec_mutex_init (&self->priv->thread_mutex);
   self->priv->target_encoder_bitrate = DEFAULT_TARGET_ENCODER_BITRATE;
   self->priv->min_encoder_bitrate = DEFAULT_MIN_ENCODER_BITRATE;
   self->priv->max_encoder_bitrate = DEFAULT_MAX_ENCODER_BITRATE;
   self->priv->bitrate_unlimited = TRUE;
   self->priv->transcoding_emitted = FALSE;
+  self->priv->share_transcoders = DEFAULT_SHARE_TRANSCODERS;
+  self->priv->ladder_renditions = DEFAULT_LADDER_RENDITIONS;
+  self->priv->idle_bin_timeout = DEFAULT_IDLE_BIN_TIMEOUT;
+  self->priv->shared_output_queue = DEFAULT_SHARED_OUTPUT_QUEUE;
+  self->priv->latency_budget = DEFAULT_LATENCY_BUDGET;
 }
 
 gboolean
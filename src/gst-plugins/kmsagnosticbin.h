@@ -21,6 +21,7 @@
 #include <gst/gst.h>
 
 #include "commons/kmsmediatype.h"
+#include "commons/kmsloop.h"
 
 G_BEGIN_DECLS
 /* #defines don't like whitespacey bits */
@@ -34,6 +35,8 @@ G_BEGIN_DECLS
   (G_TYPE_CHECK_INSTANCE_TYPE((obj),KMS_TYPE_AGNOSTIC_BIN2))
 #define KMS_IS_AGNOSTIC_BIN2_CLASS(klass) \
   (G_TYPE_CHECK_CLASS_TYPE((klass),KMS_TYPE_AGNOSTIC_BIN2))
+#define KMS_AGNOSTIC_BIN2_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS((obj),KMS_TYPE_AGNOSTIC_BIN2,KmsAgnosticBin2Class))
 #define KMS_AGNOSTIC_BIN2_CAST(obj) ((KmsAgnosticBin2*)(obj))
 
 typedef struct _KmsAgnosticBin2 KmsAgnosticBin2;
@@ -51,6 +54,9 @@ struct _KmsAgnosticBin2Class
 {
   GstBinClass parent_class;
 
+  /* Runs the work that must not be done holding the lock of any agnosticbin */
+  KmsLoop *loop;
+
   /* Signals */
   void (*media_transcoding) (GstBin *self, gboolean is_transcoding,
       KmsMediaType type);
@@ -43,16 +43,23 @@ G_DEFINE_TYPE (KmsAgnosticBin3, kms_agnostic_bin3, GST_TYPE_BIN);
   )                                          \
 )
 
+/* Costs used to choose the agnosticbin that transcodes a new output */
+#define TRANSCODING_DECODE_COST 2
+#define TRANSCODING_OUTPUT_COST 1
+
 struct _KmsAgnosticBin3Private
 {
   GRecMutex mutex;
   GSList *agnosticbins;
   GHashTable *sinkcaps;
 
+  /* Output caps string -> CapsTableEntry */
+  GHashTable *caps_table;
+  /* agnosticbin -> number of outputs it has been asked to transcode */
+  GHashTable *transcodings;
+
   guint src_pad_count;
   guint sink_pad_count;
-
-  guint last;
 };
 
 #define KMS_AGNOSTIC_BIN3_LOCK(obj) (                        \
@@ -63,6 +70,14 @@ struct _KmsAgnosticBin3Private
   g_rec_mutex_unlock (&KMS_AGNOSTIC_BIN3 (obj)->priv->mutex) \
 )
 
+/* Agnosticbin already producing some output caps */
+typedef struct _CapsTableEntry
+{
+  GstElement *transcoder;
+  /* The caps are counted in the transcodings of @transcoder */
+  gboolean transcoding;
+} CapsTableEntry;
+
 typedef enum
 {
   KMS_SRC_PAD_STATE_UNCONFIGURED,
@@ -111,7 +126,7 @@ GST_STATIC_PAD_TEMPLATE (AGNOSTICBIN3_SRC_PAD,
 
 static gboolean set_transcoder_src_target_pad (GstGhostPad *, GstElement *);
 static GstElement *kms_agnosticbin3_get_element_for_transcoding (KmsAgnosticBin3
-    *);
+    *, const GstCaps *);
 
 static KmsSrcPadData *
 create_src_pad_data ()
@@ -261,7 +276,7 @@ connect_srcpad_to_encoder (GstPad * srcpad, GstPad * sinkpad)
     }
 
     /* no one upstream supports these capabilities we need to transcode */
-    transcoder = kms_agnosticbin3_get_element_for_transcoding (self);
+    transcoder = kms_agnosticbin3_get_element_for_transcoding (self, caps);
     GST_DEBUG_OBJECT (srcpad, "Connection requires transcoding");
   } else {
     transcoder = get_transcoder_connected_to_sinkpad (sinkpad);
@@ -317,72 +332,160 @@ link_pending_src_pads (GstPad * srcpad, GstPad * sinkpad)
   g_object_unref (self);
 }
 
+static gchar *
+kms_agnostic_bin3_get_caps_key (const GstCaps * caps)
+{
+  if (caps == NULL || gst_caps_is_any (caps) || gst_caps_is_empty (caps)) {
+    return NULL;
+  }
+
+  return gst_caps_to_string (caps);
+}
+
+static void
+caps_table_entry_destroy (CapsTableEntry * entry)
+{
+  g_slice_free (CapsTableEntry, entry);
+}
+
+/* Remember that @transcoder produces @caps. Call this function with mutex held */
 static void
-append_transcoder_to_list (GstPad * sink, GSList ** elements)
+kms_agnostic_bin3_caps_table_insert (KmsAgnosticBin3 * self,
+    const GstCaps * caps, GstElement * transcoder, gboolean transcoding)
 {
-  GstElement *e;
+  gchar *key = kms_agnostic_bin3_get_caps_key (caps);
+  CapsTableEntry *entry;
 
-  e = get_transcoder_connected_to_sinkpad (sink);
-  *elements = g_slist_prepend (*elements, e);
+  if (key == NULL) {
+    return;
+  }
+
+  entry = g_slice_new (CapsTableEntry);
+  entry->transcoder = transcoder;
+  entry->transcoding = transcoding;
+  g_hash_table_insert (self->priv->caps_table, key, entry);
 }
 
-static GSList *
-kms_agnosticbin3_get_configured_transcoders (KmsAgnosticBin3 * self)
+/* Gets the transcoder producing these caps or NULL. [Transfer full] */
+/* Call this function with mutex held */
+static GstElement *
+kms_agnostic_bin3_caps_table_lookup (KmsAgnosticBin3 * self,
+    const GstCaps * caps)
 {
-  GSList *transcoders = NULL;
-  GList *pads;
+  CapsTableEntry *entry;
+  gchar *key;
+
+  key = kms_agnostic_bin3_get_caps_key (caps);
+  if (key == NULL) {
+    return NULL;
+  }
 
-  pads = g_hash_table_get_keys (self->priv->sinkcaps);
+  entry = g_hash_table_lookup (self->priv->caps_table, key);
+  g_free (key);
 
-  if (g_list_length (pads) <= 0) {
-    goto end;
+  if (entry == NULL) {
+    return NULL;
   }
 
-  g_list_foreach (pads, (GFunc) append_transcoder_to_list, &transcoders);
+  return g_object_ref (entry->transcoder);
+}
 
-end:
+/* Call this function with mutex held */
+static void
+kms_agnostic_bin3_remove_transcoding (KmsAgnosticBin3 * self,
+    GstElement * transcoder)
+{
+  guint outputs;
 
-  if (pads != NULL) {
-    g_list_free (pads);
+  outputs = GPOINTER_TO_UINT (g_hash_table_lookup (self->priv->transcodings,
+          transcoder));
+
+  if (outputs <= 1) {
+    g_hash_table_remove (self->priv->transcodings, transcoder);
+  } else {
+    g_hash_table_insert (self->priv->transcodings, transcoder,
+        GUINT_TO_POINTER (outputs - 1));
+  }
+}
+
+/*
+ * Cost of transcoding one more output in the agnosticbin fed by @sinkpad.
+ * Decoding is paid only once per agnosticbin: a raw input or an agnosticbin
+ * already transcoding can serve the output with just a new encoder.
+ */
+static guint
+kms_agnostic_bin3_get_transcoding_cost (KmsAgnosticBin3 * self,
+    GstElement * transcoder, const GstCaps * sinkcaps)
+{
+  guint outputs, cost = 0;
+
+  outputs = GPOINTER_TO_UINT (g_hash_table_lookup (self->priv->transcodings,
+          transcoder));
+
+  if (outputs == 0 && !kms_utils_caps_is_raw (sinkcaps)) {
+    cost += TRANSCODING_DECODE_COST;
   }
 
-  return transcoders;
+  cost += outputs * TRANSCODING_OUTPUT_COST;
+
+  return cost;
 }
 
-/* Gets the transcoder that can manage these caps or NULL. [Transfer full] */
+/* Gets the cheapest transcoder to produce these caps or NULL. [Transfer full] */
 static GstElement *
-kms_agnosticbin3_get_element_for_transcoding (KmsAgnosticBin3 * self)
+kms_agnosticbin3_get_element_for_transcoding (KmsAgnosticBin3 * self,
+    const GstCaps * caps)
 {
   GstElement *transcoder = NULL;
-  guint index, len;
-  GSList *l, *transcoders;
-
-  index = (guint) g_atomic_int_add (&self->priv->last, 1);
+  guint cost, min_cost = G_MAXUINT;
+  GHashTableIter iter;
+  gpointer key, value;
 
   KMS_AGNOSTIC_BIN3_LOCK (self);
 
-  transcoders = kms_agnosticbin3_get_configured_transcoders (self);
-  len = g_slist_length (transcoders);
-
-  if (len <= 0) {
+  /* Another output may have already required these caps */
+  transcoder = kms_agnostic_bin3_caps_table_lookup (self, caps);
+  if (transcoder != NULL) {
+    GST_DEBUG_OBJECT (self, "%" GST_PTR_FORMAT " already transcodes to %"
+        GST_PTR_FORMAT, transcoder, caps);
     goto end;
   }
 
-  index %= len;
-  l = g_slist_nth (transcoders, index);
-  transcoder = l->data;
+  g_hash_table_iter_init (&iter, self->priv->sinkcaps);
 
-end:
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    GstElement *candidate = get_transcoder_connected_to_sinkpad (GST_PAD (key));
 
-  KMS_AGNOSTIC_BIN3_UNLOCK (self);
+    cost = kms_agnostic_bin3_get_transcoding_cost (self, candidate,
+        GST_CAPS (value));
+    GST_LOG_OBJECT (self, "Transcoding cost in %" GST_PTR_FORMAT ": %u",
+        candidate, cost);
 
-  if (transcoder != NULL)
-    g_object_ref (transcoder);
+    if (cost < min_cost) {
+      min_cost = cost;
+      g_clear_object (&transcoder);
+      transcoder = candidate;
+    } else {
+      g_object_unref (candidate);
+    }
+  }
 
-  if (transcoders != NULL) {
-    g_slist_free_full (transcoders, (GDestroyNotify) g_object_unref);
+  if (transcoder == NULL) {
+    goto end;
   }
 
+  GST_DEBUG_OBJECT (self, "Transcoding to %" GST_PTR_FORMAT " in %"
+      GST_PTR_FORMAT " (cost: %u)", caps, transcoder, min_cost);
+
+  g_hash_table_insert (self->priv->transcodings, transcoder,
+      GUINT_TO_POINTER (GPOINTER_TO_UINT (g_hash_table_lookup (self->
+                  priv->transcodings, transcoder)) + 1));
+  kms_agnostic_bin3_caps_table_insert (self, caps, transcoder, TRUE);
+
+end:
+
+  KMS_AGNOSTIC_BIN3_UNLOCK (self);
+
   return transcoder;
 }
 
@@ -508,14 +611,17 @@ kms_agnostic_bin3_get_transcoder_by_srcpads (KmsAgnosticBin3 * self,
           srcpad = g_value_get_object (&val);
           current_caps = gst_pad_get_current_caps (srcpad);
 
-          if (gst_caps_is_always_compatible (current_caps, caps)) {
+          if (current_caps != NULL
+              && gst_caps_is_always_compatible (current_caps, caps)) {
             GST_INFO_OBJECT (agnosticbin, "Supports %" GST_PTR_FORMAT, caps);
             /* This function returns a tranfer full element */
             transcoder = g_object_ref (agnosticbin);
             done = TRUE;
           }
 
-          gst_caps_unref (current_caps);
+          if (current_caps != NULL) {
+            gst_caps_unref (current_caps);
+          }
           g_value_reset (&val);
           break;
         }
@@ -548,6 +654,7 @@ static GstElement *
 kms_agnostic_bin3_get_compatible_transcoder_tree (KmsAgnosticBin3 * self,
     const GstCaps * caps)
 {
+  GstElement *transcoder;
   GHashTableIter iter;
   gpointer key, value;
 
@@ -569,7 +676,17 @@ kms_agnostic_bin3_get_compatible_transcoder_tree (KmsAgnosticBin3 * self,
     }
   }
 
-  return kms_agnostic_bin3_get_transcoder_by_srcpads (self, caps);
+  transcoder = kms_agnostic_bin3_caps_table_lookup (self, caps);
+  if (transcoder != NULL) {
+    return transcoder;
+  }
+
+  transcoder = kms_agnostic_bin3_get_transcoder_by_srcpads (self, caps);
+  if (transcoder != NULL) {
+    kms_agnostic_bin3_caps_table_insert (self, caps, transcoder, FALSE);
+  }
+
+  return transcoder;
 }
 
 static GstPad *
@@ -613,8 +730,8 @@ kms_agnostic_bin3_create_src_pad_with_transcodification (KmsAgnosticBin3 * self,
   GST_DEBUG_OBJECT (pad, "Connect forcing transcode");
 
   /* No compatible transcoder found. Force transcodification in one of them */
-  /* Get any available transcoder. Round robin will be used */
-  transcoder = kms_agnosticbin3_get_element_for_transcoding (self);
+  /* Get the one where it is cheaper */
+  transcoder = kms_agnosticbin3_get_element_for_transcoding (self, caps);
   if (transcoder != NULL) {
     set_transcoder_src_target_pad (GST_GHOST_PAD (pad), transcoder);
   } else {
@@ -806,8 +923,8 @@ kms_agnostic_bin3_src_pad_linked (GstPad * pad, GstPad * peer,
     goto change_state;
   }
 
-  /* Get any available transcoder. Round robin will be ussed */
-  element = kms_agnosticbin3_get_element_for_transcoding (self);
+  /* Get the transcoder where it is cheaper */
+  element = kms_agnosticbin3_get_element_for_transcoding (self, caps);
   if (element == NULL) {
     GST_DEBUG_OBJECT (pad, "Can not connect to any encoder yet");
     goto change_state;
@@ -880,11 +997,108 @@ kms_agnostic_bin3_request_new_pad (GstElement * element,
   }
 }
 
+/* Checks if a src pad other than @pad wants the caps @key */
+/* Call this function with mutex held */
+static gboolean
+kms_agnostic_bin3_caps_in_use (KmsAgnosticBin3 * self, GstPad * pad,
+    const gchar * key)
+{
+  gboolean in_use = FALSE;
+  GList *l;
+
+  GST_OBJECT_LOCK (self);
+
+  for (l = GST_ELEMENT (self)->srcpads; l != NULL && !in_use; l = l->next) {
+    KmsSrcPadData *data;
+    gchar *pad_key;
+
+    if (l->data == pad) {
+      continue;
+    }
+
+    data = g_object_get_qdata (G_OBJECT (l->data),
+        kms_agnosticbin3_src_pad_data_quark ());
+    if (data == NULL) {
+      continue;
+    }
+
+    g_mutex_lock (&data->mutex);
+    pad_key = kms_agnostic_bin3_get_caps_key (data->caps);
+    g_mutex_unlock (&data->mutex);
+
+    in_use = g_strcmp0 (key, pad_key) == 0;
+    g_free (pad_key);
+  }
+
+  GST_OBJECT_UNLOCK (self);
+
+  return in_use;
+}
+
+static void
+kms_agnostic_bin3_release_src_pad (KmsAgnosticBin3 * self, GstPad * pad,
+    KmsSrcPadData * data)
+{
+  CapsTableEntry *entry;
+  GstElement *transcoder;
+  GstPad *target;
+  gchar *key;
+
+  g_mutex_lock (&data->mutex);
+  key = kms_agnostic_bin3_get_caps_key (data->caps);
+  g_mutex_unlock (&data->mutex);
+
+  KMS_AGNOSTIC_BIN3_LOCK (self);
+
+  /* The last output with these caps is gone, forget its transcoding */
+  if (key != NULL && !kms_agnostic_bin3_caps_in_use (self, pad, key)) {
+    entry = g_hash_table_lookup (self->priv->caps_table, key);
+
+    if (entry != NULL) {
+      GST_DEBUG_OBJECT (self, "%" GST_PTR_FORMAT " does not produce %s"
+          " for any output now", entry->transcoder, key);
+
+      if (entry->transcoding) {
+        kms_agnostic_bin3_remove_transcoding (self, entry->transcoder);
+      }
+      g_hash_table_remove (self->priv->caps_table, key);
+    }
+  }
+
+  KMS_AGNOSTIC_BIN3_UNLOCK (self);
+
+  g_free (key);
+
+  target = gst_ghost_pad_get_target (GST_GHOST_PAD (pad));
+  if (target != NULL) {
+    transcoder = gst_pad_get_parent_element (target);
+    gst_ghost_pad_set_target (GST_GHOST_PAD (pad), NULL);
+
+    if (transcoder != NULL) {
+      gst_element_release_request_pad (transcoder, target);
+      g_object_unref (transcoder);
+    }
+    g_object_unref (target);
+  }
+
+  gst_element_remove_pad (GST_ELEMENT (self), pad);
+}
+
 static void
 kms_agnostic_bin3_release_pad (GstElement * element, GstPad * pad)
 {
-  /* TODO: */
+  KmsSrcPadData *data;
+
   GST_DEBUG_OBJECT (element, "Release pad %" GST_PTR_FORMAT, pad);
+
+  data = g_object_get_qdata (G_OBJECT (pad),
+      kms_agnosticbin3_src_pad_data_quark ());
+
+  if (data != NULL) {
+    kms_agnostic_bin3_release_src_pad (KMS_AGNOSTIC_BIN3 (element), pad, data);
+  }
+
+  /* TODO: Release sink pads */
 }
 
 static void
@@ -894,6 +1108,8 @@ kms_agnostic_bin3_finalize (GObject * object)
 
   g_slist_free (self->priv->agnosticbins);
   g_hash_table_unref (self->priv->sinkcaps);
+  g_hash_table_unref (self->priv->caps_table);
+  g_hash_table_unref (self->priv->transcodings);
   g_rec_mutex_clear (&self->priv->mutex);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
@@ -946,6 +1162,9 @@ kms_agnostic_bin3_init (KmsAgnosticBin3 * self)
   g_rec_mutex_init (&self->priv->mutex);
   self->priv->sinkcaps = g_hash_table_new_full (g_direct_hash, g_direct_equal,
       NULL, (GDestroyNotify) gst_caps_unref);
+  self->priv->caps_table = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) caps_table_entry_destroy);
+  self->priv->transcodings = g_hash_table_new (g_direct_hash, g_direct_equal);
 }
 
 gboolean
@@ -0,0 +1,500 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "kmsrtxcache.h"
+#include "kmsutils.h"
+#include <gst/rtp/gstrtpbuffer.h>
+
+#define PLUGIN_NAME "rtxcache"
+
+#define DEFAULT_MAX_SIZE_PACKETS 512
+#define DEFAULT_MAX_SIZE_TIME 1000      /* ms */
+#define MAX_SSRCS 16
+
+#define RTX_REQUEST_EVENT "GstRTPRetransmissionRequest"
+
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp")
+    );
+
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp")
+    );
+
+GST_DEBUG_CATEGORY_STATIC (kms_rtx_cache_debug);
+#define GST_CAT_DEFAULT kms_rtx_cache_debug
+#define kms_rtx_cache_parent_class parent_class
+
+G_DEFINE_TYPE_WITH_CODE (KmsRtxCache, kms_rtx_cache,
+    GST_TYPE_ELEMENT,
+    GST_DEBUG_CATEGORY_INIT (kms_rtx_cache_debug,
+        PLUGIN_NAME, 0, "debug category for " PLUGIN_NAME " element"));
+
+#define KMS_RTX_CACHE_GET_PRIVATE(obj) ( \
+  G_TYPE_INSTANCE_GET_PRIVATE (          \
+    (obj),                               \
+    KMS_TYPE_RTX_CACHE,                  \
+    KmsRtxCachePrivate                   \
+  )                                      \
+)
+
+#define KMS_RTX_CACHE_LOCK(obj) \
+  (g_mutex_lock (&KMS_RTX_CACHE (obj)->priv->mutex))
+
+#define KMS_RTX_CACHE_UNLOCK(obj) \
+  (g_mutex_unlock (&KMS_RTX_CACHE (obj)->priv->mutex))
+
+typedef struct _RtxSlot
+{
+  GstBuffer *buffer;
+  guint16 seqnum;
+  GstClockTime time;
+} RtxSlot;
+
+/* Fixed size ring indexed by sequence number */
+typedef struct _RtxStream
+{
+  RtxSlot *slots;
+  guint size;
+
+  guint64 requests;
+  guint64 hits;
+  guint64 misses;
+  guint64 late;
+} RtxStream;
+
+struct _KmsRtxCachePrivate
+{
+  GMutex mutex;
+  GstPad *sinkpad;
+  GstPad *srcpad;
+
+  guint max_size_packets;
+  guint max_size_time;
+  GHashTable *streams;          /* <ssrc, RtxStream> */
+  GList *pending;               /* Buffers to retransmit, newest first */
+};
+
+enum
+{
+  PROP_0,
+  PROP_MAX_SIZE_PACKETS,
+  PROP_MAX_SIZE_TIME,
+  PROP_STATS,
+  N_PROPERTIES
+};
+
+static RtxStream *
+rtx_stream_new (guint size)
+{
+  RtxStream *stream = g_slice_new0 (RtxStream);
+
+  stream->size = size;
+  stream->slots = g_new0 (RtxSlot, size);
+
+  return stream;
+}
+
+static void
+rtx_stream_destroy (RtxStream * stream)
+{
+  guint i;
+
+  for (i = 0; i < stream->size; i++) {
+    if (stream->slots[i].buffer != NULL) {
+      gst_buffer_unref (stream->slots[i].buffer);
+    }
+  }
+
+  g_free (stream->slots);
+  g_slice_free (RtxStream, stream);
+}
+
+/* Must be called with the lock held */
+static void
+kms_rtx_cache_store (KmsRtxCache * self, GstBuffer * buffer, GstClockTime now)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  RtxStream *stream;
+  RtxSlot *slot;
+  guint32 ssrc;
+  guint16 seqnum;
+
+  if (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp)) {
+    GST_WARNING_OBJECT (self, "Not caching invalid RTP buffer");
+    return;
+  }
+
+  ssrc = gst_rtp_buffer_get_ssrc (&rtp);
+  seqnum = gst_rtp_buffer_get_seq (&rtp);
+  gst_rtp_buffer_unmap (&rtp);
+
+  stream = g_hash_table_lookup (self->priv->streams, GUINT_TO_POINTER (ssrc));
+
+  if (stream == NULL) {
+    if (g_hash_table_size (self->priv->streams) >= MAX_SSRCS) {
+      GST_DEBUG_OBJECT (self, "Too many SSRCs, not caching %u", ssrc);
+      return;
+    }
+
+    stream = rtx_stream_new (self->priv->max_size_packets);
+    g_hash_table_insert (self->priv->streams, GUINT_TO_POINTER (ssrc), stream);
+  }
+
+  slot = &stream->slots[seqnum % stream->size];
+
+  if (slot->buffer != NULL) {
+    gst_buffer_unref (slot->buffer);
+  }
+
+  slot->buffer = gst_buffer_ref (buffer);
+  slot->seqnum = seqnum;
+  slot->time = now;
+}
+
+static gboolean
+store_buffer_cb (GstBuffer ** buffer, guint idx, gpointer user_data)
+{
+  KmsRtxCache *self = user_data;
+
+  kms_rtx_cache_store (self, *buffer, kms_utils_get_time_nsecs ());
+
+  return TRUE;
+}
+
+static void
+kms_rtx_cache_request (KmsRtxCache * self, guint ssrc, guint seqnum)
+{
+  GstClockTime now = kms_utils_get_time_nsecs ();
+  RtxStream *stream;
+  RtxSlot *slot;
+
+  KMS_RTX_CACHE_LOCK (self);
+
+  stream = g_hash_table_lookup (self->priv->streams, GUINT_TO_POINTER (ssrc));
+
+  if (stream == NULL) {
+    GST_DEBUG_OBJECT (self, "Retransmission for unknown SSRC %u", ssrc);
+    goto end;
+  }
+
+  stream->requests++;
+  slot = &stream->slots[seqnum % stream->size];
+
+  if (slot->buffer == NULL || slot->seqnum != seqnum) {
+    GST_LOG_OBJECT (self, "Miss: SSRC %u, seqnum %u", ssrc, seqnum);
+    stream->misses++;
+  } else if (now - slot->time > self->priv->max_size_time * GST_MSECOND) {
+    GST_LOG_OBJECT (self, "Late: SSRC %u, seqnum %u", ssrc, seqnum);
+    stream->late++;
+  } else {
+    GST_LOG_OBJECT (self, "Hit: SSRC %u, seqnum %u", ssrc, seqnum);
+    stream->hits++;
+    /* The copy shares the memory, but it can be made writable downstream */
+    /* (e.g. to write hdrext values) without touching the cached packet */
+    self->priv->pending = g_list_prepend (self->priv->pending,
+        gst_buffer_copy (slot->buffer));
+  }
+
+end:
+  KMS_RTX_CACHE_UNLOCK (self);
+}
+
+/* Retransmissions go out from the streaming thread, before new packets */
+static void
+kms_rtx_cache_push_pending (KmsRtxCache * self)
+{
+  GList *pending, *l;
+
+  KMS_RTX_CACHE_LOCK (self);
+  pending = g_list_reverse (self->priv->pending);
+  self->priv->pending = NULL;
+  KMS_RTX_CACHE_UNLOCK (self);
+
+  for (l = pending; l != NULL; l = l->next) {
+    GstFlowReturn ret = gst_pad_push (self->priv->srcpad, l->data);
+
+    if (ret != GST_FLOW_OK) {
+      GST_DEBUG_OBJECT (self, "Retransmission not pushed: %s",
+          gst_flow_get_name (ret));
+    }
+  }
+
+  g_list_free (pending);
+}
+
+static GstFlowReturn
+kms_rtx_cache_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  KmsRtxCache *self = KMS_RTX_CACHE (parent);
+
+  KMS_RTX_CACHE_LOCK (self);
+  kms_rtx_cache_store (self, buffer, kms_utils_get_time_nsecs ());
+  KMS_RTX_CACHE_UNLOCK (self);
+
+  kms_rtx_cache_push_pending (self);
+
+  return gst_pad_push (self->priv->srcpad, buffer);
+}
+
+static GstFlowReturn
+kms_rtx_cache_chain_list (GstPad * pad, GstObject * parent,
+    GstBufferList * list)
+{
+  KmsRtxCache *self = KMS_RTX_CACHE (parent);
+
+  KMS_RTX_CACHE_LOCK (self);
+  gst_buffer_list_foreach (list, store_buffer_cb, self);
+  KMS_RTX_CACHE_UNLOCK (self);
+
+  kms_rtx_cache_push_pending (self);
+
+  return gst_pad_push_list (self->priv->srcpad, list);
+}
+
+static gboolean
+kms_rtx_cache_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  KmsRtxCache *self = KMS_RTX_CACHE (parent);
+  const GstStructure *s;
+  guint ssrc, seqnum;
+
+  if (GST_EVENT_TYPE (event) != GST_EVENT_CUSTOM_UPSTREAM) {
+    return gst_pad_event_default (pad, parent, event);
+  }
+
+  s = gst_event_get_structure (event);
+
+  if (!gst_structure_has_name (s, RTX_REQUEST_EVENT)) {
+    return gst_pad_event_default (pad, parent, event);
+  }
+
+  if (!gst_structure_get_uint (s, "seqnum", &seqnum) ||
+      !gst_structure_get_uint (s, "ssrc", &ssrc)) {
+    GST_WARNING_OBJECT (self, "Invalid retransmission request %"
+        GST_PTR_FORMAT, s);
+  } else {
+    kms_rtx_cache_request (self, ssrc, seqnum);
+  }
+
+  gst_event_unref (event);
+
+  return TRUE;
+}
+
+static void
+kms_rtx_cache_clear (KmsRtxCache * self)
+{
+  KMS_RTX_CACHE_LOCK (self);
+  g_hash_table_remove_all (self->priv->streams);
+  g_list_free_full (self->priv->pending, (GDestroyNotify) gst_buffer_unref);
+  self->priv->pending = NULL;
+  KMS_RTX_CACHE_UNLOCK (self);
+}
+
+static GstStructure *
+kms_rtx_cache_get_stats (KmsRtxCache * self)
+{
+  GstStructure *stats = gst_structure_new_empty ("rtx-cache-stats");
+  GHashTableIter iter;
+  gpointer key, value;
+
+  KMS_RTX_CACHE_LOCK (self);
+
+  g_hash_table_iter_init (&iter, self->priv->streams);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    RtxStream *stream = value;
+    GstStructure *ssrc_stats;
+    gchar *name;
+
+    ssrc_stats = gst_structure_new ("rtx-cache-ssrc-stats",
+        "requests", G_TYPE_UINT64, stream->requests,
+        "hits", G_TYPE_UINT64, stream->hits,
+        "misses", G_TYPE_UINT64, stream->misses,
+        "late", G_TYPE_UINT64, stream->late, NULL);
+    name = g_strdup_printf ("ssrc-%u", GPOINTER_TO_UINT (key));
+    gst_structure_set (stats, name, GST_TYPE_STRUCTURE, ssrc_stats, NULL);
+    gst_structure_free (ssrc_stats);
+    g_free (name);
+  }
+
+  KMS_RTX_CACHE_UNLOCK (self);
+
+  return stats;
+}
+
+static GstStateChangeReturn
+kms_rtx_cache_change_state (GstElement * element, GstStateChange transition)
+{
+  GstStateChangeReturn ret;
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+    kms_rtx_cache_clear (KMS_RTX_CACHE (element));
+  }
+
+  return ret;
+}
+
+static void
+kms_rtx_cache_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsRtxCache *self = KMS_RTX_CACHE (object);
+
+  KMS_RTX_CACHE_LOCK (self);
+
+  switch (property_id) {
+    case PROP_MAX_SIZE_PACKETS:
+      self->priv->max_size_packets = g_value_get_uint (value);
+      break;
+    case PROP_MAX_SIZE_TIME:
+      self->priv->max_size_time = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+
+  KMS_RTX_CACHE_UNLOCK (self);
+}
+
+static void
+kms_rtx_cache_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsRtxCache *self = KMS_RTX_CACHE (object);
+
+  switch (property_id) {
+    case PROP_MAX_SIZE_PACKETS:
+      KMS_RTX_CACHE_LOCK (self);
+      g_value_set_uint (value, self->priv->max_size_packets);
+      KMS_RTX_CACHE_UNLOCK (self);
+      break;
+    case PROP_MAX_SIZE_TIME:
+      KMS_RTX_CACHE_LOCK (self);
+      g_value_set_uint (value, self->priv->max_size_time);
+      KMS_RTX_CACHE_UNLOCK (self);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value, kms_rtx_cache_get_stats (self));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+kms_rtx_cache_finalize (GObject * object)
+{
+  KmsRtxCache *self = KMS_RTX_CACHE (object);
+
+  g_list_free_full (self->priv->pending, (GDestroyNotify) gst_buffer_unref);
+  g_hash_table_destroy (self->priv->streams);
+  g_mutex_clear (&self->priv->mutex);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+kms_rtx_cache_init (KmsRtxCache * self)
+{
+  self->priv = KMS_RTX_CACHE_GET_PRIVATE (self);
+
+  self->priv->sinkpad =
+      gst_pad_new_from_static_template (&sinktemplate, "sink");
+  gst_pad_set_chain_function (self->priv->sinkpad, kms_rtx_cache_chain);
+  gst_pad_set_chain_list_function (self->priv->sinkpad,
+      kms_rtx_cache_chain_list);
+  GST_PAD_SET_PROXY_CAPS (self->priv->sinkpad);
+  GST_PAD_SET_PROXY_ALLOCATION (self->priv->sinkpad);
+  gst_element_add_pad (GST_ELEMENT (self), self->priv->sinkpad);
+
+  self->priv->srcpad = gst_pad_new_from_static_template (&srctemplate, "src");
+  gst_pad_set_event_function (self->priv->srcpad, kms_rtx_cache_src_event);
+  GST_PAD_SET_PROXY_CAPS (self->priv->srcpad);
+  gst_element_add_pad (GST_ELEMENT (self), self->priv->srcpad);
+
+  g_mutex_init (&self->priv->mutex);
+  self->priv->streams = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) rtx_stream_destroy);
+  self->priv->max_size_packets = DEFAULT_MAX_SIZE_PACKETS;
+  self->priv->max_size_time = DEFAULT_MAX_SIZE_TIME;
+}
+
+static void
+kms_rtx_cache_class_init (KmsRtxCacheClass * klass)
+{
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = kms_rtx_cache_finalize;
+  gobject_class->set_property = kms_rtx_cache_set_property;
+  gobject_class->get_property = kms_rtx_cache_get_property;
+
+  gstelement_class->change_state = kms_rtx_cache_change_state;
+
+  gst_element_class_set_details_simple (gstelement_class,
+      "RTP retransmission cache",
+      "Codec/Network/RTP",
+      "Keeps the last packets of every SSRC in a bounded ring and "
+      "retransmits them on request", "Kurento");
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&srctemplate));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&sinktemplate));
+
+  GST_DEBUG_REGISTER_FUNCPTR (kms_rtx_cache_chain);
+  GST_DEBUG_REGISTER_FUNCPTR (kms_rtx_cache_chain_list);
+  GST_DEBUG_REGISTER_FUNCPTR (kms_rtx_cache_src_event);
+
+  g_object_class_install_property (gobject_class, PROP_MAX_SIZE_PACKETS,
+      g_param_spec_uint ("max-size-packets", "Max size packets",
+          "Packets kept per SSRC (applies to new SSRCs)", 1, G_MAXUINT16,
+          DEFAULT_MAX_SIZE_PACKETS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_SIZE_TIME,
+      g_param_spec_uint ("max-size-time", "Max size time",
+          "Packets older than this (ms) are not retransmitted", 0, G_MAXUINT,
+          DEFAULT_MAX_SIZE_TIME, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Requests, hits, misses and late requests per SSRC",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_type_class_add_private (klass, sizeof (KmsRtxCachePrivate));
+}
+
+gboolean
+kms_rtx_cache_plugin_init (GstPlugin * plugin)
+{
+  return gst_element_register (plugin, PLUGIN_NAME, GST_RANK_NONE,
+      KMS_TYPE_RTX_CACHE);
+}
@@ -0,0 +1,57 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_RTX_CACHE_H__
+#define __KMS_RTX_CACHE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+#define KMS_TYPE_RTX_CACHE \
+  (kms_rtx_cache_get_type())
+#define KMS_RTX_CACHE(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),KMS_TYPE_RTX_CACHE,KmsRtxCache))
+#define KMS_RTX_CACHE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),KMS_TYPE_RTX_CACHE,KmsRtxCacheClass))
+#define KMS_IS_RTX_CACHE(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),KMS_TYPE_RTX_CACHE))
+#define KMS_IS_RTX_CACHE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),KMS_TYPE_RTX_CACHE))
+#define KMS_RTX_CACHE_CAST(obj) ((KmsRtxCache*)(obj))
+
+typedef struct _KmsRtxCache KmsRtxCache;
+typedef struct _KmsRtxCacheClass KmsRtxCacheClass;
+typedef struct _KmsRtxCachePrivate KmsRtxCachePrivate;
+
+struct _KmsRtxCache
+{
+  GstElement element;
+
+  KmsRtxCachePrivate *priv;
+};
+
+struct _KmsRtxCacheClass
+{
+  GstElementClass parent_class;
+};
+
+GType kms_rtx_cache_get_type (void);
+
+gboolean kms_rtx_cache_plugin_init (GstPlugin * plugin);
+
+G_END_DECLS
+#endif /* __KMS_RTX_CACHE_H__ */
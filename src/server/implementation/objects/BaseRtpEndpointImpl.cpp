@@ -26,6 +26,7 @@
 #include <MediaType.hpp>
 
 #include "RembParams.hpp"
+#include "RembEstimator.hpp"
 
 #include "StatsType.hpp"
 #include "RTCInboundRTPStreamStats.hpp"
@@ -33,6 +34,7 @@
 #include "EndpointStats.hpp"
 #include "kmsstats.h"
 #include "kmsutils.h"
+#include "kmsremb.h"
 
 #define GST_CAT_DEFAULT kurento_base_rtp_endpoint_impl
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -50,10 +52,12 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define PARAM_MIN_PORT "minPort"
 #define PARAM_MAX_PORT "maxPort"
 #define PARAM_MTU "mtu"
+#define PARAM_STATS_MAX_STALENESS "statsMaxStaleness"
 
 #define PROP_MIN_PORT "min-port"
 #define PROP_MAX_PORT "max-port"
 #define PROP_MTU "mtu"
+#define PROP_STATS_MAX_STALENESS "stats-max-staleness"
 
 /* Fixed point conversion macros */
 #define FRIC        65536.                  /* 2^16 as a double */
@@ -113,6 +117,13 @@ BaseRtpEndpointImpl::BaseRtpEndpointImpl (const boost::property_tree::ptree
   } else {
     GST_DEBUG ("No predefined RTP MTU found in config; using default");
   }
+
+  if (getConfigValue <guint, BaseRtpEndpoint> (&statsMaxStaleness,
+      PARAM_STATS_MAX_STALENESS)) {
+    GST_INFO ("Stats max staleness: %u ms", statsMaxStaleness);
+    g_object_set (G_OBJECT (element), PROP_STATS_MAX_STALENESS,
+        statsMaxStaleness, NULL);
+  }
 }
 
 BaseRtpEndpointImpl::~BaseRtpEndpointImpl ()
@@ -306,6 +317,17 @@ BaseRtpEndpointImpl::getRembParams ()
 
   gst_structure_get (params, "up-losses", G_TYPE_INT, &auxi, NULL);
   ret->setUpLosses (auxi);
+
+  if (gst_structure_get (params, "estimator", G_TYPE_INT, &auxi, NULL) ) {
+    RembEstimator::type estimator = RembEstimator::type::LOSS_BASED;
+
+    if (auxi == KMS_REMB_ESTIMATOR_DELAY) {
+      estimator = RembEstimator::type::DELAY_BASED;
+    }
+
+    ret->setEstimator (std::shared_ptr<RembEstimator> (new RembEstimator (
+                         estimator) ) );
+  }
   /* REMB local end */
 
   /* REMB remote begin */
@@ -373,6 +395,19 @@ BaseRtpEndpointImpl::setRembParams (std::shared_ptr<RembParams> rembParams)
                       rembParams->getUpLosses() );
   }
 
+  if (rembParams->isSetEstimator () ) {
+    gint estimator = KMS_REMB_ESTIMATOR_LOSS;
+
+    if (rembParams->getEstimator()->getValue() ==
+        RembEstimator::type::DELAY_BASED) {
+      estimator = KMS_REMB_ESTIMATOR_DELAY;
+    }
+
+    gst_structure_set (params, "estimator", G_TYPE_INT, estimator, NULL);
+    GST_DEBUG_OBJECT (element, "New 'estimator' value: %s",
+                      rembParams->getEstimator()->getString().c_str() );
+  }
+
   /* REMB local end */
 
   /* REMB remote begin */
@@ -17,6 +17,8 @@
 #include <gst/gst.h>
 #include "MediaType.hpp"
 #include "MediaLatencyStat.hpp"
+#include "TranscodingStat.hpp"
+#include "PadStat.hpp"
 #include "MediaType.hpp"
 #include "AudioCaps.hpp"
 #include "VideoCaps.hpp"
@@ -734,6 +736,20 @@ MediaElementImpl::MediaElementImpl (const boost::property_tree::ptree &config,
     g_object_set (G_OBJECT (element), MAX_ENCODER_BITRATE, bitrate, NULL);
   }
 
+  int samplingBuffers = 1;
+  int samplingInterval = 0;
+  bool sampling =
+      getConfigValue<int, MediaElement> (&samplingBuffers,
+          "latencySamplingBuffers");
+  sampling |= getConfigValue<int, MediaElement> (&samplingInterval,
+      "latencySamplingInterval");
+  if (sampling) {
+    GST_DEBUG ("Configured latency sampling: 1 every %d buffers or %d ms",
+        samplingBuffers, samplingInterval);
+    kms_stats_set_latency_sampling (MAX (samplingBuffers, 1),
+        MAX (samplingInterval, 0));
+  }
+
   busMessageHandler = 0;
 }
 
@@ -1433,6 +1449,18 @@ std::map <std::string, std::shared_ptr<Stats>>
 {
   std::map <std::string, std::shared_ptr<Stats>> statsReport;
   GstStructure *stats;
+  const std::string key = selector != nullptr ? selector : "";
+  const auto now = std::chrono::steady_clock::now ();
+
+  if (statsMaxStaleness > 0) {
+    std::unique_lock<std::mutex> lock (statsCacheMutex);
+    auto it = statsCache.find (key);
+
+    if (it != statsCache.end () && now - it->second.collected <=
+        std::chrono::milliseconds (statsMaxStaleness) ) {
+      return it->second.report;
+    }
+  }
 
   g_signal_emit_by_name (getGstreamerElement(), "stats", selector, &stats);
 
@@ -1445,6 +1473,12 @@ std::map <std::string, std::shared_ptr<Stats>>
 
   gst_structure_free (stats);
 
+  if (statsMaxStaleness > 0) {
+    std::unique_lock<std::mutex> lock (statsCacheMutex);
+
+    statsCache[key] = {now, statsReport};
+  }
+
   return statsReport;
 }
 
@@ -1504,8 +1538,9 @@ MediaElementImpl::collectLatencyStats (
   for (i = 0; i < fields; i ++) {
     const gchar *fieldname;
     const GValue *val;
+    const GstStructure *streamStats;
     gchar *mediaType;
-    guint64 avg;
+    guint64 avg, percentile;
 
     fieldname = gst_structure_nth_field_name (stats, i);
     val = gst_structure_get_value (stats, fieldname);
@@ -1515,7 +1550,8 @@ MediaElementImpl::collectLatencyStats (
       continue;
     }
 
-    gst_structure_get (gst_value_get_structure (val), "type", G_TYPE_STRING,
+    streamStats = gst_value_get_structure (val);
+    gst_structure_get (streamStats, "type", G_TYPE_STRING,
                        &mediaType, "avg", G_TYPE_UINT64, &avg, NULL);
 
     std::shared_ptr<MediaType> type = getMediaTypeFromTypeSelector (mediaType);
@@ -1523,10 +1559,137 @@ MediaElementImpl::collectLatencyStats (
       std::make_shared <MediaLatencyStat> (fieldname, type, avg);
     g_free (mediaType);
 
+    if (gst_structure_get_uint64 (streamStats, "p50", &percentile) ) {
+      latency->setP50 (percentile);
+    }
+
+    if (gst_structure_get_uint64 (streamStats, "p95", &percentile) ) {
+      latency->setP95 (percentile);
+    }
+
+    if (gst_structure_get_uint64 (streamStats, "p99", &percentile) ) {
+      latency->setP99 (percentile);
+    }
+
     latencyStats.push_back (latency);
   }
 }
 
+static std::string
+getStringField (const GstStructure *st, const gchar *field)
+{
+  const gchar *value = gst_structure_get_string (st, field);
+
+  return value != nullptr ? value : "";
+}
+
+static void
+collectTranscodingStats (std::vector<std::shared_ptr<TranscodingStat>>
+                         &transcodingStats, const GstStructure *stats)
+{
+  gint i, j, elements, bins;
+
+  elements = gst_structure_n_fields (stats);
+
+  /* One field per element, holding one structure per processing branch */
+  for (i = 0; i < elements; i ++) {
+    const GstStructure *element;
+    const GValue *val;
+
+    val = gst_structure_get_value (stats, gst_structure_nth_field_name (stats,
+                                   i) );
+
+    if (!GST_VALUE_HOLDS_STRUCTURE (val) ) {
+      continue;
+    }
+
+    element = gst_value_get_structure (val);
+    bins = gst_structure_n_fields (element);
+
+    for (j = 0; j < bins; j ++) {
+      const gchar *name = gst_structure_nth_field_name (element, j);
+      const GstStructure *bin;
+      gint64 creationTime = 0, removalTime = 0;
+      guint64 cpuTime = 0;
+
+      val = gst_structure_get_value (element, name);
+
+      if (!GST_VALUE_HOLDS_STRUCTURE (val) ) {
+        GST_DEBUG ("Ignore unexpected value for field %s", name);
+        continue;
+      }
+
+      bin = gst_value_get_structure (val);
+      gst_structure_get (bin, "creation-time", G_TYPE_INT64, &creationTime,
+                         "removal-time", G_TYPE_INT64, &removalTime, "cpu-time",
+                         G_TYPE_UINT64, &cpuTime, NULL);
+
+      transcodingStats.push_back (std::make_shared <TranscodingStat> (name,
+                                  getStringField (bin, "type"),
+                                  getStringField (bin, "input-caps"),
+                                  getStringField (bin, "output-caps"),
+                                  getStringField (bin, "elements"), creationTime,
+                                  removalTime, cpuTime) );
+    }
+  }
+}
+
+static void
+collectPadStats (std::vector<std::shared_ptr<PadStat>> &padStats,
+                 const GstStructure *stats)
+{
+  gint i, fields;
+
+  fields = gst_structure_n_fields (stats);
+
+  /* One field per media flow, named after its direction, type and pad */
+  for (i = 0; i < fields; i ++) {
+    const gchar *name = gst_structure_nth_field_name (stats, i);
+    const GstStructure *flow;
+    const GValue *val;
+    guint64 buffers = 0, bytes = 0, keyframes = 0, gaps = 0, flagged = 0;
+    guint64 lastTimestamp = GST_CLOCK_TIME_NONE;
+
+    val = gst_structure_get_value (stats, name);
+
+    if (!GST_VALUE_HOLDS_STRUCTURE (val) ) {
+      GST_DEBUG ("Ignore unexpected value for field %s", name);
+      continue;
+    }
+
+    flow = gst_value_get_structure (val);
+    gst_structure_get (flow, "buffers", G_TYPE_UINT64, &buffers, "bytes",
+                       G_TYPE_UINT64, &bytes, "keyframes", G_TYPE_UINT64, &keyframes,
+                       "gaps", G_TYPE_UINT64, &gaps, "flagged", G_TYPE_UINT64, &flagged,
+                       "last-timestamp", G_TYPE_UINT64, &lastTimestamp, NULL);
+
+    padStats.push_back (std::make_shared <PadStat> (name,
+                        getMediaTypeFromTypeSelector (gst_structure_get_string (flow,
+                            "type") ), buffers, bytes, keyframes, gaps, flagged,
+                        GST_CLOCK_TIME_IS_VALID (lastTimestamp) ? lastTimestamp : -1) );
+  }
+}
+
+std::vector<std::shared_ptr<PadStat>>
+    MediaElementImpl::getPadStats ()
+{
+  std::vector<std::shared_ptr<PadStat>> padStats;
+  GstStructure *stats, *counters;
+
+  g_signal_emit_by_name (getGstreamerElement(), "stats",
+                         KMS_PAD_COUNTERS_SELECTOR, &stats);
+
+  if (gst_structure_get (stats, KMS_PAD_COUNTERS_FIELD, GST_TYPE_STRUCTURE,
+                         &counters, NULL) ) {
+    collectPadStats (padStats, counters);
+    gst_structure_free (counters);
+  }
+
+  gst_structure_free (stats);
+
+  return padStats;
+}
+
 static void
 setDeprecatedProperties (std::shared_ptr<ElementStats> eStats)
 {
@@ -1549,7 +1712,7 @@ MediaElementImpl::fillStatsReport (std::map
                                    double timestamp, int64_t timestampMillis)
 {
   std::shared_ptr<Stats> elementStats;
-  GstStructure *latencies;
+  GstStructure *latencies, *transcodings;
   const GValue *value;
 
   value = gst_structure_get_value (stats, KMS_MEDIA_ELEMENT_FIELD);
@@ -1578,6 +1741,14 @@ MediaElementImpl::fillStatsReport (std::map
     gst_structure_free (latencies);
   }
 
+  std::vector<std::shared_ptr<TranscodingStat>> transcodingStats;
+
+  if (gst_structure_get (gst_value_get_structure (value), "transcodings",
+                         GST_TYPE_STRUCTURE, &transcodings, NULL) ) {
+    collectTranscodingStats (transcodingStats, transcodings);
+    gst_structure_free (transcodings);
+  }
+
   if (report.find (getId () ) != report.end() ) {
     std::shared_ptr<ElementStats> eStats =
       std::dynamic_pointer_cast <ElementStats> (report[getId ()]);
@@ -1589,6 +1760,11 @@ MediaElementImpl::fillStatsReport (std::map
     report[getId ()] = elementStats;
   }
 
+  if (!transcodingStats.empty() ) {
+    std::dynamic_pointer_cast <ElementStats> (report[getId ()])->setTranscodings (
+      transcodingStats);
+  }
+
   setDeprecatedProperties (std::dynamic_pointer_cast <ElementStats>
                            (report[getId ()]) );
 }
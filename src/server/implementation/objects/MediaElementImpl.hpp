@@ -23,6 +23,7 @@
 #include "MediaLatencyStat.hpp"
 #include <EventHandler.hpp>
 #include <gst/gst.h>
+#include <chrono>
 #include <mutex>
 #include <set>
 #include "MediaFlowOutStateChanged.hpp"
@@ -40,6 +41,7 @@ class MediaType;
 class MediaElementImpl;
 class AudioCodec;
 class VideoCodec;
+class PadStat;
 
 struct MediaTypeCmp {
   bool operator() (const std::shared_ptr<MediaType> &a,
@@ -73,6 +75,7 @@ public:
   virtual std::map <std::string, std::shared_ptr<Stats>> getStats () override;
   virtual std::map <std::string, std::shared_ptr<Stats>> getStats (
         std::shared_ptr<MediaType> mediaType) override;
+  virtual std::vector<std::shared_ptr<PadStat>> getPadStats () override;
 
   virtual std::vector<std::shared_ptr<ElementConnectionData>>
       getSourceConnections () override;
@@ -175,6 +178,9 @@ protected:
   std::map <std::string, std::shared_ptr <MediaFlowState>> mediaFlowOutStates;
   std::map <std::string, std::shared_ptr <MediaTranscodingState>> mediaTranscodingStates;
 
+  /* Reports younger than this (ms) are served from the cache, 0 disables it */
+  guint statsMaxStaleness = 0;
+
   virtual void postConstructor () override;
   void collectLatencyStats (std::vector<std::shared_ptr<MediaLatencyStat>>
                             &latencyStats, const GstStructure *stats);
@@ -203,6 +209,14 @@ private:
   gulong mediaTranscodingHandler = 0;
   gulong busMessageHandler = 0;
 
+  struct CachedStats {
+    std::chrono::steady_clock::time_point collected;
+    std::map <std::string, std::shared_ptr<Stats>> report;
+  };
+
+  std::mutex statsCacheMutex;
+  std::map <std::string, CachedStats> statsCache;
+
   void disconnectAll();
   void performConnection (std::shared_ptr <ElementConnectionDataInternal> data);
   std::map <std::string, std::shared_ptr<Stats>> generateStats (
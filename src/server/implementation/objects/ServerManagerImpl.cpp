@@ -25,6 +25,8 @@
 
 #include <boost/property_tree/json_parser.hpp>
 #include <gst/gst.h>
+#include "kmselement.h"
+#include "kmsmetrics.h"
 
 #include <thread> // sleep_for()
 
@@ -34,6 +36,8 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 
 #define METADATA "metadata"
 
+#define DEFAULT_METRICS_INTERVAL 15 /* seconds */
+
 namespace kurento
 {
 
@@ -56,12 +60,139 @@ childToString (const boost::property_tree::ptree tree, const char *nodeName)
   return ss.str ();
 }
 
+static void
+collectPipelineLatency (KmsMetricsCollector *collector, GstElement *pipeline)
+{
+  KmsLatencyHistogram *audio = kms_latency_histogram_new ();
+  KmsLatencyHistogram *video = kms_latency_histogram_new ();
+  GstIterator *it;
+  gboolean done = FALSE;
+  GValue item = G_VALUE_INIT;
+  gchar *name;
+
+  it = gst_bin_iterate_elements (GST_BIN (pipeline) );
+
+  while (!done) {
+    switch (gst_iterator_next (it, &item) ) {
+    case GST_ITERATOR_OK: {
+      GstElement *element = GST_ELEMENT (g_value_get_object (&item) );
+
+      if (KMS_IS_ELEMENT (element) ) {
+        kms_element_merge_input_latency (KMS_ELEMENT (element),
+                                         KMS_MEDIA_TYPE_AUDIO, audio);
+        kms_element_merge_input_latency (KMS_ELEMENT (element),
+                                         KMS_MEDIA_TYPE_VIDEO, video);
+      }
+
+      g_value_reset (&item);
+      break;
+    }
+
+    case GST_ITERATOR_RESYNC:
+      gst_iterator_resync (it);
+      kms_latency_histogram_reset (audio);
+      kms_latency_histogram_reset (video);
+      break;
+
+    default:
+      done = TRUE;
+      break;
+    }
+  }
+
+  g_value_unset (&item);
+  gst_iterator_free (it);
+
+  name = gst_element_get_name (pipeline);
+
+  if (kms_latency_histogram_get_count (audio) > 0) {
+    kms_metrics_collector_add_latency (collector,
+                                       "kms_pipeline_input_latency_seconds",
+                                       "Input latency of all the elements of the pipeline",
+                                       audio, "pipeline", name, "media", "audio", NULL);
+  }
+
+  if (kms_latency_histogram_get_count (video) > 0) {
+    kms_metrics_collector_add_latency (collector,
+                                       "kms_pipeline_input_latency_seconds",
+                                       "Input latency of all the elements of the pipeline",
+                                       video, "pipeline", name, "media", "video", NULL);
+  }
+
+  g_free (name);
+  kms_latency_histogram_free (audio);
+  kms_latency_histogram_free (video);
+}
+
+static void
+collectServerMetrics (KmsMetricsCollector *collector, gpointer user_data)
+{
+  auto pipelines = MediaSet::getMediaSet ()->getPipelines ();
+
+  kms_metrics_collector_add (collector, "kms_process_cpu_seconds_total",
+                             KMS_METRIC_TYPE_COUNTER, "CPU time used by the media server",
+                             cpuTime (), NULL);
+  kms_metrics_collector_add (collector, "kms_process_resident_memory_bytes",
+                             KMS_METRIC_TYPE_GAUGE, "Resident memory of the media server",
+                             memoryUse () * 1024.0, NULL);
+  kms_metrics_collector_add (collector, "kms_cpu_count", KMS_METRIC_TYPE_GAUGE,
+                             "CPUs available to the media server", cpuCount (), NULL);
+  kms_metrics_collector_add (collector, "kms_sessions", KMS_METRIC_TYPE_GAUGE,
+                             "Client sessions", MediaSet::getMediaSet ()->getSessions ().size (),
+                             NULL);
+  kms_metrics_collector_add (collector, "kms_pipelines", KMS_METRIC_TYPE_GAUGE,
+                             "Media pipelines", pipelines.size (), NULL);
+
+  for (auto it : pipelines) {
+    auto pipeline = std::dynamic_pointer_cast <MediaPipelineImpl> (it);
+
+    if (pipeline) {
+      collectPipelineLatency (collector, pipeline->getPipeline () );
+    }
+  }
+}
+
 ServerManagerImpl::ServerManagerImpl (const std::shared_ptr<ServerInfo> info,
                                       const boost::property_tree::ptree &config,
                                       ModuleManager &moduleManager) : MediaObjectImpl (config),
   info (info), moduleManager (moduleManager)
 {
+  std::string metricsSocket, metricsFile;
+  int metricsInterval = DEFAULT_METRICS_INTERVAL;
+
   metadata = childToString (config, METADATA);
+
+  // Process wide metrics, element metrics are registered by each element
+  metricsCollectorId = kms_metrics_add_collector (collectServerMetrics,
+                       nullptr, nullptr);
+
+  getConfigValue <std::string, ServerManager> (&metricsSocket,
+      "metricsSocket");
+  getConfigValue <std::string, ServerManager> (&metricsFile, "metricsFile");
+  getConfigValue <int, ServerManager> (&metricsInterval, "metricsInterval");
+
+  if (!metricsSocket.empty () || !metricsFile.empty () ) {
+    GError *err = nullptr;
+
+    metricsExporter = kms_metrics_exporter_new (
+                        metricsSocket.empty () ? nullptr : metricsSocket.c_str (),
+                        metricsFile.empty () ? nullptr : metricsFile.c_str (),
+                        MAX (metricsInterval, 1), &err);
+
+    if (metricsExporter == nullptr) {
+      GST_ERROR ("Cannot export metrics: %s", err->message);
+      g_error_free (err);
+    }
+  }
+}
+
+ServerManagerImpl::~ServerManagerImpl ()
+{
+  if (metricsExporter != nullptr) {
+    kms_metrics_exporter_free (metricsExporter);
+  }
+
+  kms_metrics_remove_collector (metricsCollectorId);
 }
 
 std::shared_ptr<ServerInfo> ServerManagerImpl::getInfo ()
@@ -35,6 +35,8 @@ void Serialize (std::shared_ptr<kurento::ServerManagerImpl> &object,
                 JsonSerializer &serializer);
 } /* kurento */
 
+typedef struct _KmsMetricsExporter KmsMetricsExporter;
+
 namespace kurento
 {
 class ServerInfo;
@@ -53,7 +55,7 @@ public:
                      const boost::property_tree::ptree &config,
                      ModuleManager &moduleManager);
 
-  virtual ~ServerManagerImpl () {};
+  virtual ~ServerManagerImpl ();
 
   std::string getKmd (const std::string &moduleName) override;
 
@@ -96,6 +98,9 @@ private:
 
   ModuleManager &moduleManager;
 
+  unsigned int metricsCollectorId = 0;
+  KmsMetricsExporter *metricsExporter = nullptr;
+
   class StaticConstructor
   {
   public:
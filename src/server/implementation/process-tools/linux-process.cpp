@@ -169,6 +169,14 @@ float cpuPercentEnd (const struct cpustat_t *cpustat)
 
 // ----------------------------------------------------------------------------
 
+double
+cpuTime ()
+{
+  return (double) processTicks () / sysconf (_SC_CLK_TCK);
+}
+
+// ----------------------------------------------------------------------------
+
 long int memoryUse ()
 {
   std::ifstream statm (SELF_STATM_FILE_PATH);
@@ -48,6 +48,11 @@ void cpuPercentBegin (struct cpustat_t *cpustat);
 float cpuPercentEnd (const struct cpustat_t *cpustat);
 
 
+/**
+ * Total CPU time used by this process, in seconds.
+ */
+double cpuTime ();
+
 /**
  * Memory used by this process, in KiB.
  * This counts the Resident Set Size (RSS).
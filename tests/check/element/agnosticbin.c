@@ -964,6 +964,754 @@ GST_START_TEST (create_test)
   g_object_unref (agnosticbin);
 }
 
+GST_END_TEST
+static void
+fakesink_hand_off_quit (GstElement * fakesink, GstBuffer * buf, GstPad * pad,
+    gpointer data)
+{
+  static int count = 0;
+  GMainLoop *loop = (GMainLoop *) data;
+
+  if (count++ == 20) {
+    g_object_set (G_OBJECT (fakesink), "signal-handoffs", FALSE, NULL);
+    g_idle_add (quit_main_loop_idle, loop);
+  }
+}
+
+GST_START_TEST (caps_index)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, TRUE);
+  GstElement *pipeline =
+      gst_parse_launch ("videotestsrc is-live=true ! agnosticbin name=ag"
+      " ag. ! video/x-raw,format=I420 ! fakesink async=false sync=false"
+      " ag. ! video/x-raw,format=I420 ! fakesink name=sink async=false"
+      " sync=false signal-handoffs=true", NULL);
+  GstElement *agnosticbin = gst_bin_get_by_name (GST_BIN (pipeline), "ag");
+  GstElement *fakesink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  guint64 hits, misses;
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  g_signal_connect (G_OBJECT (fakesink), "handoff",
+      G_CALLBACK (fakesink_hand_off_quit), loop);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_timeout_add_seconds (10, timeout_check, pipeline);
+
+  mark_point ();
+  g_main_loop_run (loop);
+  mark_point ();
+
+  g_object_get (agnosticbin, "caps-index-hits", &hits, "caps-index-misses",
+      &misses, NULL);
+  GST_DEBUG ("Caps index hits: %" G_GUINT64_FORMAT ", misses: %"
+      G_GUINT64_FORMAT, hits, misses);
+
+  /* Both outputs want the same caps, only the first one needs a scan */
+  fail_unless (misses >= 1);
+  fail_unless (hits >= 1);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (agnosticbin);
+  g_object_unref (fakesink);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST
+static gboolean
+find_encode_record (GQuark field_id, const GValue * value, gpointer user_data)
+{
+  const GstStructure *record = gst_value_get_structure (value);
+  guint64 *cpu_time = user_data;
+  const gchar *elements;
+
+  if (g_strcmp0 (gst_structure_get_string (record, "type"), "encode") != 0) {
+    return TRUE;
+  }
+
+  elements = gst_structure_get_string (record, "elements");
+  GST_DEBUG ("Encode TreeBin %s: %s", g_quark_to_string (field_id), elements);
+  fail_unless (elements != NULL && g_strstr_len (elements, -1, "vp8enc") != NULL);
+  fail_unless (gst_structure_get_uint64 (record, "cpu-time", cpu_time));
+
+  return FALSE;
+}
+
+GST_START_TEST (transcoding_stats)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, TRUE);
+  GstElement *pipeline =
+      gst_parse_launch ("videotestsrc is-live=true ! agnosticbin name=ag"
+      " ag. ! video/x-vp8 ! fakesink name=sink async=false sync=false"
+      " signal-handoffs=true", NULL);
+  GstElement *agnosticbin = gst_bin_get_by_name (GST_BIN (pipeline), "ag");
+  GstElement *fakesink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  GstStructure *stats;
+  guint64 cpu_time = 0;
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  g_signal_connect (G_OBJECT (fakesink), "handoff",
+      G_CALLBACK (fakesink_hand_off_quit), loop);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_timeout_add_seconds (10, timeout_check, pipeline);
+
+  mark_point ();
+  g_main_loop_run (loop);
+  mark_point ();
+
+  g_object_get (agnosticbin, "transcoding-stats", &stats, NULL);
+  GST_DEBUG ("Transcoding stats: %" GST_PTR_FORMAT, stats);
+
+  /* The encoder has been running in the streaming thread of its TreeBin */
+  fail_if (gst_structure_foreach (stats, find_encode_record, &cpu_time));
+  fail_unless (cpu_time > 0);
+  gst_structure_free (stats);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (agnosticbin);
+  g_object_unref (fakesink);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST
+static gboolean
+link_second_encoded_output (gpointer data)
+{
+  GstElement *pipeline = data;
+  GstElement *agnosticbin = gst_bin_get_by_name (GST_BIN (pipeline), "ag");
+  GstElement *capsfilter2 = gst_bin_get_by_name (GST_BIN (pipeline), "caps2");
+
+  fail_unless (gst_element_link (agnosticbin, capsfilter2));
+
+  g_object_unref (agnosticbin);
+  g_object_unref (capsfilter2);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+unlink_encoded_output (gpointer data)
+{
+  GstElement *pipeline = data;
+  GstElement *agnosticbin = gst_bin_get_by_name (GST_BIN (pipeline), "ag");
+  GstElement *capsfilter = gst_bin_get_by_name (GST_BIN (pipeline), "caps");
+  GstElement *fakesink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  GstPad *sink, *src;
+
+  /* Drop the only consumer of the encoder, so it gets parked */
+  sink = gst_element_get_static_pad (capsfilter, "sink");
+  src = gst_pad_get_peer (sink);
+  gst_pad_unlink (src, sink);
+  gst_element_release_request_pad (agnosticbin, src);
+  g_object_unref (src);
+  g_object_unref (sink);
+
+  gst_element_set_locked_state (capsfilter, TRUE);
+  gst_element_set_locked_state (fakesink, TRUE);
+  gst_element_set_state (capsfilter, GST_STATE_NULL);
+  gst_element_set_state (fakesink, GST_STATE_NULL);
+
+  g_timeout_add (500, link_second_encoded_output, pipeline);
+
+  g_object_unref (agnosticbin);
+  g_object_unref (capsfilter);
+  g_object_unref (fakesink);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+fakesink_hand_off_relink (GstElement * fakesink, GstBuffer * buf, GstPad * pad,
+    gpointer data)
+{
+  static int count = 0;
+
+  if (count++ == 10) {
+    g_object_set (G_OBJECT (fakesink), "signal-handoffs", FALSE, NULL);
+    g_idle_add (unlink_encoded_output, data);
+  }
+}
+
+GST_START_TEST (idle_bin_reuse)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, TRUE);
+  GstElement *pipeline =
+      gst_parse_launch ("videotestsrc is-live=true ! agnosticbin name=ag"
+      " idle-bin-timeout=5000"
+      " ag. ! capsfilter name=caps caps=video/x-vp8 ! fakesink name=sink"
+      " async=false sync=false signal-handoffs=true"
+      " capsfilter name=caps2 caps=video/x-vp8 ! fakesink name=sink2"
+      " async=false sync=false signal-handoffs=true", NULL);
+  GstElement *agnosticbin = gst_bin_get_by_name (GST_BIN (pipeline), "ag");
+  GstElement *fakesink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  GstElement *fakesink2 = gst_bin_get_by_name (GST_BIN (pipeline), "sink2");
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  guint64 reuses, teardowns;
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  /* The first output is dropped and a new one links while it is parked */
+  g_signal_connect (G_OBJECT (fakesink), "handoff",
+      G_CALLBACK (fakesink_hand_off_relink), pipeline);
+  g_signal_connect (G_OBJECT (fakesink2), "handoff",
+      G_CALLBACK (fakesink_hand_off_quit), loop);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_timeout_add_seconds (10, timeout_check, pipeline);
+
+  mark_point ();
+  g_main_loop_run (loop);
+  mark_point ();
+
+  g_object_get (agnosticbin, "idle-bin-reuses", &reuses,
+      "idle-bin-teardowns", &teardowns, NULL);
+  GST_DEBUG ("Idle bin reuses: %" G_GUINT64_FORMAT ", teardowns: %"
+      G_GUINT64_FORMAT, reuses, teardowns);
+
+  fail_unless (reuses == 1);
+  fail_unless (teardowns == 0);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (agnosticbin);
+  g_object_unref (fakesink);
+  g_object_unref (fakesink2);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST
+static void
+count_queue (const GValue * value, gpointer user_data)
+{
+  GstElement *element = g_value_get_object (value);
+  guint *count = user_data;
+
+  if (g_strcmp0 (GST_OBJECT_NAME (gst_element_get_factory (element)),
+          "queue") == 0) {
+    (*count)++;
+  }
+}
+
+/* Queues directly inside the agnosticbin, one per streaming thread */
+static guint
+count_output_queues (GstElement * agnosticbin)
+{
+  GstIterator *it = gst_bin_iterate_elements (GST_BIN (agnosticbin));
+  guint count = 0;
+
+  while (gst_iterator_foreach (it, count_queue, &count) ==
+      GST_ITERATOR_RESYNC) {
+    count = 0;
+    gst_iterator_resync (it);
+  }
+  gst_iterator_free (it);
+
+  return count;
+}
+
+static guint
+run_output_queues (gboolean shared)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, TRUE);
+  gchar *description =
+      g_strdup_printf ("videotestsrc is-live=true"
+      " ! agnosticbin name=ag shared-output-queue=%s"
+      " ag. ! video/x-vp8 ! fakesink async=false sync=false"
+      " ag. ! video/x-vp8 ! fakesink async=false sync=false"
+      " ag. ! video/x-vp8 ! fakesink name=sink async=false sync=false"
+      " signal-handoffs=true", shared ? "true" : "false");
+  GstElement *pipeline = gst_parse_launch (description, NULL);
+  GstElement *agnosticbin = gst_bin_get_by_name (GST_BIN (pipeline), "ag");
+  GstElement *fakesink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  guint queues;
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  g_signal_connect (G_OBJECT (fakesink), "handoff",
+      G_CALLBACK (fakesink_hand_off_quit), loop);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_timeout_add_seconds (10, timeout_check, pipeline);
+
+  mark_point ();
+  g_main_loop_run (loop);
+  mark_point ();
+
+  queues = count_output_queues (agnosticbin);
+  GST_DEBUG ("Output queues (shared: %d): %u", shared, queues);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (agnosticbin);
+  g_object_unref (fakesink);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+  g_free (description);
+
+  return queues;
+}
+
+GST_START_TEST (shared_output_queue)
+{
+  /* The three encoded outputs are fed by one queue */
+  fail_unless_equals_int (run_output_queues (TRUE), 1);
+}
+
+GST_END_TEST
+GST_START_TEST (separate_output_queues)
+{
+  fail_unless_equals_int (run_output_queues (FALSE), 3);
+}
+
+GST_END_TEST
+static void
+get_queue (const GValue * value, gpointer user_data)
+{
+  GstElement *element = g_value_get_object (value);
+  GstElement **queue = user_data;
+
+  if (g_strcmp0 (GST_OBJECT_NAME (gst_element_get_factory (element)),
+          "queue") == 0) {
+    *queue = element;
+  }
+}
+
+static guint64
+get_output_queue_time (GstElement * agnosticbin)
+{
+  GstIterator *it = gst_bin_iterate_elements (GST_BIN (agnosticbin));
+  GstElement *queue = NULL;
+  guint64 max_size_time = 0;
+
+  while (gst_iterator_foreach (it, get_queue, &queue) == GST_ITERATOR_RESYNC) {
+    gst_iterator_resync (it);
+  }
+  gst_iterator_free (it);
+
+  fail_unless (queue != NULL);
+  g_object_get (queue, "max-size-time", &max_size_time, NULL);
+
+  return max_size_time;
+}
+
+#define STALL_MS 300
+
+static void
+fakesink_hand_off_stall (GstElement * fakesink, GstBuffer * buf,
+    GstPad * pad, gpointer data)
+{
+  static int count = 0;
+  GMainLoop *loop = (GMainLoop *) data;
+  gboolean stall = GPOINTER_TO_INT (g_object_get_data (G_OBJECT (fakesink),
+          "stall"));
+
+  count++;
+
+  /* A consumer like a recorder, blocking now and then */
+  if (stall && count % 10 == 5) {
+    g_usleep (STALL_MS * G_TIME_SPAN_MILLISECOND);
+  }
+
+  if (count == 60) {
+    g_object_set (G_OBJECT (fakesink), "signal-handoffs", FALSE, NULL);
+    g_idle_add (quit_main_loop_idle, loop);
+  }
+}
+
+static guint64
+run_latency_budget (gboolean stall)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, TRUE);
+  GstElement *pipeline =
+      gst_parse_launch ("videotestsrc is-live=true"
+      " ! agnosticbin name=ag latency-budget=1000"
+      " ! video/x-vp8 ! fakesink name=sink async=false sync=false"
+      " signal-handoffs=true", NULL);
+  GstElement *agnosticbin = gst_bin_get_by_name (GST_BIN (pipeline), "ag");
+  GstElement *fakesink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  guint64 max_size_time;
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  g_object_set_data (G_OBJECT (fakesink), "stall", GINT_TO_POINTER (stall));
+  g_signal_connect (G_OBJECT (fakesink), "handoff",
+      G_CALLBACK (fakesink_hand_off_stall), loop);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_timeout_add_seconds (10, timeout_check, pipeline);
+
+  mark_point ();
+  g_main_loop_run (loop);
+  mark_point ();
+
+  max_size_time = get_output_queue_time (agnosticbin);
+  GST_DEBUG ("Output queue size (stall: %d): %" GST_TIME_FORMAT, stall,
+      GST_TIME_ARGS (max_size_time));
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (agnosticbin);
+  g_object_unref (fakesink);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+
+  return max_size_time;
+}
+
+GST_START_TEST (latency_budget_fast_consumer)
+{
+  /* A consumer keeping up only needs a few frames queued */
+  fail_unless (run_latency_budget (FALSE) < STALL_MS * GST_MSECOND);
+}
+
+GST_END_TEST
+GST_START_TEST (latency_budget_stalling_consumer)
+{
+  guint64 max_size_time = run_latency_budget (TRUE);
+
+  /* The queue absorbs the stalls, within the budget */
+  fail_unless (max_size_time >= STALL_MS * GST_MSECOND);
+  fail_unless (max_size_time <= 1000 * GST_MSECOND);
+}
+
+GST_END_TEST
+typedef struct _RecordCount
+{
+  const gchar *type;
+  guint count;
+} RecordCount;
+
+static gboolean
+count_records (GQuark field_id, const GValue * value, gpointer user_data)
+{
+  const GstStructure *record = gst_value_get_structure (value);
+  RecordCount *records = user_data;
+
+  if (g_strcmp0 (gst_structure_get_string (record, "type"),
+          records->type) == 0) {
+    records->count++;
+  }
+
+  return TRUE;
+}
+
+/* TreeBins of @type ("encode", "decode"...) created by agnosticbin @name */
+static guint
+get_created_bins (GstElement * pipeline, const gchar * name,
+    const gchar * type)
+{
+  GstElement *agnosticbin = gst_bin_get_by_name (GST_BIN (pipeline), name);
+  RecordCount records = { type, 0 };
+  GstStructure *stats;
+
+  g_object_get (agnosticbin, "transcoding-stats", &stats, NULL);
+  GST_DEBUG ("Transcoding stats of %s: %" GST_PTR_FORMAT, name, stats);
+  gst_structure_foreach (stats, count_records, &records);
+  gst_structure_free (stats);
+  g_object_unref (agnosticbin);
+
+  return records.count;
+}
+
+static gboolean
+link_second_agnosticbin (gpointer data)
+{
+  GstElement *pipeline = data;
+  GstElement *agnosticbin = gst_bin_get_by_name (GST_BIN (pipeline), "ag2");
+  GstElement *capsfilter = gst_bin_get_by_name (GST_BIN (pipeline), "caps2");
+
+  fail_unless (gst_element_link (agnosticbin, capsfilter));
+
+  g_object_unref (agnosticbin);
+  g_object_unref (capsfilter);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+fakesink_hand_off_link_second (GstElement * fakesink, GstBuffer * buf,
+    GstPad * pad, gpointer data)
+{
+  static int count = 0;
+
+  if (count++ == 10) {
+    g_object_set (G_OBJECT (fakesink), "signal-handoffs", FALSE, NULL);
+    g_idle_add (link_second_agnosticbin, data);
+  }
+}
+
+typedef void (*SharedTranscodersCheck) (GstElement * pipeline);
+
+static void
+run_shared_transcoders_full (const gchar * description, const gchar * type,
+    guint expected_bins, SharedTranscodersCheck check)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, TRUE);
+  GstElement *pipeline = gst_parse_launch (description, NULL);
+  GstElement *fakesink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  GstElement *fakesink2 = gst_bin_get_by_name (GST_BIN (pipeline), "sink2");
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  /* The second agnosticbin asks for an encoder once the first one runs */
+  g_signal_connect (G_OBJECT (fakesink), "handoff",
+      G_CALLBACK (fakesink_hand_off_link_second), pipeline);
+  g_signal_connect (G_OBJECT (fakesink2), "handoff",
+      G_CALLBACK (fakesink_hand_off_quit), loop);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_timeout_add_seconds (10, timeout_check, pipeline);
+
+  mark_point ();
+  g_main_loop_run (loop);
+  mark_point ();
+
+  fail_unless_equals_int (get_created_bins (pipeline, "ag1", type), 1);
+  fail_unless_equals_int (get_created_bins (pipeline, "ag2", type),
+      expected_bins);
+
+  if (check != NULL) {
+    check (pipeline);
+  }
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (fakesink);
+  g_object_unref (fakesink2);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
+static void
+run_shared_transcoders (const gchar * description, guint expected_encoders)
+{
+  run_shared_transcoders_full (description, "encode", expected_encoders,
+      NULL);
+}
+
+GST_START_TEST (shared_encoder)
+{
+  /* Both agnosticbins get the media of the same tee */
+  run_shared_transcoders ("videotestsrc is-live=true ! tee name=t"
+      " t. ! agnosticbin name=ag1 share-transcoders=true"
+      " t. ! agnosticbin name=ag2 share-transcoders=true"
+      " ag1. ! video/x-vp8 ! fakesink name=sink async=false sync=false"
+      " signal-handoffs=true"
+      " capsfilter name=caps2 caps=video/x-vp8 ! fakesink name=sink2"
+      " async=false sync=false signal-handoffs=true", 0);
+}
+
+GST_END_TEST
+GST_START_TEST (shared_encoder_two_filters)
+{
+  /* Same source and stream id, but each filter produces different media */
+  run_shared_transcoders ("videotestsrc is-live=true ! tee name=t"
+      " t. ! queue ! videoflip method=horizontal-flip"
+      " ! agnosticbin name=ag1 share-transcoders=true"
+      " t. ! queue ! videoflip method=vertical-flip"
+      " ! agnosticbin name=ag2 share-transcoders=true"
+      " ag1. ! video/x-vp8 ! fakesink name=sink async=false sync=false"
+      " signal-handoffs=true"
+      " capsfilter name=caps2 caps=video/x-vp8 ! fakesink name=sink2"
+      " async=false sync=false signal-handoffs=true", 1);
+}
+
+GST_END_TEST
+GST_START_TEST (shared_decoder)
+{
+  /* The second agnosticbin decodes with the decoder of the first one */
+  run_shared_transcoders_full ("videotestsrc is-live=true"
+      " ! vp8enc deadline=1 ! tee name=t"
+      " t. ! agnosticbin name=ag1 share-transcoders=true"
+      " t. ! agnosticbin name=ag2 share-transcoders=true"
+      " ag1. ! video/x-raw ! fakesink name=sink async=false sync=false"
+      " signal-handoffs=true"
+      " capsfilter name=caps2 caps=video/x-raw ! fakesink name=sink2"
+      " async=false sync=false signal-handoffs=true", "decode", 0, NULL);
+}
+
+GST_END_TEST
+static gint
+get_current_width (GstPad * pad)
+{
+  GstCaps *caps = gst_pad_get_current_caps (pad);
+  gint width = 0;
+
+  if (caps != NULL) {
+    gst_structure_get_int (gst_caps_get_structure (caps, 0), "width", &width);
+    gst_caps_unref (caps);
+  }
+
+  return width;
+}
+
+static gboolean
+send_remb (gpointer fakesink)
+{
+  guint bitrate = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (fakesink),
+          "remb-bitrate"));
+  GstStructure *remb = gst_structure_new ("REMB", "bitrate", G_TYPE_UINT,
+      bitrate, "ssrc", G_TYPE_UINT, 1, NULL);
+
+  GST_DEBUG ("Sending REMB of %u bps", bitrate);
+  gst_element_send_event (GST_ELEMENT (fakesink),
+      gst_event_new_custom (GST_EVENT_CUSTOM_UPSTREAM, remb));
+
+  return G_SOURCE_REMOVE;
+}
+
+static gint
+find_vp8enc (const GValue * item, gconstpointer unused)
+{
+  GstElement *element = g_value_get_object (item);
+  GstElementFactory *factory = gst_element_get_factory (element);
+
+  if (factory != NULL
+      && g_strcmp0 (GST_OBJECT_NAME (factory), "vp8enc") == 0) {
+    return 0;
+  }
+
+  return 1;
+}
+
+static void
+check_shared_encoder_bitrate (GstElement * pipeline)
+{
+  GstElement *agnosticbin = gst_bin_get_by_name (GST_BIN (pipeline), "ag2");
+  GstElement *fakesink = gst_bin_get_by_name (GST_BIN (pipeline), "sink2");
+  GValue item = G_VALUE_INIT;
+  GstIterator *it;
+  gint target_bitrate;
+
+  /* ag2 uses the encoder of ag1, but its own limits still apply */
+  g_object_set (agnosticbin, "max-encoder-bitrate", 100000, NULL);
+  g_object_set_data (G_OBJECT (fakesink), "remb-bitrate",
+      GUINT_TO_POINTER (1000000));
+  send_remb (fakesink);
+
+  it = gst_bin_iterate_recurse (GST_BIN (pipeline));
+  fail_unless (gst_iterator_find_custom (it, (GCompareFunc) find_vp8enc,
+          &item, NULL));
+  gst_iterator_free (it);
+
+  g_object_get (g_value_get_object (&item), "target-bitrate", &target_bitrate,
+      NULL);
+  fail_unless_equals_int (target_bitrate, 100000);
+
+  g_value_unset (&item);
+  g_object_unref (fakesink);
+  g_object_unref (agnosticbin);
+}
+
+GST_START_TEST (shared_encoder_bitrate)
+{
+  run_shared_transcoders_full ("videotestsrc is-live=true ! tee name=t"
+      " t. ! agnosticbin name=ag1 share-transcoders=true"
+      " t. ! agnosticbin name=ag2 share-transcoders=true"
+      " ag1. ! video/x-vp8 ! fakesink name=sink async=false sync=false"
+      " signal-handoffs=true"
+      " capsfilter name=caps2 caps=video/x-vp8 ! fakesink name=sink2"
+      " async=false sync=false signal-handoffs=true", "encode", 0,
+      check_shared_encoder_bitrate);
+}
+
+GST_END_TEST;
+
+static gint width_over_threshold = 0;
+
+static void
+fakesink_hand_off_ladder (GstElement * fakesink, GstBuffer * buf,
+    GstPad * pad, gpointer data)
+{
+  static int count = 0;
+  GMainLoop *loop = (GMainLoop *) data;
+  gint width = get_current_width (pad);
+
+  count++;
+
+  if (count == 10) {
+    /* Under the target bitrate, but over the threshold of rendition 0 */
+    g_object_set_data (G_OBJECT (fakesink), "remb-bitrate",
+        GUINT_TO_POINTER (200000));
+    g_idle_add (send_remb, fakesink);
+  } else if (count == 60) {
+    width_over_threshold = width;
+    g_object_set_data (G_OBJECT (fakesink), "remb-bitrate",
+        GUINT_TO_POINTER (100000));
+    g_idle_add (send_remb, fakesink);
+  } else if (count > 60 && width == 160) {
+    g_object_set (G_OBJECT (fakesink), "signal-handoffs", FALSE, NULL);
+    g_idle_add (quit_main_loop_idle, loop);
+  }
+}
+
+GST_START_TEST (rendition_ladder)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, TRUE);
+  GstElement *pipeline =
+      gst_parse_launch ("videotestsrc is-live=true"
+      " ! video/x-raw,width=320,height=240"
+      " ! agnosticbin ladder-renditions=3 target-encoder-bitrate=300000"
+      " ! video/x-vp8 ! fakesink name=sink async=false sync=false"
+      " signal-handoffs=true", NULL);
+  GstElement *fakesink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  g_signal_connect (G_OBJECT (fakesink), "handoff",
+      G_CALLBACK (fakesink_hand_off_ladder), loop);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_timeout_add_seconds (10, timeout_check, pipeline);
+
+  mark_point ();
+  g_main_loop_run (loop);
+  mark_point ();
+
+  /* 200 kbps keeps the full resolution, 100 kbps moves to rendition 1 */
+  fail_unless_equals_int (width_over_threshold, 320);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (fakesink);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
 GST_END_TEST
 GST_START_TEST (h264_encoding_odd_dimension)
 {
@@ -1440,6 +2188,18 @@ agnostic2_suite (void)
 
   suite_add_tcase (s, tc_chain);
   tcase_add_test (tc_chain, create_test);
+  tcase_add_test (tc_chain, caps_index);
+  tcase_add_test (tc_chain, transcoding_stats);
+  tcase_add_test (tc_chain, idle_bin_reuse);
+  tcase_add_test (tc_chain, shared_output_queue);
+  tcase_add_test (tc_chain, separate_output_queues);
+  tcase_add_test (tc_chain, latency_budget_fast_consumer);
+  tcase_add_test (tc_chain, latency_budget_stalling_consumer);
+  tcase_add_test (tc_chain, shared_encoder);
+  tcase_add_test (tc_chain, shared_encoder_two_filters);
+  tcase_add_test (tc_chain, shared_encoder_bitrate);
+  tcase_add_test (tc_chain, shared_decoder);
+  tcase_add_test (tc_chain, rendition_ladder);
   tcase_add_test (tc_chain, simple_link);
   tcase_add_test (tc_chain, encoded_input_link);
   tcase_add_test (tc_chain, static_link);
@@ -1291,6 +1291,215 @@ GST_START_TEST (two_sinks_one_src_test)
   fail_unless (success, "No buffer received");
 }
 
+GST_END_TEST static gboolean
+request_transcoded_src_pad (GstElement * agnosticbin)
+{
+  GstCaps *caps = gst_caps_from_string ("video/x-h264");
+  GstPad *srcpad, *target, *transcodersink;
+  GstElement *transcoder;
+  GstCaps *transcodercaps;
+  GstPadTemplate *templ;
+
+  templ =
+      gst_element_class_get_pad_template (GST_ELEMENT_GET_CLASS (agnosticbin),
+      "src_%u");
+  srcpad = gst_element_request_pad (agnosticbin, templ, NULL, caps);
+  target = gst_ghost_pad_get_target (GST_GHOST_PAD (srcpad));
+  fail_if (target == NULL, "Source pad not connected to any transcoder");
+
+  transcoder = gst_pad_get_parent_element (target);
+  transcodersink = gst_element_get_static_pad (transcoder, "sink");
+  transcodercaps = gst_pad_get_current_caps (transcodersink);
+
+  /* Encoding the raw input is cheaper than decoding and encoding the VP8 one */
+  GST_DEBUG_OBJECT (transcoder, "Transcoding from %" GST_PTR_FORMAT,
+      transcodercaps);
+  fail_unless (gst_structure_has_name (gst_caps_get_structure (transcodercaps,
+              0), "video/x-raw"));
+
+  gst_caps_unref (transcodercaps);
+  g_object_unref (transcodersink);
+  g_object_unref (transcoder);
+  g_object_unref (target);
+  g_object_unref (srcpad);
+  gst_caps_unref (caps);
+
+  g_idle_add (quit_main_loop_idle, NULL);
+
+  return G_SOURCE_REMOVE;
+}
+
+GST_START_TEST (transcode_in_cheapest_test)
+{
+  GstElement *source1 = gst_element_factory_make ("videotestsrc", NULL);
+  GstElement *source2 = gst_element_factory_make ("videotestsrc", NULL);
+  GstElement *enc2 = gst_element_factory_make ("vp8enc", NULL);
+  GstElement *agnosticbin = gst_element_factory_make ("agnosticbin3", NULL);
+  GstBus *bus;
+
+  pipeline = gst_pipeline_new (__FUNCTION__);
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  g_object_set (G_OBJECT (source1), "is-live", TRUE, NULL);
+  g_object_set (G_OBJECT (source2), "is-live", TRUE, NULL);
+
+  loop = g_main_loop_new (NULL, TRUE);
+
+  gst_bin_add_many (GST_BIN (pipeline), source1, source2, enc2, agnosticbin,
+      NULL);
+
+  if (!gst_element_link (source2, enc2)) {
+    fail ("Could not link videotestsrc2 to encoder2");
+  }
+
+  if (!gst_element_link_pads (enc2, "src", agnosticbin, "sink_%u")) {
+    fail ("Could not link encoder2 to agnosticbin");
+  }
+
+  if (!gst_element_link_pads (source1, "src", agnosticbin, "sink_%u")) {
+    fail ("Could not link videotestsrc1 to agnosticbin");
+  }
+
+  call_on_negotiated (agnosticbin, (GSourceFunc) request_transcoded_src_pad,
+      agnosticbin);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_timeout_add_seconds (4, print_timedout_pipeline, NULL);
+
+  g_main_loop_run (loop);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST static GstElement *
+request_transcoder (GstElement * agnosticbin, const gchar * caps_str,
+    GstPad ** srcpad)
+{
+  GstCaps *caps = gst_caps_from_string (caps_str);
+  GstElement *transcoder;
+  GstPadTemplate *templ;
+  GstPad *target;
+
+  templ =
+      gst_element_class_get_pad_template (GST_ELEMENT_GET_CLASS (agnosticbin),
+      "src_%u");
+  *srcpad = gst_element_request_pad (agnosticbin, templ, NULL, caps);
+  target = gst_ghost_pad_get_target (GST_GHOST_PAD (*srcpad));
+  fail_if (target == NULL, "Source pad not connected to any transcoder");
+
+  transcoder = gst_pad_get_parent_element (target);
+
+  g_object_unref (target);
+  gst_caps_unref (caps);
+
+  return transcoder;
+}
+
+static gboolean
+release_transcoded_src_pad (GstElement * agnosticbin)
+{
+  const gchar *released_caps[] = {
+    "video/x-h264,width=(int)160",
+    "video/x-h264,width=(int)320",
+    "video/x-h264,width=(int)640"
+  };
+  GstElement *transcoder;
+  GstPad *srcpad, *sinkpad;
+  GstCaps *caps;
+  guint16 srcpads;
+  guint i;
+
+  srcpads = agnosticbin->numsrcpads;
+
+  /*
+   * Had the released outputs been counted, encoding a fourth one in the raw
+   * input would look more expensive than decoding the VP8 one.
+   */
+  for (i = 0; i < G_N_ELEMENTS (released_caps); i++) {
+    transcoder = request_transcoder (agnosticbin, released_caps[i], &srcpad);
+    gst_element_release_request_pad (agnosticbin, srcpad);
+    g_object_unref (srcpad);
+    g_object_unref (transcoder);
+
+    fail_unless_equals_int (agnosticbin->numsrcpads, srcpads);
+  }
+
+  transcoder = request_transcoder (agnosticbin, "video/x-h264", &srcpad);
+  sinkpad = gst_element_get_static_pad (transcoder, "sink");
+  caps = gst_pad_get_current_caps (sinkpad);
+
+  GST_DEBUG_OBJECT (transcoder, "Transcoding from %" GST_PTR_FORMAT, caps);
+  fail_unless (gst_structure_has_name (gst_caps_get_structure (caps, 0),
+          "video/x-raw"));
+
+  gst_caps_unref (caps);
+  g_object_unref (sinkpad);
+  g_object_unref (srcpad);
+  g_object_unref (transcoder);
+
+  g_idle_add (quit_main_loop_idle, NULL);
+
+  return G_SOURCE_REMOVE;
+}
+
+GST_START_TEST (release_transcoded_src_pad_test)
+{
+  GstElement *source1 = gst_element_factory_make ("videotestsrc", NULL);
+  GstElement *source2 = gst_element_factory_make ("videotestsrc", NULL);
+  GstElement *enc2 = gst_element_factory_make ("vp8enc", NULL);
+  GstElement *agnosticbin = gst_element_factory_make ("agnosticbin3", NULL);
+  GstBus *bus;
+
+  pipeline = gst_pipeline_new (__FUNCTION__);
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  g_object_set (G_OBJECT (source1), "is-live", TRUE, NULL);
+  g_object_set (G_OBJECT (source2), "is-live", TRUE, NULL);
+
+  loop = g_main_loop_new (NULL, TRUE);
+
+  gst_bin_add_many (GST_BIN (pipeline), source1, source2, enc2, agnosticbin,
+      NULL);
+
+  if (!gst_element_link (source2, enc2)) {
+    fail ("Could not link videotestsrc2 to encoder2");
+  }
+
+  if (!gst_element_link_pads (enc2, "src", agnosticbin, "sink_%u")) {
+    fail ("Could not link encoder2 to agnosticbin");
+  }
+
+  if (!gst_element_link_pads (source1, "src", agnosticbin, "sink_%u")) {
+    fail ("Could not link videotestsrc1 to agnosticbin");
+  }
+
+  call_on_negotiated (agnosticbin, (GSourceFunc) release_transcoded_src_pad,
+      agnosticbin);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_timeout_add_seconds (4, print_timedout_pipeline, NULL);
+
+  g_main_loop_run (loop);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
 GST_END_TEST typedef struct _ReceivedPads
 {
   GMutex mutex;
@@ -1499,6 +1708,8 @@ agnosticbin3_suite (void)
   /* complex use cases */
   tcase_add_test (tc_chain, two_sinks_one_src_test);
   tcase_add_test (tc_chain, two_sinks_two_srcs_test);
+  tcase_add_test (tc_chain, transcode_in_cheapest_test);
+  tcase_add_test (tc_chain, release_transcoded_src_pad_test);
   tcase_add_test (tc_chain, connect_two_sources_three_sinks);
 
   return s;
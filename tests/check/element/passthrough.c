@@ -305,6 +305,176 @@ GST_START_TEST (check_bitrate)
   g_main_loop_unref (loop);
 }
 
+GST_END_TEST;
+
+static void
+fakesink_hand_off_counters (GstElement * fakesink, GstBuffer * buf,
+    GstPad * pad, gpointer data)
+{
+  static int count = 0;
+  GMainLoop *loop = (GMainLoop *) data;
+
+  if (count++ == 30) {
+    g_idle_add (quit_main_loop_idle, loop);
+  }
+}
+
+static guint64
+get_pad_counter (const GstStructure * counters, const gchar * flow,
+    const gchar * name)
+{
+  const GstStructure *flow_counters;
+  guint64 value = 0;
+
+  fail_unless (gst_structure_has_field (counters, flow), "No counters for %s",
+      flow);
+  flow_counters = gst_value_get_structure (gst_structure_get_value (counters,
+          flow));
+  fail_unless (gst_structure_has_name (flow_counters, "pad-stats"));
+  fail_unless (gst_structure_get_uint64 (flow_counters, name, &value));
+
+  return value;
+}
+
+GST_START_TEST (check_pad_counters)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, TRUE);
+  GstElement *pipeline = gst_pipeline_new (__FUNCTION__);
+  GstElement *videotestsrc = gst_element_factory_make ("videotestsrc", NULL);
+  GstElement *fakesink = gst_element_factory_make ("fakesink", NULL);
+  GstElement *passthrough = gst_element_factory_make ("passthrough", NULL);
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  GstStructure *stats, *counters;
+  guint64 in_buffers, out_buffers;
+
+  g_object_set (G_OBJECT (videotestsrc), "is-live", TRUE, NULL);
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  g_object_set (G_OBJECT (fakesink), "sync", TRUE, "signal-handoffs", TRUE,
+      "async", FALSE, NULL);
+  g_signal_connect (G_OBJECT (fakesink), "handoff",
+      G_CALLBACK (fakesink_hand_off_counters), loop);
+
+  g_object_set_qdata (G_OBJECT (passthrough), video_sink_quark (), fakesink);
+  g_signal_connect (passthrough, "pad-added", G_CALLBACK (on_pad_added_cb),
+      NULL);
+
+  gst_bin_add_many (GST_BIN (pipeline), passthrough, fakesink, NULL);
+  fail_unless (kms_element_request_srcpad (passthrough,
+          KMS_ELEMENT_PAD_TYPE_VIDEO));
+  fail_if (!connect_sink_async (passthrough, videotestsrc, pipeline,
+          "sink_video_default"));
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  g_timeout_add_seconds (10, timeout_check, pipeline);
+  g_main_loop_run (loop);
+
+  /* Counters do not need media stats to be enabled, but their own selector */
+  g_signal_emit_by_name (passthrough, "stats", "video", &stats);
+  fail_if (gst_structure_has_field (stats, "pad-counters"));
+  gst_structure_free (stats);
+
+  g_signal_emit_by_name (passthrough, "stats", "pad-counters", &stats);
+  fail_unless (gst_structure_get (stats, "pad-counters", GST_TYPE_STRUCTURE,
+          &counters, NULL));
+
+  in_buffers = get_pad_counter (counters, "in-video-default", "buffers");
+  out_buffers = get_pad_counter (counters, "out-video-default", "buffers");
+  GST_INFO ("Pad counters: %" GST_PTR_FORMAT, counters);
+
+  fail_unless (in_buffers > 30);
+  fail_unless (out_buffers > 0 && out_buffers <= in_buffers);
+  fail_unless (get_pad_counter (counters, "in-video-default", "bytes") > 0);
+  fail_unless (get_pad_counter (counters, "in-video-default",
+          "last-timestamp") != GST_CLOCK_TIME_NONE);
+
+  /* No audio flows */
+  fail_unless_equals_int (gst_structure_n_fields (counters), 2);
+
+  gst_structure_free (counters);
+  gst_structure_free (stats);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (check_pad_counters_bufferlist)
+{
+  GstElement *pipeline = gst_pipeline_new (__FUNCTION__);
+  GstElement *passthrough = gst_element_factory_make ("passthrough", NULL);
+  GstStructure *stats, *counters;
+  GstPad *srcpad, *sinkpad;
+  GstBufferList *bufflist;
+  GstSegment segment;
+  GstCaps *caps;
+  guint i;
+
+  gst_bin_add (GST_BIN (pipeline), passthrough);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  srcpad = gst_pad_new ("src", GST_PAD_SRC);
+  sinkpad = gst_element_get_static_pad (passthrough, "sink_video_default");
+  fail_unless (gst_pad_link (srcpad, sinkpad) == GST_PAD_LINK_OK);
+  g_object_unref (sinkpad);
+  gst_pad_set_active (srcpad, TRUE);
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  caps = gst_caps_from_string ("video/x-raw,format=I420,width=320,"
+      "height=240,framerate=30/1");
+  gst_pad_push_event (srcpad, gst_event_new_caps (caps));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  bufflist = gst_buffer_list_new ();
+  for (i = 0; i < 3; i++) {
+    GstBuffer *buf = gst_buffer_new_allocate (NULL, 320 * 240 * 3 / 2, NULL);
+
+    GST_BUFFER_PTS (buf) = i * GST_SECOND / 30;
+    if (i == 1) {
+      GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_GAP);
+    }
+    gst_buffer_list_add (bufflist, buf);
+  }
+  gst_pad_push_list (srcpad, bufflist);
+
+  /* Both flow probes count every buffer of the list */
+  g_signal_emit_by_name (passthrough, "stats", "pad-counters", &stats);
+  fail_unless (gst_structure_get (stats, "pad-counters", GST_TYPE_STRUCTURE,
+          &counters, NULL));
+  GST_INFO ("Pad counters: %" GST_PTR_FORMAT, counters);
+
+  fail_unless_equals_uint64 (get_pad_counter (counters, "in-video-default",
+          "buffers"), 3);
+  fail_unless_equals_uint64 (get_pad_counter (counters, "out-video-default",
+          "buffers"), 3);
+  fail_unless_equals_uint64 (get_pad_counter (counters, "out-video-default",
+          "bytes"), 3 * 320 * 240 * 3 / 2);
+  fail_unless_equals_uint64 (get_pad_counter (counters, "out-video-default",
+          "last-timestamp"), 2 * GST_SECOND / 30);
+
+  /* Gap buffers are still delivered, they are only counted as flagged */
+  fail_unless_equals_uint64 (get_pad_counter (counters, "in-video-default",
+          "flagged"), 1);
+  fail_unless_equals_uint64 (get_pad_counter (counters, "out-video-default",
+          "flagged"), 1);
+
+  gst_structure_free (counters);
+  gst_structure_free (stats);
+
+  gst_pad_set_active (srcpad, FALSE);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (srcpad);
+  g_object_unref (pipeline);
+}
+
 GST_END_TEST;
 /* Suite initialization */
 static Suite *
@@ -317,6 +487,8 @@ passthrough_suite (void)
 
   tcase_add_test (tc_chain, check_connecion);
   tcase_add_test (tc_chain, check_bitrate);
+  tcase_add_test (tc_chain, check_pad_counters);
+  tcase_add_test (tc_chain, check_pad_counters_bufferlist);
 
   return s;
 }
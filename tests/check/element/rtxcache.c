@@ -0,0 +1,214 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/rtp/gstrtpbuffer.h>
+
+#define SSRC 1234
+#define RTP_CAPS "application/x-rtp"
+
+static GstPad *mysrcpad, *mysinkpad;
+
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (RTP_CAPS)
+    );
+
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (RTP_CAPS)
+    );
+
+static GstElement *
+setup_rtxcache (guint max_size_packets)
+{
+  GstElement *rtxcache;
+  GstCaps *caps;
+
+  rtxcache = gst_check_setup_element ("rtxcache");
+  g_object_set (rtxcache, "max-size-packets", max_size_packets, NULL);
+  mysrcpad = gst_check_setup_src_pad (rtxcache, &srctemplate);
+  mysinkpad = gst_check_setup_sink_pad (rtxcache, &sinktemplate);
+  gst_pad_set_active (mysrcpad, TRUE);
+  gst_pad_set_active (mysinkpad, TRUE);
+
+  fail_unless (gst_element_set_state (rtxcache, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_SUCCESS);
+
+  caps = gst_caps_from_string (RTP_CAPS);
+  gst_check_setup_events (mysrcpad, rtxcache, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  return rtxcache;
+}
+
+static void
+cleanup_rtxcache (GstElement * rtxcache)
+{
+  gst_check_drop_buffers ();
+  gst_pad_set_active (mysrcpad, FALSE);
+  gst_pad_set_active (mysinkpad, FALSE);
+  gst_check_teardown_src_pad (rtxcache);
+  gst_check_teardown_sink_pad (rtxcache);
+  gst_check_teardown_element (rtxcache);
+}
+
+static void
+push_rtp (guint16 seqnum)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstBuffer *buffer;
+
+  buffer = gst_rtp_buffer_new_allocate (100, 0, 0);
+  gst_rtp_buffer_map (buffer, GST_MAP_WRITE, &rtp);
+  gst_rtp_buffer_set_ssrc (&rtp, SSRC);
+  gst_rtp_buffer_set_seq (&rtp, seqnum);
+  gst_rtp_buffer_unmap (&rtp);
+
+  fail_unless_equals_int (gst_pad_push (mysrcpad, buffer), GST_FLOW_OK);
+}
+
+static void
+request_rtx (guint seqnum)
+{
+  GstEvent *event;
+
+  event = gst_event_new_custom (GST_EVENT_CUSTOM_UPSTREAM,
+      gst_structure_new ("GstRTPRetransmissionRequest",
+          "seqnum", G_TYPE_UINT, seqnum, "ssrc", G_TYPE_UINT, SSRC, NULL));
+
+  fail_unless (gst_pad_push_event (mysinkpad, event));
+}
+
+static guint16
+output_seqnum (guint idx)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstBuffer *buffer = g_list_nth_data (buffers, idx);
+  guint16 seqnum;
+
+  fail_unless (buffer != NULL);
+  gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp);
+  seqnum = gst_rtp_buffer_get_seq (&rtp);
+  gst_rtp_buffer_unmap (&rtp);
+
+  return seqnum;
+}
+
+static guint64
+get_counter (GstElement * rtxcache, const gchar * name)
+{
+  GstStructure *stats;
+  const GValue *value;
+  const GstStructure *ssrc_stats;
+  gchar *ssrc_id;
+  guint64 counter = 0;
+
+  g_object_get (rtxcache, "stats", &stats, NULL);
+  ssrc_id = g_strdup_printf ("ssrc-%u", SSRC);
+  value = gst_structure_get_value (stats, ssrc_id);
+  fail_unless (value != NULL);
+  ssrc_stats = gst_value_get_structure (value);
+  fail_unless (gst_structure_get_uint64 (ssrc_stats, name, &counter));
+  g_free (ssrc_id);
+  gst_structure_free (stats);
+
+  return counter;
+}
+
+GST_START_TEST (retransmit_on_request)
+{
+  GstElement *rtxcache = setup_rtxcache (512);
+  guint i;
+
+  for (i = 0; i < 10; i++) {
+    push_rtp (i);
+  }
+  fail_unless_equals_int (g_list_length (buffers), 10);
+
+  request_rtx (3);
+  request_rtx (600);
+  request_rtx (5);
+
+  /* Retransmissions go out before the next packet */
+  push_rtp (10);
+  fail_unless_equals_int (g_list_length (buffers), 13);
+  fail_unless_equals_int (output_seqnum (10), 3);
+  fail_unless_equals_int (output_seqnum (11), 5);
+  fail_unless_equals_int (output_seqnum (12), 10);
+
+  /* Retransmissions are not the cached packets */
+  fail_if (g_list_nth_data (buffers, 10) == g_list_nth_data (buffers, 3));
+  fail_unless (gst_buffer_is_writable (g_list_nth_data (buffers, 10)));
+
+  /* Everything is too old now */
+  g_object_set (rtxcache, "max-size-time", 0, NULL);
+  g_usleep (1000);
+  request_rtx (4);
+  push_rtp (11);
+  fail_unless_equals_int (g_list_length (buffers), 14);
+
+  fail_unless_equals_int (get_counter (rtxcache, "requests"), 4);
+  fail_unless_equals_int (get_counter (rtxcache, "hits"), 2);
+  fail_unless_equals_int (get_counter (rtxcache, "misses"), 1);
+  fail_unless_equals_int (get_counter (rtxcache, "late"), 1);
+
+  cleanup_rtxcache (rtxcache);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (bounded_ring)
+{
+  GstElement *rtxcache = setup_rtxcache (8);
+  guint i;
+
+  for (i = 0; i < 20; i++) {
+    push_rtp (i);
+  }
+
+  /* Seqnum 2 was overwritten by 10 and 18 */
+  request_rtx (2);
+  request_rtx (19);
+  push_rtp (20);
+
+  fail_unless_equals_int (g_list_length (buffers), 22);
+  fail_unless_equals_int (output_seqnum (20), 19);
+  fail_unless_equals_int (get_counter (rtxcache, "misses"), 1);
+  fail_unless_equals_int (get_counter (rtxcache, "hits"), 1);
+
+  cleanup_rtxcache (rtxcache);
+}
+
+GST_END_TEST;
+
+static Suite *
+rtxcache_suite (void)
+{
+  Suite *s = suite_create ("rtxcache");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, retransmit_on_request);
+  tcase_add_test (tc_chain, bounded_ring);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtxcache);
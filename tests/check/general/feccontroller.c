@@ -0,0 +1,98 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+
+#include <kmsfeccontroller.h>
+
+/* RTCP fraction lost of @percent % */
+#define LOSS(percent) ((percent) * 256 / 100)
+
+GST_START_TEST (clean_link)
+{
+  KmsFecController *fc = kms_fec_controller_new (50);
+  guint i;
+
+  fail_unless_equals_int (kms_fec_controller_get_percentage (fc), 0);
+
+  for (i = 0; i < 10; i++) {
+    fail_unless_equals_int (kms_fec_controller_update (fc, 0), 0);
+  }
+
+  kms_fec_controller_free (fc);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (lossy_link)
+{
+  KmsFecController *fc = kms_fec_controller_new (50);
+  guint percentage;
+
+  percentage = kms_fec_controller_update (fc, LOSS (10));
+  fail_unless (percentage >= 20 && percentage <= 30,
+      "Unexpected percentage %u", percentage);
+
+  /* Never above the maximum */
+  fail_unless_equals_int (kms_fec_controller_update (fc, LOSS (60)), 50);
+  fail_unless_equals_int (kms_fec_controller_update (fc, 255), 50);
+
+  kms_fec_controller_free (fc);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (back_to_zero)
+{
+  KmsFecController *fc = kms_fec_controller_new (50);
+  guint percentage, i;
+
+  percentage = kms_fec_controller_update (fc, LOSS (10));
+  fail_unless (percentage > 0);
+
+  /* A couple of good reports do not remove the protection */
+  fail_unless_equals_int (kms_fec_controller_update (fc, 0), percentage);
+  fail_unless_equals_int (kms_fec_controller_update (fc, 0), percentage);
+  fail_unless (kms_fec_controller_update (fc, 0) < percentage);
+
+  for (i = 0; i < 10; i++) {
+    kms_fec_controller_update (fc, 0);
+  }
+
+  fail_unless_equals_int (kms_fec_controller_get_percentage (fc), 0);
+
+  kms_fec_controller_free (fc);
+}
+
+GST_END_TEST;
+
+static Suite *
+feccontroller_suite (void)
+{
+  Suite *s = suite_create ("feccontroller");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_add_test (tc_chain, clean_link);
+  tcase_add_test (tc_chain, lossy_link);
+  tcase_add_test (tc_chain, back_to_zero);
+
+  return s;
+}
+
+GST_CHECK_MAIN (feccontroller);
@@ -0,0 +1,321 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/rtp/gstrtpbuffer.h>
+
+#include <kmsjbcontroller.h>
+
+#define PACKETS_PER_UPDATE 100
+#define RTT (5 * GST_MSECOND)
+
+static guint
+run_updates_with_rtt (KmsJbController * jbc, guint n, guint64 * pushed,
+    guint64 * late, guint late_per_update, GstClockTime jitter,
+    GstClockTime rtt)
+{
+  guint i, latency = 0;
+
+  for (i = 0; i < n; i++) {
+    *pushed += PACKETS_PER_UPDATE;
+    *late += late_per_update;
+    latency = kms_jb_controller_update (jbc, *pushed, *late, jitter, rtt);
+  }
+
+  return latency;
+}
+
+static guint
+run_updates (KmsJbController * jbc, guint n, guint64 * pushed, guint64 * late,
+    guint late_per_update, GstClockTime jitter)
+{
+  return run_updates_with_rtt (jbc, n, pushed, late, late_per_update, jitter,
+      RTT);
+}
+
+GST_START_TEST (good_link_shrinks)
+{
+  KmsJbController *jbc = kms_jb_controller_new (20, 1000, 500);
+  guint64 pushed = 0, late = 0;
+  guint latency;
+
+  latency = run_updates (jbc, 10, &pushed, &late, 0, 2 * GST_MSECOND);
+  fail_unless (latency < 500);
+  fail_unless (latency > 100, "Latency must decrease slowly, got %u",
+      latency);
+
+  latency = run_updates (jbc, 200, &pushed, &late, 0, 2 * GST_MSECOND);
+  fail_unless_equals_int (latency, 20);
+
+  kms_jb_controller_free (jbc);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (above_rtt)
+{
+  KmsJbController *jbc = kms_jb_controller_new (20, 1000, 500);
+  guint64 pushed = 0, late = 0;
+  guint latency;
+
+  /* Retransmissions need a round trip */
+  latency = run_updates_with_rtt (jbc, 200, &pushed, &late, 0,
+      2 * GST_MSECOND, 200 * GST_MSECOND);
+  fail_unless (latency > 200, "Latency %u below the RTT", latency);
+
+  kms_jb_controller_free (jbc);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (unknown_rtt)
+{
+  KmsJbController *jbc = kms_jb_controller_new (20, 1000, 500);
+  guint64 pushed = 0, late = 0;
+
+  /* Never below the initial latency while the RTT is not known */
+  fail_unless_equals_int (run_updates_with_rtt (jbc, 200, &pushed, &late, 0,
+          2 * GST_MSECOND, GST_CLOCK_TIME_NONE), 500);
+
+  /* But it still grows */
+  fail_unless (run_updates_with_rtt (jbc, 1, &pushed, &late, 10,
+          2 * GST_MSECOND, GST_CLOCK_TIME_NONE) > 500);
+
+  kms_jb_controller_free (jbc);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (bad_link_grows)
+{
+  KmsJbController *jbc = kms_jb_controller_new (20, 1000, 100);
+  guint64 pushed = 0, late = 0;
+  guint latency;
+
+  /* Follows the jitter at once */
+  latency = run_updates (jbc, 1, &pushed, &late, 0, 50 * GST_MSECOND);
+  fail_unless (latency >= 200);
+
+  /* Late packets push it up to the maximum */
+  latency = run_updates (jbc, 30, &pushed, &late, 10, 50 * GST_MSECOND);
+  fail_unless_equals_int (latency, 1000);
+
+  kms_jb_controller_free (jbc);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (hold_after_late)
+{
+  KmsJbController *jbc = kms_jb_controller_new (20, 1000, 100);
+  guint64 pushed = 0, late = 0;
+  guint latency, grown;
+
+  grown = run_updates (jbc, 1, &pushed, &late, 10, 2 * GST_MSECOND);
+  fail_unless (grown >= 125);
+
+  /* Good link again, but it does not shrink right away */
+  latency = run_updates (jbc, 5, &pushed, &late, 0, 2 * GST_MSECOND);
+  fail_unless_equals_int (latency, grown);
+
+  latency = run_updates (jbc, 20, &pushed, &late, 0, 2 * GST_MSECOND);
+  fail_unless (latency < grown);
+
+  kms_jb_controller_free (jbc);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (fixed_latency)
+{
+  KmsJbController *jbc = kms_jb_controller_new (300, 300, 500);
+  guint64 pushed = 0, late = 0;
+
+  fail_if (kms_jb_controller_is_adaptive (jbc));
+  fail_unless_equals_int (kms_jb_controller_get_latency (jbc), 300);
+  fail_unless_equals_int (run_updates (jbc, 10, &pushed, &late, 10,
+          50 * GST_MSECOND), 300);
+
+  kms_jb_controller_free (jbc);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (no_traffic)
+{
+  KmsJbController *jbc = kms_jb_controller_new (20, 1000, 500);
+
+  fail_unless_equals_int (kms_jb_controller_update (jbc, 0, 0, 0, RTT), 500);
+  fail_unless_equals_int (kms_jb_controller_update (jbc, 0, 0, 0, RTT), 500);
+
+  kms_jb_controller_free (jbc);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (update_from_stats)
+{
+  KmsJbController *jbc = kms_jb_controller_new (20, 1000, 100);
+  GstStructure *jb_stats, *source_stats;
+
+  jb_stats = gst_structure_new ("application/x-rtp-jitterbuffer-stats",
+      "num-pushed", G_TYPE_UINT64, (guint64) 100,
+      "num-late", G_TYPE_UINT64, (guint64) 0, NULL);
+  /* 50 ms of jitter at 90 kHz */
+  source_stats = gst_structure_new ("application/x-rtp-source-stats",
+      "clock-rate", G_TYPE_INT, 90000, "jitter", G_TYPE_UINT, 4500,
+      "have-rb", G_TYPE_BOOLEAN, TRUE,
+      "rb-round-trip", G_TYPE_UINT, 65536 / 10, NULL);
+
+  fail_unless (kms_jb_controller_update_from_stats (jbc, jb_stats,
+          source_stats));
+  fail_unless_equals_int (kms_jb_controller_get_latency (jbc), 210);
+
+  /* Nothing is learnt from a source without jitter, like an internal one */
+  gst_structure_remove_field (source_stats, "jitter");
+  gst_structure_set (jb_stats, "num-pushed", G_TYPE_UINT64, (guint64) 200,
+      "num-late", G_TYPE_UINT64, (guint64) 100, NULL);
+  fail_if (kms_jb_controller_update_from_stats (jbc, jb_stats, source_stats));
+  fail_unless_equals_int (kms_jb_controller_get_latency (jbc), 210);
+
+  gst_structure_free (jb_stats);
+  gst_structure_free (source_stats);
+  kms_jb_controller_free (jbc);
+}
+
+GST_END_TEST;
+
+static GstBuffer *
+create_rtp_buffer (guint16 seq)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstBuffer *buf;
+
+  buf = gst_rtp_buffer_new_allocate (100, 0, 0);
+  gst_rtp_buffer_map (buf, GST_MAP_WRITE, &rtp);
+  gst_rtp_buffer_set_payload_type (&rtp, 96);
+  gst_rtp_buffer_set_ssrc (&rtp, 1);
+  gst_rtp_buffer_set_seq (&rtp, seq);
+  gst_rtp_buffer_set_timestamp (&rtp, seq * 3000);
+  gst_rtp_buffer_unmap (&rtp);
+
+  return buf;
+}
+
+/* The fields read must exist in the elements the endpoint uses */
+GST_START_TEST (update_from_element_stats)
+{
+  GstElement *session = gst_element_factory_make ("rtpsession", NULL);
+  GstElement *jitterbuffer = gst_element_factory_make ("rtpjitterbuffer",
+      NULL);
+  KmsJbController *jbc = kms_jb_controller_new (20, 1000, 100);
+  GstStructure *jb_stats, *source_stats;
+  GObject *internal_session, *source = NULL;
+  GstPad *srcpad, *sinkpad;
+  GstSegment segment;
+  GstCaps *caps;
+  guint16 seq;
+
+  fail_unless (session != NULL && jitterbuffer != NULL);
+
+  srcpad = gst_pad_new ("src", GST_PAD_SRC);
+  sinkpad = gst_element_get_request_pad (session, "recv_rtp_sink");
+  fail_unless (gst_pad_link (srcpad, sinkpad) == GST_PAD_LINK_OK);
+  gst_pad_set_active (srcpad, TRUE);
+  gst_element_set_state (session, GST_STATE_PLAYING);
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  caps = gst_caps_new_simple ("application/x-rtp", "media", G_TYPE_STRING,
+      "video", "payload", G_TYPE_INT, 96, "clock-rate", G_TYPE_INT, 90000,
+      NULL);
+  gst_pad_push_event (srcpad, gst_event_new_caps (caps));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  /* Nobody is linked downstream, but the source gets the packets */
+  for (seq = 0; seq < 10; seq++) {
+    gst_pad_push (srcpad, create_rtp_buffer (seq));
+  }
+
+  g_object_get (session, "internal-session", &internal_session, NULL);
+  g_signal_emit_by_name (internal_session, "get-source-by-ssrc", 1, &source);
+  fail_unless (source != NULL);
+  g_object_get (source, "stats", &source_stats, NULL);
+  g_object_get (jitterbuffer, "stats", &jb_stats, NULL);
+
+  fail_unless (kms_jb_controller_update_from_stats (jbc, jb_stats,
+          source_stats), "Missing fields in %" GST_PTR_FORMAT " or %"
+      GST_PTR_FORMAT, jb_stats, source_stats);
+
+  gst_structure_free (jb_stats);
+  gst_structure_free (source_stats);
+  g_object_unref (source);
+  g_object_unref (internal_session);
+
+  gst_element_set_state (session, GST_STATE_NULL);
+  gst_pad_set_active (srcpad, FALSE);
+  gst_element_release_request_pad (session, sinkpad);
+  gst_object_unref (sinkpad);
+  gst_object_unref (srcpad);
+  gst_object_unref (session);
+  gst_object_unref (jitterbuffer);
+  kms_jb_controller_free (jbc);
+}
+
+GST_END_TEST;
+
+/* Adapting is opt-in, endpoints keep a fixed latency by default */
+GST_START_TEST (endpoint_fixed_by_default)
+{
+  GstElement *endpoint = gst_element_factory_make ("dummyrtp", NULL);
+  guint min_latency, max_latency;
+
+  fail_unless (endpoint != NULL);
+  g_object_get (endpoint, "min-jitter-buffer-latency", &min_latency,
+      "max-jitter-buffer-latency", &max_latency, NULL);
+  fail_unless_equals_int (max_latency, 0);
+  fail_unless_equals_int (min_latency, 0);
+
+  gst_object_unref (endpoint);
+}
+
+GST_END_TEST;
+
+static Suite *
+jbcontroller_suite (void)
+{
+  Suite *s = suite_create ("jbcontroller");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_add_test (tc_chain, good_link_shrinks);
+  tcase_add_test (tc_chain, bad_link_grows);
+  tcase_add_test (tc_chain, hold_after_late);
+  tcase_add_test (tc_chain, fixed_latency);
+  tcase_add_test (tc_chain, no_traffic);
+  tcase_add_test (tc_chain, above_rtt);
+  tcase_add_test (tc_chain, unknown_rtt);
+  tcase_add_test (tc_chain, update_from_stats);
+  tcase_add_test (tc_chain, update_from_element_stats);
+  tcase_add_test (tc_chain, endpoint_fixed_by_default);
+
+  return s;
+}
+
+GST_CHECK_MAIN (jbcontroller);
@@ -0,0 +1,161 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+
+#include <kmslatencyhistogram.h>
+
+/* Relative error of the logarithmic buckets */
+#define MAX_ERROR (1.0 / 16)
+
+static void
+check_close (GstClockTime value, GstClockTime expected)
+{
+  fail_unless (ABS ((gdouble) value - expected) <= expected * MAX_ERROR,
+      "%" G_GUINT64_FORMAT " is not close to %" G_GUINT64_FORMAT, value,
+      expected);
+}
+
+GST_START_TEST (percentiles)
+{
+  KmsLatencyHistogram *histogram = kms_latency_histogram_new ();
+  GstStructure *stats;
+  guint64 p99;
+  gint i;
+
+  stats = gst_structure_new_empty ("latency");
+  kms_latency_histogram_append_percentiles (histogram, stats);
+  fail_if (gst_structure_has_field (stats, "p50"));
+
+  for (i = 1; i <= 1000; i++) {
+    kms_latency_histogram_record (histogram, i * GST_MSECOND);
+  }
+
+  fail_unless_equals_uint64 (kms_latency_histogram_get_count (histogram),
+      1000);
+  check_close (kms_latency_histogram_get_percentile (histogram, 50),
+      500 * GST_MSECOND);
+  check_close (kms_latency_histogram_get_percentile (histogram, 95),
+      950 * GST_MSECOND);
+
+  kms_latency_histogram_append_percentiles (histogram, stats);
+  fail_unless (gst_structure_get_uint64 (stats, "p99", &p99));
+  check_close (p99, 990 * GST_MSECOND);
+
+  /* Values out of range are clamped */
+  kms_latency_histogram_record (histogram, -GST_SECOND);
+  kms_latency_histogram_record (histogram, 100 * 3600 * GST_SECOND);
+  check_close (kms_latency_histogram_get_percentile (histogram, 0), 0);
+  fail_unless (kms_latency_histogram_get_percentile (histogram, 100) >=
+      1000 * GST_SECOND);
+
+  gst_structure_free (stats);
+  kms_latency_histogram_free (histogram);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (merge)
+{
+  KmsLatencyHistogram *audio = kms_latency_histogram_new ();
+  KmsLatencyHistogram *video = kms_latency_histogram_new ();
+  KmsLatencyHistogram *all = kms_latency_histogram_new ();
+  GstClockTime sum;
+  guint64 count;
+  gint i;
+
+  for (i = 0; i < 90; i++) {
+    kms_latency_histogram_record (audio, 10 * GST_MSECOND);
+  }
+
+  for (i = 0; i < 10; i++) {
+    kms_latency_histogram_record (video, 200 * GST_MSECOND);
+  }
+
+  kms_latency_histogram_merge (all, audio);
+  kms_latency_histogram_merge (all, video);
+
+  fail_unless_equals_uint64 (kms_latency_histogram_get_count (all), 100);
+  kms_latency_histogram_get_totals (all, &count, &sum);
+  fail_unless_equals_uint64 (count, 100);
+  fail_unless_equals_uint64 (sum, 90 * 10 * GST_MSECOND +
+      10 * 200 * GST_MSECOND);
+  check_close (kms_latency_histogram_get_percentile (all, 50),
+      10 * GST_MSECOND);
+  check_close (kms_latency_histogram_get_percentile (all, 95),
+      200 * GST_MSECOND);
+
+  /* Sources are untouched */
+  fail_unless_equals_uint64 (kms_latency_histogram_get_count (audio), 90);
+
+  kms_latency_histogram_reset (all);
+  fail_unless_equals_uint64 (kms_latency_histogram_get_count (all), 0);
+
+  kms_latency_histogram_free (audio);
+  kms_latency_histogram_free (video);
+  kms_latency_histogram_free (all);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (decay)
+{
+  KmsLatencyHistogram *histogram = kms_latency_histogram_new ();
+  GstClockTime sum;
+  guint64 count;
+  gint i;
+
+  for (i = 0; i < 100000; i++) {
+    kms_latency_histogram_record (histogram, GST_MSECOND);
+  }
+
+  /* Old values fade out, so the median follows the new latency */
+  for (i = 0; i < 200000; i++) {
+    kms_latency_histogram_record (histogram, 100 * GST_MSECOND);
+  }
+
+  fail_unless (kms_latency_histogram_get_count (histogram) <= 1 << 16);
+  check_close (kms_latency_histogram_get_percentile (histogram, 50),
+      100 * GST_MSECOND);
+
+  /* Totals are not decayed */
+  kms_latency_histogram_get_totals (histogram, &count, &sum);
+  fail_unless_equals_uint64 (count, 300000);
+  fail_unless_equals_uint64 (sum, 100000 * GST_MSECOND +
+      200000 * 100 * GST_MSECOND);
+
+  kms_latency_histogram_free (histogram);
+}
+
+GST_END_TEST;
+
+static Suite *
+latencyhistogram_suite (void)
+{
+  Suite *s = suite_create ("latencyhistogram");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_add_test (tc_chain, percentiles);
+  tcase_add_test (tc_chain, merge);
+  tcase_add_test (tc_chain, decay);
+
+  return s;
+}
+
+GST_CHECK_MAIN (latencyhistogram);
@@ -0,0 +1,118 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+
+#include <kmsstats.h>
+#include <kmsbufferlacentymeta.h>
+
+#define BUFFERS 20
+
+static GstFlowReturn
+count_meta_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  gint *metas = g_object_get_data (G_OBJECT (pad), "metas");
+
+  if (kms_buffer_get_buffer_latency_meta (buffer) != NULL) {
+    (*metas)++;
+  }
+
+  gst_buffer_unref (buffer);
+
+  return GST_FLOW_OK;
+}
+
+static gint
+push_and_count_metas (guint every_n_buffers, guint interval_ms)
+{
+  GstPad *srcpad, *sinkpad;
+  GstSegment segment;
+  GstCaps *caps;
+  gint metas = 0;
+  guint i;
+
+  srcpad = gst_pad_new ("src", GST_PAD_SRC);
+  sinkpad = gst_pad_new ("sink", GST_PAD_SINK);
+  gst_pad_set_chain_function (sinkpad, count_meta_chain);
+  g_object_set_data (G_OBJECT (sinkpad), "metas", &metas);
+  fail_unless (gst_pad_link (srcpad, sinkpad) == GST_PAD_LINK_OK);
+  gst_pad_set_active (srcpad, TRUE);
+  gst_pad_set_active (sinkpad, TRUE);
+
+  kms_stats_set_latency_sampling (every_n_buffers, interval_ms);
+  kms_stats_add_buffer_latency_meta_probe (srcpad, TRUE,
+      KMS_MEDIA_TYPE_VIDEO);
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  caps = gst_caps_new_any ();
+  gst_pad_push_event (srcpad, gst_event_new_caps (caps));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  for (i = 0; i < BUFFERS; i++) {
+    fail_unless (gst_pad_push (srcpad, gst_buffer_new ()) == GST_FLOW_OK);
+  }
+
+  gst_pad_set_active (srcpad, FALSE);
+  gst_pad_set_active (sinkpad, FALSE);
+  gst_object_unref (srcpad);
+  gst_object_unref (sinkpad);
+
+  kms_stats_set_latency_sampling (1, 0);
+
+  return metas;
+}
+
+GST_START_TEST (sample_every_buffer)
+{
+  fail_unless_equals_int (push_and_count_metas (1, 0), BUFFERS);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (sample_every_n_buffers)
+{
+  fail_unless_equals_int (push_and_count_metas (5, 0), BUFFERS / 5);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (sample_interval)
+{
+  /* All buffers are pushed well within one interval */
+  fail_unless_equals_int (push_and_count_metas (1, 60000), 1);
+}
+
+GST_END_TEST;
+
+static Suite *
+latencysampling_suite (void)
+{
+  Suite *s = suite_create ("latencysampling");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_add_test (tc_chain, sample_every_buffer);
+  tcase_add_test (tc_chain, sample_every_n_buffers);
+  tcase_add_test (tc_chain, sample_interval);
+
+  return s;
+}
+
+GST_CHECK_MAIN (latencysampling);
@@ -0,0 +1,199 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <kmsmetrics.h>
+
+static void
+collect_test_metrics (KmsMetricsCollector * collector, gpointer user_data)
+{
+  KmsLatencyHistogram *histogram = user_data;
+
+  kms_metrics_collector_add (collector, "test_buffers_total",
+      KMS_METRIC_TYPE_COUNTER, "Test buffers", 42, "element", "src0",
+      "media", "video", NULL);
+  kms_metrics_collector_add (collector, "test_buffers_total",
+      KMS_METRIC_TYPE_COUNTER, "Test buffers", 7, "element", "src\"1\"",
+      "media", "audio", NULL);
+  kms_metrics_collector_add (collector, "test_pipelines",
+      KMS_METRIC_TYPE_GAUGE, NULL, 3, NULL);
+  kms_metrics_collector_add_latency (collector, "test_latency_seconds",
+      "Test latency", histogram, "element", "src0", NULL);
+}
+
+static guint
+add_test_collector (KmsLatencyHistogram ** histogram)
+{
+  gint i;
+
+  *histogram = kms_latency_histogram_new ();
+
+  for (i = 0; i < 10; i++) {
+    kms_latency_histogram_record (*histogram, 16 * GST_MSECOND);
+  }
+
+  return kms_metrics_add_collector (collect_test_metrics, *histogram,
+      (GDestroyNotify) kms_latency_histogram_free);
+}
+
+static void
+check_test_metrics (const gchar * metrics)
+{
+  GST_DEBUG ("Metrics:\n%s", metrics);
+
+  fail_unless (strstr (metrics, "# HELP test_buffers_total Test buffers\n"
+          "# TYPE test_buffers_total counter\n"
+          "test_buffers_total{element=\"src0\",media=\"video\"} 42\n"
+          "test_buffers_total{element=\"src\\\"1\\\"\",media=\"audio\"} 7\n")
+      != NULL);
+  fail_unless (strstr (metrics, "# TYPE test_pipelines gauge\n"
+          "test_pipelines 3\n") != NULL);
+  fail_unless (strstr (metrics, "# TYPE test_latency_seconds summary\n"
+          "test_latency_seconds{element=\"src0\",quantile=\"0.5\"} 0.016")
+      != NULL);
+  fail_unless (strstr (metrics,
+          "test_latency_seconds_sum{element=\"src0\"} 0.16\n"
+          "test_latency_seconds_count{element=\"src0\"} 10\n") != NULL);
+}
+
+GST_START_TEST (render)
+{
+  KmsLatencyHistogram *histogram;
+  gchar *metrics;
+  guint id;
+
+  id = add_test_collector (&histogram);
+
+  metrics = kms_metrics_render ();
+  check_test_metrics (metrics);
+  g_free (metrics);
+
+  kms_metrics_remove_collector (id);
+
+  metrics = kms_metrics_render ();
+  fail_unless (strstr (metrics, "test_buffers_total") == NULL);
+  g_free (metrics);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (export_file)
+{
+  KmsLatencyHistogram *histogram;
+  KmsMetricsExporter *exporter;
+  gchar *dir, *path, *metrics = NULL;
+  guint id, i;
+
+  dir = g_dir_make_tmp ("kmsmetrics-XXXXXX", NULL);
+  fail_unless (dir != NULL);
+  path = g_build_filename (dir, "metrics.prom", NULL);
+
+  id = add_test_collector (&histogram);
+  exporter = kms_metrics_exporter_new (NULL, path, 1, NULL);
+  fail_unless (exporter != NULL);
+
+  /* The first write happens as soon as the exporter starts */
+  for (i = 0; i < 100 && !g_file_get_contents (path, &metrics, NULL, NULL);
+      i++) {
+    g_usleep (10000);
+  }
+
+  fail_unless (metrics != NULL);
+  check_test_metrics (metrics);
+  g_free (metrics);
+
+  kms_metrics_exporter_free (exporter);
+  kms_metrics_remove_collector (id);
+
+  g_unlink (path);
+  g_rmdir (dir);
+  g_free (path);
+  g_free (dir);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (export_socket)
+{
+  KmsLatencyHistogram *histogram;
+  KmsMetricsExporter *exporter;
+  struct sockaddr_un addr;
+  GString *metrics;
+  gchar *dir, *path, buf[1024];
+  gssize len;
+  guint id;
+  gint fd;
+
+  dir = g_dir_make_tmp ("kmsmetrics-XXXXXX", NULL);
+  fail_unless (dir != NULL);
+  path = g_build_filename (dir, "metrics.sock", NULL);
+
+  id = add_test_collector (&histogram);
+  exporter = kms_metrics_exporter_new (path, NULL, 0, NULL);
+  fail_unless (exporter != NULL);
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  g_strlcpy (addr.sun_path, path, sizeof (addr.sun_path));
+  fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  fail_unless (fd >= 0);
+  fail_unless (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) == 0);
+
+  /* The exporter closes the connection once everything is sent */
+  metrics = g_string_new (NULL);
+
+  while ((len = read (fd, buf, sizeof (buf))) > 0) {
+    g_string_append_len (metrics, buf, len);
+  }
+
+  close (fd);
+  check_test_metrics (metrics->str);
+  g_string_free (metrics, TRUE);
+
+  kms_metrics_exporter_free (exporter);
+  kms_metrics_remove_collector (id);
+  fail_if (g_file_test (path, G_FILE_TEST_EXISTS));
+
+  g_rmdir (dir);
+  g_free (path);
+  g_free (dir);
+}
+
+GST_END_TEST;
+
+static Suite *
+metrics_suite (void)
+{
+  Suite *s = suite_create ("metrics");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_add_test (tc_chain, render);
+  tcase_add_test (tc_chain, export_file);
+  tcase_add_test (tc_chain, export_socket);
+
+  return s;
+}
+
+GST_CHECK_MAIN (metrics);
@@ -130,6 +130,143 @@ GST_START_TEST (check_take_into_account_after_clear_time)
 
 GST_END_TEST;
 
+#define N_SENDERS 8
+#define N_EVENTS 1000
+
+typedef struct _SenderData
+{
+  GstPad *pad;
+  guint ssrc;
+} SenderData;
+
+static gpointer
+send_remb_events (gpointer user_data)
+{
+  SenderData *data = user_data;
+  guint i;
+
+  /* Go up and down, finishing at 1000 * (ssrc + 1) */
+  for (i = 0; i < N_EVENTS; i++) {
+    guint br = 1000 * (data->ssrc + 1) +
+        ((i * 7919) % 5000) * (N_EVENTS - 1 - i);
+
+    gst_pad_send_event (data->pad,
+        kms_utils_remb_event_upstream_new (br, data->ssrc));
+  }
+
+  return NULL;
+}
+
+GST_START_TEST (check_concurrent_updates)
+{
+  GThread *threads[N_SENDERS];
+  SenderData senders[N_SENDERS];
+  RembEventManager *manager;
+  GstPad *pad;
+  guint min_br = 0;
+  guint i;
+
+  pad = gst_pad_new (NULL, GST_PAD_SRC);
+  gst_pad_set_active (pad, TRUE);
+  manager = kms_utils_remb_event_manager_create (pad);
+  kms_utils_remb_event_manager_set_callback (manager, bitrate_cb, &min_br,
+      NULL);
+
+  for (i = 0; i < N_SENDERS; i++) {
+    senders[i].pad = pad;
+    senders[i].ssrc = i;
+    threads[i] = g_thread_new (NULL, send_remb_events, &senders[i]);
+  }
+
+  for (i = 0; i < N_SENDERS; i++) {
+    g_thread_join (threads[i]);
+  }
+
+  /* The minimum follows the last REMB of every SSRC */
+  fail_unless_equals_int (kms_utils_remb_event_manager_get_min (manager), 1000);
+  fail_unless_equals_int (min_br, 1000);
+
+  kms_utils_remb_event_manager_destroy (manager);
+  g_object_unref (pad);
+}
+
+GST_END_TEST;
+
+#define N_REFRESHES 20000
+
+typedef struct _RefreshData
+{
+  GstPad *pad;
+  guint ssrc;
+  guint low;
+  guint high;
+} RefreshData;
+
+static gpointer
+refresh_remb (gpointer user_data)
+{
+  RefreshData *data = user_data;
+  guint i;
+
+  for (i = 0; i < N_REFRESHES; i++) {
+    guint br = (i % 2 == 0) ? data->high : data->low;
+
+    gst_pad_send_event (data->pad,
+        kms_utils_remb_event_upstream_new (br, data->ssrc));
+  }
+
+  return NULL;
+}
+
+static void
+check_not_above_cb (RembEventManager * manager, guint bitrate,
+    gpointer user_data)
+{
+  guint *max_notified = user_data;
+
+  if (bitrate > *max_notified) {
+    *max_notified = bitrate;
+  }
+}
+
+/*
+ * SSRC 1 keeps going up and down, so every rise rescans the slots, while
+ * SSRC 2 refreshes its slot. A slot refreshed after the scan took its time
+ * is not expired, so the minimum never goes above SSRC 2 bitrate.
+ */
+GST_START_TEST (check_refresh_during_scan)
+{
+  RefreshData rising = { NULL, 1, 100, 200 };
+  RefreshData steady = { NULL, 2, 150, 150 };
+  GThread *rising_thread, *steady_thread;
+  RembEventManager *manager;
+  guint max_notified = 0;
+  GstPad *pad;
+
+  pad = gst_pad_new (NULL, GST_PAD_SRC);
+  gst_pad_set_active (pad, TRUE);
+  manager = kms_utils_remb_event_manager_create (pad);
+
+  gst_pad_send_event (pad, kms_utils_remb_event_upstream_new (150, 2));
+  kms_utils_remb_event_manager_set_callback (manager, check_not_above_cb,
+      &max_notified, NULL);
+
+  rising.pad = steady.pad = pad;
+  rising_thread = g_thread_new (NULL, refresh_remb, &rising);
+  steady_thread = g_thread_new (NULL, refresh_remb, &steady);
+  g_thread_join (rising_thread);
+  g_thread_join (steady_thread);
+
+  fail_unless (max_notified <= 150, "Slot expired while refreshed (%u)",
+      max_notified);
+  fail_unless_equals_int (kms_utils_remb_event_manager_get_min (manager), 100);
+
+  kms_utils_remb_event_manager_destroy (manager);
+  g_object_unref (pad);
+}
+
+GST_END_TEST;
+
 /* Suite initialization */
 static Suite *
 rembmanager_suite (void)
@@ -140,6 +277,8 @@ rembmanager_suite (void)
   suite_add_tcase (s, tc_chain);
   tcase_add_test (tc_chain, check_min_br_update);
   tcase_add_test (tc_chain, check_take_into_account_after_clear_time);
+  tcase_add_test (tc_chain, check_concurrent_updates);
+  tcase_add_test (tc_chain, check_refresh_during_scan);
 
   return s;
 }
@@ -0,0 +1,350 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Offline replay of packet timing traces through KmsRembLocal, to compare the
+ * loss-based and the delay-based estimators without a network.
+ *
+ * A recorded trace can be replayed setting KMS_REMB_TRACE to a file with one
+ * packet per line: "<send time us> <arrival time us> <size>", where a
+ * negative arrival time means that the packet was lost. Lines can be in any
+ * order, they are sorted by arrival before replaying them.
+ */
+
+#include <gst/check/gstcheck.h>
+
+#include <kmsremb.h>
+
+#define PACKET_SIZE 1200        /* Bytes */
+#define PROPAGATION_DELAY 20000 /* us */
+#define MAX_QUEUE_DELAY 500000  /* us */
+#define RTCP_INTERVAL 200000    /* us */
+
+typedef struct _TracePacket
+{
+  guint64 send;
+  gint64 arrival;               /* -1 if lost */
+  guint size;
+} TracePacket;
+
+typedef struct _RembSample
+{
+  guint64 time;
+  guint remb;
+} RembSample;
+
+/*
+ * Constant bitrate sender behind a drop-tail bottleneck whose capacity
+ * changes from @capacity to @drop_capacity at @drop_at.
+ */
+static GArray *
+generate_bottleneck_trace (guint send_bps, guint capacity, guint drop_capacity,
+    guint64 drop_at, guint64 duration)
+{
+  GArray *trace = g_array_new (FALSE, FALSE, sizeof (TracePacket));
+  guint64 interval = (guint64) PACKET_SIZE * 8 * G_USEC_PER_SEC / send_bps;
+  guint64 link_free = 0, t;
+
+  for (t = 0; t < duration; t += interval) {
+    guint bps = t < drop_at ? capacity : drop_capacity;
+    guint64 start = MAX (t, link_free);
+    TracePacket p;
+
+    p.send = t;
+    p.size = PACKET_SIZE;
+
+    if (start - t > MAX_QUEUE_DELAY) {
+      p.arrival = -1;
+    } else {
+      link_free = start + (guint64) PACKET_SIZE * 8 * G_USEC_PER_SEC / bps;
+      p.arrival = link_free + PROPAGATION_DELAY;
+    }
+
+    g_array_append_val (trace, p);
+  }
+
+  return trace;
+}
+
+static GArray *
+load_trace (const gchar * path)
+{
+  GArray *trace;
+  gchar *contents;
+  gchar **lines, **line;
+
+  if (!g_file_get_contents (path, &contents, NULL, NULL)) {
+    return NULL;
+  }
+
+  trace = g_array_new (FALSE, FALSE, sizeof (TracePacket));
+  lines = g_strsplit (contents, "\n", -1);
+
+  for (line = lines; *line != NULL; line++) {
+    TracePacket p;
+
+    if (sscanf (*line, "%" G_GUINT64_FORMAT " %" G_GINT64_FORMAT " %u",
+            &p.send, &p.arrival, &p.size) == 3) {
+      g_array_append_val (trace, p);
+    }
+  }
+
+  g_strfreev (lines);
+  g_free (contents);
+
+  return trace;
+}
+
+static guint32
+abs_send_time_from_us (guint64 us)
+{
+  return (guint32) (((us << 18) / G_USEC_PER_SEC) & 0x00ffffff);
+}
+
+static KmsRembLocal *
+create_remb_local (GstElement ** rtpbin, GstPad ** pad,
+    KmsRembEstimator estimator)
+{
+  GObject *rtpsession = NULL;
+  GstStructure *params;
+  KmsRembLocal *rl;
+
+  *rtpbin = gst_element_factory_make ("rtpbin", NULL);
+  fail_unless (*rtpbin != NULL);
+  *pad = gst_element_get_request_pad (*rtpbin, "recv_rtp_sink_0");
+  g_signal_emit_by_name (*rtpbin, "get-internal-session", 0, &rtpsession);
+  fail_unless (rtpsession != NULL);
+
+  rl = kms_remb_local_create (rtpsession, 0, 0);
+  g_object_unref (rtpsession);
+
+  params = gst_structure_new ("remb-params", "estimator", G_TYPE_INT,
+      estimator, NULL);
+  kms_remb_local_set_params (rl, params);
+  gst_structure_free (params);
+
+  return rl;
+}
+
+static void
+destroy_remb_local (KmsRembLocal * rl, GstElement * rtpbin, GstPad * pad)
+{
+  kms_remb_local_destroy (rl);
+  gst_element_release_request_pad (rtpbin, pad);
+  gst_object_unref (pad);
+  gst_object_unref (rtpbin);
+}
+
+/* Lost packets are accounted when they were sent */
+static guint64
+trace_packet_get_time (const TracePacket * p)
+{
+  return p->arrival < 0 ? p->send : (guint64) p->arrival;
+}
+
+static gint
+compare_arrival (gconstpointer a, gconstpointer b)
+{
+  const TracePacket *pa = a, *pb = b;
+  guint64 ta = trace_packet_get_time (pa), tb = trace_packet_get_time (pb);
+
+  if (ta != tb) {
+    return ta < tb ? -1 : 1;
+  }
+
+  /* Keep the send order of simultaneous events */
+  return pa->send < pb->send ? -1 : (pa->send > pb->send ? 1 : 0);
+}
+
+/* Packets are replayed in arrival order, RTCP intervals use the local time */
+static GArray *
+replay_trace (GArray * trace, KmsRembEstimator estimator)
+{
+  GArray *samples = g_array_new (FALSE, FALSE, sizeof (RembSample));
+  guint64 next_update = RTCP_INTERVAL, bytes = 0, received = 0, lost = 0;
+  GstElement *rtpbin;
+  KmsRembLocal *rl;
+  GstPad *pad;
+  guint i;
+
+  rl = create_remb_local (&rtpbin, &pad, estimator);
+
+  /* Reordered packets and losses are not in arrival order */
+  g_array_sort (trace, compare_arrival);
+
+  for (i = 0; i < trace->len; i++) {
+    TracePacket *p = &g_array_index (trace, TracePacket, i);
+    guint64 time = trace_packet_get_time (p);
+
+    while (time >= next_update) {
+      guint64 expected = received + lost;
+
+      if (expected > 0 && kms_remb_local_process_stats (rl,
+              bytes * 8 * G_USEC_PER_SEC / RTCP_INTERVAL,
+              lost * 256 / expected, received, next_update * GST_USECOND)) {
+        RembSample s = { next_update, rl->remb };
+
+        g_array_append_val (samples, s);
+        GST_LOG ("%s t: %" G_GUINT64_FORMAT " ms, remb: %u bps, lost: %"
+            G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT,
+            estimator == KMS_REMB_ESTIMATOR_DELAY ? "delay" : "loss",
+            next_update / 1000, rl->remb, lost, expected);
+      }
+
+      bytes = received = lost = 0;
+      next_update += RTCP_INTERVAL;
+    }
+
+    if (p->arrival < 0) {
+      lost++;
+      continue;
+    }
+
+    received++;
+    bytes += p->size;
+    kms_remb_local_on_rtp_packet (rl, abs_send_time_from_us (p->send),
+        p->arrival * GST_USECOND, p->size);
+  }
+
+  destroy_remb_local (rl, rtpbin, pad);
+
+  return samples;
+}
+
+/* First time after @from when the estimation goes below @bitrate */
+static guint64
+first_time_below (GArray * samples, guint64 from, guint bitrate)
+{
+  guint i;
+
+  for (i = 0; i < samples->len; i++) {
+    RembSample *s = &g_array_index (samples, RembSample, i);
+
+    if (s->time >= from && s->remb < bitrate) {
+      return s->time;
+    }
+  }
+
+  return G_MAXUINT64;
+}
+
+static guint
+last_remb (GArray * samples)
+{
+  fail_if (samples->len == 0);
+
+  return g_array_index (samples, RembSample, samples->len - 1).remb;
+}
+
+GST_START_TEST (replay_steady)
+{
+  GArray *trace, *loss, *delay;
+
+  trace = generate_bottleneck_trace (1500000, 3000000, 3000000, 0,
+      10 * G_USEC_PER_SEC);
+
+  loss = replay_trace (trace, KMS_REMB_ESTIMATOR_LOSS);
+  delay = replay_trace (trace, KMS_REMB_ESTIMATOR_DELAY);
+
+  GST_INFO ("Steady link, final REMB: loss %u bps, delay %u bps",
+      last_remb (loss), last_remb (delay));
+
+  /* Without congestion no estimator goes below the sent bitrate */
+  fail_unless (first_time_below (loss, 0, 1400000) == G_MAXUINT64);
+  fail_unless (first_time_below (delay, 0, 1400000) == G_MAXUINT64);
+
+  g_array_unref (loss);
+  g_array_unref (delay);
+  g_array_unref (trace);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (replay_capacity_drop)
+{
+  guint64 drop_at = 5 * G_USEC_PER_SEC, t_loss, t_delay;
+  GArray *trace, *loss, *delay;
+
+  trace = generate_bottleneck_trace (1500000, 3000000, 1000000, drop_at,
+      10 * G_USEC_PER_SEC);
+
+  loss = replay_trace (trace, KMS_REMB_ESTIMATOR_LOSS);
+  delay = replay_trace (trace, KMS_REMB_ESTIMATOR_DELAY);
+
+  t_loss = first_time_below (loss, drop_at, 1500000);
+  t_delay = first_time_below (delay, drop_at, 1500000);
+
+  GST_INFO ("Capacity drop, reaction time: loss %" G_GINT64_FORMAT
+      " ms, delay %" G_GINT64_FORMAT " ms",
+      t_loss == G_MAXUINT64 ? -1 : (gint64) (t_loss - drop_at) / 1000,
+      t_delay == G_MAXUINT64 ? -1 : (gint64) (t_delay - drop_at) / 1000);
+
+  /* The queue builds up before any loss, so delay reacts first */
+  fail_unless (t_delay != G_MAXUINT64);
+  fail_unless (t_delay - drop_at <= 2 * G_USEC_PER_SEC);
+  fail_unless (t_delay <= t_loss);
+
+  g_array_unref (loss);
+  g_array_unref (delay);
+  g_array_unref (trace);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (replay_trace_file)
+{
+  const gchar *path = g_getenv ("KMS_REMB_TRACE");
+  GArray *trace, *loss, *delay;
+
+  if (path == NULL) {
+    GST_INFO ("KMS_REMB_TRACE not set, nothing to replay");
+    return;
+  }
+
+  trace = load_trace (path);
+  fail_unless (trace != NULL, "Can not read trace '%s'", path);
+
+  loss = replay_trace (trace, KMS_REMB_ESTIMATOR_LOSS);
+  delay = replay_trace (trace, KMS_REMB_ESTIMATOR_DELAY);
+
+  GST_INFO ("Trace '%s' (%u packets), final REMB: loss %u bps, delay %u bps",
+      path, trace->len, loss->len > 0 ? last_remb (loss) : 0,
+      delay->len > 0 ? last_remb (delay) : 0);
+
+  g_array_unref (loss);
+  g_array_unref (delay);
+  g_array_unref (trace);
+}
+
+GST_END_TEST;
+
+static Suite *
+rembreplay_suite (void)
+{
+  Suite *s = suite_create ("rembreplay");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_add_test (tc_chain, replay_steady);
+  tcase_add_test (tc_chain, replay_capacity_drop);
+  tcase_add_test (tc_chain, replay_trace_file);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rembreplay);
@@ -0,0 +1,561 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Closed loop simulation of the REMB congestion control: a sender paced at
+ * the bitrate chosen by RembEventManager, one or more bottleneck links with
+ * synthetic capacity and loss traces, a KmsRembLocal estimating each link and
+ * a KmsRembRemote turning its REMB into the upstream bitrate event.
+ *
+ * Every scenario reports convergence time, overshoot and link utilisation.
+ * RembParams can be tuned offline with KMS_REMB_SIM_PARAMS, e.g.
+ * KMS_REMB_SIM_PARAMS="remb-params, exponential-factor=(float)0.06"
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gsttestclock.h>
+#include <gst/rtp/gstrtcpbuffer.h>
+
+#include <kmsremb.h>
+#include <kmsrtcp.h>
+
+#define PACKET_SIZE 1200        /* Bytes */
+#define PROPAGATION_DELAY 30000 /* us */
+#define MAX_QUEUE_DELAY 300000  /* us */
+#define RTCP_INTERVAL 200000    /* us */
+#define TICK 1000               /* us */
+#define REMB_ON_CONNECT 300000  /* bps */
+#define REMB_MIN 30000          /* bps */
+#define SENDER_SSRC 1111
+#define MEDIA_SSRC 2222
+
+/* A capacity change is converged once the target is within this band */
+#define CONVERGED_MIN 0.5
+#define CONVERGED_MAX 1.1
+
+/* Regression bounds, with some margin over the loss-based estimator results */
+#define MAX_CONVERGENCE (5 * G_USEC_PER_SEC)
+#define MIN_UTILISATION 0.5
+
+typedef struct _SimScenario
+{
+  const gchar *name;
+  guint64 duration;             /* us */
+  guint n_links;
+  /* Capacity in bps of @link at @t. Link 0 is always the bottleneck */
+  guint (*capacity) (guint link, guint64 t);
+  /* Random loss probability at @t, may be NULL */
+  gdouble (*loss) (guint64 t);
+  /* Capacity change measured for convergence */
+  guint64 event;
+} SimScenario;
+
+typedef struct _SimResult
+{
+  gint64 convergence;           /* us after the event, -1 if never */
+  gdouble overshoot;            /* over the bottleneck capacity, after event */
+  gdouble utilisation;          /* bottleneck goodput over its capacity */
+  gdouble loss_rate;
+} SimResult;
+
+typedef struct _SimPacket
+{
+  guint64 send;
+  guint64 arrival;
+} SimPacket;
+
+typedef struct _SimFeedback
+{
+  guint64 time;
+  guint bitrate;
+} SimFeedback;
+
+typedef struct _SimLink
+{
+  guint32 ssrc;                 /* Local SSRC of the sending endpoint */
+  GstElement *rtpbin;
+  GstPad *rtpbin_pad;
+  GObject *rtpsession;
+  /* Receiver output, the REMBs of its consumers are aggregated on it */
+  GstPad *recv_pad;
+  KmsRembLocal *rl;
+  KmsRembRemote *rm;
+
+  /* Upstream events from rm go through this pair to the sender */
+  GstPad *src;
+  GstPad *sink;
+
+  guint64 link_free;
+  GQueue in_flight;             /* SimPacket */
+  GQueue feedback;              /* SimFeedback */
+
+  guint64 bytes, received, lost;
+  guint64 total_bytes, total_received, total_lost;
+} SimLink;
+
+typedef struct _Sim
+{
+  GRand *rand;
+  /* Simulated time, used by the REMB event managers to expire entries */
+  GstClock *clock;
+  GstPad *encoder_pad;
+  RembEventManager *manager;
+  guint target;
+  SimLink *links;
+  guint n_links;
+} Sim;
+
+/* Scenarios begin */
+
+static guint
+step_drop_capacity (guint link, guint64 t)
+{
+  return t < 30 * G_USEC_PER_SEC ? 2000000 : 500000;
+}
+
+static guint
+bursts_capacity (guint link, guint64 t)
+{
+  return 1500000;
+}
+
+/* 1 s of 10% random losses every 8 s */
+static gdouble
+bursts_loss (guint64 t)
+{
+  return (t / G_USEC_PER_SEC) % 8 == 7 ? 0.1 : 0;
+}
+
+static guint
+ramp_capacity (guint link, guint64 t)
+{
+  return 300000 + (guint) (2200000 * t / (60 * G_USEC_PER_SEC));
+}
+
+static guint
+subscribers_capacity (guint link, guint64 t)
+{
+  return link == 0 ? 800000 : 2500000;
+}
+
+static const SimScenario step_drop = {
+  "step-drop", 60 * G_USEC_PER_SEC, 1, step_drop_capacity, NULL,
+  30 * G_USEC_PER_SEC
+};
+
+static const SimScenario bursts = {
+  "bursts", 60 * G_USEC_PER_SEC, 1, bursts_capacity, bursts_loss, 0
+};
+
+static const SimScenario ramp = {
+  "slow-ramp", 60 * G_USEC_PER_SEC, 1, ramp_capacity, NULL, 0
+};
+
+static const SimScenario subscribers = {
+  "two-subscribers", 60 * G_USEC_PER_SEC, 2, subscribers_capacity, NULL, 0
+};
+
+/* Scenarios end */
+
+static void
+on_bitrate_updated (RembEventManager * manager, guint bitrate, gpointer data)
+{
+  Sim *sim = data;
+
+  sim->target = MAX (bitrate, REMB_MIN);
+}
+
+static gboolean
+link_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  Sim *sim = g_object_get_data (G_OBJECT (pad), "sim");
+
+  /* All the links share the encoder, as branches of a tee */
+  return gst_pad_send_event (sim->encoder_pad, event);
+}
+
+static void
+apply_params (SimLink * link, KmsRembEstimator estimator)
+{
+  const gchar *str = g_getenv ("KMS_REMB_SIM_PARAMS");
+  GstStructure *params = NULL;
+
+  if (str != NULL) {
+    params = gst_structure_from_string (str, NULL);
+    fail_unless (params != NULL, "Wrong KMS_REMB_SIM_PARAMS '%s'", str);
+  } else {
+    params = gst_structure_new_empty ("remb-params");
+  }
+
+  gst_structure_set (params, "estimator", G_TYPE_INT, estimator, NULL);
+  kms_remb_local_set_params (link->rl, params);
+  kms_remb_remote_set_params (link->rm, params);
+  gst_structure_free (params);
+}
+
+static void
+sim_link_init (Sim * sim, SimLink * link, guint32 ssrc,
+    KmsRembEstimator estimator)
+{
+  link->ssrc = ssrc;
+  link->rtpbin = gst_element_factory_make ("rtpbin", NULL);
+  fail_unless (link->rtpbin != NULL);
+  link->rtpbin_pad =
+      gst_element_get_request_pad (link->rtpbin, "recv_rtp_sink_0");
+  g_signal_emit_by_name (link->rtpbin, "get-internal-session", 0,
+      &link->rtpsession);
+  fail_unless (link->rtpsession != NULL);
+
+  link->src = gst_pad_new ("src", GST_PAD_SRC);
+  g_object_set_data (G_OBJECT (link->src), "sim", sim);
+  gst_pad_set_event_function (link->src, link_src_event);
+  link->sink = gst_pad_new ("sink", GST_PAD_SINK);
+  fail_unless (GST_PAD_LINK_SUCCESSFUL (gst_pad_link (link->src,
+              link->sink)));
+  gst_pad_set_active (link->src, TRUE);
+  gst_pad_set_active (link->sink, TRUE);
+
+  link->rl = kms_remb_local_create (link->rtpsession, 0, 0);
+  kms_remb_local_add_remote_session (link->rl, link->rtpsession, MEDIA_SSRC);
+
+  /* As done by KmsBaseRtpEndpoint for received video */
+  link->recv_pad = gst_pad_new ("recv", GST_PAD_SRC);
+  gst_pad_set_active (link->recv_pad, TRUE);
+  link->rl->event_manager =
+      kms_utils_remb_event_manager_create (link->recv_pad);
+  kms_utils_remb_event_manager_set_clock (link->rl->event_manager,
+      sim->clock);
+
+  link->rm = kms_remb_remote_create (link->rtpsession, link->ssrc, 0, 0,
+      link->sink);
+  apply_params (link, estimator);
+
+  g_queue_init (&link->in_flight);
+  g_queue_init (&link->feedback);
+}
+
+static void
+sim_packet_free (SimPacket * p)
+{
+  g_slice_free (SimPacket, p);
+}
+
+static void
+sim_feedback_free (SimFeedback * f)
+{
+  g_slice_free (SimFeedback, f);
+}
+
+static void
+sim_link_clear (SimLink * link)
+{
+  kms_remb_remote_destroy (link->rm);
+  kms_remb_local_destroy (link->rl);
+  gst_object_unref (link->recv_pad);
+
+  g_queue_free_full (&link->in_flight, (GDestroyNotify) sim_packet_free);
+  g_queue_init (&link->in_flight);
+  g_queue_free_full (&link->feedback, (GDestroyNotify) sim_feedback_free);
+  g_queue_init (&link->feedback);
+
+  gst_pad_unlink (link->src, link->sink);
+  gst_object_unref (link->src);
+  gst_object_unref (link->sink);
+
+  g_object_unref (link->rtpsession);
+  gst_element_release_request_pad (link->rtpbin, link->rtpbin_pad);
+  gst_object_unref (link->rtpbin_pad);
+  gst_object_unref (link->rtpbin);
+}
+
+static void
+sim_link_send (Sim * sim, const SimScenario * sc, guint idx, guint64 t)
+{
+  SimLink *link = &sim->links[idx];
+  guint64 start;
+  SimPacket *p;
+
+  if (sc->loss != NULL && g_rand_double (sim->rand) < sc->loss (t)) {
+    link->lost++;
+    return;
+  }
+
+  start = MAX (t, link->link_free);
+  if (start - t > MAX_QUEUE_DELAY) {
+    link->lost++;
+    return;
+  }
+
+  link->link_free = start +
+      (guint64) PACKET_SIZE * 8 * G_USEC_PER_SEC / sc->capacity (idx, t);
+
+  p = g_slice_new (SimPacket);
+  p->send = t;
+  p->arrival = link->link_free + PROPAGATION_DELAY;
+  g_queue_push_tail (&link->in_flight, p);
+}
+
+static void
+sim_link_send_remb (SimLink * link, guint bitrate)
+{
+  GstRTCPBuffer rtcp = GST_RTCP_BUFFER_INIT;
+  KmsRTCPPSFBAFBREMBPacket remb;
+  GstRTCPPacket packet;
+  GstBuffer *buf, *fci;
+  guint len;
+
+  buf = gst_rtcp_buffer_new (1400);
+  gst_rtcp_buffer_map (buf, GST_MAP_READWRITE, &rtcp);
+  fail_unless (gst_rtcp_buffer_add_packet (&rtcp, GST_RTCP_TYPE_PSFB,
+          &packet));
+
+  remb.bitrate = bitrate;
+  remb.n_ssrcs = 1;
+  remb.ssrcs[0] = link->ssrc;
+  fail_unless (kms_rtcp_psfb_afb_remb_marshall_packet (&packet, &remb,
+          MEDIA_SSRC));
+
+  len = gst_rtcp_packet_fb_get_fci_length (&packet) * 4;
+  fci = gst_buffer_new_wrapped (g_memdup (gst_rtcp_packet_fb_get_fci
+          (&packet), len), len);
+  gst_rtcp_buffer_unmap (&rtcp);
+  gst_buffer_unref (buf);
+
+  g_signal_emit_by_name (link->rtpsession, "on-feedback-rtcp",
+      GST_RTCP_TYPE_PSFB, GST_RTCP_PSFB_TYPE_AFB, MEDIA_SSRC, link->ssrc, fci);
+  gst_buffer_unref (fci);
+}
+
+static guint32
+abs_send_time_from_us (guint64 us)
+{
+  return (guint32) (((us << 18) / G_USEC_PER_SEC) & 0x00ffffff);
+}
+
+static void
+sim_link_receive (SimLink * link, guint64 t)
+{
+  SimPacket *p;
+  SimFeedback *f;
+
+  while ((p = g_queue_peek_head (&link->in_flight)) != NULL
+      && p->arrival <= t) {
+    g_queue_pop_head (&link->in_flight);
+    link->received++;
+    link->bytes += PACKET_SIZE;
+    kms_remb_local_on_rtp_packet (link->rl, abs_send_time_from_us (p->send),
+        p->arrival * GST_USECOND, PACKET_SIZE);
+    sim_packet_free (p);
+  }
+
+  while ((f = g_queue_peek_head (&link->feedback)) != NULL && f->time <= t) {
+    g_queue_pop_head (&link->feedback);
+    sim_link_send_remb (link, f->bitrate);
+    sim_feedback_free (f);
+  }
+}
+
+/* Same REMB value as kms_remb_local_on_sending_rtcp */
+static void
+sim_link_rtcp (SimLink * link, guint64 t)
+{
+  guint64 expected = link->received + link->lost;
+
+  if (expected > 0 && kms_remb_local_process_stats (link->rl,
+          link->bytes * 8 * G_USEC_PER_SEC / RTCP_INTERVAL,
+          link->lost * 256 / expected, link->received, t * GST_USECOND)) {
+    SimFeedback *f = g_slice_new (SimFeedback);
+
+    f->time = t + PROPAGATION_DELAY;
+    f->bitrate = kms_remb_local_get_bitrate (link->rl);
+    g_queue_push_tail (&link->feedback, f);
+  }
+
+  link->total_bytes += link->bytes;
+  link->total_received += link->received;
+  link->total_lost += link->lost;
+  link->bytes = link->received = link->lost = 0;
+}
+
+static void
+run_scenario (const SimScenario * sc, KmsRembEstimator estimator,
+    SimResult * res)
+{
+  guint64 t, next_send = 0, next_rtcp = RTCP_INTERVAL;
+  gdouble capacity_bits = 0, goodput_bits = 0;
+  Sim sim = { 0, };
+  guint i;
+
+  sim.rand = g_rand_new_with_seed (1);
+  sim.clock = gst_test_clock_new ();
+  sim.target = REMB_ON_CONNECT;
+  sim.encoder_pad = gst_pad_new ("encoder", GST_PAD_SRC);
+  gst_pad_set_active (sim.encoder_pad, TRUE);
+  sim.manager = kms_utils_remb_event_manager_create (sim.encoder_pad);
+  kms_utils_remb_event_manager_set_clock (sim.manager, sim.clock);
+  kms_utils_remb_event_manager_set_callback (sim.manager, on_bitrate_updated,
+      &sim, NULL);
+
+  sim.n_links = sc->n_links;
+  sim.links = g_new0 (SimLink, sim.n_links);
+  for (i = 0; i < sim.n_links; i++) {
+    sim_link_init (&sim, &sim.links[i], SENDER_SSRC + i, estimator);
+  }
+
+  res->convergence = -1;
+  res->overshoot = 0;
+
+  for (t = 0; t < sc->duration; t += TICK) {
+    gst_test_clock_set_time (GST_TEST_CLOCK (sim.clock), t * GST_USECOND);
+
+    while (next_send <= t) {
+      for (i = 0; i < sim.n_links; i++) {
+        sim_link_send (&sim, sc, i, next_send);
+      }
+      next_send += (guint64) PACKET_SIZE * 8 * G_USEC_PER_SEC / sim.target;
+    }
+
+    for (i = 0; i < sim.n_links; i++) {
+      sim_link_receive (&sim.links[i], t);
+    }
+
+    if (t >= next_rtcp) {
+      guint capacity = sc->capacity (0, t);
+
+      capacity_bits += (gdouble) capacity * RTCP_INTERVAL / G_USEC_PER_SEC;
+      goodput_bits += MIN (sim.links[0].bytes * 8,
+          (gdouble) capacity * RTCP_INTERVAL / G_USEC_PER_SEC);
+
+      for (i = 0; i < sim.n_links; i++) {
+        sim_link_rtcp (&sim.links[i], t);
+      }
+
+      if (t >= sc->event) {
+        if (res->convergence < 0 && sim.target >= CONVERGED_MIN * capacity
+            && sim.target <= CONVERGED_MAX * capacity) {
+          res->convergence = t - sc->event;
+        }
+
+        res->overshoot = MAX (res->overshoot,
+            ((gdouble) sim.target - capacity) / capacity);
+      }
+
+      GST_LOG ("%s t: %" G_GUINT64_FORMAT " ms, capacity: %u, target: %u",
+          sc->name, t / 1000, capacity, sim.target);
+
+      next_rtcp += RTCP_INTERVAL;
+    }
+  }
+
+  res->utilisation = goodput_bits / capacity_bits;
+  res->loss_rate = sim.links[0].total_lost == 0 ? 0 :
+      (gdouble) sim.links[0].total_lost / (sim.links[0].total_lost +
+      sim.links[0].total_received);
+
+  GST_INFO ("%-16s %-5s convergence: %6" G_GINT64_FORMAT
+      " ms, overshoot: %5.1f%%, utilisation: %5.1f%%, losses: %4.1f%%",
+      sc->name, estimator == KMS_REMB_ESTIMATOR_DELAY ? "delay" : "loss",
+      res->convergence < 0 ? -1 : res->convergence / 1000,
+      res->overshoot * 100, res->utilisation * 100, res->loss_rate * 100);
+
+  for (i = 0; i < sim.n_links; i++) {
+    sim_link_clear (&sim.links[i]);
+  }
+  g_free (sim.links);
+
+  kms_utils_remb_event_manager_destroy (sim.manager);
+  gst_object_unref (sim.encoder_pad);
+  gst_object_unref (sim.clock);
+  g_rand_free (sim.rand);
+}
+
+GST_START_TEST (sim_step_drop)
+{
+  SimResult loss, delay;
+
+  run_scenario (&step_drop, KMS_REMB_ESTIMATOR_LOSS, &loss);
+  run_scenario (&step_drop, KMS_REMB_ESTIMATOR_DELAY, &delay);
+
+  fail_unless (loss.convergence >= 0);
+  fail_unless (loss.convergence <= MAX_CONVERGENCE);
+  fail_unless (delay.convergence >= 0);
+  fail_unless (delay.convergence <= MAX_CONVERGENCE);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (sim_bursts)
+{
+  SimResult loss, delay;
+
+  run_scenario (&bursts, KMS_REMB_ESTIMATOR_LOSS, &loss);
+  run_scenario (&bursts, KMS_REMB_ESTIMATOR_DELAY, &delay);
+
+  /* Short loss bursts must not collapse the bitrate */
+  fail_unless (loss.utilisation > MIN_UTILISATION);
+  fail_unless (delay.utilisation > MIN_UTILISATION);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (sim_slow_ramp)
+{
+  SimResult loss, delay;
+
+  run_scenario (&ramp, KMS_REMB_ESTIMATOR_LOSS, &loss);
+  run_scenario (&ramp, KMS_REMB_ESTIMATOR_DELAY, &delay);
+
+  fail_unless (loss.utilisation > MIN_UTILISATION);
+  fail_unless (delay.utilisation > MIN_UTILISATION);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (sim_two_subscribers)
+{
+  SimResult loss, delay;
+
+  run_scenario (&subscribers, KMS_REMB_ESTIMATOR_LOSS, &loss);
+  run_scenario (&subscribers, KMS_REMB_ESTIMATOR_DELAY, &delay);
+
+  /* The sender follows the most constrained subscriber */
+  fail_unless (loss.convergence >= 0);
+  fail_unless (loss.convergence <= MAX_CONVERGENCE);
+  fail_unless (delay.convergence >= 0);
+  fail_unless (delay.convergence <= MAX_CONVERGENCE);
+}
+
+GST_END_TEST;
+
+static Suite *
+rembsim_suite (void)
+{
+  Suite *s = suite_create ("rembsim");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_set_timeout (tc_chain, 120);
+
+  tcase_add_test (tc_chain, sim_step_drop);
+  tcase_add_test (tc_chain, sim_bursts);
+  tcase_add_test (tc_chain, sim_slow_ramp);
+  tcase_add_test (tc_chain, sim_two_subscribers);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rembsim);
@@ -0,0 +1,452 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/rtp/gstrtpbuffer.h>
+
+#include <kmsrtphdrext.h>
+#include <constants.h>
+
+#define ABS_SEND_TIME_ID 3
+#define ABS_SEND_TIME_SIZE 3
+#define PAYLOAD_SIZE 1200
+#define BENCHMARK_PACKETS 200000
+#define BENCHMARK_LIST_LENGTH 10
+
+static GstBuffer *
+generate_rtp_buffer (void)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstBuffer *buf;
+
+  buf = gst_rtp_buffer_new_allocate (PAYLOAD_SIZE, 0, 0);
+
+  gst_rtp_buffer_map (buf, GST_MAP_READWRITE, &rtp);
+  gst_rtp_buffer_set_payload_type (&rtp, 96);
+  gst_rtp_buffer_set_ssrc (&rtp, 0x1);
+  gst_rtp_buffer_set_seq (&rtp, 1);
+  gst_rtp_buffer_unmap (&rtp);
+
+  return buf;
+}
+
+static guint32
+get_abs_send_time (GstBuffer * buf)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint8 *data;
+  guint32 value;
+  guint size;
+
+  fail_unless (gst_rtp_buffer_map (buf, GST_MAP_READ, &rtp));
+  fail_unless (gst_rtp_buffer_get_extension_onebyte_header (&rtp,
+          ABS_SEND_TIME_ID, 0, (gpointer *) & data, &size));
+  fail_unless (size == ABS_SEND_TIME_SIZE);
+  value = (data[0] << 16) | (data[1] << 8) | data[2];
+  gst_rtp_buffer_unmap (&rtp);
+
+  return value;
+}
+
+GST_START_TEST (test_abs_send_time_from_time)
+{
+  /* 6.18 fixed point seconds */
+  fail_unless (kms_rtp_hdr_ext_abs_send_time_from_time (0) == 0);
+  fail_unless (kms_rtp_hdr_ext_abs_send_time_from_time (GST_SECOND) ==
+      (1 << 18));
+  fail_unless (kms_rtp_hdr_ext_abs_send_time_from_time (GST_SECOND / 2) ==
+      (1 << 17));
+  /* Wraps around every 64 seconds */
+  fail_unless (kms_rtp_hdr_ext_abs_send_time_from_time (65 * GST_SECOND) ==
+      (1 << 18));
+}
+
+GST_END_TEST;
+
+static GstSDPMedia *
+create_media_with_extmaps (void)
+{
+  GstSDPMedia *media;
+
+  gst_sdp_media_new (&media);
+  gst_sdp_media_set_media (media, "video");
+  gst_sdp_media_add_attribute (media, "extmap",
+      "3 " RTP_HDR_EXT_ABS_SEND_TIME_URI);
+  gst_sdp_media_add_attribute (media, "extmap",
+      "5 " RTP_HDR_EXT_TRANSPORT_CC_URI);
+  gst_sdp_media_add_attribute (media, "extmap",
+      "6/sendrecv " RTP_HDR_EXT_PLAYOUT_DELAY_URI);
+  gst_sdp_media_add_attribute (media, "extmap", "7 urn:unknown");
+
+  return media;
+}
+
+static guint8 *
+get_ext (GstRTPBuffer * rtp, guint8 id, guint expected_size)
+{
+  gpointer data;
+  guint size;
+
+  fail_unless (gst_rtp_buffer_get_extension_onebyte_header (rtp, id, 0,
+          &data, &size));
+  fail_unless (size == expected_size);
+
+  return data;
+}
+
+GST_START_TEST (test_list)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  KmsRtpHdrExtConfig config;
+  KmsRtpHdrExtList *list;
+  GstSDPMedia *media;
+  GstBuffer *buf;
+  gint seqnum = 0xffff;
+  guint8 *data;
+
+  media = create_media_with_extmaps ();
+  config.transport_seqnum = &seqnum;
+  config.min_playout_delay = 100;
+  config.max_playout_delay = 500;
+
+  list = kms_rtp_hdr_ext_list_new (media, &config);
+  fail_unless (list != NULL);
+  fail_unless (kms_rtp_hdr_ext_list_get_length (list) == 3);
+  fail_unless (kms_rtp_hdr_ext_list_has_updaters (list));
+
+  buf = generate_rtp_buffer ();
+  fail_unless (gst_rtp_buffer_map (buf, GST_MAP_WRITE, &rtp));
+  fail_if (kms_rtp_hdr_ext_list_is_reserved (list, &rtp));
+  fail_unless (kms_rtp_hdr_ext_list_reserve (list, &rtp));
+  fail_unless (kms_rtp_hdr_ext_list_is_reserved (list, &rtp));
+  fail_unless (kms_rtp_hdr_ext_list_reserve (list, &rtp));
+  fail_unless (gst_rtp_buffer_get_payload_len (&rtp) == PAYLOAD_SIZE);
+
+  /* playout-delay is written when reserved: 10 and 50 (x 10 ms) */
+  data = get_ext (&rtp, 6, RTP_HDR_EXT_PLAYOUT_DELAY_SIZE);
+  fail_unless (data[0] == 0x00 && data[1] == 0xa0 && data[2] == 0x32);
+  gst_rtp_buffer_unmap (&rtp);
+
+  fail_unless (gst_rtp_buffer_map (buf, GST_MAP_WRITE, &rtp));
+  kms_rtp_hdr_ext_list_update (list, &rtp, 1 * GST_SECOND);
+  gst_rtp_buffer_unmap (&rtp);
+
+  fail_unless (get_abs_send_time (buf) == 1 << 18);
+
+  fail_unless (gst_rtp_buffer_map (buf, GST_MAP_WRITE, &rtp));
+  data = get_ext (&rtp, 5, RTP_HDR_EXT_TRANSPORT_CC_SIZE);
+  fail_unless (data[0] == 0xff && data[1] == 0xff);
+  kms_rtp_hdr_ext_list_update (list, &rtp, 1 * GST_SECOND);
+  /* The transport-wide sequence number wraps around */
+  data = get_ext (&rtp, 5, RTP_HDR_EXT_TRANSPORT_CC_SIZE);
+  fail_unless (data[0] == 0x00 && data[1] == 0x00);
+  gst_rtp_buffer_unmap (&rtp);
+
+  gst_buffer_unref (buf);
+  kms_rtp_hdr_ext_list_free (list);
+
+  GST_DEBUG ("Disabled extensions are not part of the list");
+  config.transport_seqnum = NULL;
+  config.max_playout_delay = -1;
+  list = kms_rtp_hdr_ext_list_new (media, &config);
+  fail_unless (list != NULL);
+  fail_unless (kms_rtp_hdr_ext_list_get_length (list) == 1);
+  kms_rtp_hdr_ext_list_free (list);
+
+  gst_sdp_media_free (media);
+
+  GST_DEBUG ("playout-delay alone is never written when sending");
+  gst_sdp_media_new (&media);
+  gst_sdp_media_set_media (media, "audio");
+  gst_sdp_media_add_attribute (media, "extmap",
+      "6 " RTP_HDR_EXT_PLAYOUT_DELAY_URI);
+  config.max_playout_delay = 500;
+  list = kms_rtp_hdr_ext_list_new (media, &config);
+  fail_unless (list != NULL);
+  fail_unless (kms_rtp_hdr_ext_list_get_length (list) == 1);
+  fail_if (kms_rtp_hdr_ext_list_has_updaters (list));
+  kms_rtp_hdr_ext_list_free (list);
+
+  gst_sdp_media_free (media);
+}
+
+GST_END_TEST;
+
+static GstFlowReturn
+chain_list_func (GstPad * pad, GstObject * parent, GstBufferList * list)
+{
+  GstBufferList **received = g_object_get_data (G_OBJECT (pad), "received");
+
+  *received = list;
+
+  return GST_FLOW_OK;
+}
+
+GST_START_TEST (test_list_probe_bufferlist)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstBufferList *bufflist, *received = NULL;
+  KmsRtpHdrExtConfig config;
+  GstPad *srcpad, *sinkpad;
+  GstSDPMedia *media;
+  KmsRtpHdrExtList *list;
+  GstBuffer *shared, *sent;
+  gint seqnum = 0;
+  guint32 abs_send_time = 0;
+  guint8 *data;
+  guint i;
+
+  media = create_media_with_extmaps ();
+  config.transport_seqnum = &seqnum;
+  config.min_playout_delay = 100;
+  config.max_playout_delay = 500;
+
+  srcpad = gst_pad_new ("src", GST_PAD_SRC);
+  sinkpad = gst_pad_new ("sink", GST_PAD_SINK);
+  gst_pad_set_chain_function (sinkpad, gst_check_chain_func);
+  gst_pad_set_chain_list_function (sinkpad, chain_list_func);
+  g_object_set_data (G_OBJECT (sinkpad), "received", &received);
+  fail_unless (gst_pad_link (srcpad, sinkpad) == GST_PAD_LINK_OK);
+  gst_pad_set_active (srcpad, TRUE);
+  gst_pad_set_active (sinkpad, TRUE);
+
+  /* Payloader output, then rtpbin output */
+  kms_rtp_hdr_ext_list_add_probe (kms_rtp_hdr_ext_list_new (media, &config),
+      srcpad, TRUE);
+  kms_rtp_hdr_ext_list_add_probe (kms_rtp_hdr_ext_list_new (media, &config),
+      srcpad, FALSE);
+
+  /* A shared packet must be copied, not written in place */
+  shared = generate_rtp_buffer ();
+  bufflist = gst_buffer_list_new ();
+  gst_buffer_list_add (bufflist, gst_buffer_ref (shared));
+  gst_buffer_list_add (bufflist, generate_rtp_buffer ());
+  gst_buffer_list_add (bufflist, generate_rtp_buffer ());
+
+  fail_unless (gst_pad_push_list (srcpad, bufflist) == GST_FLOW_OK);
+
+  GST_DEBUG ("The list reaches the peer as a whole");
+  fail_unless (received != NULL);
+  fail_unless_equals_int (gst_buffer_list_length (received), 3);
+
+  for (i = 0; i < 3; i++) {
+    GstBuffer *buf = gst_buffer_list_get (received, i);
+
+    fail_if (buf == shared);
+
+    GST_DEBUG ("All packets share the time sampled for the list");
+    if (i == 0) {
+      abs_send_time = get_abs_send_time (buf);
+    } else {
+      fail_unless (get_abs_send_time (buf) == abs_send_time);
+    }
+
+    fail_unless (gst_rtp_buffer_map (buf, GST_MAP_READ, &rtp));
+    data = get_ext (&rtp, 5, RTP_HDR_EXT_TRANSPORT_CC_SIZE);
+    fail_unless_equals_int ((data[0] << 8) | data[1], i);
+    get_ext (&rtp, 6, RTP_HDR_EXT_PLAYOUT_DELAY_SIZE);
+    gst_rtp_buffer_unmap (&rtp);
+  }
+
+  fail_unless (gst_rtp_buffer_map (shared, GST_MAP_READ, &rtp));
+  fail_if (gst_rtp_buffer_get_extension (&rtp));
+  gst_rtp_buffer_unmap (&rtp);
+
+  gst_buffer_list_unref (received);
+  gst_buffer_unref (shared);
+
+  GST_DEBUG ("Packets kept for retransmission are written in place");
+  shared = generate_rtp_buffer ();
+  list = kms_rtp_hdr_ext_list_new (media, &config);
+  fail_unless (gst_rtp_buffer_map (shared, GST_MAP_WRITE, &rtp));
+  fail_unless (kms_rtp_hdr_ext_list_reserve (list, &rtp));
+  gst_rtp_buffer_unmap (&rtp);
+  kms_rtp_hdr_ext_list_free (list);
+
+  fail_unless (gst_pad_push (srcpad, gst_buffer_ref (shared)) == GST_FLOW_OK);
+  fail_unless_equals_int (g_list_length (buffers), 1);
+  sent = GST_BUFFER (buffers->data);
+  fail_unless (sent == shared);
+
+  fail_unless (gst_rtp_buffer_map (sent, GST_MAP_READ, &rtp));
+  data = get_ext (&rtp, 5, RTP_HDR_EXT_TRANSPORT_CC_SIZE);
+  fail_unless_equals_int ((data[0] << 8) | data[1], 3);
+  gst_rtp_buffer_unmap (&rtp);
+
+  gst_check_drop_buffers ();
+  gst_buffer_unref (shared);
+
+  gst_pad_set_active (srcpad, FALSE);
+  gst_pad_set_active (sinkpad, FALSE);
+  gst_object_unref (srcpad);
+  gst_object_unref (sinkpad);
+  gst_sdp_media_free (media);
+}
+
+GST_END_TEST;
+
+/* Previous send path: copy shared buffers and add the extension afterwards */
+static GstBuffer *
+legacy_add_abs_send_time (GstBuffer * buf, guint32 value)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint8 *time;
+
+  buf = gst_buffer_make_writable (buf);
+  gst_rtp_buffer_map (buf, GST_MAP_WRITE, &rtp);
+
+  time = g_malloc0 (ABS_SEND_TIME_SIZE);
+  time[0] = (guint8) (value >> 16);
+  time[1] = (guint8) (value >> 8);
+  time[2] = (guint8) (value);
+  gst_rtp_buffer_add_extension_onebyte_header (&rtp, ABS_SEND_TIME_ID, time,
+      ABS_SEND_TIME_SIZE);
+  g_free (time);
+
+  gst_rtp_buffer_unmap (&rtp);
+
+  return buf;
+}
+
+static GstFlowReturn
+count_in_place_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  GstBuffer *reserved = g_object_get_data (G_OBJECT (pad), "reserved");
+  guint *in_place = g_object_get_data (G_OBJECT (pad), "in-place");
+
+  if (buffer == reserved) {
+    (*in_place)++;
+  }
+
+  gst_buffer_unref (buffer);
+
+  return GST_FLOW_OK;
+}
+
+static gdouble
+get_packets_per_second (gint64 start, guint packets)
+{
+  gint64 elapsed = MAX (g_get_monotonic_time () - start, 1);
+
+  return (gdouble) packets *G_USEC_PER_SEC / elapsed;
+}
+
+GST_START_TEST (benchmark_abs_send_time)
+{
+  GstBuffer *template = generate_rtp_buffer ();
+  GstBuffer *reserved = gst_buffer_copy (template);
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  KmsRtpHdrExtConfig config;
+  KmsRtpHdrExtList *list;
+  GstPad *srcpad, *sinkpad;
+  GstSDPMedia *media;
+  gdouble legacy, update, update_list;
+  guint in_place = 0;
+  gint64 start;
+  guint i;
+
+  /* Shared buffer, as seen after a tee */
+  start = g_get_monotonic_time ();
+  for (i = 0; i < BENCHMARK_PACKETS; i++) {
+    GstBuffer *buf = legacy_add_abs_send_time (gst_buffer_ref (template), i);
+
+    gst_buffer_unref (buf);
+  }
+  legacy = get_packets_per_second (start, BENCHMARK_PACKETS);
+
+  /* Extension reserved by the payloader, only its value is written */
+  gst_sdp_media_new (&media);
+  gst_sdp_media_set_media (media, "video");
+  gst_sdp_media_add_attribute (media, "extmap",
+      "3 " RTP_HDR_EXT_ABS_SEND_TIME_URI);
+  config.transport_seqnum = NULL;
+  config.min_playout_delay = 0;
+  config.max_playout_delay = -1;
+  list = kms_rtp_hdr_ext_list_new (media, &config);
+  fail_unless (list != NULL);
+
+  fail_unless (gst_rtp_buffer_map (reserved, GST_MAP_WRITE, &rtp));
+  fail_unless (kms_rtp_hdr_ext_list_reserve (list, &rtp));
+  gst_rtp_buffer_unmap (&rtp);
+
+  /* Send probe, with a ref kept as the retransmission cache does */
+  srcpad = gst_pad_new ("src", GST_PAD_SRC);
+  sinkpad = gst_pad_new ("sink", GST_PAD_SINK);
+  gst_pad_set_chain_function (sinkpad, count_in_place_chain);
+  g_object_set_data (G_OBJECT (sinkpad), "reserved", reserved);
+  g_object_set_data (G_OBJECT (sinkpad), "in-place", &in_place);
+  fail_unless (gst_pad_link (srcpad, sinkpad) == GST_PAD_LINK_OK);
+  gst_pad_set_active (srcpad, TRUE);
+  gst_pad_set_active (sinkpad, TRUE);
+  kms_rtp_hdr_ext_list_add_probe (list, srcpad, FALSE);
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < BENCHMARK_PACKETS; i++) {
+    gst_pad_push (srcpad, gst_buffer_ref (reserved));
+  }
+  update = get_packets_per_second (start, BENCHMARK_PACKETS);
+  fail_unless_equals_int (in_place, BENCHMARK_PACKETS);
+
+  /* Same packets in buffer lists, a single clock read per list */
+  in_place = 0;
+  start = g_get_monotonic_time ();
+  for (i = 0; i < BENCHMARK_PACKETS / BENCHMARK_LIST_LENGTH; i++) {
+    GstBufferList *bufflist = gst_buffer_list_new ();
+    guint j;
+
+    for (j = 0; j < BENCHMARK_LIST_LENGTH; j++) {
+      gst_buffer_list_add (bufflist, gst_buffer_ref (reserved));
+    }
+
+    gst_pad_push_list (srcpad, bufflist);
+  }
+  update_list = get_packets_per_second (start, BENCHMARK_PACKETS);
+  fail_unless_equals_int (in_place, BENCHMARK_PACKETS);
+
+  GST_INFO ("abs-send-time: copy and add %.0f packets/s, send probe %.0f"
+      " packets/s, send probe with lists %.0f packets/s", legacy, update,
+      update_list);
+  fail_unless (get_abs_send_time (reserved) != 0);
+
+  gst_pad_set_active (srcpad, FALSE);
+  gst_pad_set_active (sinkpad, FALSE);
+  gst_object_unref (srcpad);
+  gst_object_unref (sinkpad);
+  gst_sdp_media_free (media);
+  gst_buffer_unref (reserved);
+  gst_buffer_unref (template);
+}
+
+GST_END_TEST;
+
+static Suite *
+rtphdrext_suite (void)
+{
+  Suite *s = suite_create ("rtphdrext");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_add_test (tc_chain, test_abs_send_time_from_time);
+  tcase_add_test (tc_chain, test_list);
+  tcase_add_test (tc_chain, test_list_probe_bufferlist);
+  tcase_add_test (tc_chain, benchmark_abs_send_time);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtphdrext);
@@ -0,0 +1,134 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+
+#include <kmsstats.h>
+
+#define MAX_AGE (100 * GST_MSECOND)
+
+/* Every collection gets a different "collection" value */
+static GstStructure *
+collect_stats (const gchar * selector, guint * collections)
+{
+  (*collections)++;
+
+  return gst_structure_new ("stats", "collection", G_TYPE_UINT, *collections,
+      NULL);
+}
+
+static guint
+get_collection (KmsStatsSnapshots * snapshots, const gchar * selector,
+    GstClockTime now, GstClockTime max_age, guint * collections)
+{
+  GstStructure *stats;
+  guint collection = 0;
+
+  stats = kms_stats_snapshots_get (snapshots, selector, now, max_age,
+      (KmsStatsCollectFunc) collect_stats, collections);
+  fail_unless (gst_structure_get_uint (stats, "collection", &collection));
+  gst_structure_free (stats);
+
+  return collection;
+}
+
+GST_START_TEST (cached_within_max_age)
+{
+  KmsStatsSnapshots *snapshots = kms_stats_snapshots_new ();
+  guint collections = 0;
+
+  fail_unless_equals_int (get_collection (snapshots, NULL, 0, MAX_AGE,
+          &collections), 1);
+  fail_unless_equals_int (get_collection (snapshots, NULL, MAX_AGE / 2,
+          MAX_AGE, &collections), 1);
+  fail_unless_equals_int (get_collection (snapshots, NULL, MAX_AGE,
+          MAX_AGE, &collections), 1);
+  fail_unless_equals_int (collections, 1);
+
+  /* Too old, collected again and cached from then on */
+  fail_unless_equals_int (get_collection (snapshots, NULL, MAX_AGE + 1,
+          MAX_AGE, &collections), 2);
+  fail_unless_equals_int (get_collection (snapshots, NULL, MAX_AGE + 2,
+          MAX_AGE, &collections), 2);
+  fail_unless_equals_int (collections, 2);
+
+  kms_stats_snapshots_free (snapshots);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (cached_per_selector)
+{
+  KmsStatsSnapshots *snapshots = kms_stats_snapshots_new ();
+  guint collections = 0;
+
+  fail_unless_equals_int (get_collection (snapshots, "video", 0, MAX_AGE,
+          &collections), 1);
+  fail_unless_equals_int (get_collection (snapshots, "audio", 0, MAX_AGE,
+          &collections), 2);
+  fail_unless_equals_int (get_collection (snapshots, NULL, 0, MAX_AGE,
+          &collections), 3);
+
+  fail_unless_equals_int (get_collection (snapshots, "video", 1, MAX_AGE,
+          &collections), 1);
+  fail_unless_equals_int (get_collection (snapshots, "audio", 1, MAX_AGE,
+          &collections), 2);
+  fail_unless_equals_int (get_collection (snapshots, NULL, 1, MAX_AGE,
+          &collections), 3);
+
+  kms_stats_snapshots_free (snapshots);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (always_fresh_without_max_age)
+{
+  KmsStatsSnapshots *snapshots = kms_stats_snapshots_new ();
+  guint collections = 0;
+
+  fail_unless_equals_int (get_collection (snapshots, NULL, 0, 0,
+          &collections), 1);
+  fail_unless_equals_int (get_collection (snapshots, NULL, 0, 0,
+          &collections), 2);
+
+  /* Nothing was kept while the max age was 0 */
+  fail_unless_equals_int (get_collection (snapshots, NULL, 0, MAX_AGE,
+          &collections), 3);
+  fail_unless_equals_int (get_collection (snapshots, NULL, 0, MAX_AGE,
+          &collections), 3);
+
+  kms_stats_snapshots_free (snapshots);
+}
+
+GST_END_TEST;
+
+static Suite *
+statssnapshots_suite (void)
+{
+  Suite *s = suite_create ("statssnapshots");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_add_test (tc_chain, cached_within_max_age);
+  tcase_add_test (tc_chain, cached_per_selector);
+  tcase_add_test (tc_chain, always_fresh_without_max_age);
+
+  return s;
+}
+
+GST_CHECK_MAIN (statssnapshots);
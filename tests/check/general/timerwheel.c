@@ -0,0 +1,110 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+
+#include <kmstimerwheel.h>
+
+#define PERIOD 100              /* ms */
+#define SLOTS 4
+#define TIMERS 16
+
+typedef struct _TimerData
+{
+  gint fired;
+  gint once;
+  gint destroyed;
+} TimerData;
+
+static gboolean
+timer_cb (gpointer user_data)
+{
+  TimerData *data = user_data;
+
+  g_atomic_int_inc (&data->fired);
+
+  return !g_atomic_int_get (&data->once);
+}
+
+static void
+timer_destroy (gpointer user_data)
+{
+  TimerData *data = user_data;
+
+  g_atomic_int_inc (&data->destroyed);
+}
+
+GST_START_TEST (fire_and_remove)
+{
+  KmsLoop *loop = kms_loop_new ();
+  KmsTimerWheel *wheel = kms_timer_wheel_new (loop, PERIOD, SLOTS);
+  TimerData data[TIMERS] = { {0} };
+  guint ids[TIMERS];
+  guint i;
+
+  for (i = 0; i < TIMERS; i++) {
+    data[i].once = (i == 0);
+    ids[i] = kms_timer_wheel_add (wheel, timer_cb, &data[i], timer_destroy);
+  }
+  fail_unless_equals_int (kms_timer_wheel_size (wheel), TIMERS);
+
+  g_usleep (PERIOD * 3.5 * 1000);
+
+  /* Every timer fires once per period */
+  for (i = 1; i < TIMERS; i++) {
+    gint fired = g_atomic_int_get (&data[i].fired);
+
+    fail_unless (fired >= 2 && fired <= 4, "Timer %u fired %d times", i,
+        fired);
+  }
+
+  /* Timers returning FALSE are removed */
+  fail_unless_equals_int (g_atomic_int_get (&data[0].fired), 1);
+  fail_unless_equals_int (g_atomic_int_get (&data[0].destroyed), 1);
+  fail_unless_equals_int (kms_timer_wheel_size (wheel), TIMERS - 1);
+  fail_if (kms_timer_wheel_remove (wheel, ids[0]));
+
+  fail_unless (kms_timer_wheel_remove (wheel, ids[1]));
+  fail_unless_equals_int (g_atomic_int_get (&data[1].destroyed), 1);
+  i = g_atomic_int_get (&data[1].fired);
+  g_usleep (PERIOD * 2 * 1000);
+  fail_unless_equals_int (g_atomic_int_get (&data[1].fired), i);
+
+  kms_timer_wheel_free (wheel);
+  g_object_unref (loop);
+
+  for (i = 2; i < TIMERS; i++) {
+    fail_unless_equals_int (data[i].destroyed, 1);
+  }
+}
+
+GST_END_TEST;
+
+static Suite *
+timerwheel_suite (void)
+{
+  Suite *s = suite_create ("timerwheel");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_add_test (tc_chain, fire_and_remove);
+
+  return s;
+}
+
+GST_CHECK_MAIN (timerwheel);
@@ -15,6 +15,8 @@
  *
  */
 #include "kmsutils.h"
+#include "kmsstats.h"
+#include "kmsbufferlacentymeta.h"
 #include "sdp_utils.h"
 
 #include <gst/check/gstcheck.h>
@@ -380,6 +382,118 @@ GST_START_TEST (check_kms_utils_drop_until_keyframe_bufferlist)
 
 GST_END_TEST;
 
+GST_START_TEST (check_kms_stats_latency_meta_bufferlist)
+{
+  KmsBufferLatencyMeta *meta0, *meta1, *meta2;
+  GstBuffer *buf0, *buf1, *buf2;
+  GstBufferList *bufflist;
+  GstPad *sinkpad, *srcpad;
+  GstPadLinkReturn plr;
+  GstBufferList *received_bufflist;
+
+  srcpad = gst_pad_new ("src", GST_PAD_SRC);
+  fail_if (srcpad == NULL);
+  gst_pad_set_active (srcpad, TRUE);
+  kms_stats_add_buffer_latency_meta_probe (srcpad, TRUE, KMS_MEDIA_TYPE_VIDEO);
+
+  sinkpad = gst_pad_new ("sink", GST_PAD_SINK);
+  fail_if (sinkpad == NULL);
+  gst_pad_set_chain_function (sinkpad, gst_check_chain_func);
+  gst_pad_set_chain_list_function_full (sinkpad, check_chain_list_func,
+      &received_bufflist, NULL);
+  gst_pad_set_active (sinkpad, TRUE);
+
+  plr = gst_pad_link (srcpad, sinkpad);
+  fail_unless (GST_PAD_LINK_SUCCESSFUL (plr));
+
+  GST_DEBUG ("The list reaches the peer as a whole");
+  bufflist = gst_buffer_list_new ();
+  buf0 = gst_buffer_new ();
+  gst_buffer_list_add (bufflist, buf0);
+  buf1 = gst_buffer_new ();
+  gst_buffer_list_add (bufflist, buf1);
+  buf2 = gst_buffer_new ();
+  gst_buffer_list_add (bufflist, buf2);
+  received_bufflist = NULL;
+  gst_pad_push_list (srcpad, bufflist);
+  fail_unless (received_bufflist != NULL);
+  fail_unless (gst_buffer_list_length (received_bufflist) == 3);
+
+  GST_DEBUG ("All buffers share the time sampled for the list");
+  meta0 = kms_buffer_get_buffer_latency_meta (gst_buffer_list_get
+      (received_bufflist, 0));
+  meta1 = kms_buffer_get_buffer_latency_meta (gst_buffer_list_get
+      (received_bufflist, 1));
+  meta2 = kms_buffer_get_buffer_latency_meta (gst_buffer_list_get
+      (received_bufflist, 2));
+  fail_unless (meta0 != NULL && meta1 != NULL && meta2 != NULL);
+  fail_unless (meta0->ts == meta1->ts);
+  fail_unless (meta0->ts == meta2->ts);
+  gst_buffer_list_unref (received_bufflist);
+
+  gst_pad_unlink (srcpad, sinkpad);
+  gst_object_unref (srcpad);
+  gst_object_unref (sinkpad);
+}
+
+GST_END_TEST;
+
+static guint factory_select_count;
+
+static GstElementFactory *
+select_identity_factory (const GstCaps * caps, const GstCaps * other_caps)
+{
+  factory_select_count++;
+
+  return gst_element_factory_find ("identity");
+}
+
+static GstElementFactory *
+select_no_factory (const GstCaps * caps, const GstCaps * other_caps)
+{
+  factory_select_count++;
+
+  return NULL;
+}
+
+GST_START_TEST (check_kms_utils_factory_cache)
+{
+  GstCaps *caps = gst_caps_from_string ("video/x-vp8");
+  GstCaps *other_caps = gst_caps_from_string ("video/x-h264");
+  GstElementFactory *f1, *f2;
+
+  factory_select_count = 0;
+
+  f1 = kms_utils_factory_cache_get ("test", caps, NULL,
+      select_identity_factory);
+  f2 = kms_utils_factory_cache_get ("test", caps, NULL,
+      select_identity_factory);
+  fail_unless (f1 != NULL);
+  fail_unless (f1 == f2);
+  fail_unless (factory_select_count == 1);
+  gst_object_unref (f1);
+  gst_object_unref (f2);
+
+  /* Different caps are a different entry */
+  f1 = kms_utils_factory_cache_get ("test", other_caps, NULL,
+      select_identity_factory);
+  fail_unless (f1 != NULL);
+  fail_unless (factory_select_count == 2);
+  gst_object_unref (f1);
+
+  /* Failed selections are cached too */
+  fail_unless (kms_utils_factory_cache_get ("test-none", caps, other_caps,
+          select_no_factory) == NULL);
+  fail_unless (kms_utils_factory_cache_get ("test-none", caps, other_caps,
+          select_no_factory) == NULL);
+  fail_unless (factory_select_count == 3);
+
+  gst_caps_unref (caps);
+  gst_caps_unref (other_caps);
+}
+
+GST_END_TEST;
+
 /* Suite initialization */
 static Suite *
 utils_suite (void)
@@ -397,6 +511,8 @@ utils_suite (void)
 
   tcase_add_test (tc_chain, check_kms_utils_drop_until_keyframe_buffer);
   tcase_add_test (tc_chain, check_kms_utils_drop_until_keyframe_bufferlist);
+  tcase_add_test (tc_chain, check_kms_stats_latency_meta_bufferlist);
+  tcase_add_test (tc_chain, check_kms_utils_factory_cache);
 
   return s;
 }